@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <openssl/sha.h>
 
 // ANSI color codes for interactive UI
 #define COLOR_GREEN "\033[1;32m"
@@ -14,16 +19,535 @@
 #define MAX_NAME_LEN 20
 #define MAX_ACCOUNTS 50
 #define MAX_LINE_LEN 100
+#define MAX_BLOCKS 100
+#define HASH_LEN SHA256_DIGEST_LENGTH
+#define KEY_BITS (HASH_LEN * 8)
+#define MAX_WORKERS 64
+#define TASKS_PER_WORKER 8          // Subtrees per worker, so stealing can even out uneven ones
+#define PARALLEL_MIN_NODES 4096     // Smaller tries are rehashed serially
+#define NONCE_WINDOW 64             // How far ahead of an account's nonce a transfer may be queued
+
+// Signed-off transfer request; the nonce orders a sender's transfers and makes each one usable once
+typedef struct {
+    int sender;                     // Index into account_list
+    int receiver;
+    float amount;
+    uint64_t nonce;                 // Must equal the sender's nonce when it is applied
+    bool used;                      // Queue slot is occupied
+} Transfer;
 
 // Account structure
 typedef struct {
     char name[MAX_NAME_LEN]; // Account holder's name
     float balance;          // Current balance
+    uint64_t nonce;         // Transfers sent so far; the next one must carry this nonce
+    int leaf;               // State trie leaf committing to this account
+    Transfer *queued;       // Future-nonce transfers, slot nonce % NONCE_WINDOW (NULL until needed)
+    int queued_count;       // Occupied slots in queued
+    float batch_balance;    // validate_batch scratch: balance after the batch so far
+    uint64_t batch_nonce;   // validate_batch scratch: next nonce within the batch
+    int batch_id;           // Batch that last set the scratch fields
 } Account;
 
-// Global account list and count
-Account account_list[MAX_ACCOUNTS];
+// Outcome of submitting a transfer to the mempool
+typedef enum {
+    SUBMIT_APPLIED,                 // Nonce was next in line and the balance covered it
+    SUBMIT_QUEUED,                  // Nonce is ahead; waits for the gap to fill
+    SUBMIT_REPLAY,                  // Nonce already used
+    SUBMIT_DUPLICATE,               // Another transfer already waits with this nonce
+    SUBMIT_TOO_FAR,                 // Nonce is beyond the queue window
+    SUBMIT_INSUFFICIENT             // Nonce was next but the balance is too low
+} SubmitResult;
+
+// State trie node: a binary Patricia trie keyed by SHA-256(name).
+// Each node caches its hash; dirty nodes are rehashed at the next commit.
+typedef struct {
+    bool is_leaf;
+    int bit;                        // Internal: key bit that separates the children
+    int child[2];                   // Internal: subtrees whose keys have that bit 0 / 1
+    int account;                    // Leaf: index into account_list
+    unsigned char key[HASH_LEN];    // Leaf: SHA-256 of the account name
+    unsigned char hash[HASH_LEN];   // Cached node hash
+    bool dirty;                     // Hash is stale
+} TrieNode;
+
+// Block header: commits to the previous block and the resulting state
+typedef struct {
+    int height;
+    unsigned char prev_hash[HASH_LEN];
+    unsigned char state_root[HASH_LEN];
+    int tx_count;                   // Transfers applied in this block
+    int rehashed;                   // Trie nodes rehashed to compute state_root
+} BlockHeader;
+
+// One step of a balance proof, from the leaf up to the root
+typedef struct {
+    int bit;                        // Bit of the parent node
+    unsigned char sibling[HASH_LEN];
+} ProofStep;
+
+// Worker's task deque: the owner pops from the bottom, thieves take from the top
+typedef struct {
+    int tasks[4 * TASKS_PER_WORKER]; // Roots of dirty subtrees
+    int top;
+    int bottom;
+    pthread_mutex_t lock;
+    int rehashed;                   // Nodes this worker hashed in the current batch
+    int steals;                     // Tasks it took from other workers
+} WorkerDeque;
+
+// Work-stealing pool that rehashes independent dirty subtrees; worker 0 is the calling thread
+typedef struct {
+    pthread_t threads[MAX_WORKERS];
+    WorkerDeque deques[MAX_WORKERS];
+    int worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;           // A new batch of tasks is ready
+    pthread_cond_t done;            // The last helper finished the batch
+    int generation;                 // Batches started so far
+    int running;                    // Helpers still working on the batch
+    int steals;                     // Tasks taken from another worker's deque since the start
+    bool stopping;
+} HashPool;
+
+// Global account list and count (grown on demand; the users file is capped at MAX_ACCOUNTS)
+Account *account_list = NULL;
 int account_count = 0;
+int account_capacity = 0;
+int batch_counter = 0;
+
+// Global state trie (2n - 1 nodes for n accounts)
+TrieNode *trie_nodes = NULL;
+int trie_node_count = 0;
+int trie_root = -1;
+
+// Global hashing pool (single-threaded until hash_pool_start)
+HashPool pool = {.worker_count = 1};
+
+// Global chain of block headers and transfers waiting for the next block
+BlockHeader chain[MAX_BLOCKS];
+int block_count = 0;
+int pending_transfers = 0;
+
+int find_account_index(const char *name);
+
+// Function to read bit i (most significant first) of a trie key
+int key_bit(const unsigned char *key, int i) {
+    return (key[i / 8] >> (7 - i % 8)) & 1;
+}
+
+// Function to hash an account name into its trie key
+void account_key(const char *name, unsigned char key[HASH_LEN]) {
+    SHA256((const unsigned char *)name, strlen(name), key);
+}
+
+// Function to encode a balance in whole cents, so the commitment does not depend on float layout
+int64_t balance_cents(float balance) {
+    return (int64_t)(balance * 100.0f + 0.5f);
+}
+
+// Function to hash a leaf: 0x00 || key || balance in cents || nonce (both little-endian)
+void hash_leaf(const unsigned char *key, int64_t cents, uint64_t nonce, unsigned char out[HASH_LEN]) {
+    unsigned char buf[1 + HASH_LEN + 16];
+    buf[0] = 0x00;
+    memcpy(buf + 1, key, HASH_LEN);
+    for (int i = 0; i < 8; i++) {
+        buf[1 + HASH_LEN + i] = (unsigned char)((uint64_t)cents >> (8 * i));
+        buf[1 + HASH_LEN + 8 + i] = (unsigned char)(nonce >> (8 * i));
+    }
+    SHA256(buf, sizeof(buf), out);
+}
+
+// Function to hash an internal node: 0x01 || bit || left || right
+void hash_internal(int bit, const unsigned char *left, const unsigned char *right, unsigned char out[HASH_LEN]) {
+    unsigned char buf[2 + 2 * HASH_LEN];
+    buf[0] = 0x01;
+    buf[1] = (unsigned char)bit;
+    memcpy(buf + 2, left, HASH_LEN);
+    memcpy(buf + 2 + HASH_LEN, right, HASH_LEN);
+    SHA256(buf, sizeof(buf), out);
+}
+
+// Function to make room for n accounts and their trie nodes
+bool reserve_accounts(int n) {
+    if (n <= account_capacity) {
+        return true;
+    }
+    Account *accounts = realloc(account_list, (size_t)n * sizeof(Account));
+    if (!accounts) {
+        return false;
+    }
+    account_list = accounts;
+    TrieNode *nodes = realloc(trie_nodes, (size_t)(2 * n) * sizeof(TrieNode));
+    if (!nodes) {
+        return false;
+    }
+    trie_nodes = nodes;
+    account_capacity = n;
+    return true;
+}
+
+// Function to add an account's leaf to the state trie; false if the key is already present
+bool trie_insert(int account) {
+    int leaf = trie_node_count;
+    TrieNode *node = &trie_nodes[leaf];
+    memset(node, 0, sizeof(*node));
+    node->is_leaf = true;
+    node->account = account;
+    node->dirty = true;
+    account_key(account_list[account].name, node->key);
+
+    if (trie_root < 0) {
+        trie_root = leaf;
+        trie_node_count++;
+        account_list[account].leaf = leaf;
+        return true;
+    }
+
+    // Find the closest existing leaf and the first bit where the keys differ
+    int n = trie_root;
+    while (!trie_nodes[n].is_leaf) {
+        n = trie_nodes[n].child[key_bit(node->key, trie_nodes[n].bit)];
+    }
+    int split = 0;
+    while (split < KEY_BITS && key_bit(node->key, split) == key_bit(trie_nodes[n].key, split)) {
+        split++;
+    }
+    if (split == KEY_BITS) {
+        return false;
+    }
+
+    // Descend to where the split belongs, marking the path dirty
+    int *link = &trie_root;
+    while (!trie_nodes[*link].is_leaf && trie_nodes[*link].bit < split) {
+        trie_nodes[*link].dirty = true;
+        link = &trie_nodes[*link].child[key_bit(node->key, trie_nodes[*link].bit)];
+    }
+    int inner = leaf + 1;
+    int side = key_bit(node->key, split);
+    memset(&trie_nodes[inner], 0, sizeof(TrieNode));
+    trie_nodes[inner].bit = split;
+    trie_nodes[inner].child[side] = leaf;
+    trie_nodes[inner].child[!side] = *link;
+    trie_nodes[inner].dirty = true;
+    *link = inner;
+    trie_node_count += 2;
+    account_list[account].leaf = leaf;
+    return true;
+}
+
+// Function to mark the path from the root to an account's leaf dirty after its balance changed
+void trie_touch(int account) {
+    const unsigned char *key = trie_nodes[account_list[account].leaf].key;
+    int n = trie_root;
+    while (!trie_nodes[n].is_leaf) {
+        trie_nodes[n].dirty = true;
+        n = trie_nodes[n].child[key_bit(key, trie_nodes[n].bit)];
+    }
+    trie_nodes[n].dirty = true;
+}
+
+// Function to rehash the dirty part of a subtree; clean subtrees keep their cached hash
+int trie_rehash(int n) {
+    TrieNode *node = &trie_nodes[n];
+    if (!node->dirty) {
+        return 0;
+    }
+    int rehashed = 1;
+    if (node->is_leaf) {
+        const Account *acct = &account_list[node->account];
+        hash_leaf(node->key, balance_cents(acct->balance), acct->nonce, node->hash);
+    } else {
+        rehashed += trie_rehash(node->child[0]) + trie_rehash(node->child[1]);
+        hash_internal(node->bit, trie_nodes[node->child[0]].hash, trie_nodes[node->child[1]].hash, node->hash);
+    }
+    node->dirty = false;
+    return rehashed;
+}
+
+// Function to run tasks from a worker's own deque, then steal from the others until all are empty
+void run_hash_tasks(int id) {
+    WorkerDeque *own = &pool.deques[id];
+    own->rehashed = 0;
+    own->steals = 0;
+    while (true) {
+        int task = -1;
+        pthread_mutex_lock(&own->lock);
+        if (own->bottom > own->top) {
+            task = own->tasks[--own->bottom];
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        for (int i = 1; task < 0 && i < pool.worker_count; i++) {
+            WorkerDeque *victim = &pool.deques[(id + i) % pool.worker_count];
+            pthread_mutex_lock(&victim->lock);
+            if (victim->bottom > victim->top) {
+                task = victim->tasks[victim->top++];
+                own->steals++;
+            }
+            pthread_mutex_unlock(&victim->lock);
+        }
+        if (task < 0) {
+            return;
+        }
+        own->rehashed += trie_rehash(task);
+    }
+}
+
+// Function run by each helper thread: wait for a batch, work it, report back
+void *hash_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    int seen = 0;
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        while (pool.generation == seen && !pool.stopping) {
+            pthread_cond_wait(&pool.start, &pool.lock);
+        }
+        if (pool.stopping) {
+            break;
+        }
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+        run_hash_tasks(id);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.running == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+// Function to start a hashing pool with the given number of workers (including the caller)
+bool hash_pool_start(int workers) {
+    if (workers > MAX_WORKERS) {
+        workers = MAX_WORKERS;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.start, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.generation = 0;
+    pool.running = 0;
+    pool.steals = 0;
+    pool.stopping = false;
+    pool.worker_count = 1;
+    pthread_mutex_init(&pool.deques[0].lock, NULL);
+    for (int i = 1; i < workers; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+        if (pthread_create(&pool.threads[i], NULL, hash_worker, (void *)(intptr_t)i) != 0) {
+            return false;
+        }
+        pool.worker_count++;
+    }
+    return true;
+}
+
+// Function to stop the helper threads and go back to serial hashing
+void hash_pool_stop() {
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 1; i < pool.worker_count; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    for (int i = 0; i < pool.worker_count; i++) {
+        pthread_mutex_destroy(&pool.deques[i].lock);
+    }
+    pthread_cond_destroy(&pool.start);
+    pthread_cond_destroy(&pool.done);
+    pthread_mutex_destroy(&pool.lock);
+    pool.worker_count = 1;
+}
+
+// Function to deal the dirty subtrees at the given depth round-robin onto the workers' deques
+void collect_dirty_subtrees(int n, int depth, int target, int *next) {
+    TrieNode *node = &trie_nodes[n];
+    if (!node->dirty) {
+        return;
+    }
+    if (node->is_leaf || depth == target) {
+        WorkerDeque *deque = &pool.deques[(*next)++ % pool.worker_count];
+        deque->tasks[deque->bottom++] = n;
+        return;
+    }
+    collect_dirty_subtrees(node->child[0], depth + 1, target, next);
+    collect_dirty_subtrees(node->child[1], depth + 1, target, next);
+}
+
+// Function to rehash the dirty subtrees below the top few levels in parallel.
+// The top levels are left dirty for the caller to hash once the workers have joined.
+int parallel_rehash(int root) {
+    int target = 0;
+    while ((1 << target) < pool.worker_count * TASKS_PER_WORKER) {
+        target++;
+    }
+    for (int i = 0; i < pool.worker_count; i++) {
+        pool.deques[i].top = 0;
+        pool.deques[i].bottom = 0;
+    }
+    int next = 0;
+    collect_dirty_subtrees(root, 0, target, &next);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.running = pool.worker_count - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    run_hash_tasks(0);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.running > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    int rehashed = 0;
+    for (int i = 0; i < pool.worker_count; i++) {
+        rehashed += pool.deques[i].rehashed;
+        pool.steals += pool.deques[i].steals;
+    }
+    return rehashed;
+}
+
+// Function to bring the trie up to date and return its root (all zeros when empty)
+int trie_commit(unsigned char root[HASH_LEN]) {
+    if (trie_root < 0) {
+        memset(root, 0, HASH_LEN);
+        return 0;
+    }
+    int rehashed = 0;
+    if (pool.worker_count > 1 && trie_node_count >= PARALLEL_MIN_NODES) {
+        rehashed = parallel_rehash(trie_root);
+    }
+    rehashed += trie_rehash(trie_root);
+    memcpy(root, trie_nodes[trie_root].hash, HASH_LEN);
+    return rehashed;
+}
+
+// Function to collect the sibling hashes from an account's leaf up to the root
+int trie_prove(int account, ProofStep proof[KEY_BITS]) {
+    const unsigned char *key = trie_nodes[account_list[account].leaf].key;
+    ProofStep path[KEY_BITS];
+    int depth = 0;
+    int n = trie_root;
+    while (!trie_nodes[n].is_leaf) {
+        int side = key_bit(key, trie_nodes[n].bit);
+        path[depth].bit = trie_nodes[n].bit;
+        memcpy(path[depth].sibling, trie_nodes[trie_nodes[n].child[!side]].hash, HASH_LEN);
+        depth++;
+        n = trie_nodes[n].child[side];
+    }
+    for (int i = 0; i < depth; i++) {
+        proof[i] = path[depth - 1 - i];
+    }
+    return depth;
+}
+
+// Function to check a balance proof using only the name, balance, nonce, proof and state root
+bool verify_proof(const char *name, float balance, uint64_t nonce, const ProofStep *proof, int depth,
+                  const unsigned char root[HASH_LEN]) {
+    unsigned char key[HASH_LEN], hash[HASH_LEN];
+    account_key(name, key);
+    hash_leaf(key, balance_cents(balance), nonce, hash);
+    for (int i = 0; i < depth; i++) {
+        if (key_bit(key, proof[i].bit)) {
+            hash_internal(proof[i].bit, proof[i].sibling, hash, hash);
+        } else {
+            hash_internal(proof[i].bit, hash, proof[i].sibling, hash);
+        }
+    }
+    return memcmp(hash, root, HASH_LEN) == 0;
+}
+
+// Function to print a hash as hex
+void print_hash(const unsigned char hash[HASH_LEN]) {
+    for (int i = 0; i < HASH_LEN; i++) {
+        printf("%02x", hash[i]);
+    }
+}
+
+// Function to hash a block header: height || prev_hash || state_root || tx_count
+void hash_header(const BlockHeader *header, unsigned char out[HASH_LEN]) {
+    unsigned char buf[4 + 2 * HASH_LEN + 4];
+    memcpy(buf, &header->height, 4);
+    memcpy(buf + 4, header->prev_hash, HASH_LEN);
+    memcpy(buf + 4 + HASH_LEN, header->state_root, HASH_LEN);
+    memcpy(buf + 4 + 2 * HASH_LEN, &header->tx_count, 4);
+    SHA256(buf, sizeof(buf), out);
+}
+
+// Function to seal the pending transfers into a block whose header carries the state root
+bool seal_block() {
+    if (block_count == MAX_BLOCKS) {
+        printf(COLOR_RED "Error: Chain is full (%d blocks).\n" COLOR_RESET, MAX_BLOCKS);
+        return false;
+    }
+    BlockHeader *header = &chain[block_count];
+    memset(header, 0, sizeof(*header));
+    header->height = block_count;
+    if (block_count > 0) {
+        hash_header(&chain[block_count - 1], header->prev_hash);
+    }
+    header->tx_count = pending_transfers;
+    header->rehashed = trie_commit(header->state_root);
+    block_count++;
+    pending_transfers = 0;
+
+    printf(COLOR_GREEN "Sealed block %d with %d transfer(s)\n" COLOR_RESET, header->height, header->tx_count);
+    printf("State root: ");
+    print_hash(header->state_root);
+    printf("\n(rehashed %d of %d trie nodes)\n", header->rehashed, trie_node_count);
+    return true;
+}
+
+// Function to display the block headers
+void display_chain() {
+    printf(COLOR_CYAN "\n=== Block Headers ===\n" COLOR_RESET);
+    printf("Height | Transfers | Rehashed | State root\n");
+    printf("--------------------------------------------------------------------------------------------\n");
+    for (int i = 0; i < block_count; i++) {
+        printf("%6d | %9d | %8d | ", chain[i].height, chain[i].tx_count, chain[i].rehashed);
+        print_hash(chain[i].state_root);
+        printf("\n");
+    }
+    if (pending_transfers > 0) {
+        printf(COLOR_YELLOW "%d transfer(s) waiting for the next block\n" COLOR_RESET, pending_transfers);
+    }
+    printf("\n");
+}
+
+// Function to prove an account's balance against the latest block's state root
+void prove_balance(const char *name) {
+    int idx = find_account_index(name);
+    if (idx == -1) {
+        printf(COLOR_RED "Error: Account '%s' not found.\n" COLOR_RESET, name);
+        return;
+    }
+    if (pending_transfers > 0) {
+        printf(COLOR_YELLOW "Seal the %d pending transfer(s) first; proofs are against the latest block.\n" COLOR_RESET,
+               pending_transfers);
+        return;
+    }
+    const BlockHeader *tip = &chain[block_count - 1];
+    ProofStep proof[KEY_BITS];
+    int depth = trie_prove(idx, proof);
+
+    printf(COLOR_CYAN "\n=== Balance Proof ===\n" COLOR_RESET);
+    printf("%s has %.2f and nonce %llu at block %d\n", name, account_list[idx].balance,
+           (unsigned long long)account_list[idx].nonce, tip->height);
+    for (int i = 0; i < depth; i++) {
+        printf("  bit %3d sibling ", proof[i].bit);
+        print_hash(proof[i].sibling);
+        printf("\n");
+    }
+    if (verify_proof(name, account_list[idx].balance, account_list[idx].nonce, proof, depth, tip->state_root)) {
+        printf(COLOR_GREEN "Proof verifies against state root (%d hashes)\n" COLOR_RESET, depth + 1);
+    } else {
+        printf(COLOR_RED "Proof does not match the state root!\n" COLOR_RESET);
+    }
+}
 
 // Function to read accounts from file
 bool read_accounts_from_file(const char *filename) {
@@ -33,6 +557,12 @@ bool read_accounts_from_file(const char *filename) {
         return false;
     }
 
+    if (!reserve_accounts(MAX_ACCOUNTS)) {
+        printf(COLOR_RED "Error: Out of memory\n" COLOR_RESET);
+        fclose(file);
+        return false;
+    }
+
     char line[MAX_LINE_LEN];
     while (fgets(line, MAX_LINE_LEN, file) && account_count < MAX_ACCOUNTS) {
         // Remove newline
@@ -44,12 +574,17 @@ bool read_accounts_from_file(const char *filename) {
         char *balance_str = strtok(NULL, ",");
         if (name && balance_str) {
             if (strlen(name) < MAX_NAME_LEN) {
+                memset(&account_list[account_count], 0, sizeof(Account));
                 strcpy(account_list[account_count].name, name);
                 account_list[account_count].balance = atof(balance_str);
                 if (account_list[account_count].balance < 0) {
                     printf(COLOR_RED "Warning: Negative balance for %s ignored\n" COLOR_RESET, name);
                     continue;
                 }
+                if (!trie_insert(account_count)) {
+                    printf(COLOR_RED "Warning: Duplicate account %s ignored\n" COLOR_RESET, name);
+                    continue;
+                }
                 account_count++;
             }
         }
@@ -75,16 +610,145 @@ int find_account_index(const char *name) {
 // Function to display all accounts
 void display_accounts() {
     printf(COLOR_CYAN "\n=== Account Balances ===\n" COLOR_RESET);
-    printf("Name            | Balance\n");
-    printf("-------------------------\n");
+    printf("Name            | Balance  | Nonce | Queued\n");
+    printf("--------------------------------------------\n");
     for (int i = 0; i < account_count; i++) {
-        printf("%-15s | %.2f\n", account_list[i].name, account_list[i].balance);
+        printf("%-15s | %-8.2f | %5llu | %6d\n", account_list[i].name, account_list[i].balance,
+               (unsigned long long)account_list[i].nonce, account_list[i].queued_count);
     }
     printf("\n");
 }
 
+// Function to move a validated amount and mark both accounts for the next state root
+void apply_transfer(int sender_idx, int receiver_idx, float amount) {
+    account_list[sender_idx].balance -= amount;
+    account_list[sender_idx].nonce++;
+    account_list[receiver_idx].balance += amount;
+    trie_touch(sender_idx);
+    trie_touch(receiver_idx);
+    pending_transfers++;
+}
+
+// Function to apply queued transfers that have become valid, starting from one account.
+// Each applied transfer may unblock its sender's next nonce and its receiver's queue.
+void promote_queued(int first) {
+    int *stack = malloc(16 * sizeof(int));
+    int depth = 0, capacity = 16;
+    if (!stack) {
+        return;
+    }
+    stack[depth++] = first;
+    while (depth > 0) {
+        Account *acct = &account_list[stack[--depth]];
+        while (acct->queued_count > 0) {
+            Transfer *next = &acct->queued[acct->nonce % NONCE_WINDOW];
+            if (!next->used || next->nonce != acct->nonce || acct->balance < next->amount) {
+                break;
+            }
+            Transfer tx = *next;
+            next->used = false;
+            acct->queued_count--;
+            apply_transfer(tx.sender, tx.receiver, tx.amount);
+            if (account_list[tx.receiver].queued_count == 0) {
+                continue;
+            }
+            if (depth == capacity) {
+                int *grown = realloc(stack, (size_t)(capacity * 2) * sizeof(int));
+                if (!grown) {
+                    break;
+                }
+                stack = grown;
+                capacity *= 2;
+            }
+            stack[depth++] = tx.receiver;
+        }
+    }
+    free(stack);
+}
+
+// Function to submit an already-validated transfer (distinct, known accounts, positive amount) by nonce
+SubmitResult submit_transfer(const Transfer *tx) {
+    Account *sender = &account_list[tx->sender];
+    if (tx->nonce < sender->nonce) {
+        return SUBMIT_REPLAY;
+    }
+    if (tx->nonce == sender->nonce) {
+        if (sender->balance < tx->amount) {
+            return SUBMIT_INSUFFICIENT;
+        }
+        // A transfer queued earlier with this nonce (still unfunded when it came due) is superseded
+        Transfer *superseded = sender->queued ? &sender->queued[tx->nonce % NONCE_WINDOW] : NULL;
+        if (superseded && superseded->used && superseded->nonce == tx->nonce) {
+            superseded->used = false;
+            sender->queued_count--;
+        }
+        apply_transfer(tx->sender, tx->receiver, tx->amount);
+        promote_queued(tx->sender);
+        if (account_list[tx->receiver].queued_count > 0) {
+            promote_queued(tx->receiver);
+        }
+        return SUBMIT_APPLIED;
+    }
+    if (tx->nonce >= sender->nonce + NONCE_WINDOW) {
+        return SUBMIT_TOO_FAR;
+    }
+    if (!sender->queued && !(sender->queued = calloc(NONCE_WINDOW, sizeof(Transfer)))) {
+        return SUBMIT_TOO_FAR;
+    }
+    // Nonces in the window map to distinct slots, and a slot is emptied once its nonce is used
+    // (by promotion or by a direct transfer above), so an occupied slot holds this very nonce
+    Transfer *slot = &sender->queued[tx->nonce % NONCE_WINDOW];
+    if (slot->used) {
+        return SUBMIT_DUPLICATE;
+    }
+    *slot = *tx;
+    slot->used = true;
+    sender->queued_count++;
+    return SUBMIT_QUEUED;
+}
+
+// Function to check that a batch applies cleanly in order: every sender's nonces continue
+// from its current nonce with no gaps or repeats, and no balance goes short. State is untouched.
+bool validate_batch(const Transfer *batch, int count, int *failed_at) {
+    int id = ++batch_counter;
+    for (int i = 0; i < count; i++) {
+        const Transfer *tx = &batch[i];
+        *failed_at = i;
+        if (tx->sender < 0 || tx->sender >= account_count || tx->receiver < 0 ||
+            tx->receiver >= account_count || tx->sender == tx->receiver || tx->amount <= 0) {
+            return false;
+        }
+        Account *accts[2] = {&account_list[tx->sender], &account_list[tx->receiver]};
+        for (int j = 0; j < 2; j++) {
+            if (accts[j]->batch_id != id) {
+                accts[j]->batch_id = id;
+                accts[j]->batch_balance = accts[j]->balance;
+                accts[j]->batch_nonce = accts[j]->nonce;
+            }
+        }
+        if (tx->nonce != accts[0]->batch_nonce || accts[0]->batch_balance < tx->amount) {
+            return false;
+        }
+        accts[0]->batch_nonce++;
+        accts[0]->batch_balance -= tx->amount;
+        accts[1]->batch_balance += tx->amount;
+    }
+    return true;
+}
+
+// Function to apply a whole batch, or nothing if any transfer in it is out of order or unfunded
+bool apply_batch(const Transfer *batch, int count, int *failed_at) {
+    if (!validate_batch(batch, count, failed_at)) {
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        apply_transfer(batch[i].sender, batch[i].receiver, batch[i].amount);
+    }
+    return true;
+}
+
 // Function to transfer funds between accounts
-bool transferFunds(const char *sender, const char *receiver, float amount) {
+bool transferFunds(const char *sender, const char *receiver, float amount, uint64_t nonce) {
     // Validate inputs
     if (amount <= 0) {
         printf(COLOR_RED "Error: Amount must be positive.\n" COLOR_RESET);
@@ -107,24 +771,283 @@ bool transferFunds(const char *sender, const char *receiver, float amount) {
         return false;
     }
 
-    // Check sufficient balance
-    if (account_list[sender_idx].balance < amount) {
-        printf(COLOR_RED "Error: Insufficient balance. %s has %.2f, needs %.2f\n" COLOR_RESET,
-               sender, account_list[sender_idx].balance, amount);
-        return false;
+    // Apply now, queue for later, or reject by nonce
+    Transfer tx = {sender_idx, receiver_idx, amount, nonce, false};
+    uint64_t expected = account_list[sender_idx].nonce;
+    switch (submit_transfer(&tx)) {
+        case SUBMIT_APPLIED:
+            printf(COLOR_GREEN "\n🎉 Transaction successful! 🎉\n" COLOR_RESET);
+            printf("Transferred %.2f from %s to %s (nonce %llu)\n", amount, sender, receiver,
+                   (unsigned long long)nonce);
+            if (account_list[sender_idx].nonce > nonce + 1) {
+                printf("Also applied %llu queued transfer(s) from %s\n",
+                       (unsigned long long)(account_list[sender_idx].nonce - nonce - 1), sender);
+            }
+            return true;
+        case SUBMIT_QUEUED:
+            printf(COLOR_YELLOW "Queued: %s's next nonce is %llu, this transfer waits for nonce %llu\n" COLOR_RESET,
+                   sender, (unsigned long long)expected, (unsigned long long)nonce);
+            return true;
+        case SUBMIT_REPLAY:
+            printf(COLOR_RED "Error: Nonce %llu already used by %s (next is %llu). Replay rejected.\n" COLOR_RESET,
+                   (unsigned long long)nonce, sender, (unsigned long long)expected);
+            return false;
+        case SUBMIT_DUPLICATE:
+            printf(COLOR_RED "Error: A transfer with nonce %llu from %s is already queued.\n" COLOR_RESET,
+                   (unsigned long long)nonce, sender);
+            return false;
+        case SUBMIT_TOO_FAR:
+            printf(COLOR_RED "Error: Nonce %llu is more than %d ahead of %s's next nonce %llu.\n" COLOR_RESET,
+                   (unsigned long long)nonce, NONCE_WINDOW - 1, sender, (unsigned long long)expected);
+            return false;
+        case SUBMIT_INSUFFICIENT:
+            printf(COLOR_RED "Error: Insufficient balance. %s has %.2f, needs %.2f\n" COLOR_RESET,
+                   sender, account_list[sender_idx].balance, amount);
+            return false;
     }
+    return false;
+}
 
-    // Perform transfer
-    account_list[sender_idx].balance -= amount;
-    account_list[receiver_idx].balance += amount;
+// Function to read a monotonic clock in seconds
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to build a fresh state of generated accounts and commit its first root
+bool bench_reset(int accounts) {
+    if (!reserve_accounts(accounts)) {
+        return false;
+    }
+    for (int i = 0; i < account_count; i++) {
+        free(account_list[i].queued);
+    }
+    account_count = 0;
+    trie_node_count = 0;
+    trie_root = -1;
+    pending_transfers = 0;
+    for (int i = 0; i < accounts; i++) {
+        memset(&account_list[i], 0, sizeof(Account));
+        snprintf(account_list[i].name, MAX_NAME_LEN, "acct%d", i);
+        account_list[i].balance = 1000.0f;
+        trie_insert(i);
+        account_count++;
+    }
+    unsigned char root[HASH_LEN];
+    trie_commit(root);
+    return true;
+}
 
-    printf(COLOR_GREEN "\n🎉 Transaction successful! 🎉\n" COLOR_RESET);
-    printf("Transferred %.2f from %s to %s\n", amount, sender, receiver);
+// Function to time state roots over blocks of random transfers with a given number of workers
+bool bench_run(int accounts, int transfers, int blocks, int workers,
+               double *root_seconds, int *rehashed, int *steals, unsigned char root[HASH_LEN]) {
+    if (!bench_reset(accounts) || (workers > 1 && !hash_pool_start(workers))) {
+        return false;
+    }
+    unsigned int seed = 42;
+    *root_seconds = 0;
+    *rehashed = 0;
+    *steals = 0;
+    for (int b = 0; b < blocks; b++) {
+        for (int t = 0; t < transfers; t++) {
+            int s = rand_r(&seed) % accounts;
+            int r = rand_r(&seed) % accounts;
+            float amount = (rand_r(&seed) % 100 + 1) / 100.0f;
+            if (s != r && account_list[s].balance >= amount) {
+                apply_transfer(s, r, amount);
+            }
+        }
+        double start = now_seconds();
+        *rehashed += trie_commit(root);
+        *root_seconds += now_seconds() - start;
+        pending_transfers = 0;
+    }
+    if (workers > 1) {
+        *steals = pool.steals;
+        hash_pool_stop();
+    }
     return true;
 }
 
+// Function to compare serial and parallel state root times on the same transfer blocks
+int run_root_benchmark(int accounts, int transfers, int blocks, int max_workers) {
+    printf(COLOR_CYAN "\n=== State Root Benchmark ===\n" COLOR_RESET);
+    printf("%d accounts, %d blocks of %d transfers, up to %d workers (%ld cores online)\n",
+           accounts, blocks, transfers, max_workers, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("Workers | Root ms/block | Nodes/block | Steals | Speedup\n");
+    printf("--------------------------------------------------------\n");
+
+    unsigned char serial_root[HASH_LEN], root[HASH_LEN];
+    double serial_seconds = 0;
+    bool roots_match = true;
+    for (int workers = 1;; workers *= 2) {
+        if (workers > max_workers) {
+            workers = max_workers;
+        }
+        double seconds;
+        int rehashed, steals;
+        if (!bench_run(accounts, transfers, blocks, workers, &seconds, &rehashed, &steals, root)) {
+            printf(COLOR_RED "Error: Could not set up %d accounts with %d workers\n" COLOR_RESET, accounts, workers);
+            return 1;
+        }
+        if (workers == 1) {
+            serial_seconds = seconds;
+            memcpy(serial_root, root, HASH_LEN);
+        } else if (memcmp(root, serial_root, HASH_LEN) != 0) {
+            roots_match = false;
+        }
+        printf("%7d | %13.2f | %11d | %6d | %6.2fx\n", workers, seconds * 1000 / blocks,
+               rehashed / blocks, steals, serial_seconds / seconds);
+        if (workers == max_workers) {
+            break;
+        }
+    }
+
+    printf("\nFinal state root: ");
+    print_hash(serial_root);
+    printf("\n");
+    if (!roots_match) {
+        printf(COLOR_RED "Parallel state roots differ from the serial one!\n" COLOR_RESET);
+        return 1;
+    }
+    printf(COLOR_GREEN "All worker counts produced the same state root\n" COLOR_RESET);
+    return 0;
+}
+
+// Function to time pipelined mempool submission and in-order batch validation, then replay everything
+int run_nonce_benchmark(int senders, int per_sender) {
+    int total = senders * per_sender;
+    Transfer *txs = malloc((size_t)total * sizeof(Transfer));
+    if (!txs || !bench_reset(senders * 2)) {
+        printf(COLOR_RED "Error: Out of memory\n" COLOR_RESET);
+        free(txs);
+        return 1;
+    }
+    printf(COLOR_CYAN "\n=== Nonce Benchmark ===\n" COLOR_RESET);
+    printf("%d senders x %d transfers, arriving up to %d nonces out of order\n",
+           senders, per_sender, NONCE_WINDOW / 2);
+    printf("Path           | Transfers | Time ms | Transfers/s | Accepted | Rejected\n");
+    printf("-------------------------------------------------------------------------\n");
+
+    // Round-robin over senders in nonce order, then shuffle each sender's nonces within
+    // short spans, as pipelined clients whose requests overtake each other would
+    unsigned int seed = 7;
+    for (int n = 0; n < per_sender; n++) {
+        for (int s = 0; s < senders; s++) {
+            Transfer *tx = &txs[n * senders + s];
+            tx->sender = s;
+            tx->receiver = senders + rand_r(&seed) % senders;
+            tx->amount = 0.01f;
+            tx->nonce = (uint64_t)n;
+            tx->used = false;
+        }
+    }
+    int span = NONCE_WINDOW / 2;
+    for (int start = 0; start < per_sender; start += span) {
+        int end = start + span < per_sender ? start + span : per_sender;
+        for (int s = 0; s < senders; s++) {
+            for (int n = end - 1; n > start; n--) {
+                int m = start + rand_r(&seed) % (n - start + 1);
+                Transfer swap = txs[n * senders + s];
+                txs[n * senders + s] = txs[m * senders + s];
+                txs[m * senders + s] = swap;
+            }
+        }
+    }
+
+    int accepted = 0, rejected = 0;
+    double start = now_seconds();
+    for (int i = 0; i < total; i++) {
+        SubmitResult result = submit_transfer(&txs[i]);
+        accepted += result == SUBMIT_APPLIED || result == SUBMIT_QUEUED;
+        rejected += result != SUBMIT_APPLIED && result != SUBMIT_QUEUED;
+    }
+    double seconds = now_seconds() - start;
+    printf("Mempool        | %9d | %7.2f | %11.0f | %8d | %8d\n", total, seconds * 1000, total / seconds, accepted, rejected);
+
+    bool ok = rejected == 0;
+    for (int s = 0; s < senders; s++) {
+        ok = ok && account_list[s].nonce == (uint64_t)per_sender && account_list[s].queued_count == 0;
+    }
+
+    accepted = rejected = 0;
+    start = now_seconds();
+    for (int i = 0; i < total; i++) {
+        SubmitResult result = submit_transfer(&txs[i]);
+        accepted += result != SUBMIT_REPLAY;
+        rejected += result == SUBMIT_REPLAY;
+    }
+    seconds = now_seconds() - start;
+    printf("Mempool replay | %9d | %7.2f | %11.0f | %8d | %8d\n", total, seconds * 1000, total / seconds, accepted, rejected);
+    ok = ok && accepted == 0;
+
+    // Same transfers as blocks: each block must continue every sender's nonce sequence
+    for (int n = 0; n < per_sender; n++) {
+        for (int s = 0; s < senders; s++) {
+            txs[n * senders + s].nonce = (uint64_t)n;
+            txs[n * senders + s].sender = s;
+        }
+    }
+    bench_reset(senders * 2);
+    int block = senders * 16 < total ? senders * 16 : total;
+    int failed_at;
+    accepted = rejected = 0;
+    start = now_seconds();
+    for (int i = 0; i < total; i += block) {
+        int count = total - i < block ? total - i : block;
+        if (apply_batch(&txs[i], count, &failed_at)) {
+            accepted += count;
+        } else {
+            rejected += count;
+        }
+    }
+    seconds = now_seconds() - start;
+    printf("Batch          | %9d | %7.2f | %11.0f | %8d | %8d\n", total, seconds * 1000, total / seconds, accepted, rejected);
+    ok = ok && rejected == 0;
+
+    // A replayed block and a block with a nonce gap must both be refused as a whole
+    bool replay_refused = !apply_batch(txs, block, &failed_at);
+    txs[total - 1].nonce++;
+    bench_reset(senders * 2);
+    bool gap_refused = !apply_batch(txs, total, &failed_at) && failed_at == total - 1;
+    printf("\nReplayed block refused: %s, block with a nonce gap refused at transfer %d: %s\n",
+           replay_refused ? "yes" : "no", failed_at, gap_refused ? "yes" : "no");
+    free(txs);
+
+    if (!ok || !replay_refused || !gap_refused) {
+        printf(COLOR_RED "Nonce ordering check failed!\n" COLOR_RESET);
+        return 1;
+    }
+    printf(COLOR_GREEN "Every sender ended at nonce %d with nothing left queued\n" COLOR_RESET, per_sender);
+    return 0;
+}
+
 // Main function with interactive menu
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--root-bench") == 0) {
+        int accounts = argc > 2 ? atoi(argv[2]) : 100000;
+        int transfers = argc > 3 ? atoi(argv[3]) : 10000;
+        int blocks = argc > 4 ? atoi(argv[4]) : 5;
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int max_workers = argc > 5 ? atoi(argv[5]) : (cores > 1 ? (int)cores : 4);
+        if (accounts < 2 || transfers < 1 || blocks < 1 || max_workers < 1 || max_workers > MAX_WORKERS) {
+            printf(COLOR_RED "Usage: %s --root-bench [accounts] [transfers] [blocks] [max workers <= %d]\n" COLOR_RESET,
+                   argv[0], MAX_WORKERS);
+            return 1;
+        }
+        return run_root_benchmark(accounts, transfers, blocks, max_workers);
+    }
+    if (argc > 1 && strcmp(argv[1], "--nonce-bench") == 0) {
+        int senders = argc > 2 ? atoi(argv[2]) : 1000;
+        int per_sender = argc > 3 ? atoi(argv[3]) : 1000;
+        if (senders < 1 || per_sender < 1 || per_sender > 10000) {
+            printf(COLOR_RED "Usage: %s --nonce-bench [senders] [transfers per sender <= 10000]\n" COLOR_RESET, argv[0]);
+            return 1;
+        }
+        return run_nonce_benchmark(senders, per_sender);
+    }
+
     printf(COLOR_GREEN "=====================================\n" COLOR_RESET);
     printf(COLOR_GREEN "   Account/Balance Transaction Simulator  \n" COLOR_RESET);
     printf(COLOR_GREEN "=====================================\n" COLOR_RESET);
@@ -135,13 +1058,19 @@ int main() {
         return 1;
     }
 
+    // Genesis block commits to the initial balances
+    seal_block();
+
     int choice;
     while (true) {
         printf(COLOR_CYAN "\n=== Menu ===\n" COLOR_RESET);
         printf("1. View account balances\n");
         printf("2. Transfer funds\n");
-        printf("3. Exit\n");
-        printf(COLOR_YELLOW "Enter choice (1-3): " COLOR_RESET);
+        printf("3. Seal block\n");
+        printf("4. View block headers\n");
+        printf("5. Prove account balance\n");
+        printf("6. Exit\n");
+        printf(COLOR_YELLOW "Enter choice (1-6): " COLOR_RESET);
         scanf("%d", &choice);
 
         switch (choice) {
@@ -151,6 +1080,7 @@ int main() {
             case 2: {
                 char sender[MAX_NAME_LEN], receiver[MAX_NAME_LEN];
                 float amount;
+                unsigned long long nonce;
 
                 // Display accounts for selection
                 display_accounts();
@@ -160,16 +1090,37 @@ int main() {
                 scanf("%s", receiver);
                 printf(COLOR_YELLOW "Enter amount to transfer: " COLOR_RESET);
                 scanf("%f", &amount);
+                int sender_idx = find_account_index(sender);
+                if (sender_idx != -1) {
+                    printf(COLOR_YELLOW "Enter nonce (%s's next is %llu): " COLOR_RESET, sender,
+                           (unsigned long long)account_list[sender_idx].nonce);
+                } else {
+                    printf(COLOR_YELLOW "Enter nonce: " COLOR_RESET);
+                }
+                scanf("%llu", &nonce);
 
                 printf(COLOR_CYAN "\n=== Balances Before Transaction ===\n" COLOR_RESET);
                 display_accounts();
-                if (transferFunds(sender, receiver, amount)) {
+                if (transferFunds(sender, receiver, amount, nonce)) {
                     printf(COLOR_CYAN "\n=== Balances After Transaction ===\n" COLOR_RESET);
                     display_accounts();
                 }
                 break;
             }
             case 3:
+                seal_block();
+                break;
+            case 4:
+                display_chain();
+                break;
+            case 5: {
+                char name[MAX_NAME_LEN];
+                printf(COLOR_YELLOW "Enter account name: " COLOR_RESET);
+                scanf("%19s", name);
+                prove_balance(name);
+                break;
+            }
+            case 6:
                 printf(COLOR_GREEN "Thank you for using the simulator! Goodbye.\n" COLOR_RESET);
                 return 0;
             default:
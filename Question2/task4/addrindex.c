@@ -0,0 +1,474 @@
+#include <openssl/rand.h>
+#include "addrindex.h"
+#include "block_tree.h"
+#include "blockfilter.h"
+#include "p2p.h"
+#include "siphash.h"
+
+/* ================ ADDRESS TABLE ================ */
+static uint64_t address_hash(const AddressIndex *index, const char *address, size_t length)
+{
+    return siphash24(index->k0, index->k1, address, length);
+}
+
+// Slot holding the address, or the empty slot where it would go
+static int find_slot(const AddressIndex *index, const char *address, size_t length)
+{
+    int mask = index->slot_capacity - 1;
+    int slot = (int)(address_hash(index, address, length) & (uint64_t)mask);
+    while (index->slots[slot])
+    {
+        const char *stored = index->records[index->slots[slot] - 1].address;
+        if (memcmp(stored, address, length) == 0 && stored[length] == '\0')
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int grow_slots(AddressIndex *index)
+{
+    int capacity = index->slot_capacity * 2;
+    int *slots = calloc((size_t)capacity, sizeof(int));
+    if (!slots)
+        return 0;
+    free(index->slots);
+    index->slots = slots;
+    index->slot_capacity = capacity;
+    for (int id = 0; id < index->count; id++)
+    {
+        const char *address = index->records[id].address;
+        index->slots[find_slot(index, address, strlen(address))] = id + 1;
+    }
+    return 1;
+}
+
+// Returns the address's record, giving it the next ID the first time it is seen
+static AddressRecord *intern_address(AddressIndex *index, const char *address, size_t length)
+{
+    if (length == 0 || length > TX_MAX_ADDRESS)
+        return NULL;
+    int slot = find_slot(index, address, length);
+    if (index->slots[slot])
+        return &index->records[index->slots[slot] - 1];
+
+    if ((index->count + 1) * 10 > index->slot_capacity * 7)
+    {
+        if (!grow_slots(index))
+            return NULL;
+        slot = find_slot(index, address, length);
+    }
+    if (index->count == index->capacity)
+    {
+        int capacity = index->capacity ? index->capacity * 2 : 256;
+        AddressRecord *grown = realloc(index->records, (size_t)capacity * sizeof(AddressRecord));
+        if (!grown)
+            return NULL;
+        index->records = grown;
+        index->capacity = capacity;
+    }
+    AddressRecord *record = &index->records[index->count];
+    memset(record, 0, sizeof(*record));
+    memcpy(record->address, address, length);
+    record->last_height = -1;
+    writer_init(&record->history);
+    index->slots[slot] = ++index->count;
+    return record;
+}
+
+static AddressRecord *lookup_address(const AddressIndex *index, const char *address, size_t length)
+{
+    if (length == 0 || length > TX_MAX_ADDRESS || index->slot_capacity == 0)
+        return NULL;
+    int slot = find_slot(index, address, length);
+    return index->slots[slot] ? &index->records[index->slots[slot] - 1] : NULL;
+}
+
+/* ================ HISTORY ================ */
+static uint64_t zigzag_encode(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void push_entry(AddressIndex *index, AddressRecord *record, int height, int position, int64_t delta)
+{
+    size_t before = record->history.length;
+    put_varint(&record->history, (uint64_t)(height - (record->last_height < 0 ? 0 : record->last_height)));
+    put_varint(&record->history, (uint64_t)position);
+    put_varint(&record->history, zigzag_encode(delta));
+    record->balance += (uint64_t)delta;
+    record->last_height = height;
+    record->entries++;
+    index->entries++;
+    index->bytes += record->history.length - before;
+}
+
+// The newest entry starts just after the third byte back, counted from the one before its last,
+// that has no continuation bit: the end of the previous entry (or the start of the stream)
+static void pop_entry(AddressIndex *index, AddressRecord *record)
+{
+    const unsigned char *data = record->history.data;
+    size_t start = record->history.length - 1;
+    for (int ends = 0; start > 0; start--)
+    {
+        if (!(data[start - 1] & 0x80) && ++ends == 3)
+            break;
+    }
+
+    ByteReader reader;
+    reader_init(&reader, data + start, record->history.length - start);
+    uint64_t gap = get_varint(&reader);
+    get_varint(&reader);
+    int64_t delta = zigzag_decode(get_varint(&reader));
+    index->bytes -= record->history.length - start;
+    index->entries--;
+    record->history.length = start;
+    record->balance -= (uint64_t)delta;
+    record->entries--;
+    record->last_height = record->entries > 0 ? record->last_height - (int)gap : -1;
+}
+
+void address_cursor_init(AddressCursor *cursor, const AddressRecord *record)
+{
+    reader_init(&cursor->reader, record->history.data, record->history.length);
+    cursor->height = 0;
+}
+
+int address_cursor_next(AddressCursor *cursor, AddressEntry *entry)
+{
+    if (cursor->reader.offset >= cursor->reader.length)
+        return 0;
+    uint64_t gap = get_varint(&cursor->reader);
+    uint64_t position = get_varint(&cursor->reader);
+    uint64_t delta = get_varint(&cursor->reader);
+    if (!cursor->reader.ok)
+        return 0;
+    cursor->height += (int)gap;
+    entry->height = cursor->height;
+    entry->position = (int)position;
+    entry->delta = zigzag_decode(delta);
+    return 1;
+}
+
+/* ================ INDEX ================ */
+int address_index_init(AddressIndex *index)
+{
+    memset(index, 0, sizeof(*index));
+    index->height = -1;
+    index->slot_capacity = ADDRINDEX_MIN_SLOTS;
+    index->slots = calloc((size_t)index->slot_capacity, sizeof(int));
+    if (!index->slots || RAND_bytes((unsigned char *)&index->k0, sizeof(index->k0)) != 1 ||
+        RAND_bytes((unsigned char *)&index->k1, sizeof(index->k1)) != 1)
+    {
+        free(index->slots);
+        index->slots = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void address_index_free(AddressIndex *index)
+{
+    for (int id = 0; id < index->count; id++)
+        writer_free(&index->records[id].history);
+    free(index->records);
+    free(index->slots);
+    memset(index, 0, sizeof(*index));
+    index->height = -1;
+}
+
+typedef struct
+{
+    const char *address; // Not null-terminated
+    size_t length;       // Bytes in address
+    int64_t delta;       // Net effect of the transaction on it
+} TouchedAddress;
+
+static void touch(TouchedAddress *touched, int *count, const char *address, size_t length, int64_t delta)
+{
+    for (int i = 0; i < *count; i++)
+    {
+        if (touched[i].length == length && memcmp(touched[i].address, address, length) == 0)
+        {
+            touched[i].delta += delta;
+            return;
+        }
+    }
+    touched[*count] = (TouchedAddress){address, length, delta};
+    (*count)++;
+}
+
+// Called after ledger_connect_block accepted the block: undo holds the coins its inputs spent,
+// in order, which is where the amounts leaving each sender come from
+int address_index_connect(AddressIndex *index, const Block *block, int height, const BlockUndo *undo)
+{
+    if (height != index->height + 1)
+        return 0;
+    int spent = 0;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView tx;
+        TouchedAddress touched[1 + TX_MAX_INPUTS + TX_MAX_OUTPUTS];
+        int count = 0;
+        if (!block_transaction(block, i, &tx))
+            continue;
+        // A sender without inputs issues its outputs: it appears in the history with nothing spent
+        if (tx.sender_length > 0)
+            touch(touched, &count, tx.sender, tx.sender_length, 0);
+        for (int j = 0; j < tx.input_count && spent < undo->count; j++)
+        {
+            const Coin *coin = &undo->coins[spent++];
+            touch(touched, &count, coin->address, strlen(coin->address), -(int64_t)coin->amount);
+        }
+        const unsigned char *cursor = tx.outputs;
+        for (int j = 0; j < tx.output_count; j++)
+        {
+            TxOutputView output;
+            tx_next_output(&cursor, &output);
+            touch(touched, &count, output.address, output.address_length, (int64_t)output.amount);
+        }
+
+        for (int t = 0; t < count; t++)
+        {
+            AddressRecord *record = intern_address(index, touched[t].address, touched[t].length);
+            if (record)
+                push_entry(index, record, height, i, touched[t].delta);
+        }
+    }
+    index->height = height;
+    return 1;
+}
+
+// Reverses the connect of the tip block; every address the block touched drops its entries at height
+void address_index_disconnect(AddressIndex *index, const Block *block, int height)
+{
+    if (height != index->height)
+        return;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView tx;
+        if (!block_transaction(block, i, &tx))
+            continue;
+        AddressRecord *record = lookup_address(index, tx.sender, tx.sender_length);
+        while (record && record->last_height == height)
+            pop_entry(index, record);
+        const unsigned char *cursor = tx.outputs;
+        for (int j = 0; j < tx.output_count; j++)
+        {
+            TxOutputView output;
+            tx_next_output(&cursor, &output);
+            record = lookup_address(index, output.address, output.address_length);
+            while (record && record->last_height == height)
+                pop_entry(index, record);
+        }
+    }
+    index->height = height - 1;
+}
+
+const AddressRecord *address_index_find(const AddressIndex *index, const char *address)
+{
+    return lookup_address(index, address, strlen(address));
+}
+
+/* ================ BENCHMARK ================ */
+typedef struct
+{
+    const char *address; // Owner being summed
+    uint64_t total;      // Its unspent coins
+} BalanceScan;
+
+static int sum_coin(const Coin *coin, void *context)
+{
+    BalanceScan *scan = context;
+    if (strcmp(coin->address, scan->address) == 0)
+        scan->total += coin->amount;
+    return 1;
+}
+
+typedef struct
+{
+    double scan_ms;  // Without the index
+    double index_us; // Through the index
+    int queries;     // Addresses looked up
+    int mismatches;  // Answers that differed
+} AddrBenchRow;
+
+// Every record's balance, entry count and history bytes, for comparing two indexes
+static int same_index(const AddressIndex *a, const AddressIndex *b)
+{
+    if (a->count != b->count || a->entries != b->entries || a->bytes != b->bytes || a->height != b->height)
+        return 0;
+    for (int id = 0; id < a->count; id++)
+    {
+        const AddressRecord *x = &a->records[id];
+        const AddressRecord *y = address_index_find(b, x->address);
+        if (!y || x->balance != y->balance || x->entries != y->entries || x->last_height != y->last_height ||
+            x->history.length != y->history.length || memcmp(x->history.data, y->history.data, x->history.length) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+int run_addrindex_benchmark(int block_count, int queries)
+{
+    if (block_count < 12 || block_count > 100000 || queries < 1)
+    {
+        print_error("Usage: --addrindex-bench <blocks 12-100000> [queries]");
+        return 1;
+    }
+    print_header("ADDRESS INDEX BENCHMARK");
+    printf(COLOR_CYAN "Connecting %d blocks with the address index on, then answering %d balance and history queries..."
+                      COLOR_RESET "\n",
+           block_count, queries);
+    fflush(stdout);
+
+    BenchCoin *coins = malloc((size_t)block_count * 2 * MAX_TRANSACTIONS * sizeof(BenchCoin));
+    Block *block = malloc(sizeof(Block));
+    BlockTree tree;
+    Blockchain chain = {0};
+    AddressIndex index, rebuilt;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    int ok = coins && block && address_index_init(&index) && address_index_init(&rebuilt);
+    tree.addresses = &index;
+    unsigned int seed = 5050;
+    int coin_count = 0, disconnected, connected;
+    for (int height = 0; height < block_count && ok; height++)
+    {
+        int nonce_attempts;
+        BlockNode *inserted;
+        ledger_bench_block(block, height, coins, &coin_count, &seed);
+        strcpy(block->previous_hash, height ? chain.blocks[height - 1].hash
+                                            : "0000000000000000000000000000000000000000000000000000000000000000");
+        solve_block(block, 1, &nonce_attempts);
+        ok = block_tree_insert_validated(&tree, block, &inserted) == TREE_ACCEPTED &&
+             block_tree_activate_best(&tree, &chain, &disconnected, &connected) && chain.block_count == height + 1;
+    }
+    free(coins);
+    free(block);
+
+    // Building a second index from the blocks and their undo data, apart from the rest of connection
+    uint64_t started = monotonic_ns();
+    for (int height = 0; ok && height < chain.block_count; height++)
+    {
+        const BlockNode *node = block_tree_find(&tree, chain.blocks[height].hash);
+        ok = node && address_index_connect(&rebuilt, &chain.blocks[height], height, &node->undo);
+    }
+    double build_us = (double)(monotonic_ns() - started) / 1e3 / block_count;
+    ok = ok && same_index(&index, &rebuilt);
+
+    // Disconnecting the last blocks and connecting them again must give back the same bytes
+    int reorg_depth = 10, reorg_ok = ok;
+    for (int height = chain.block_count - 1; ok && height >= chain.block_count - reorg_depth; height--)
+        address_index_disconnect(&rebuilt, &chain.blocks[height], height);
+    for (int i = 0; reorg_ok && i < 20; i++)
+    {
+        char address[TX_MAX_ADDRESS + 1];
+        snprintf(address, sizeof(address), "owner-%03d", rand_r(&seed) % 500);
+        const AddressRecord *record = address_index_find(&rebuilt, address);
+        int found = 0;
+        for (int height = 0; height < chain.block_count - reorg_depth; height++)
+            found += rescan_block(&chain.blocks[height], height, address, NULL, NULL);
+        reorg_ok = (record ? record->entries : 0) == found;
+    }
+    for (int height = chain.block_count - reorg_depth; reorg_ok && height < chain.block_count; height++)
+    {
+        const BlockNode *node = block_tree_find(&tree, chain.blocks[height].hash);
+        reorg_ok = address_index_connect(&rebuilt, &chain.blocks[height], height, &node->undo);
+    }
+    reorg_ok = reorg_ok && same_index(&index, &rebuilt);
+    address_index_free(&rebuilt);
+    if (!ok)
+    {
+        print_error("Could not build the benchmark chain");
+        block_tree_free(&tree);
+        address_index_free(&index);
+        free(chain.blocks);
+        return 1;
+    }
+
+    AddrBenchRow rows[2] = {0};
+    uint64_t history_entries = 0;
+    for (int q = 0; q < queries; q++)
+    {
+        char address[TX_MAX_ADDRESS + 1];
+        snprintf(address, sizeof(address), "owner-%03d", rand_r(&seed) % 500);
+
+        // Balance: a pass over the UTXO set against one lookup
+        BalanceScan scan = {address, 0};
+        uint64_t t0 = monotonic_ns();
+        utxo_set_for_each(&tree.utxos, sum_coin, &scan);
+        uint64_t t1 = monotonic_ns();
+        const AddressRecord *record = address_index_find(&index, address);
+        uint64_t balance = record ? record->balance : 0;
+        uint64_t t2 = monotonic_ns();
+        rows[0].scan_ms += (double)(t1 - t0) / 1e6;
+        rows[0].index_us += (double)(t2 - t1) / 1e3;
+        rows[0].queries++;
+        rows[0].mismatches += balance != scan.total;
+
+        // History: reading every block against decoding the address's entries
+        int found = 0, decoded = 0;
+        for (int height = 0; height < chain.block_count; height++)
+            found += rescan_block(&chain.blocks[height], height, address, NULL, NULL);
+        uint64_t t3 = monotonic_ns();
+        record = address_index_find(&index, address);
+        if (record)
+        {
+            AddressCursor cursor;
+            AddressEntry entry;
+            address_cursor_init(&cursor, record);
+            while (address_cursor_next(&cursor, &entry))
+                decoded++;
+        }
+        uint64_t t4 = monotonic_ns();
+        rows[1].scan_ms += (double)(t3 - t2) / 1e6;
+        rows[1].index_us += (double)(t4 - t3) / 1e3;
+        rows[1].queries++;
+        rows[1].mismatches += decoded != found;
+        history_entries += (uint64_t)decoded;
+    }
+
+    printf(COLOR_BLUE "┌────────────┬─────────────┬─────────────┬────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-11s" COLOR_BLUE " │ " COLOR_YELLOW "%-11s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │\n",
+           "Query", "Full scan", "Index", "Speedup");
+    printf(COLOR_BLUE "├────────────┼─────────────┼─────────────┼────────────┤\n");
+    const char *names[2] = {"Balance", "History"};
+    for (int r = 0; r < 2; r++)
+    {
+        char scan[32], indexed[32];
+        snprintf(scan, sizeof(scan), "%.3f ms", rows[r].scan_ms / rows[r].queries);
+        snprintf(indexed, sizeof(indexed), "%.3f us", rows[r].index_us / rows[r].queries);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-10s" COLOR_BLUE " │ " COLOR_RESET "%-11s" COLOR_BLUE " │ " COLOR_RESET "%-11s" COLOR_BLUE
+                          " │ " COLOR_GREEN "%9.0fx" COLOR_BLUE " │\n",
+               names[r], scan, indexed, rows[r].scan_ms * 1e3 / rows[r].index_us);
+    }
+    printf(COLOR_BLUE "└────────────┴─────────────┴─────────────┴────────────┘" COLOR_RESET "\n");
+
+    printf(COLOR_GREEN "\nIndex: %d addresses, %llu entries in %.1f KiB (%.2f bytes each), %.1f entries per history"
+                       COLOR_RESET "\n",
+           index.count, (unsigned long long)index.entries, index.bytes / 1024.0, (double)index.bytes / index.entries,
+           (double)history_entries / queries);
+    printf(COLOR_GREEN "Connect cost: %.2f us per block on top of the UTXO update" COLOR_RESET "\n", build_us);
+
+    int mismatches = rows[0].mismatches + rows[1].mismatches;
+    block_tree_free(&tree);
+    address_index_free(&index);
+    free(chain.blocks);
+    if (mismatches > 0 || !reorg_ok)
+    {
+        printf(COLOR_RED "✗ The index disagreed with a full scan for %d queries%s" COLOR_RESET "\n", mismatches,
+               reorg_ok ? "" : ", and after a reorg");
+        return 1;
+    }
+    printf(COLOR_GREEN "✓ Every balance and history matched a full scan, and a %d-block reorg restored the index byte for byte"
+                       COLOR_RESET "\n",
+           reorg_depth);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef ADDRINDEX_H
+#define ADDRINDEX_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "ledger.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define ADDRINDEX_MIN_SLOTS 1024   // Initial size of the address table (a power of two)
+#define ADDRINDEX_HISTORY 100      // Newest entries getaddresshistory returns by default
+#define ADDRINDEX_MAX_HISTORY 2000 // Most it returns in one call
+
+/* ================ DATA STRUCTURES ================ */
+// One interned address. Its history is a varint stream of (height gap, transaction position,
+// zigzag amount delta) per transaction that sends from or pays to it, oldest first. The last
+// byte of a varint is the only one without the high bit, so the newest entry can be found by
+// reading back from the end: a disconnect pops entries without any undo data of its own.
+typedef struct
+{
+    char address[TX_MAX_ADDRESS + 1]; // Interned text
+    uint64_t balance;                 // Sum of the deltas: the address's unspent coins
+    int last_height;                  // Height of the newest entry (-1: none)
+    int entries;                      // Transactions in history
+    ByteWriter history;               // Delta-encoded entries
+} AddressRecord;
+
+typedef struct
+{
+    int height;    // Block holding the transaction
+    int position;  // Index of the transaction in the block
+    int64_t delta; // Received by the address minus the coins it spent
+} AddressEntry;
+
+// Walks a record's history oldest first
+typedef struct
+{
+    ByteReader reader; // Over AddressRecord.history
+    int height;        // Height of the entry last returned
+} AddressCursor;
+
+// Address ID -> record, plus an open-addressing table from the text to the ID
+typedef struct
+{
+    AddressRecord *records; // Indexed by address ID; an ID stays valid once given out
+    int count;              // Addresses interned
+    int capacity;           // Allocated length of records
+    int *slots;             // Record ID + 1 per slot (0: empty)
+    int slot_capacity;      // Power of two
+    uint64_t k0, k1;        // Secret SipHash key, so addresses cannot be picked to share a slot
+    int height;             // Highest block connected (-1: none)
+    uint64_t entries;       // History entries over every address
+    uint64_t bytes;         // Bytes of history over every address
+} AddressIndex;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int address_index_init(AddressIndex *index);
+void address_index_free(AddressIndex *index);
+int address_index_connect(AddressIndex *index, const Block *block, int height, const BlockUndo *undo);
+void address_index_disconnect(AddressIndex *index, const Block *block, int height);
+const AddressRecord *address_index_find(const AddressIndex *index, const char *address);
+void address_cursor_init(AddressCursor *cursor, const AddressRecord *record);
+int address_cursor_next(AddressCursor *cursor, AddressEntry *entry);
+int run_addrindex_benchmark(int block_count, int queries);
+
+#endif
@@ -0,0 +1,376 @@
+#include <pthread.h>
+#include <sys/mman.h>
+#include "alloc.h"
+#include "block_tree.h"
+#include "metrics.h"
+
+/* ================ CHUNKS ================ */
+#define CHUNK_HEADER ((sizeof(AllocChunk) + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1))
+#define BACKING_MALLOC 0  // AllocChunk.mapped: plain malloc
+#define BACKING_MMAP 1    // Anonymous mapping, transparent hugepages requested
+#define BACKING_HUGETLB 2 // Mapping from the reserved hugepage pool
+
+static int hugepages;
+static AllocStats stats[ALLOC_KINDS];
+static SlabPool *registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *kind_names[ALLOC_KINDS] = {"block_undo", "block_node", "mempool_tx"};
+
+static void count(uint64_t *field, int64_t delta)
+{
+    __atomic_fetch_add(field, (uint64_t)delta, __ATOMIC_RELAXED);
+}
+
+void alloc_set_hugepages(int enabled)
+{
+    __atomic_store_n(&hugepages, enabled, __ATOMIC_RELAXED);
+}
+
+const char *alloc_kind_name(int kind)
+{
+    return kind_names[kind];
+}
+
+// Arena totals are kept per kind; slab pools are summed from the registry
+void alloc_stats(int kind, AllocStats *out)
+{
+    pthread_mutex_lock(&registry_lock);
+    out->reserved_bytes = __atomic_load_n(&stats[kind].reserved_bytes, __ATOMIC_RELAXED);
+    out->live_bytes = __atomic_load_n(&stats[kind].live_bytes, __ATOMIC_RELAXED);
+    out->huge_bytes = __atomic_load_n(&stats[kind].huge_bytes, __ATOMIC_RELAXED);
+    out->allocations = __atomic_load_n(&stats[kind].allocations, __ATOMIC_RELAXED);
+    for (const SlabPool *pool = registry; pool; pool = pool->next)
+    {
+        if (pool->kind != kind)
+            continue;
+        out->live_bytes += __atomic_load_n(&pool->live, __ATOMIC_RELAXED) * pool->record_size;
+        out->allocations += __atomic_load_n(&pool->allocations, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+// Large slab chunks go to hugepages when enabled: the reserved pool if the system has one,
+// otherwise a mapping marked for transparent hugepages
+static AllocChunk *new_chunk(size_t size, int kind, int may_be_huge)
+{
+    void *memory = NULL;
+    int backing = BACKING_MALLOC;
+    if (may_be_huge && __atomic_load_n(&hugepages, __ATOMIC_RELAXED))
+    {
+        size = (size + ALLOC_HUGE_PAGE - 1) & ~(size_t)(ALLOC_HUGE_PAGE - 1);
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        backing = BACKING_HUGETLB;
+        if (memory == MAP_FAILED)
+        {
+            memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            backing = BACKING_MMAP;
+            if (memory == MAP_FAILED)
+                return NULL;
+            madvise(memory, size, MADV_HUGEPAGE);
+        }
+    }
+    else if (!(memory = malloc(size)))
+        return NULL;
+
+    AllocChunk *chunk = memory;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = CHUNK_HEADER;
+    chunk->mapped = backing;
+    count(&stats[kind].reserved_bytes, (int64_t)size);
+    if (backing == BACKING_HUGETLB)
+        count(&stats[kind].huge_bytes, (int64_t)size);
+    return chunk;
+}
+
+static void free_chunks(AllocChunk *chunk, int kind)
+{
+    while (chunk)
+    {
+        AllocChunk *next = chunk->next;
+        count(&stats[kind].reserved_bytes, -(int64_t)chunk->size);
+        if (chunk->mapped == BACKING_HUGETLB)
+            count(&stats[kind].huge_bytes, -(int64_t)chunk->size);
+        if (chunk->mapped == BACKING_MALLOC)
+            free(chunk);
+        else
+            munmap(chunk, chunk->size);
+        chunk = next;
+    }
+}
+
+/* ================ SLAB POOLS ================ */
+void slab_pool_init(SlabPool *pool, size_t record_size, int kind)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (record_size < sizeof(void *))
+        record_size = sizeof(void *);
+    pool->record_size = (record_size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+    pool->kind = kind;
+}
+
+// Pools with chunks are listed so a scrape can read their counters; the list only changes when
+// a pool gets its first chunk or is destroyed, never on an allocation
+static void register_pool(SlabPool *pool)
+{
+    pthread_mutex_lock(&registry_lock);
+    pool->next = registry;
+    registry = pool;
+    pool->registered = 1;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void unregister_pool(SlabPool *pool)
+{
+    pthread_mutex_lock(&registry_lock);
+    for (SlabPool **link = &registry; *link; link = &(*link)->next)
+    {
+        if (*link == pool)
+        {
+            *link = pool->next;
+            break;
+        }
+    }
+    // Its allocations stay in the total, so the counter never goes down
+    count(&stats[pool->kind].allocations, (int64_t)pool->allocations);
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void *slab_alloc(SlabPool *pool)
+{
+    void *record = pool->free_list;
+    if (record)
+        pool->free_list = *(void **)record;
+    else
+    {
+        AllocChunk *chunk = pool->chunks;
+        if (!chunk || chunk->used + pool->record_size > chunk->size)
+        {
+            // At least 16 records per chunk, so large records do not get a malloc each
+            size_t size = CHUNK_HEADER + 16 * pool->record_size;
+            if (!(chunk = new_chunk(size > ALLOC_SLAB_CHUNK ? size : ALLOC_SLAB_CHUNK, pool->kind, 1)))
+                return NULL;
+            chunk->next = pool->chunks;
+            pool->chunks = chunk;
+            if (!pool->registered)
+                register_pool(pool);
+        }
+        record = (unsigned char *)chunk + chunk->used;
+        chunk->used += pool->record_size;
+    }
+    // Only this thread writes them; plain stores, no locked add
+    __atomic_store_n(&pool->live, pool->live + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->allocations, pool->allocations + 1, __ATOMIC_RELAXED);
+    return record;
+}
+
+void slab_free(SlabPool *pool, void *record)
+{
+    if (!record)
+        return;
+    *(void **)record = pool->free_list;
+    pool->free_list = record;
+    __atomic_store_n(&pool->live, pool->live - 1, __ATOMIC_RELAXED);
+}
+
+// Every record goes at once, freed or not
+void slab_pool_destroy(SlabPool *pool)
+{
+    if (pool->registered)
+        unregister_pool(pool);
+    free_chunks(pool->chunks, pool->kind);
+    slab_pool_init(pool, pool->record_size, pool->kind);
+}
+
+/* ================ ARENAS ================ */
+void arena_init(Arena *arena, int kind)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->kind = kind;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1);
+    AllocChunk *chunk = arena->chunks;
+    if (!chunk || chunk->used + size > chunk->size)
+    {
+        // Arenas are small and short-lived, so they never take hugepages
+        size_t wanted = CHUNK_HEADER + size;
+        if (!(chunk = new_chunk(wanted > ALLOC_ARENA_CHUNK ? wanted : ALLOC_ARENA_CHUNK, arena->kind, 0)))
+            return NULL;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    void *memory = (unsigned char *)chunk + chunk->used;
+    chunk->used += size;
+    arena->live += size;
+    count(&stats[arena->kind].live_bytes, (int64_t)size);
+    count(&stats[arena->kind].allocations, 1);
+    return memory;
+}
+
+// Frees everything the arena handed out; it can be used again afterwards
+void arena_release(Arena *arena)
+{
+    count(&stats[arena->kind].live_bytes, -(int64_t)arena->live);
+    free_chunks(arena->chunks, arena->kind);
+    arena->chunks = NULL;
+    arena->live = 0;
+}
+
+/* ================ ALLOCATOR BENCHMARK ================ */
+#define BENCH_WINDOW 4096   // Mempool transactions alive at once during the churn test
+#define BENCH_UNDO_COINS 40 // Coins one block's undo grows to
+
+typedef struct
+{
+    const char *name; // Workload
+    double malloc_ns; // Per operation with malloc/realloc/free
+    double pool_ns;   // Per operation with the slab pool or arena
+} AllocBenchRow;
+
+static uint64_t bench_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Mempool-like: one transaction leaves and another arrives, in random order
+static double churn(int records, SlabPool *pool)
+{
+    void **live = calloc(BENCH_WINDOW, sizeof(void *));
+    uint64_t state = 88172645463325252ull;
+    uint64_t start = metrics_now_ns();
+    for (int i = 0; i < records; i++)
+    {
+        int slot = (int)(bench_random(&state) % BENCH_WINDOW);
+        if (pool)
+            slab_free(pool, live[slot]);
+        else
+            free(live[slot]);
+        live[slot] = pool ? slab_alloc(pool) : malloc(MAX_TX_SIZE / 2);
+        ((unsigned char *)live[slot])[0] = (unsigned char)i;
+    }
+    double elapsed = (double)(metrics_now_ns() - start);
+    for (int slot = 0; slot < BENCH_WINDOW; slot++)
+    {
+        if (!pool)
+            free(live[slot]);
+    }
+    if (pool)
+        slab_pool_destroy(pool);
+    free(live);
+    return elapsed / records;
+}
+
+// Block-tree-like: nodes are only added, then the whole tree is dropped
+static double grow_tree(int records, SlabPool *pool)
+{
+    void **nodes = malloc((size_t)records * sizeof(void *));
+    uint64_t start = metrics_now_ns();
+    for (int i = 0; i < records; i++)
+    {
+        nodes[i] = pool ? slab_alloc(pool) : malloc(sizeof(BlockNode));
+        memset(nodes[i], 0, 64);
+    }
+    if (pool)
+        slab_pool_destroy(pool);
+    else
+    {
+        for (int i = 0; i < records; i++)
+            free(nodes[i]);
+    }
+    double elapsed = (double)(metrics_now_ns() - start);
+    free(nodes);
+    return elapsed / records;
+}
+
+// Undo-like: a block spends its coins, then is disconnected. The malloc side grows the list
+// by doubling, as undo data did before; the arena side is sized from the block's inputs first.
+static double undo_blocks(int blocks, int use_arena)
+{
+    uint64_t start = metrics_now_ns();
+    for (int b = 0; b < blocks; b++)
+    {
+        Arena arena;
+        arena_init(&arena, ALLOC_BLOCK_UNDO);
+        Coin *coins = use_arena ? arena_alloc(&arena, BENCH_UNDO_COINS * sizeof(Coin)) : NULL;
+        int capacity = use_arena ? BENCH_UNDO_COINS : 0;
+        for (int i = 0; i < BENCH_UNDO_COINS; i++)
+        {
+            if (i == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 16;
+                coins = realloc(coins, (size_t)capacity * sizeof(Coin));
+            }
+            coins[i].amount = (uint64_t)i;
+        }
+        if (use_arena)
+            arena_release(&arena);
+        else
+            free(coins);
+    }
+    return (double)(metrics_now_ns() - start) / blocks;
+}
+
+int run_alloc_benchmark(int records, int huge)
+{
+    if (records < BENCH_WINDOW)
+    {
+        print_error("Usage: --alloc-bench [records, at least 4096] [hugepages 0/1]");
+        return 1;
+    }
+    alloc_set_hugepages(huge);
+    print_header("SLAB POOL AND ARENA BENCHMARK");
+    printf(COLOR_CYAN "%d operations per workload, hugepages %s" COLOR_RESET "\n\n", records, huge ? "on" : "off");
+
+    SlabPool pool;
+    AllocBenchRow rows[3];
+    rows[0].name = "Mempool churn (256 B)";
+    rows[0].malloc_ns = churn(records, NULL);
+    slab_pool_init(&pool, MAX_TX_SIZE / 2, ALLOC_MEMPOOL_TX);
+    rows[0].pool_ns = churn(records, &pool);
+
+    int nodes = records / 100;
+    rows[1].name = "Tree nodes, then drop";
+    rows[1].malloc_ns = grow_tree(nodes, NULL);
+    slab_pool_init(&pool, sizeof(BlockNode), ALLOC_BLOCK_NODES);
+    rows[1].pool_ns = grow_tree(nodes, &pool);
+
+    int blocks = records / BENCH_UNDO_COINS;
+    rows[2].name = "Undo per block";
+    rows[2].malloc_ns = undo_blocks(blocks, 0);
+    rows[2].pool_ns = undo_blocks(blocks, 1);
+
+    printf(COLOR_BLUE "┌───────────────────────┬─────────────┬─────────────┬─────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-21s" COLOR_BLUE " │ " COLOR_YELLOW "%-11s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-11s" COLOR_BLUE " │ " COLOR_YELLOW "%-7s" COLOR_BLUE " │\n",
+           "Workload", "malloc ns", "pool ns", "Speedup");
+    printf(COLOR_BLUE "├───────────────────────┼─────────────┼─────────────┼─────────┤\n");
+    for (int i = 0; i < 3; i++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-21s" COLOR_BLUE " │ " COLOR_CYAN "%-11.1f" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-11.1f" COLOR_BLUE " │ " COLOR_CYAN "%-6.2fx" COLOR_BLUE " │\n",
+               rows[i].name, rows[i].malloc_ns, rows[i].pool_ns, rows[i].malloc_ns / rows[i].pool_ns);
+    }
+    printf(COLOR_BLUE "└───────────────────────┴─────────────┴─────────────┴─────────┘" COLOR_RESET "\n");
+
+    // Every pool and arena above was destroyed, so nothing may still be counted as held
+    int leaked = 0;
+    for (int kind = 0; kind < ALLOC_KINDS; kind++)
+    {
+        AllocStats held;
+        alloc_stats(kind, &held);
+        leaked |= held.reserved_bytes != 0 || held.live_bytes != 0;
+    }
+    if (leaked)
+    {
+        print_error("Allocator statistics still show memory held after every pool was released");
+        return 1;
+    }
+    printf(COLOR_GREEN "\n✔ Every pool and arena returned its memory; statistics are back to zero" COLOR_RESET "\n");
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ================ CONSTANTS ================ */
+#define ALLOC_ALIGN 16                    // Every record and arena allocation starts on this boundary
+#define ALLOC_SLAB_CHUNK (64 * 1024)      // Bytes a slab pool asks for at a time
+#define ALLOC_HUGE_PAGE (2 * 1024 * 1024) // Slab chunk size when hugepages are enabled
+#define ALLOC_ARENA_CHUNK 4096            // Smallest chunk an arena asks for
+
+#define ALLOC_BLOCK_UNDO 0  // Per-block undo arenas; 0 so a zeroed BlockUndo counts here
+#define ALLOC_BLOCK_NODES 1 // Block tree nodes
+#define ALLOC_MEMPOOL_TX 2  // Encoded transactions waiting in the mempool
+#define ALLOC_KINDS 3
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct AllocChunk
+{
+    struct AllocChunk *next; // Older chunk of the same pool or arena
+    size_t size;             // Bytes mapped, header included
+    size_t used;             // Bytes handed out, header included
+    int mapped;              // 0: malloc, 1: mmap, 2: mmap from the hugepage pool
+} AllocChunk;
+
+// Fixed-size records carved out of large chunks; freed records are reused before new ones are
+// carved. Owned by one thread, like the structure it serves. Destroying it frees every record.
+typedef struct SlabPool
+{
+    size_t record_size;    // Bytes per record, rounded up to ALLOC_ALIGN
+    int kind;              // ALLOC_* statistics bucket
+    void *free_list;       // Freed records, linked through their first bytes
+    AllocChunk *chunks;    // Newest first; only the newest may have room left
+    size_t live;           // Records handed out and not freed (read by scrapes)
+    uint64_t allocations;  // Records handed out since the pool was created (read by scrapes)
+    struct SlabPool *next; // Next pool in the statistics registry
+    int registered;        // In the registry, which happens with the first chunk
+} SlabPool;
+
+// Bump allocator: nothing is freed on its own, everything is released at once.
+// An all-zero Arena is empty and ready to use.
+typedef struct
+{
+    AllocChunk *chunks; // Newest first
+    int kind;           // ALLOC_* statistics bucket
+    size_t live;        // Bytes handed out since the last release
+} Arena;
+
+typedef struct
+{
+    uint64_t reserved_bytes; // Held in chunks
+    uint64_t live_bytes;     // Handed out and not yet freed or released
+    uint64_t huge_bytes;     // Part of reserved_bytes backed by hugepages
+    uint64_t allocations;    // Records or arena allocations handed out since start
+} AllocStats;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void alloc_set_hugepages(int enabled);
+const char *alloc_kind_name(int kind);
+void alloc_stats(int kind, AllocStats *stats);
+
+void slab_pool_init(SlabPool *pool, size_t record_size, int kind);
+void *slab_alloc(SlabPool *pool);
+void slab_free(SlabPool *pool, void *record);
+void slab_pool_destroy(SlabPool *pool);
+
+void arena_init(Arena *arena, int kind);
+void *arena_alloc(Arena *arena, size_t size);
+void arena_release(Arena *arena);
+
+int run_alloc_benchmark(int records, int hugepages);
+
+#endif
@@ -0,0 +1,495 @@
+#include "block_tree.h"
+#include "metrics.h"
+#include "trace.h"
+#include "retarget.h"
+#include "signature.h"
+#include "transaction.h"
+
+#define GENESIS_PREV_HASH "0000000000000000000000000000000000000000000000000000000000000000"
+
+/* ================ HASH INDEX ================ */
+static uint64_t hash_key(const char *hash)
+{
+    // Block hashes are uniformly random, so the first 16 hex digits make a good key
+    uint64_t key = 0;
+    for (int i = 0; i < 16 && hash[i]; i++)
+    {
+        char c = hash[i];
+        int v = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : 0;
+        key = (key << 4) | (uint64_t)v;
+    }
+    return key;
+}
+
+static void index_put(BlockNode **slots, int capacity, BlockNode *node)
+{
+    int mask = capacity - 1;
+    int slot = (int)(hash_key(node->block.hash) & (uint64_t)mask);
+    while (slots[slot])
+    {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = node;
+}
+
+static int index_grow(BlockTree *tree)
+{
+    int capacity = tree->slot_capacity ? tree->slot_capacity * 2 : 64;
+    BlockNode **slots = calloc((size_t)capacity, sizeof(BlockNode *));
+    if (!slots)
+        return 0;
+    for (int i = 0; i < tree->node_count; i++)
+    {
+        index_put(slots, capacity, tree->nodes[i]);
+    }
+    free(tree->slots);
+    tree->slots = slots;
+    tree->slot_capacity = capacity;
+    return 1;
+}
+
+/* ================ SKIP LIST ================ */
+static int invert_lowest_one(int n)
+{
+    return n & (n - 1);
+}
+
+static int skip_height(int height)
+{
+    // Same spacing as Bitcoin Core: any ancestor is reachable in O(log n) jumps
+    if (height < 2)
+        return 0;
+    return (height & 1) ? invert_lowest_one(invert_lowest_one(height - 1)) + 1 : invert_lowest_one(height);
+}
+
+BlockNode *block_node_ancestor(BlockNode *node, int height)
+{
+    if (!node || height > node->height || height < 0)
+        return NULL;
+
+    BlockNode *walk = node;
+    int walk_height = node->height;
+    while (walk_height > height)
+    {
+        int skip_h = skip_height(walk_height);
+        int skip_prev_h = skip_height(walk_height - 1);
+        if (walk->skip && (skip_h == height ||
+                           (skip_h > height && !(skip_prev_h < skip_h - 2 && skip_prev_h >= height))))
+        {
+            walk = walk->skip;
+            walk_height = skip_h;
+        }
+        else
+        {
+            walk = walk->parent;
+            walk_height--;
+        }
+    }
+    return walk;
+}
+
+BlockNode *block_tree_fork_point(BlockNode *a, BlockNode *b)
+{
+    if (!a || !b)
+        return NULL;
+    if (a->height > b->height)
+        a = block_node_ancestor(a, b->height);
+    else if (b->height > a->height)
+        b = block_node_ancestor(b, a->height);
+
+    while (a != b && a->skip && b->skip && a->skip != b->skip)
+    {
+        a = a->skip;
+        b = b->skip;
+    }
+    while (a != b)
+    {
+        a = a->parent;
+        b = b->parent;
+    }
+    return a;
+}
+
+/* ================ TREE ================ */
+void block_tree_init(BlockTree *tree)
+{
+    memset(tree, 0, sizeof(*tree));
+    slab_pool_init(&tree->node_pool, sizeof(BlockNode), ALLOC_BLOCK_NODES);
+    filter_index_init(&tree->filters);
+}
+
+void block_tree_free(BlockTree *tree)
+{
+    for (int i = 0; i < tree->node_count; i++)
+        block_undo_free(&tree->nodes[i]->undo);
+    slab_pool_destroy(&tree->node_pool);
+    free(tree->nodes);
+    free(tree->slots);
+    utxo_set_free(&tree->utxos);
+    filter_index_free(&tree->filters);
+    block_tree_init(tree);
+}
+
+uint64_t block_work(uint32_t bits)
+{
+    // Expected hashes to find a block: 16^d for a target with d leading hex zeros
+    return target_work(bits);
+}
+
+BlockNode *block_tree_find(const BlockTree *tree, const char *hash)
+{
+    if (tree->slot_capacity == 0)
+        return NULL;
+
+    int mask = tree->slot_capacity - 1;
+    int slot = (int)(hash_key(hash) & (uint64_t)mask);
+    while (tree->slots[slot])
+    {
+        if (strcmp(tree->slots[slot]->block.hash, hash) == 0)
+            return tree->slots[slot];
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+BlockNode *block_tree_find_prefix(const BlockTree *tree, const char *prefix)
+{
+    size_t length = strlen(prefix);
+    BlockNode *match = NULL;
+    if (length == 0)
+        return NULL;
+    for (int i = 0; i < tree->node_count; i++)
+    {
+        if (strncmp(tree->nodes[i]->block.hash, prefix, length) == 0)
+        {
+            if (match)
+                return NULL; // Ambiguous prefix
+            match = tree->nodes[i];
+        }
+    }
+    return match;
+}
+
+BlockNode *block_tree_find_block(const BlockTree *tree, const char *hash)
+{
+    BlockNode *node = block_tree_find(tree, hash);
+    return node && node->have_data ? node : NULL;
+}
+
+// The target may be anything down to the pow limit: an easier one would let a peer build a chain
+// of high declared work for almost nothing. The retarget schedule needs the parent, so insert checks it
+int validate_block_header(const Block *header)
+{
+    char computed_hash[HASH_SIZE];
+    if (target_work(header->target_bits) < target_work(target_bits_from_difficulty(POW_LIMIT_DIFFICULTY)))
+        return 0;
+    calculate_block_hash(header, computed_hash);
+    return strcmp(computed_hash, header->hash) == 0 && hash_meets_target(header->hash, header->target_bits);
+}
+
+// Everything but signatures: the transactions parse and the header's Merkle root commits to them
+int validate_block_structure(const Block *block)
+{
+    char computed_root[HASH_SIZE];
+    if (block->transaction_count < 0 || block->transaction_count > MAX_TRANSACTIONS || block->tx_offsets[0] != 0)
+        return 0;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView view;
+        if (block->tx_offsets[i + 1] <= block->tx_offsets[i] || block->tx_offsets[i + 1] > BLOCK_TX_BYTES ||
+            !block_transaction(block, i, &view))
+            return 0;
+    }
+    compute_merkle_root(block, computed_root);
+    return strcmp(computed_root, block->merkle_root) == 0;
+}
+
+// signature_threads: 0 spreads the block's signatures over every core, 1 keeps them on the caller
+int validate_block_body(const Block *block, int signature_threads)
+{
+    return validate_block_structure(block) && verify_block_signatures(block, signature_threads) == -1;
+}
+
+// True for the assume-valid block and its ancestors, once its header is on the best header chain.
+// Their signatures were vouched for by whoever chose the hash; proof-of-work, linkage and the
+// UTXO transitions are still checked, so a wrong body cannot hide behind the Merkle root.
+int block_tree_assumes_valid(const BlockTree *tree, const char *hash, int height)
+{
+    if (tree->assume_valid[0] == '\0' || !tree->best_header || height < 0)
+        return 0;
+    BlockNode *anchor = block_tree_find(tree, tree->assume_valid);
+    if (!anchor || height > anchor->height || block_node_ancestor(tree->best_header, anchor->height) != anchor)
+        return 0;
+    return strcmp(block_node_ancestor(anchor, height)->block.hash, hash) == 0;
+}
+
+static BlockNode *new_node(BlockTree *tree, const Block *block, BlockNode *parent)
+{
+    if (tree->node_count == tree->node_capacity)
+    {
+        int capacity = tree->node_capacity ? tree->node_capacity * 2 : 32;
+        BlockNode **nodes = realloc(tree->nodes, (size_t)capacity * sizeof(BlockNode *));
+        if (!nodes)
+            return NULL;
+        tree->nodes = nodes;
+        tree->node_capacity = capacity;
+    }
+    if ((tree->node_count + 1) * 10 > tree->slot_capacity * 7 && !index_grow(tree))
+        return NULL;
+
+    BlockNode *node = slab_alloc(&tree->node_pool);
+    if (!node)
+        return NULL;
+    node->block = *block;
+    node->parent = parent;
+    node->height = parent ? parent->height + 1 : 0;
+    node->child_count = 0;
+    node->have_data = 0;
+    node->failed = parent ? parent->failed : 0;
+    node->pruned = 0;
+    memset(&node->undo, 0, sizeof(node->undo));
+    node->skip = parent ? block_node_ancestor(parent, skip_height(node->height)) : NULL;
+    node->chain_work = (parent ? parent->chain_work : 0) + block_work(block->target_bits);
+
+    if (parent)
+        parent->child_count++;
+    tree->nodes[tree->node_count++] = node;
+    index_put(tree->slots, tree->slot_capacity, node);
+
+    // First-seen wins ties, so the tip only moves on strictly more work
+    if (!tree->best_header || node->chain_work > tree->best_header->chain_work)
+        tree->best_header = node;
+    return node;
+}
+
+static void set_have_data(BlockTree *tree, BlockNode *node, const Block *block)
+{
+    node->block = *block;
+    node->have_data = 1;
+    if (!node->failed && (!tree->best || node->chain_work > tree->best->chain_work))
+        tree->best = node;
+}
+
+// The target the retarget rule gives for a child of parent, computed over parent's own branch the
+// same way node_block_template computes it over the active chain
+static int follows_schedule(const BlockTree *tree, const BlockNode *parent, uint32_t bits)
+{
+    if (!tree->retarget || tree->retarget->algorithm == RETARGET_FIXED)
+        return 1;
+    int count = parent->height + 1;
+    int64_t *timestamps = malloc((size_t)count * sizeof(int64_t));
+    uint32_t *branch_bits = malloc((size_t)count * sizeof(uint32_t));
+    int follows = 0;
+    if (timestamps && branch_bits)
+    {
+        for (const BlockNode *node = parent; node; node = node->parent)
+        {
+            timestamps[node->height] = (int64_t)node->block.timestamp;
+            branch_bits[node->height] = node->block.target_bits;
+        }
+        follows = bits == retarget_next_bits(tree->retarget, timestamps, branch_bits, count);
+    }
+    free(timestamps);
+    free(branch_bits);
+    return follows;
+}
+
+static int insert(BlockTree *tree, const Block *block, BlockNode **out, int header_only, int validated)
+{
+    BlockNode *existing = block_tree_find(tree, block->hash);
+    if (existing && (existing->have_data || header_only))
+    {
+        if (out)
+            *out = existing;
+        return TREE_DUPLICATE;
+    }
+
+    if (!validated && !validate_block_header(block))
+        return TREE_INVALID;
+    if (!validated && !header_only &&
+        !(block_tree_assumes_valid(tree, block->hash, block->index) ? validate_block_structure(block)
+                                                                     : validate_block_body(block, 0)))
+        return TREE_INVALID;
+
+    // A header we already hold is completed in place once its parent has data
+    if (existing)
+    {
+        if (existing->parent && !existing->parent->have_data)
+            return TREE_NEED_DATA;
+        set_have_data(tree, existing, block);
+        if (out)
+            *out = existing;
+        return TREE_ACCEPTED;
+    }
+
+    BlockNode *parent = NULL;
+    if (tree->node_count == 0)
+    {
+        if (block->index != 0 || strcmp(block->previous_hash, GENESIS_PREV_HASH) != 0)
+            return TREE_ORPHAN;
+    }
+    else
+    {
+        parent = block_tree_find(tree, block->previous_hash);
+        if (!parent)
+            return TREE_ORPHAN;
+        if (block->index != parent->height + 1 || !follows_schedule(tree, parent, block->target_bits))
+            return TREE_INVALID;
+        if (!header_only && !parent->have_data)
+            return TREE_NEED_DATA;
+    }
+
+    BlockNode *node = new_node(tree, block, parent);
+    if (!node)
+        return TREE_INVALID;
+    if (!header_only)
+        set_have_data(tree, node, block);
+    if (out)
+        *out = node;
+    return TREE_ACCEPTED;
+}
+
+int block_tree_insert(BlockTree *tree, const Block *block, BlockNode **out)
+{
+    return insert(tree, block, out, 0, 0);
+}
+
+int block_tree_insert_header(BlockTree *tree, const Block *header, BlockNode **out)
+{
+    return insert(tree, header, out, 1, 0);
+}
+
+int block_tree_insert_validated(BlockTree *tree, const Block *block, BlockNode **out)
+{
+    // Caller already ran validate_block_header/validate_block_body, possibly on another thread
+    return insert(tree, block, out, 0, 1);
+}
+
+// Marks node and everything built on it, then falls back to the most-work tip that is left
+static void mark_failed(BlockTree *tree, BlockNode *node)
+{
+    tree->best = NULL;
+    for (int i = 0; i < tree->node_count; i++)
+    {
+        BlockNode *other = tree->nodes[i];
+        if (other->height >= node->height && block_node_ancestor(other, node->height) == node)
+            other->failed = 1;
+        if (other->have_data && !other->failed && (!tree->best || other->chain_work > tree->best->chain_work))
+            tree->best = other;
+    }
+}
+
+// Walks down from the new prune point and stops at the first node an earlier call reached. Only
+// the files and the undo data are released: the body is inline in node->block and chain->blocks.
+static void prune_bodies(BlockTree *tree)
+{
+    int height = blockstore_prune(tree->store, tree->active->height);
+    for (BlockNode *node = height >= 0 ? block_node_ancestor(tree->active, height) : NULL; node && !node->pruned;
+         node = node->parent)
+    {
+        node->pruned = 1;
+        block_undo_free(&node->undo);
+    }
+    metrics_gauge_set(GAUGE_BLOCK_FILE_BYTES, (int64_t)tree->store->disk_bytes);
+    metrics_gauge_set(GAUGE_PRUNED_HEIGHT, height);
+}
+
+int block_tree_activate_best(BlockTree *tree, Blockchain *chain, int *disconnected, int *connected)
+{
+    BlockNode *start = tree->active;
+    *disconnected = 0;
+    *connected = 0;
+
+    while (tree->best && tree->best != tree->active)
+    {
+        if (!ensure_chain_capacity(chain, tree->best->height + 1))
+            return 0;
+        BlockNode *fork = tree->active ? block_tree_fork_point(tree->active, tree->best) : NULL;
+        int fork_height = fork ? fork->height : -1;
+        if (tree->store && fork_height < tree->store->pruned_height)
+        {
+            // Stepping back that far needs undo data that was pruned, so the branch is given up
+            mark_failed(tree, block_node_ancestor(tree->best, fork_height + 1));
+            continue;
+        }
+
+        // Step back to the fork, putting back every coin the abandoned blocks spent
+        while (tree->active != fork)
+        {
+            if (tree->addresses)
+                address_index_disconnect(tree->addresses, &tree->active->block, tree->active->height);
+            ledger_disconnect_block(&tree->utxos, &tree->active->block, &tree->active->undo);
+            tree->active = tree->active->parent;
+        }
+        chain->block_count = fork_height + 1;
+        filter_index_truncate(&tree->filters, fork_height + 1);
+
+        // Then forward along the new branch; a block that does not apply ends it
+        BlockNode *target = tree->best;
+        for (int height = fork_height + 1; height <= target->height; height++)
+        {
+            BlockNode *node = block_node_ancestor(target, height);
+            uint64_t started = metrics_now_ns();
+            uint64_t span = trace_begin();
+            int applied = ledger_connect_block(&tree->utxos, &node->block, node->height, &node->undo);
+            trace_end("connect_block", "height", height, span);
+            if (!applied)
+            {
+                mark_failed(tree, node);
+                break;
+            }
+            metrics_observe_ns(HISTOGRAM_BLOCK_CONNECT, metrics_now_ns() - started);
+            metrics_count(METRIC_BLOCKS_CONNECTED, 1);
+            filter_index_connect(&tree->filters, &node->block, height);
+            if (tree->addresses)
+                address_index_connect(tree->addresses, &node->block, height, &node->undo);
+            chain->blocks[height] = node->block;
+            chain->block_count = height + 1;
+            tree->active = node;
+            if (tree->store && !blockstore_append(tree->store, &node->block))
+                return 0;
+            // Flushing between blocks keeps every batch a consistent snapshot of one tip
+            if (utxo_set_over_budget(&tree->utxos))
+                utxo_set_flush(&tree->utxos);
+        }
+    }
+
+    if (tree->store && tree->active)
+        prune_bodies(tree);
+
+    // Net effect only: a branch that failed halfway and was rolled back counts for nothing
+    BlockNode *fork = start && tree->active ? block_tree_fork_point(start, tree->active) : NULL;
+    int fork_height = fork ? fork->height : -1;
+    *disconnected = start ? start->height - fork_height : 0;
+    *connected = tree->active ? tree->active->height - fork_height : 0;
+    metrics_gauge_set(GAUGE_CHAIN_HEIGHT, tree->active ? tree->active->height : -1);
+    metrics_gauge_set(GAUGE_UTXO_COINS, tree->utxos.count);
+    return 1;
+}
+
+void display_chain_tips(const BlockTree *tree)
+{
+    print_header("CHAIN TIPS");
+
+    if (tree->node_count == 0)
+    {
+        print_error("Block tree is empty");
+        return;
+    }
+
+    printf(COLOR_BLUE "┌──────────────────────────────────────────────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_CYAN "BLOCK TREE (%d blocks)" COLOR_BLUE "                               │\n", tree->node_count);
+    printf(COLOR_BLUE "├──────────────────────────────────────────────────────┤\n");
+    for (int i = 0; i < tree->node_count; i++)
+    {
+        if (tree->nodes[i]->child_count > 0)
+            continue;
+        const BlockNode *tip = tree->nodes[i];
+        const BlockNode *fork = block_tree_fork_point((BlockNode *)tip, tree->active);
+        printf(COLOR_BLUE "│ " COLOR_ORANGE "Height %-4d" COLOR_BLUE " %.12s...%s %s\n", tip->height, tip->block.hash,
+               tip->block.hash + 52, tip == tree->active ? COLOR_GREEN "active" : !tip->have_data ? COLOR_GRAY "headers" : COLOR_YELLOW "fork");
+        printf(COLOR_BLUE "│   " COLOR_CYAN "Work: %-10llu Fork depth: %-3d" COLOR_RESET "\n",
+               (unsigned long long)tip->chain_work, fork ? tip->height - fork->height : tip->height + 1);
+    }
+    printf(COLOR_BLUE "└──────────────────────────────────────────────────────┘\n");
+}
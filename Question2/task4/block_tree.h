@@ -0,0 +1,74 @@
+#ifndef BLOCK_TREE_H
+#define BLOCK_TREE_H
+
+#include <stdint.h>
+#include "addrindex.h"
+#include "blockchain.h"
+#include "blockfilter.h"
+#include "blockstore.h"
+#include "ledger.h"
+#include "retarget.h"
+#include "utxo.h"
+
+/* ================ CONSTANTS ================ */
+#define TREE_ACCEPTED 0   // Block stored as a new node
+#define TREE_DUPLICATE 1  // Block already known
+#define TREE_ORPHAN 2     // Parent not known yet
+#define TREE_INVALID 3    // Bad hash, bad proof-of-work or bad height
+#define TREE_NEED_DATA 4  // Parent is known only by its header
+#define TREE_BAD_LEDGER 5 // Transactions do not apply to the UTXO set of their branch
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct BlockNode
+{
+    Block block;              // Header, plus transactions once have_data is set
+    struct BlockNode *parent; // Block this one builds on (NULL for genesis)
+    struct BlockNode *skip;   // Far ancestor used to jump back in O(log n)
+    int height;               // Distance from genesis
+    int child_count;          // Blocks built directly on this one
+    int have_data;            // 0 while only the header is known
+    int failed;               // This block or an ancestor did not apply to the UTXO set
+    int pruned;               // Body deleted from disk and undo released; block, held inline, stays in memory
+    uint64_t chain_work;      // Total work of genesis..this block
+    BlockUndo undo;           // Coins this block spent, kept while it is on the active chain
+} BlockNode;
+
+typedef struct BlockTree
+{
+    BlockNode **nodes;            // Every node, in insertion order (owns the memory)
+    int node_count;               // Number of nodes in the tree
+    int node_capacity;            // Allocated length of nodes
+    BlockNode **slots;            // Open-addressing index keyed by block hash
+    int slot_capacity;            // Power of two
+    BlockNode *best;              // Tip with the most cumulative work (full blocks only)
+    BlockNode *best_header;       // Tip with the most cumulative work (headers included)
+    BlockNode *active;            // Tip currently copied into Blockchain.blocks
+    UtxoSet utxos;                // Unspent outputs as of active
+    SlabPool node_pool;           // Memory of every BlockNode
+    BlockStore *store;            // Block files written as blocks connect (NULL: memory only)
+    char assume_valid[HASH_SIZE]; // This block and its ancestors skip signature checks ("": none do)
+    FilterIndex filters;          // Block filters of the active chain, by height
+    AddressIndex *addresses;      // History and balance per address, kept as blocks connect (NULL: not kept)
+    RetargetParams *retarget;     // Schedule each block's target is checked against (NULL or fixed: any target)
+} BlockTree;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void block_tree_init(BlockTree *tree);
+void block_tree_free(BlockTree *tree);
+uint64_t block_work(uint32_t bits);
+BlockNode *block_tree_find(const BlockTree *tree, const char *hash);
+BlockNode *block_tree_find_prefix(const BlockTree *tree, const char *prefix);
+BlockNode *block_tree_find_block(const BlockTree *tree, const char *hash);
+int block_tree_insert(BlockTree *tree, const Block *block, BlockNode **out);
+int block_tree_insert_header(BlockTree *tree, const Block *header, BlockNode **out);
+int block_tree_insert_validated(BlockTree *tree, const Block *block, BlockNode **out);
+int validate_block_structure(const Block *block);
+int validate_block_body(const Block *block, int signature_threads);
+int block_tree_assumes_valid(const BlockTree *tree, const char *hash, int height);
+int validate_block_header(const Block *header);
+BlockNode *block_node_ancestor(BlockNode *node, int height);
+BlockNode *block_tree_fork_point(BlockNode *a, BlockNode *b);
+int block_tree_activate_best(BlockTree *tree, Blockchain *chain, int *disconnected, int *connected);
+void display_chain_tips(const BlockTree *tree);
+
+#endif
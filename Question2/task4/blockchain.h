@@ -0,0 +1,97 @@
+#ifndef BLOCKCHAIN_H
+#define BLOCKCHAIN_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/sha.h>
+
+/* ================ CONSTANTS ================ */
+#define HASH_SIZE 65         // Size of SHA-256 hash string (64 chars + null terminator)
+#define MAX_TRANSACTIONS 10  // Maximum transactions per block
+#define BLOCK_TX_BYTES 2048  // Encoded transaction bytes a block can hold
+#define MAX_TX_SIZE 512      // Largest single encoded transaction
+#define TX_TEXT_SIZE 256     // Longest human-readable transaction, with null terminator
+#define DEFAULT_DIFFICULTY 4 // Default mining difficulty (number of leading zeros)
+#define TXID_SIZE 32         // Raw SHA-256 of the encoded transaction
+#define PUBLIC_KEY_SIZE 32   // Raw Ed25519 public key
+#define SIGNATURE_SIZE 64    // Raw Ed25519 signature
+#define ADDRESS_SIZE 41      // Key address: 40 hex chars of SHA-256(public key) + null terminator
+
+/* ================ COLOR SCHEME ================ */
+#define COLOR_BRIGHT "\033[1m"
+#define COLOR_RESET "\033[0m"
+#define COLOR_RED "\033[38;5;203m"
+#define COLOR_GREEN "\033[38;5;84m"
+#define COLOR_YELLOW "\033[38;5;227m"
+#define COLOR_BLUE "\033[38;5;75m"
+#define COLOR_PURPLE "\033[38;5;141m"
+#define COLOR_CYAN "\033[38;5;87m"
+#define COLOR_GRAY "\033[38;5;245m"
+#define COLOR_ORANGE "\033[38;5;214m"
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char public_key[PUBLIC_KEY_SIZE]; // Key whose address is the sender (all zero = unsigned)
+    unsigned char signature[SIGNATURE_SIZE];   // Ed25519 signature over the txid
+} TxWitness;
+
+typedef struct
+{
+    int index;                                 // Block index in the chain
+    time_t timestamp;                          // Time when block was created
+    unsigned char tx_data[BLOCK_TX_BYTES];     // Encoded transactions, back to back (fixed so Block copies by value)
+    uint16_t tx_offsets[MAX_TRANSACTIONS + 1]; // Transaction i spans tx_offsets[i]..tx_offsets[i + 1]
+    TxWitness witnesses[MAX_TRANSACTIONS];     // Signature of each transaction, if any
+    int transaction_count;                     // Number of transactions in block
+    char previous_hash[HASH_SIZE];             // Hash of previous block in chain
+    char merkle_root[HASH_SIZE];               // Merkle root of the transaction IDs
+    int difficulty;                            // Leading hex zeros of the target (for display)
+    uint32_t target_bits;                      // Compact 256-bit target the hash must not exceed
+    int nonce;                                 // Proof-of-work nonce
+    char hash[HASH_SIZE];                      // Current block's hash
+} Block;
+
+struct BlockTree;
+
+typedef struct
+{
+    Block *blocks;          // Active (most-work) chain, indexed by height
+    int block_count;        // Number of blocks in chain
+    int block_capacity;     // Allocated length of blocks
+    struct BlockTree *tree; // Every known block, including forks
+} Blockchain;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void print_header(const char *text);
+void print_success(const char *text);
+void print_error(const char *text);
+void bytes_to_hex(const unsigned char *bytes, size_t length, char *hex);
+int hex_to_bytes(const char *hex, unsigned char *bytes, size_t length);
+
+void calculate_sha256(const char *input, char output[HASH_SIZE]);
+void compute_txid(const unsigned char *tx, size_t length, unsigned char txid[TXID_SIZE]);
+void compute_wtxid(const unsigned char *tx, size_t length, const TxWitness *witness, unsigned char wtxid[TXID_SIZE]);
+void compute_merkle_root(const Block *block, char merkle_root[HASH_SIZE]);
+int block_header_prefix(const Block *block, char *prefix, size_t size);
+void hash_block_header(const Block *block, char *output_hash);
+void calculate_block_hash(const Block *block, char *output_hash);
+void solve_block(Block *block, int difficulty, int *nonce_attempts);
+void mine_block(Block *block, int difficulty, double *time_taken, int *nonce_attempts);
+int ensure_chain_capacity(Blockchain *chain, int block_count);
+int submit_block(Blockchain *chain, const Block *block, int *disconnected, int *connected);
+void initialize_genesis_block(Blockchain *chain, int difficulty);
+void add_block(Blockchain *chain, const char transactions[][TX_TEXT_SIZE],
+               int transaction_count, const char *prev_hash, int difficulty);
+int verify_blockchain(const Blockchain *chain);
+int read_transactions_from_input(char transactions[][TX_TEXT_SIZE]);
+void add_block_from_input(Blockchain *chain, int difficulty);
+void add_fork_block_from_input(Blockchain *chain, int difficulty);
+void display_blockchain(const Blockchain *chain);
+void simulate_mining(Blockchain *chain, int start_difficulty, int end_difficulty);
+void show_menu(Blockchain *chain);
+
+#endif
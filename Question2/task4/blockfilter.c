@@ -0,0 +1,465 @@
+#include "blockfilter.h"
+#include "block_tree.h"
+#include "ledger.h"
+#include "p2p.h"
+#include "siphash.h"
+#include "wire.h"
+
+/* ================ GOLOMB-RICE CODING ================ */
+typedef struct
+{
+    ByteWriter *out; // Receives whole bytes
+    uint64_t bits;   // Pending bits, newest lowest
+    int count;       // How many of them are pending (under 8 between calls)
+} BitWriter;
+
+typedef struct
+{
+    const unsigned char *data; // Coded deltas
+    size_t length;             // Bytes in data
+    size_t offset;             // Next byte to load
+    uint64_t bits;             // Loaded bits, next one highest of the available ones
+    int available;             // Loaded bits not read yet
+} BitReader;
+
+static void put_bits(BitWriter *writer, uint64_t value, int count)
+{
+    writer->bits = (writer->bits << count) | (value & ((1ull << count) - 1));
+    writer->count += count;
+    while (writer->count >= 8)
+    {
+        writer->count -= 8;
+        put_u8(writer->out, (uint8_t)(writer->bits >> writer->count));
+    }
+}
+
+// Quotient in unary (that many ones, then a zero), then the remainder in FILTER_P bits
+static void put_golomb(BitWriter *writer, uint64_t value)
+{
+    uint64_t quotient = value >> FILTER_P;
+    for (; quotient >= 32; quotient -= 32)
+        put_bits(writer, 0xffffffffu, 32);
+    put_bits(writer, (1ull << quotient) - 1, (int)quotient);
+    put_bits(writer, 0, 1);
+    put_bits(writer, value, FILTER_P);
+}
+
+// Tops the window up to at least 57 bits, or to whatever is left
+static void refill_bits(BitReader *reader)
+{
+    while (reader->available <= 56 && reader->offset < reader->length)
+    {
+        reader->bits = (reader->bits << 8) | reader->data[reader->offset++];
+        reader->available += 8;
+    }
+}
+
+static int get_bits(BitReader *reader, int count, uint64_t *value)
+{
+    if (reader->available < count)
+        refill_bits(reader);
+    if (reader->available < count)
+        return 0;
+    reader->available -= count;
+    *value = (reader->bits >> reader->available) & ((1ull << count) - 1);
+    return 1;
+}
+
+// The unary quotient is counted a window at a time rather than bit by bit
+static int get_golomb(BitReader *reader, uint64_t *value)
+{
+    uint64_t quotient = 0, remainder;
+    for (;;)
+    {
+        refill_bits(reader);
+        if (reader->available == 0)
+            return 0;
+        // Unread bits moved to the top; the zeros shifted in below them end any run of ones
+        uint64_t window = reader->bits << (64 - reader->available);
+        int ones = ~window ? __builtin_clzll(~window) : 64;
+        if (ones < reader->available)
+        {
+            quotient += (uint64_t)ones;
+            reader->available -= ones + 1;
+            break;
+        }
+        quotient += (uint64_t)reader->available;
+        reader->available = 0;
+    }
+    if (!get_bits(reader, FILTER_P, &remainder))
+        return 0;
+    *value = (quotient << FILTER_P) | remainder;
+    return 1;
+}
+
+/* ================ FILTERS ================ */
+static int hex_nibble(char c)
+{
+    return c >= 'a' ? c - 'a' + 10 : c >= 'A' ? c - 'A' + 10 : c - '0';
+}
+
+// SipHash key: the first 16 bytes of the block hash, decoded here rather than with hex_to_bytes
+// because a rescan derives one key per block tested
+static void filter_key(const char *block_hash, uint64_t *k0, uint64_t *k1)
+{
+    *k0 = *k1 = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        *k0 = (*k0 << 8) | (uint64_t)(hex_nibble(block_hash[2 * i]) << 4 | hex_nibble(block_hash[2 * i + 1]));
+        *k1 = (*k1 << 8) | (uint64_t)(hex_nibble(block_hash[16 + 2 * i]) << 4 | hex_nibble(block_hash[17 + 2 * i]));
+    }
+}
+
+// Spreads a 64-bit hash over [0, range) without a division
+static uint64_t map_to_range(uint64_t hash, uint64_t range)
+{
+    return (uint64_t)(((unsigned __int128)hash * range) >> 64);
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Appends the block's filter to out and returns how many distinct elements it codes
+int blockfilter_build(const Block *block, ByteWriter *out)
+{
+    uint64_t hashes[FILTER_MAX_ELEMENTS], k0, k1;
+    int count = 0;
+    filter_key(block->hash, &k0, &k1);
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView tx;
+        if (!block_transaction(block, i, &tx))
+            continue;
+        if (tx.sender_length > 0)
+            hashes[count++] = siphash24(k0, k1, tx.sender, tx.sender_length);
+        const unsigned char *cursor = tx.inputs;
+        for (int j = 0; j < tx.input_count; j++)
+        {
+            TxInputView input;
+            unsigned char outpoint[FILTER_OUTPOINT_SIZE];
+            tx_next_input(&cursor, &input);
+            memcpy(outpoint, input.prev_txid, TXID_SIZE);
+            for (int b = 0; b < 4; b++)
+                outpoint[TXID_SIZE + b] = (unsigned char)(input.index >> (8 * b));
+            hashes[count++] = siphash24(k0, k1, outpoint, sizeof(outpoint));
+        }
+        cursor = tx.outputs;
+        for (int j = 0; j < tx.output_count; j++)
+        {
+            TxOutputView output;
+            tx_next_output(&cursor, &output);
+            hashes[count++] = siphash24(k0, k1, output.address, output.address_length);
+        }
+    }
+
+    // Repeated elements hash alike; dropping them before mapping keeps the range at distinct * M
+    qsort(hashes, (size_t)count, sizeof(uint64_t), compare_u64);
+    int distinct = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (distinct == 0 || hashes[i] != hashes[distinct - 1])
+            hashes[distinct++] = hashes[i];
+    }
+
+    // The mapping keeps order, so the mapped values are already sorted for delta coding
+    BitWriter bits = {out, 0, 0};
+    uint64_t range = (uint64_t)distinct * FILTER_M, previous = 0;
+    put_varint(out, (uint64_t)distinct);
+    for (int i = 0; i < distinct; i++)
+    {
+        uint64_t value = map_to_range(hashes[i], range);
+        put_golomb(&bits, value - previous);
+        previous = value;
+    }
+    if (bits.count > 0)
+        put_bits(&bits, 0, 8 - bits.count);
+    return distinct;
+}
+
+/* ================ FILTER INDEX ================ */
+void filter_index_init(FilterIndex *index)
+{
+    memset(index, 0, sizeof(*index));
+    writer_init(&index->bytes);
+}
+
+void filter_index_free(FilterIndex *index)
+{
+    free(index->entries);
+    writer_free(&index->bytes);
+    filter_index_init(index);
+}
+
+// Called as a block connects at height; a block replacing one a reorg disconnected drops the rest
+int filter_index_connect(FilterIndex *index, const Block *block, int height)
+{
+    if (height < index->count)
+        filter_index_truncate(index, height);
+    if (height != index->count)
+        return 0;
+    if (index->count == index->capacity)
+    {
+        int capacity = index->capacity ? index->capacity * 2 : 1024;
+        FilterEntry *grown = realloc(index->entries, (size_t)capacity * sizeof(FilterEntry));
+        if (!grown)
+            return 0;
+        index->entries = grown;
+        index->capacity = capacity;
+    }
+    FilterEntry *entry = &index->entries[index->count++];
+    filter_key(block->hash, &entry->k0, &entry->k1);
+    entry->offset = (uint32_t)index->bytes.length;
+    entry->elements = (uint16_t)blockfilter_build(block, &index->bytes);
+    entry->length = (uint16_t)(index->bytes.length - entry->offset);
+    return 1;
+}
+
+void filter_index_truncate(FilterIndex *index, int count)
+{
+    if (count < 0)
+        count = 0;
+    if (count >= index->count)
+        return;
+    index->count = count;
+    index->bytes.length = count > 0 ? index->entries[count - 1].offset + index->entries[count - 1].length : 0;
+}
+
+// Walks the coded values and up to FILTER_MATCH_BATCH sorted queries side by side; stops at the first equal pair
+static int match_batch(const FilterIndex *index, const FilterEntry *entry, const FilterItem *items, int count)
+{
+    uint64_t queries[FILTER_MATCH_BATCH];
+    uint64_t range = (uint64_t)entry->elements * FILTER_M;
+    for (int i = 0; i < count; i++)
+        queries[i] = map_to_range(siphash24(entry->k0, entry->k1, items[i].data, items[i].length), range);
+    if (count > 1)
+        qsort(queries, (size_t)count, sizeof(uint64_t), compare_u64);
+
+    ByteReader header;
+    reader_init(&header, index->bytes.data + entry->offset, entry->length);
+    get_varint(&header);
+    BitReader reader = {header.data + header.offset, header.length - header.offset, 0, 0, 0};
+    uint64_t value = 0, delta;
+    int next = 0;
+    for (int i = 0; i < entry->elements && get_golomb(&reader, &delta); i++)
+    {
+        value += delta;
+        while (next < count && queries[next] < value)
+            next++;
+        if (next == count)
+            return 0;
+        if (queries[next] == value)
+            return 1;
+    }
+    return 0;
+}
+
+// Any number of items: larger sets are tested a batch at a time, so none is ever left out
+int filter_index_match(const FilterIndex *index, int height, const FilterItem *items, int count)
+{
+    if (height < 0 || height >= index->count || count <= 0)
+        return 0;
+    const FilterEntry *entry = &index->entries[height];
+    if (entry->elements == 0)
+        return 0;
+    for (int first = 0; first < count; first += FILTER_MATCH_BATCH)
+    {
+        int batch = count - first < FILTER_MATCH_BATCH ? count - first : FILTER_MATCH_BATCH;
+        if (match_batch(index, entry, items + first, batch))
+            return 1;
+    }
+    return 0;
+}
+
+/* ================ RESCAN ================ */
+int transaction_touches_address(const TxView *tx, const char *address, size_t length)
+{
+    if (tx->sender_length == length && memcmp(tx->sender, address, length) == 0)
+        return 1;
+    const unsigned char *cursor = tx->outputs;
+    for (int j = 0; j < tx->output_count; j++)
+    {
+        TxOutputView output;
+        tx_next_output(&cursor, &output);
+        if (output.address_length == length && memcmp(output.address, address, length) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Reads every transaction of the block; returns how many touch the address, or -1 if visit stopped
+int rescan_block(const Block *block, int height, const char *address, RescanVisit visit, void *context)
+{
+    size_t length = strlen(address);
+    int found = 0;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView tx;
+        if (!block_transaction(block, i, &tx) || !transaction_touches_address(&tx, address, length))
+            continue;
+        found++;
+        if (visit && !visit(height, i, &tx, context))
+            return -1;
+    }
+    return found;
+}
+
+// Tests the filter of every active block and reads only the blocks that match
+int blockfilter_rescan(const Blockchain *chain, const FilterIndex *index, const char *address, RescanVisit visit,
+                       void *context, RescanStats *stats)
+{
+    FilterItem item = {address, strlen(address)};
+    memset(stats, 0, sizeof(*stats));
+    for (int height = 0; height < chain->block_count; height++)
+    {
+        stats->blocks++;
+        // A height the index does not cover yet is read in full
+        if (height < index->count && !filter_index_match(index, height, &item, 1))
+            continue;
+        stats->matched++;
+        int found = rescan_block(&chain->blocks[height], height, address, visit, context);
+        if (found < 0)
+            break;
+        stats->transactions += found;
+        stats->false_positives += found == 0;
+    }
+    return 1;
+}
+
+/* ================ BENCHMARK ================ */
+typedef struct
+{
+    double full_ms;      // Reading every block
+    double filter_ms;    // Testing filters, reading the matches
+    int queries;         // Addresses looked up
+    int matched;         // Blocks read through filters
+    int found;           // Transactions found (the same both ways)
+    int mismatches;      // Queries where the two scans disagreed
+    int false_positives; // Blocks read without finding anything
+} FilterBenchRow;
+
+static void bench_query(const BlockTree *tree, const Blockchain *chain, const char *address, FilterBenchRow *row)
+{
+    uint64_t started = monotonic_ns();
+    int full = 0;
+    for (int height = 0; height < chain->block_count; height++)
+        full += rescan_block(&chain->blocks[height], height, address, NULL, NULL);
+    uint64_t middle = monotonic_ns();
+    RescanStats stats;
+    blockfilter_rescan(chain, &tree->filters, address, NULL, NULL, &stats);
+    uint64_t finished = monotonic_ns();
+
+    row->full_ms += (double)(middle - started) / 1e6;
+    row->filter_ms += (double)(finished - middle) / 1e6;
+    row->queries++;
+    row->matched += stats.matched;
+    row->found += stats.transactions;
+    row->mismatches += stats.transactions != full;
+    row->false_positives += stats.false_positives;
+}
+
+int run_filter_benchmark(int block_count, int queries)
+{
+    if (block_count < 1 || block_count > 100000 || queries < 1)
+    {
+        print_error("Usage: --filter-bench <blocks 1-100000> [queries]");
+        return 1;
+    }
+    print_header("BLOCK FILTER BENCHMARK");
+    printf(COLOR_CYAN "Connecting %d blocks, then rescanning for %d active and %d unused addresses..." COLOR_RESET "\n",
+           block_count, queries, queries);
+    fflush(stdout);
+
+    BenchCoin *coins = malloc((size_t)block_count * 2 * MAX_TRANSACTIONS * sizeof(BenchCoin));
+    Block *block = malloc(sizeof(Block));
+    BlockTree tree;
+    Blockchain chain = {0};
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    int ok = coins && block;
+    unsigned int seed = 4949;
+    int coin_count = 0, disconnected, connected;
+    uint64_t block_bytes = 0;
+    for (int height = 0; height < block_count && ok; height++)
+    {
+        int nonce_attempts;
+        BlockNode *inserted;
+        ledger_bench_block(block, height, coins, &coin_count, &seed);
+        strcpy(block->previous_hash, height ? chain.blocks[height - 1].hash
+                                            : "0000000000000000000000000000000000000000000000000000000000000000");
+        solve_block(block, 1, &nonce_attempts);
+        ok = block_tree_insert_validated(&tree, block, &inserted) == TREE_ACCEPTED &&
+             block_tree_activate_best(&tree, &chain, &disconnected, &connected) && chain.block_count == height + 1;
+        block_bytes += block->tx_offsets[block->transaction_count];
+    }
+    free(coins);
+    free(block);
+
+    // Building every filter again, apart from the rest of block connection
+    ByteWriter rebuilt;
+    uint64_t elements = 0, started = monotonic_ns();
+    writer_init(&rebuilt);
+    for (int height = 0; ok && height < chain.block_count; height++)
+        elements += (uint64_t)blockfilter_build(&chain.blocks[height], &rebuilt);
+    double build_us = (double)(monotonic_ns() - started) / 1e3 / block_count;
+    uint64_t filter_bytes = rebuilt.length;
+    ok = ok && rebuilt.length == tree.filters.bytes.length && tree.filters.count == block_count &&
+         memcmp(rebuilt.data, tree.filters.bytes.data, rebuilt.length) == 0;
+    writer_free(&rebuilt);
+    if (!ok)
+    {
+        print_error("Could not build the benchmark chain");
+        block_tree_free(&tree);
+        free(chain.blocks);
+        return 1;
+    }
+
+    FilterBenchRow rows[2] = {0};
+    char address[TX_MAX_ADDRESS + 1];
+    for (int q = 0; q < queries; q++)
+    {
+        snprintf(address, sizeof(address), "owner-%03d", rand_r(&seed) % 500);
+        bench_query(&tree, &chain, address, &rows[0]);
+        snprintf(address, sizeof(address), "wallet-%06d", q);
+        bench_query(&tree, &chain, address, &rows[1]);
+    }
+
+    printf(COLOR_BLUE "┌────────────────┬───────────┬────────────┬────────────────┬──────────┬─────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-14s" COLOR_BLUE " │ " COLOR_YELLOW "%-9s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-14s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-7s" COLOR_BLUE " │\n",
+           "Address", "Full scan", "Filter", "Blocks read", "Tx found", "Speedup");
+    printf(COLOR_BLUE "├────────────────┼───────────┼────────────┼────────────────┼──────────┼─────────┤\n");
+    const char *names[2] = {"Active", "Unused"};
+    for (int r = 0; r < 2; r++)
+    {
+        char full[32], filtered[32], read[32];
+        snprintf(full, sizeof(full), "%.3f ms", rows[r].full_ms / rows[r].queries);
+        snprintf(filtered, sizeof(filtered), "%.3f ms", rows[r].filter_ms / rows[r].queries);
+        snprintf(read, sizeof(read), "%.1f of %d", (double)rows[r].matched / rows[r].queries, block_count);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-14s" COLOR_BLUE " │ " COLOR_RESET "%-9s" COLOR_BLUE " │ " COLOR_RESET "%-10s" COLOR_BLUE
+                          " │ " COLOR_RESET "%-14s" COLOR_BLUE " │ " COLOR_RESET "%-8.1f" COLOR_BLUE " │ " COLOR_GREEN "%6.1fx" COLOR_BLUE " │\n",
+               names[r], full, filtered, read, (double)rows[r].found / rows[r].queries,
+               rows[r].full_ms / rows[r].filter_ms);
+    }
+    printf(COLOR_BLUE "└────────────────┴───────────┴────────────┴────────────────┴──────────┴─────────┘" COLOR_RESET "\n");
+
+    uint64_t tests = (uint64_t)rows[1].queries * (uint64_t)block_count;
+    printf(COLOR_GREEN "\nFilters: %.1f bytes and %.1f elements per block (%.1f%% of transaction bytes), built in %.2f us each"
+                       COLOR_RESET "\n",
+           (double)filter_bytes / block_count, (double)elements / block_count, 100.0 * filter_bytes / block_bytes, build_us);
+    printf(COLOR_GREEN "False positives: %d in %llu tests of unused addresses (expected about %.1f)" COLOR_RESET "\n",
+           rows[1].false_positives, (unsigned long long)tests, (double)tests / FILTER_M);
+
+    int mismatches = rows[0].mismatches + rows[1].mismatches;
+    block_tree_free(&tree);
+    free(chain.blocks);
+    if (mismatches > 0 || rows[1].found > 0)
+    {
+        printf(COLOR_RED "✗ Filtered rescans disagreed with full scans for %d addresses" COLOR_RESET "\n", mismatches);
+        return 1;
+    }
+    print_success("Every filtered rescan found the same transactions as a full scan");
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef BLOCKFILTER_H
+#define BLOCKFILTER_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "transaction.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define FILTER_P 19           // Golomb-Rice parameter: each remainder takes 19 bits
+#define FILTER_M 784931       // Hashes spread over elements * M values: a missing item matches about 1 time in M
+#define FILTER_MATCH_BATCH 16 // Query items sorted and tested per pass over a filter
+
+#define FILTER_OUTPOINT_SIZE (TXID_SIZE + 4) // Outpoint element: txid, then the index little-endian
+// Every sender, spent outpoint and output address of a full block
+#define FILTER_MAX_ELEMENTS (MAX_TRANSACTIONS * (1 + TX_MAX_INPUTS + TX_MAX_OUTPUTS))
+
+/* ================ DATA STRUCTURES ================ */
+// Where one block's Golomb-coded set lives. The set holds everything the block touches: each
+// sender and output address, and each outpoint its inputs spend. Element hashes are keyed by
+// the block hash, so a false positive in one block says nothing about the next.
+typedef struct
+{
+    uint64_t k0, k1;   // SipHash key: the first 16 bytes of the block hash
+    uint32_t offset;   // Start of the filter in FilterIndex.bytes
+    uint16_t length;   // Bytes of filter: varint element count, then the coded deltas
+    uint16_t elements; // Distinct elements coded
+} FilterEntry;
+
+// Filters of the active chain by height, back to back in one buffer so a rescan streams
+// through a few hundred bytes per block instead of touching each block
+typedef struct
+{
+    FilterEntry *entries; // Indexed by height
+    int count;            // Heights covered (the active chain's length)
+    int capacity;         // Allocated length of entries
+    ByteWriter bytes;     // Every filter, in height order
+} FilterIndex;
+
+typedef struct
+{
+    const void *data; // Address text or FILTER_OUTPOINT_SIZE outpoint bytes
+    size_t length;    // Bytes in data
+} FilterItem;
+
+typedef struct
+{
+    int blocks;          // Filters tested
+    int matched;         // Blocks whose filter matched, and which were read
+    int false_positives; // Matched blocks without any of the wallet's transactions
+    int transactions;    // Transactions sending from or paying to the address
+} RescanStats;
+
+// Called for each transaction the rescan finds; returning 0 stops it
+typedef int (*RescanVisit)(int height, int index, const TxView *tx, void *context);
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int blockfilter_build(const Block *block, ByteWriter *out);
+void filter_index_init(FilterIndex *index);
+void filter_index_free(FilterIndex *index);
+int filter_index_connect(FilterIndex *index, const Block *block, int height);
+void filter_index_truncate(FilterIndex *index, int count);
+int filter_index_match(const FilterIndex *index, int height, const FilterItem *items, int count);
+int transaction_touches_address(const TxView *tx, const char *address, size_t length);
+int rescan_block(const Block *block, int height, const char *address, RescanVisit visit, void *context);
+int blockfilter_rescan(const Blockchain *chain, const FilterIndex *index, const char *address, RescanVisit visit,
+                       void *context, RescanStats *stats);
+int run_filter_benchmark(int block_count, int queries);
+
+#endif
@@ -0,0 +1,330 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "blockstore.h"
+#include "block_tree.h"
+#include "ledger.h"
+#include "pipeline.h"
+#include "trace.h"
+
+/* ================ FILES ================ */
+static void file_path(const BlockStore *store, int number, char *path, size_t size)
+{
+    snprintf(path, size, "%s/blk-%05d.dat", store->dir, number);
+}
+
+int blockstore_wipe(const char *dir)
+{
+    DIR *listing = opendir(dir);
+    if (!listing)
+        return 0;
+    struct dirent *item;
+    while ((item = readdir(listing)) != NULL)
+    {
+        if (strncmp(item->d_name, "blk-", 4) == 0)
+        {
+            char path[600];
+            snprintf(path, sizeof(path), "%s/%s", dir, item->d_name);
+            unlink(path);
+        }
+    }
+    closedir(listing);
+    return 1;
+}
+
+// Like the coin database, nothing is reloaded on start: leftover files are removed
+int blockstore_open(BlockStore *store, const char *dir, size_t file_limit)
+{
+    memset(store, 0, sizeof(*store));
+    snprintf(store->dir, sizeof(store->dir), "%s", dir);
+    store->file_limit = file_limit;
+    store->pruned_height = -1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return 0;
+    return blockstore_wipe(dir);
+}
+
+// A depth below PRUNE_MIN_BLOCKS is raised to it; bytes only bound what lies beyond that window
+void blockstore_set_prune(BlockStore *store, uint64_t bytes, int depth)
+{
+    store->prune_bytes = bytes;
+    store->prune_depth = depth > 0 && depth < PRUNE_MIN_BLOCKS ? PRUNE_MIN_BLOCKS : depth;
+}
+
+static int start_file(BlockStore *store)
+{
+    if (store->current)
+    {
+        // Finished files are only read again to serve old blocks, so they need not stay cached
+        posix_fadvise(fileno(store->current), 0, 0, POSIX_FADV_DONTNEED);
+        fclose(store->current);
+        store->current = NULL;
+    }
+    if (store->file_count == store->file_capacity)
+    {
+        int capacity = store->file_capacity ? store->file_capacity * 2 : 16;
+        BlockFile *files = realloc(store->files, (size_t)capacity * sizeof(BlockFile));
+        if (!files)
+            return 0;
+        store->files = files;
+        store->file_capacity = capacity;
+    }
+    char path[300];
+    file_path(store, store->next_number, path, sizeof(path));
+    store->current = fopen(path, "wb");
+    if (!store->current)
+        return 0;
+    BlockFile *file = &store->files[store->file_count++];
+    file->number = store->next_number++;
+    file->low_height = INT32_MAX;
+    file->high_height = -1;
+    file->bytes = 0;
+    return 1;
+}
+
+int blockstore_append(BlockStore *store, const Block *block)
+{
+    if ((!store->current || store->files[store->file_count - 1].bytes >= store->file_limit) && !start_file(store))
+        return 0;
+    BlockFile *file = &store->files[store->file_count - 1];
+    if (!block_store_append(store->current, block))
+        return 0;
+    long size = ftell(store->current);
+    if (size < 0)
+        return 0;
+    store->disk_bytes += (uint64_t)size - file->bytes;
+    file->bytes = (uint64_t)size;
+    if (block->index < file->low_height)
+        file->low_height = block->index;
+    if (block->index > file->high_height)
+        file->high_height = block->index;
+    return 1;
+}
+
+// Deletes the oldest files the budgets allow and returns the height at or below which bodies may be
+// gone. Files are taken strictly oldest first, so that height never goes down.
+int blockstore_prune(BlockStore *store, int tip_height)
+{
+    TRACE_SCOPE("prune_block_files", "height", tip_height);
+    int deleted = 0;
+    // The open file is never deleted, nor one holding a block within PRUNE_MIN_BLOCKS of the tip
+    while (deleted < store->file_count - 1)
+    {
+        const BlockFile *file = &store->files[deleted];
+        int beyond_depth = store->prune_depth && file->high_height <= tip_height - store->prune_depth;
+        int over_budget = store->prune_bytes && store->disk_bytes > store->prune_bytes;
+        if (file->high_height > tip_height - PRUNE_MIN_BLOCKS || (!beyond_depth && !over_budget))
+            break;
+        char path[300];
+        file_path(store, file->number, path, sizeof(path));
+        if (unlink(path) != 0 && errno != ENOENT)
+            break;
+        store->disk_bytes -= file->bytes;
+        store->pruned_files++;
+        store->pruned_bytes += file->bytes;
+        if (file->high_height > store->pruned_height)
+            store->pruned_height = file->high_height;
+        deleted++;
+    }
+    if (deleted > 0)
+    {
+        store->file_count -= deleted;
+        memmove(store->files, store->files + deleted, (size_t)store->file_count * sizeof(BlockFile));
+    }
+    return store->pruned_height;
+}
+
+void blockstore_close(BlockStore *store)
+{
+    if (store->current)
+        fclose(store->current);
+    free(store->files);
+    store->current = NULL;
+    store->files = NULL;
+    store->file_count = 0;
+    store->file_capacity = 0;
+}
+
+/* ================ BENCHMARK ================ */
+#define BENCH_FILE_BYTES (64 * 1024) // Smaller files than a node's, so a short chain spans many
+#define BENCH_CHECKPOINTS 8          // Table rows
+
+typedef struct
+{
+    Blockchain chain; // Active chain copy
+    BlockTree tree;   // Nodes, UTXO set and undo data
+    BlockStore store; // Block files
+    char dir[64];     // Where the files go
+} PruneBenchNode;
+
+typedef struct
+{
+    int height;             // Tip at the checkpoint
+    uint64_t disk_bytes[2]; // Block files on disk, full then pruned
+    uint64_t undo_bytes[2]; // Undo data held, full then pruned
+    int pruned_height;      // Prune point of the pruned node
+} PruneBenchRow;
+
+static uint64_t undo_bytes(const BlockTree *tree)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < tree->node_count; i++)
+        total += tree->nodes[i]->undo.arena.live;
+    return total;
+}
+
+static int bench_node_open(PruneBenchNode *bench, const char *name, uint64_t budget)
+{
+    memset(bench, 0, sizeof(*bench));
+    block_tree_init(&bench->tree);
+    bench->chain.tree = &bench->tree;
+    snprintf(bench->dir, sizeof(bench->dir), "/tmp/prune-bench-%d-%s", (int)getpid(), name);
+    if (!blockstore_open(&bench->store, bench->dir, BENCH_FILE_BYTES))
+        return 0;
+    blockstore_set_prune(&bench->store, budget, 0);
+    bench->tree.store = &bench->store;
+    return 1;
+}
+
+static void bench_node_close(PruneBenchNode *bench)
+{
+    blockstore_close(&bench->store);
+    blockstore_wipe(bench->dir);
+    rmdir(bench->dir);
+    block_tree_free(&bench->tree);
+    free(bench->chain.blocks);
+}
+
+static int bench_submit(PruneBenchNode *bench, const Block *block, int *disconnected)
+{
+    BlockNode *inserted;
+    int connected;
+    return block_tree_insert_validated(&bench->tree, block, &inserted) == TREE_ACCEPTED &&
+           block_tree_activate_best(&bench->tree, &bench->chain, disconnected, &connected);
+}
+
+static void bench_mine(Block *block, const char *previous_hash)
+{
+    int nonce_attempts;
+    strcpy(block->previous_hash, previous_hash);
+    solve_block(block, 1, &nonce_attempts);
+}
+
+int run_prune_benchmark(int block_count, int budget_kib)
+{
+    if (block_count < 1 || block_count > 100000 || budget_kib < 64)
+    {
+        print_error("Usage: --prune-bench <blocks 1-100000> [budget KiB, at least 64]");
+        return 1;
+    }
+    print_header("BLOCK PRUNING BENCHMARK");
+
+    // Each block issues 8 coins and makes up to 9 payments that each turn one coin into two
+    BenchCoin *coins = malloc((size_t)block_count * 2 * MAX_TRANSACTIONS * sizeof(BenchCoin));
+    PruneBenchNode *nodes = malloc(2 * sizeof(PruneBenchNode));
+    Block *block = malloc(sizeof(Block));
+    if (!coins || !nodes || !block || !bench_node_open(&nodes[0], "full", 0) ||
+        !bench_node_open(&nodes[1], "pruned", (uint64_t)budget_kib * 1024))
+    {
+        print_error("Could not set up the benchmark nodes");
+        free(coins);
+        free(nodes);
+        free(block);
+        return 1;
+    }
+    printf(COLOR_CYAN "Connecting %d blocks to a full node and to one pruning to %d KiB (%d KiB files)..." COLOR_RESET "\n",
+           block_count, budget_kib, BENCH_FILE_BYTES / 1024);
+    fflush(stdout);
+
+    PruneBenchRow rows[BENCH_CHECKPOINTS];
+    int row_count = 0, ok = 1, disconnected;
+    unsigned int seed = 4242;
+    int coin_count = 0;
+    for (int height = 0; height < block_count && ok; height++)
+    {
+        ledger_bench_block(block, height, coins, &coin_count, &seed);
+        bench_mine(block, height ? nodes[0].chain.blocks[height - 1].hash
+                                 : "0000000000000000000000000000000000000000000000000000000000000000");
+        ok = bench_submit(&nodes[0], block, &disconnected) && bench_submit(&nodes[1], block, &disconnected) &&
+             nodes[1].chain.block_count == height + 1;
+        if (ok && (int64_t)(height + 1) * BENCH_CHECKPOINTS / block_count > row_count)
+        {
+            PruneBenchRow *row = &rows[row_count++];
+            row->height = height;
+            row->pruned_height = nodes[1].store.pruned_height;
+            for (int i = 0; i < 2; i++)
+            {
+                row->disk_bytes[i] = nodes[i].store.disk_bytes;
+                row->undo_bytes[i] = undo_bytes(&nodes[i].tree);
+            }
+        }
+    }
+    free(coins);
+    int same = ok && nodes[0].tree.utxos.count == nodes[1].tree.utxos.count &&
+               nodes[0].tree.utxos.total == nodes[1].tree.utxos.total;
+
+    printf(COLOR_BLUE "┌────────┬────────────┬────────────┬───────────┬────────────┬─────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-6s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-9s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-11s" COLOR_BLUE " │\n",
+           "Height", "Full KiB", "Pruned KiB", "Pruned to", "Full undo", "Pruned undo");
+    printf(COLOR_BLUE "├────────┼────────────┼────────────┼───────────┼────────────┼─────────────┤\n");
+    for (int r = 0; r < row_count; r++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-6d" COLOR_BLUE " │ " COLOR_CYAN "%-10llu" COLOR_BLUE " │ " COLOR_CYAN "%-10llu" COLOR_BLUE
+                          " │ " COLOR_CYAN "%-9d" COLOR_BLUE " │ " COLOR_CYAN "%-10llu" COLOR_BLUE " │ " COLOR_CYAN "%-11llu" COLOR_BLUE " │\n",
+               rows[r].height, (unsigned long long)rows[r].disk_bytes[0] / 1024, (unsigned long long)rows[r].disk_bytes[1] / 1024,
+               rows[r].pruned_height, (unsigned long long)rows[r].undo_bytes[0] / 1024,
+               (unsigned long long)rows[r].undo_bytes[1] / 1024);
+    }
+    printf(COLOR_BLUE "└────────┴────────────┴────────────┴───────────┴────────────┴─────────────┘" COLOR_RESET "\n");
+    printf(COLOR_GREEN "\nThe pruned node deleted %llu files (%.1f MiB) and kept %d files" COLOR_RESET "\n",
+           (unsigned long long)nodes[1].store.pruned_files, nodes[1].store.pruned_bytes / 1048576.0,
+           nodes[1].store.file_count);
+
+    // A longer branch forking below the prune point: the full node follows it, the pruned node
+    // has no undo data to step back with and stays where it is
+    int pruned_height = nodes[1].store.pruned_height, reorg_checked = 0;
+    int tip = nodes[0].chain.block_count - 1;
+    if (ok && same && pruned_height > 0)
+    {
+        char previous[HASH_SIZE];
+        strcpy(previous, nodes[0].chain.blocks[pruned_height - 1].hash);
+        const BlockNode *kept = nodes[1].tree.active;
+        int full_disconnected = 0;
+        for (int height = pruned_height; height <= tip + 1 && ok; height++)
+        {
+            BenchCoin mint[MAX_TRANSACTIONS * 2];
+            int mint_count = 0;
+            ledger_bench_block(block, height, mint, &mint_count, &seed);
+            bench_mine(block, previous);
+            strcpy(previous, block->hash);
+            int full_step = 0, pruned_step = 0;
+            ok = bench_submit(&nodes[0], block, &full_step) && bench_submit(&nodes[1], block, &pruned_step) &&
+                 pruned_step == 0;
+            full_disconnected += full_step;
+        }
+        reorg_checked = ok && full_disconnected == tip - pruned_height + 1 && nodes[1].tree.active == kept;
+        if (reorg_checked)
+            printf(COLOR_GREEN "A branch forking at height %d reorganized the full node (%d blocks back) and was refused by the pruned one" COLOR_RESET "\n",
+                   pruned_height - 1, full_disconnected);
+    }
+    free(block);
+    bench_node_close(&nodes[0]);
+    bench_node_close(&nodes[1]);
+    free(nodes);
+
+    if (!ok || !same)
+    {
+        print_error("The pruned node does not match the full one");
+        return 1;
+    }
+    if (pruned_height > 0 && !reorg_checked)
+    {
+        print_error("The pruned node followed a reorg below its prune point");
+        return 1;
+    }
+    print_success("Both nodes ended with the same UTXO set");
+    return 0;
+}
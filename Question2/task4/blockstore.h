@@ -0,0 +1,49 @@
+#ifndef BLOCKSTORE_H
+#define BLOCKSTORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define BLOCKSTORE_FILE_BYTES (1024 * 1024) // A block file is finished once it holds this many bytes
+#define PRUNE_MIN_BLOCKS 288                // Blocks below the tip that always keep body and undo (deepest reorg)
+
+/* ================ DATA STRUCTURES ================ */
+// One blk-<number>.dat file of length-prefixed block records (the pipeline's block file format)
+typedef struct
+{
+    int number;      // File name suffix
+    int low_height;  // Lowest height stored in the file
+    int high_height; // Highest height stored in the file
+    uint64_t bytes;  // File size
+} BlockFile;
+
+// Connected blocks, appended in connection order; a reorg appends the new branch again
+typedef struct BlockStore
+{
+    char dir[256];         // Directory holding the blk-<number>.dat files
+    BlockFile *files;      // Oldest first; the last one is open for appending
+    int file_count;        // Used entries in files
+    int file_capacity;     // Allocated length of files
+    FILE *current;         // Last file in files
+    int next_number;       // Number of the next file
+    size_t file_limit;     // Bytes after which a new file is started
+    uint64_t disk_bytes;   // Size of every file still on disk
+    uint64_t prune_bytes;  // Byte budget for the files (0: no limit)
+    int prune_depth;       // Height budget: bodies kept below the tip (0: no limit)
+    int pruned_height;     // Every block at or below this height may be gone from disk (-1: none)
+    uint64_t pruned_files; // Files deleted so far
+    uint64_t pruned_bytes; // Bytes those files held
+} BlockStore;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int blockstore_wipe(const char *dir);
+int blockstore_open(BlockStore *store, const char *dir, size_t file_limit);
+void blockstore_set_prune(BlockStore *store, uint64_t bytes, int depth);
+int blockstore_append(BlockStore *store, const Block *block);
+int blockstore_prune(BlockStore *store, int tip_height);
+void blockstore_close(BlockStore *store);
+int run_prune_benchmark(int block_count, int budget_kib);
+
+#endif
@@ -0,0 +1,387 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "coindb.h"
+
+#define RUN_MAGIC "UTXORUN1"
+#define RUN_HEADER_SIZE 16 // magic(8) + record count(8)
+
+_Static_assert(COINDB_RECORD_SIZE == COINDB_KEY_SIZE + 1 + 8 + 4 + TX_MAX_ADDRESS, "record layout");
+
+/* ================ RECORDS ================ */
+static void encode_key(const OutPoint *outpoint, unsigned char key[COINDB_KEY_SIZE])
+{
+    memcpy(key, outpoint->txid, TXID_SIZE);
+    for (int i = 0; i < 4; i++)
+        key[TXID_SIZE + i] = (unsigned char)(outpoint->index >> (24 - 8 * i));
+}
+
+static void encode_record(const Coin *coin, int live, unsigned char record[COINDB_RECORD_SIZE])
+{
+    unsigned char *p = record + COINDB_KEY_SIZE;
+    memset(record, 0, COINDB_RECORD_SIZE);
+    encode_key(&coin->outpoint, record);
+    *p++ = (unsigned char)live;
+    for (int i = 0; i < 8; i++)
+        *p++ = (unsigned char)(coin->amount >> (8 * i));
+    for (int i = 0; i < 4; i++)
+        *p++ = (unsigned char)((uint32_t)coin->height >> (8 * i));
+    memcpy(p, coin->address, strlen(coin->address));
+}
+
+static int decode_record(const unsigned char *record, Coin *coin)
+{
+    const unsigned char *p = record + COINDB_KEY_SIZE;
+    memset(coin, 0, sizeof(*coin));
+    memcpy(coin->outpoint.txid, record, TXID_SIZE);
+    for (int i = 0; i < 4; i++)
+        coin->outpoint.index = (coin->outpoint.index << 8) | record[TXID_SIZE + i];
+    int live = *p++;
+    for (int i = 0; i < 8; i++)
+        coin->amount |= (uint64_t)*p++ << (8 * i);
+    uint32_t height = 0;
+    for (int i = 0; i < 4; i++)
+        height |= (uint32_t)*p++ << (8 * i);
+    coin->height = (int)height;
+    memcpy(coin->address, p, TX_MAX_ADDRESS);
+    return live;
+}
+
+static const unsigned char *run_record(const CoinRun *run, uint64_t i)
+{
+    return run->map + RUN_HEADER_SIZE + i * COINDB_RECORD_SIZE;
+}
+
+/* ================ BLOOM FILTER ================ */
+static void bloom_hashes(const unsigned char *key, uint64_t *h1, uint64_t *h2)
+{
+    // Keys start with a SHA-256 txid, so its bytes are already uniform
+    memcpy(h1, key, sizeof(*h1));
+    memcpy(h2, key + 8, sizeof(*h2));
+    *h1 ^= ((uint64_t)key[TXID_SIZE + 2] << 8 | key[TXID_SIZE + 3]) * 0x9e3779b97f4a7c15ull;
+    *h2 |= 1;
+}
+
+static int bloom_may_contain(const CoinRun *run, const unsigned char *key)
+{
+    uint64_t h1, h2;
+    bloom_hashes(key, &h1, &h2);
+    for (int i = 0; i < COINDB_BLOOM_HASHES; i++)
+    {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % run->bloom_bits;
+        if (!(run->bloom[bit / 64] & (1ull << (bit % 64))))
+            return 0;
+    }
+    return 1;
+}
+
+static int bloom_build(CoinRun *run)
+{
+    run->bloom_bits = run->count * COINDB_BLOOM_BITS + 64;
+    run->bloom = calloc((size_t)(run->bloom_bits + 63) / 64, sizeof(uint64_t));
+    if (!run->bloom)
+        return 0;
+    for (uint64_t r = 0; r < run->count; r++)
+    {
+        uint64_t h1, h2;
+        bloom_hashes(run_record(run, r), &h1, &h2);
+        for (int i = 0; i < COINDB_BLOOM_HASHES; i++)
+        {
+            uint64_t bit = (h1 + (uint64_t)i * h2) % run->bloom_bits;
+            run->bloom[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+    return 1;
+}
+
+/* ================ RUN FILES ================ */
+static void run_path(const CoinDB *db, uint64_t seq, char *path, size_t size)
+{
+    snprintf(path, size, "%s/run-%08llu.dat", db->dir, (unsigned long long)seq);
+}
+
+static int run_map(const CoinDB *db, uint64_t seq, CoinRun *run)
+{
+    char path[300];
+    struct stat info;
+    memset(run, 0, sizeof(*run));
+    run_path(db, seq, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &info) != 0 || info.st_size < RUN_HEADER_SIZE)
+    {
+        close(fd);
+        return 0;
+    }
+    void *map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    run->seq = seq;
+    run->map = map;
+    run->map_size = (size_t)info.st_size;
+    for (int i = 0; i < 8; i++)
+        run->count |= (uint64_t)run->map[8 + i] << (8 * i);
+    if (memcmp(run->map, RUN_MAGIC, 8) != 0 ||
+        run->count != (run->map_size - RUN_HEADER_SIZE) / COINDB_RECORD_SIZE || !bloom_build(run))
+    {
+        munmap((void *)run->map, run->map_size);
+        return 0;
+    }
+    return 1;
+}
+
+static void run_unmap(CoinRun *run)
+{
+    if (run->map)
+        munmap((void *)run->map, run->map_size);
+    free(run->bloom);
+    memset(run, 0, sizeof(*run));
+}
+
+typedef struct
+{
+    FILE *file;     // Temporary file being filled
+    char path[300]; // Its name until run_finish renames it
+    uint64_t count; // Records written
+} RunWriter;
+
+static int run_begin(const CoinDB *db, RunWriter *writer)
+{
+    unsigned char header[RUN_HEADER_SIZE] = {0};
+    memcpy(header, RUN_MAGIC, 8);
+    snprintf(writer->path, sizeof(writer->path), "%s/run.tmp", db->dir);
+    writer->count = 0;
+    writer->file = fopen(writer->path, "wb");
+    return writer->file && fwrite(header, 1, sizeof(header), writer->file) == sizeof(header);
+}
+
+static int run_put(RunWriter *writer, const unsigned char *record)
+{
+    writer->count++;
+    return fwrite(record, 1, COINDB_RECORD_SIZE, writer->file) == COINDB_RECORD_SIZE;
+}
+
+// Durable before it is visible: the run is synced, then renamed into place and mapped
+static int run_finish(CoinDB *db, RunWriter *writer, int ok, CoinRun *run)
+{
+    char path[300];
+    uint64_t seq = db->next_seq;
+    unsigned char count[8];
+    for (int i = 0; i < 8; i++)
+        count[i] = (unsigned char)(writer->count >> (8 * i));
+    ok = ok && fseek(writer->file, 8, SEEK_SET) == 0 && fwrite(count, 1, sizeof(count), writer->file) == sizeof(count) &&
+         fflush(writer->file) == 0 && fsync(fileno(writer->file)) == 0;
+    if (writer->file)
+        fclose(writer->file);
+    run_path(db, seq, path, sizeof(path));
+    if (!ok || rename(writer->path, path) != 0 || !run_map(db, seq, run))
+    {
+        unlink(writer->path);
+        return 0;
+    }
+    db->next_seq++;
+    db->bytes_written += RUN_HEADER_SIZE + writer->count * COINDB_RECORD_SIZE;
+    return 1;
+}
+
+static void run_remove(CoinDB *db, CoinRun *run)
+{
+    char path[300];
+    run_path(db, run->seq, path, sizeof(path));
+    run_unmap(run);
+    unlink(path);
+}
+
+/* ================ MERGING ================ */
+// Folds the newest run into the one before it; tombstones go once nothing older is left to shadow
+static int merge_newest(CoinDB *db)
+{
+    CoinRun *older = &db->runs[db->run_count - 2];
+    CoinRun *newer = &db->runs[db->run_count - 1];
+    int drop_tombstones = db->run_count == 2;
+    uint64_t i = 0, j = 0;
+    RunWriter writer;
+    CoinRun merged;
+    int ok = run_begin(db, &writer);
+
+    while (ok && (i < older->count || j < newer->count))
+    {
+        const unsigned char *record;
+        int order = i == older->count   ? 1
+                    : j == newer->count ? -1
+                                        : memcmp(run_record(older, i), run_record(newer, j), COINDB_KEY_SIZE);
+        if (order < 0)
+            record = run_record(older, i++);
+        else
+        {
+            record = run_record(newer, j++);
+            i += order == 0;
+        }
+        if (!drop_tombstones || record[COINDB_KEY_SIZE])
+            ok = run_put(&writer, record);
+    }
+    if (!run_finish(db, &writer, ok, &merged))
+        return 0;
+
+    run_remove(db, older);
+    run_remove(db, newer);
+    db->runs[db->run_count - 2] = merged;
+    db->run_count--;
+    db->merges++;
+    return 1;
+}
+
+/* ================ COIN DATABASE ================ */
+// Removes every run file (and a half-written one) from dir
+int coindb_wipe(const char *dir)
+{
+    DIR *listing = opendir(dir);
+    if (!listing)
+        return 0;
+    struct dirent *item;
+    while ((item = readdir(listing)) != NULL)
+    {
+        if (strncmp(item->d_name, "run", 3) == 0)
+        {
+            char path[600];
+            snprintf(path, sizeof(path), "%s/%s", dir, item->d_name);
+            unlink(path);
+        }
+    }
+    closedir(listing);
+    return 1;
+}
+
+// The chain itself is not stored yet, so leftover runs describe a tip this process does not
+// know; they are removed and the database starts empty
+int coindb_open(CoinDB *db, const char *dir)
+{
+    memset(db, 0, sizeof(*db));
+    snprintf(db->dir, sizeof(db->dir), "%s", dir);
+    db->next_seq = 1;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return 0;
+    return coindb_wipe(dir);
+}
+
+void coindb_close(CoinDB *db)
+{
+    for (int i = 0; i < db->run_count; i++)
+        run_unmap(&db->runs[i]);
+    db->run_count = 0;
+}
+
+// Newest run first; each is a Bloom probe and, if that passes, a binary search over the mapping
+int coindb_get(CoinDB *db, const OutPoint *outpoint, Coin *coin)
+{
+    unsigned char key[COINDB_KEY_SIZE];
+    encode_key(outpoint, key);
+    db->lookups++;
+    for (int r = db->run_count - 1; r >= 0; r--)
+    {
+        const CoinRun *run = &db->runs[r];
+        if (!bloom_may_contain(run, key))
+        {
+            db->bloom_skips++;
+            continue;
+        }
+        uint64_t low = 0, high = run->count;
+        while (low < high)
+        {
+            uint64_t mid = low + (high - low) / 2;
+            int order = memcmp(run_record(run, mid), key, COINDB_KEY_SIZE);
+            if (order == 0)
+                return decode_record(run_record(run, mid), coin);
+            if (order < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+    }
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    unsigned char ka[COINDB_KEY_SIZE], kb[COINDB_KEY_SIZE];
+    encode_key(&(*(CoinsEntry *const *)a)->coin.outpoint, ka);
+    encode_key(&(*(CoinsEntry *const *)b)->coin.outpoint, kb);
+    return memcmp(ka, kb, COINDB_KEY_SIZE);
+}
+
+// Writes one batch of changes as a new run (spent entries become tombstones), then merges
+// while the run before the newest is not much larger, so runs stay few and roughly geometric
+int coindb_write(CoinDB *db, CoinsEntry **entries, int count)
+{
+    unsigned char record[COINDB_RECORD_SIZE];
+    RunWriter writer;
+    CoinRun run;
+    if (count == 0)
+        return 1;
+    // A merge that failed last time left the spare slot in use: it has to succeed before another run fits
+    while (db->run_count > COINDB_MAX_RUNS)
+    {
+        if (!merge_newest(db))
+            return 0;
+    }
+    qsort(entries, (size_t)count, sizeof(*entries), compare_entries);
+
+    int ok = run_begin(db, &writer);
+    for (int i = 0; ok && i < count; i++)
+    {
+        encode_record(&entries[i]->coin, !entries[i]->spent, record);
+        ok = run_put(&writer, record);
+    }
+    if (!run_finish(db, &writer, ok, &run))
+        return 0;
+    db->runs[db->run_count++] = run;
+
+    while (db->run_count > 1 &&
+           (db->run_count > COINDB_MAX_RUNS ||
+            db->runs[db->run_count - 2].count <= db->runs[db->run_count - 1].count * COINDB_MERGE_RATIO))
+    {
+        if (!merge_newest(db))
+            return db->run_count <= COINDB_MAX_RUNS;
+    }
+    return 1;
+}
+
+// Visits every live coin in key order; where several runs hold a key, the newest decides
+int coindb_scan(CoinDB *db, int (*visit)(const Coin *coin, void *context), void *context)
+{
+    uint64_t cursor[COINDB_MAX_RUNS + 1] = {0};
+    for (;;)
+    {
+        int winner = -1;
+        for (int r = 0; r < db->run_count; r++)
+        {
+            if (cursor[r] == db->runs[r].count)
+                continue;
+            // <= so that on equal keys the later (newer) run wins
+            if (winner < 0 || memcmp(run_record(&db->runs[r], cursor[r]),
+                                     run_record(&db->runs[winner], cursor[winner]), COINDB_KEY_SIZE) <= 0)
+                winner = r;
+        }
+        if (winner < 0)
+            return 1;
+
+        const unsigned char *record = run_record(&db->runs[winner], cursor[winner]);
+        Coin coin;
+        int live = decode_record(record, &coin);
+        for (int r = 0; r < db->run_count; r++)
+        {
+            if (r != winner && cursor[r] < db->runs[r].count &&
+                memcmp(run_record(&db->runs[r], cursor[r]), record, COINDB_KEY_SIZE) == 0)
+                cursor[r]++;
+        }
+        cursor[winner]++;
+        if (live && !visit(&coin, context))
+            return 0;
+    }
+}
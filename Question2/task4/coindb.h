@@ -0,0 +1,47 @@
+#ifndef COINDB_H
+#define COINDB_H
+
+#include <stdint.h>
+#include "utxo.h"
+
+/* ================ CONSTANTS ================ */
+#define COINDB_MAX_RUNS 8               // Sorted runs kept on disk at most
+#define COINDB_MERGE_RATIO 2            // Newest run is merged down while the one before is at most this much larger
+#define COINDB_KEY_SIZE (TXID_SIZE + 4) // txid + big-endian output index, so memcmp sorts by outpoint
+#define COINDB_RECORD_SIZE 89           // key(36) + live flag(1) + amount(8) + height(4) + address(40)
+#define COINDB_BLOOM_BITS 10            // Filter bits per record (about 1% false positives)
+#define COINDB_BLOOM_HASHES 7           // Probes per lookup
+
+/* ================ DATA STRUCTURES ================ */
+// One immutable sorted file of fixed-size records, mapped read-only
+typedef struct
+{
+    uint64_t seq;             // Larger is newer; newer runs shadow older ones
+    const unsigned char *map; // Whole file (header + records)
+    size_t map_size;          // Bytes mapped
+    uint64_t count;           // Records in the run
+    uint64_t *bloom;          // Membership filter over the keys
+    uint64_t bloom_bits;      // Bits in bloom
+} CoinRun;
+
+typedef struct CoinDB
+{
+    char dir[256];                     // Directory holding run-<seq>.dat files
+    CoinRun runs[COINDB_MAX_RUNS + 1]; // Oldest first
+    int run_count;                     // Used entries in runs
+    uint64_t next_seq;                 // Sequence number for the next run
+    uint64_t lookups;                  // coindb_get calls
+    uint64_t bloom_skips;              // Runs a lookup skipped thanks to the filter
+    uint64_t bytes_written;            // Flushes plus merges
+    uint64_t merges;                   // Runs merged into their predecessor
+} CoinDB;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int coindb_wipe(const char *dir);
+int coindb_open(CoinDB *db, const char *dir);
+void coindb_close(CoinDB *db);
+int coindb_get(CoinDB *db, const OutPoint *outpoint, Coin *coin);
+int coindb_write(CoinDB *db, CoinsEntry **entries, int count);
+int coindb_scan(CoinDB *db, int (*visit)(const Coin *coin, void *context), void *context);
+
+#endif
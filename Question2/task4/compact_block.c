@@ -0,0 +1,156 @@
+#include "compact_block.h"
+#include "siphash.h"
+#include "block_tree.h"
+#include "transaction.h"
+
+/* ================ SHORT IDS ================ */
+static void derive_keys(CompactBlock *compact)
+{
+    // Keying on the header means an attacker cannot precompute colliding transactions
+    ByteWriter seed;
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    writer_init(&seed);
+    serialize_block_header(&seed, &compact->block);
+    put_u64(&seed, compact->salt);
+    SHA256(seed.data, seed.length, digest);
+    writer_free(&seed);
+
+    compact->k0 = 0;
+    compact->k1 = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        compact->k0 |= (uint64_t)digest[i] << (8 * i);
+        compact->k1 |= (uint64_t)digest[8 + i] << (8 * i);
+    }
+}
+
+uint64_t compact_short_id(const CompactBlock *compact, const unsigned char txid[TXID_SIZE])
+{
+    return siphash24(compact->k0, compact->k1, txid, TXID_SIZE) & SHORT_ID_MASK;
+}
+
+void compact_block_from_block(CompactBlock *compact, const Block *block, uint64_t salt)
+{
+    memset(compact, 0, sizeof(*compact));
+    compact->block = *block;
+    compact->salt = salt;
+    derive_keys(compact);
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        unsigned char txid[TXID_SIZE];
+        size_t length;
+        const unsigned char *tx = block_transaction_bytes(block, i, &length);
+        compute_txid(tx, length, txid);
+        compact->short_ids[i] = compact_short_id(compact, txid);
+        compact->have[i] = 1;
+    }
+}
+
+/* ================ ENCODING ================ */
+void serialize_compact_block(ByteWriter *writer, const CompactBlock *compact)
+{
+    serialize_block_header(writer, &compact->block);
+    put_u64(writer, compact->salt);
+    put_u8(writer, (uint8_t)compact->block.transaction_count);
+    for (int i = 0; i < compact->block.transaction_count; i++)
+    {
+        unsigned char bytes[SHORT_ID_SIZE];
+        for (int b = 0; b < SHORT_ID_SIZE; b++)
+            bytes[b] = (unsigned char)(compact->short_ids[i] >> (8 * b));
+        put_bytes(writer, bytes, SHORT_ID_SIZE);
+    }
+}
+
+int deserialize_compact_block(ByteReader *reader, CompactBlock *compact)
+{
+    memset(compact, 0, sizeof(*compact));
+    if (!deserialize_block_header(reader, &compact->block))
+        return 0;
+    compact->salt = get_u64(reader);
+    compact->block.transaction_count = get_u8(reader);
+    if (compact->block.transaction_count > MAX_TRANSACTIONS)
+        return 0;
+    for (int i = 0; i < compact->block.transaction_count; i++)
+    {
+        unsigned char bytes[SHORT_ID_SIZE];
+        get_bytes(reader, bytes, SHORT_ID_SIZE);
+        for (int b = 0; b < SHORT_ID_SIZE; b++)
+            compact->short_ids[i] |= (uint64_t)bytes[b] << (8 * b);
+    }
+    compact->missing = compact->block.transaction_count;
+    derive_keys(compact);
+    return reader->ok;
+}
+
+/* ================ RECONSTRUCTION ================ */
+int compact_block_fill_from_mempool(CompactBlock *compact, const Mempool *pool)
+{
+    int count = compact->block.transaction_count;
+
+    // Two entries with the same short ID cannot be told apart; the caller falls back to the full block
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = i + 1; j < count; j++)
+        {
+            if (compact->short_ids[i] == compact->short_ids[j])
+                return -1;
+        }
+    }
+
+    for (int e = 0; e < pool->count && compact->missing > 0; e++)
+    {
+        uint64_t id = siphash24(compact->k0, compact->k1, pool->entries[e].txid, TXID_SIZE) & SHORT_ID_MASK;
+        for (int i = 0; i < count; i++)
+        {
+            if (!compact->have[i] && compact->short_ids[i] == id)
+            {
+                compact_block_fill_transaction(compact, i, pool->entries[e].tx, pool->entries[e].length,
+                                               &pool->entries[e].witness);
+                break;
+            }
+        }
+    }
+    return compact->missing;
+}
+
+// Transactions arrive in any order, so they wait in found until the last one lets the block be laid out
+static void assemble_block(CompactBlock *compact)
+{
+    Block *block = &compact->block;
+    int count = block->transaction_count;
+    TxWitness witnesses[MAX_TRANSACTIONS];
+    memcpy(witnesses, block->witnesses, sizeof(witnesses));
+    block_clear_transactions(block);
+    for (int i = 0; i < count; i++)
+        block_add_transaction(block, compact->found + compact->found_offsets[i], compact->found_lengths[i], &witnesses[i]);
+}
+
+int compact_block_fill_transaction(CompactBlock *compact, int position, const unsigned char *tx, size_t length,
+                                   const TxWitness *witness)
+{
+    unsigned char txid[TXID_SIZE];
+    if (position < 0 || position >= compact->block.transaction_count || compact->have[position])
+        return 0;
+    compute_txid(tx, length, txid);
+    if (compact_short_id(compact, txid) != compact->short_ids[position] ||
+        length > BLOCK_TX_BYTES - compact->found_used)
+        return 0;
+
+    memcpy(compact->found + compact->found_used, tx, length);
+    compact->found_offsets[position] = (uint16_t)compact->found_used;
+    compact->found_lengths[position] = (uint16_t)length;
+    compact->found_used += length;
+    compact->block.witnesses[position] = *witness;
+    compact->have[position] = 1;
+    if (--compact->missing == 0)
+        assemble_block(compact);
+    return 1;
+}
+
+int compact_block_is_valid(const CompactBlock *compact)
+{
+    // A short-ID collision with some other mempool transaction shows up as a merkle root mismatch
+    if (compact->missing != 0)
+        return 0;
+    return validate_block_body(&compact->block, 0);
+}
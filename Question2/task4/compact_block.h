@@ -0,0 +1,38 @@
+#ifndef COMPACT_BLOCK_H
+#define COMPACT_BLOCK_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "mempool.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define SHORT_ID_SIZE 6                 // Bytes per short transaction ID on the wire
+#define SHORT_ID_MASK 0xffffffffffffULL // Low 48 bits of the SipHash output
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    Block block;                              // Header fields; transactions copied in once all are found
+    uint64_t salt;                            // Sender-chosen nonce mixed into the SipHash key
+    uint64_t k0, k1;                          // SipHash key derived from header + salt
+    uint64_t short_ids[MAX_TRANSACTIONS];     // One per transaction in the block
+    int have[MAX_TRANSACTIONS];               // 1 once the matching transaction is known
+    int missing;                              // Count of have[] still 0
+    unsigned char found[BLOCK_TX_BYTES];      // Transactions in the order they were found
+    uint16_t found_offsets[MAX_TRANSACTIONS]; // Where each position's transaction starts in found
+    uint16_t found_lengths[MAX_TRANSACTIONS]; // And its length
+    size_t found_used;                        // Bytes of found in use
+} CompactBlock;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void compact_block_from_block(CompactBlock *compact, const Block *block, uint64_t salt);
+uint64_t compact_short_id(const CompactBlock *compact, const unsigned char txid[TXID_SIZE]);
+void serialize_compact_block(ByteWriter *writer, const CompactBlock *compact);
+int deserialize_compact_block(ByteReader *reader, CompactBlock *compact);
+int compact_block_fill_from_mempool(CompactBlock *compact, const Mempool *pool);
+int compact_block_fill_transaction(CompactBlock *compact, int position, const unsigned char *tx, size_t length,
+                                   const TxWitness *witness);
+int compact_block_is_valid(const CompactBlock *compact);
+
+#endif
@@ -0,0 +1,204 @@
+#include <ctype.h>
+#include <stdarg.h>
+#include "json.h"
+
+/* ================ JSON INPUT ================ */
+const char *json_space(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        p++;
+    return p;
+}
+
+// Just past the value that starts at p (after any whitespace), or NULL if it is malformed
+const char *json_skip(const char *p, const char *end, int depth)
+{
+    p = json_space(p, end);
+    if (p >= end || depth > 32)
+        return NULL;
+    if (*p == '"')
+    {
+        for (p++; p < end; p++)
+        {
+            if (*p == '\\')
+                p++;
+            else if (*p == '"')
+                return p + 1;
+        }
+        return NULL;
+    }
+    if (*p == '{' || *p == '[')
+    {
+        char close = *p == '{' ? '}' : ']';
+        p = json_space(p + 1, end);
+        if (p < end && *p == close)
+            return p + 1;
+        for (;;)
+        {
+            if (close == '}')
+            {
+                p = json_space(p, end);
+                if (p >= end || *p != '"' || !(p = json_skip(p, end, depth + 1)))
+                    return NULL;
+                p = json_space(p, end);
+                if (p >= end || *p != ':')
+                    return NULL;
+                p++;
+            }
+            if (!(p = json_skip(p, end, depth + 1)))
+                return NULL;
+            p = json_space(p, end);
+            if (p >= end)
+                return NULL;
+            if (*p == close)
+                return p + 1;
+            if (*p != ',')
+                return NULL;
+            p++;
+        }
+    }
+    // Numbers, true, false and null run up to the next delimiter
+    const char *start = p;
+    while (p < end && (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.'))
+        p++;
+    return p > start ? p : NULL;
+}
+
+// Steps over the next member or item of a validated container whose opening bracket was already consumed
+int json_next(const char **cursor, const char *end, JsonSpan *key, JsonSpan *value)
+{
+    const char *p = json_space(*cursor, end);
+    if (p < end && *p == ',')
+        p = json_space(p + 1, end);
+    if (p >= end || *p == '}' || *p == ']')
+        return 0;
+    if (key)
+    {
+        key->start = p;
+        key->end = json_skip(p, end, 0);
+        p = json_space(key->end, end) + 1; // The ':' was checked when the body was validated
+    }
+    value->start = json_space(p, end);
+    value->end = json_skip(value->start, end, 0);
+    *cursor = value->end;
+    return 1;
+}
+
+int json_member(const JsonSpan *object, const char *name, JsonSpan *value)
+{
+    if (object->start >= object->end || *object->start != '{')
+        return 0;
+    const char *cursor = object->start + 1;
+    size_t length = strlen(name);
+    JsonSpan key;
+    while (json_next(&cursor, object->end, &key, value))
+    {
+        if ((size_t)(key.end - key.start) == length + 2 && memcmp(key.start + 1, name, length) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int json_item(const JsonSpan *array, int index, JsonSpan *value)
+{
+    if (array->start >= array->end || *array->start != '[')
+        return 0;
+    const char *cursor = array->start + 1;
+    for (int i = 0; json_next(&cursor, array->end, NULL, value); i++)
+    {
+        if (i == index)
+            return 1;
+    }
+    return 0;
+}
+
+// Unescapes a string value into text; fails if it is not a string or does not fit
+int json_text(const JsonSpan *value, char *text, size_t size)
+{
+    if (value->end - value->start < 2 || *value->start != '"')
+        return 0;
+    size_t length = 0;
+    for (const char *p = value->start + 1; p < value->end - 1; p++)
+    {
+        char c = *p;
+        if (c == '\\')
+        {
+            c = *++p;
+            if (c == 'n')
+                c = '\n';
+            else if (c == 't')
+                c = '\t';
+            else if (c == 'r')
+                c = '\r';
+            else if (c == 'u')
+            {
+                // Only the ASCII range; addresses and encoded transactions never need more
+                unsigned int code;
+                char digits[5] = {0};
+                if (value->end - 1 - p < 5)
+                    return 0;
+                memcpy(digits, p + 1, 4);
+                if (sscanf(digits, "%4x", &code) != 1 || code == 0 || code > 0x7f)
+                    return 0;
+                c = (char)code;
+                p += 4;
+            }
+            else if (c != '"' && c != '\\' && c != '/')
+                return 0;
+        }
+        if (length + 1 >= size)
+            return 0;
+        text[length++] = c;
+    }
+    text[length] = '\0';
+    return 1;
+}
+
+int json_integer(const JsonSpan *value, long long *number)
+{
+    char text[24];
+    size_t length = (size_t)(value->end - value->start);
+    if (length == 0 || length >= sizeof(text))
+        return 0;
+    memcpy(text, value->start, length);
+    text[length] = '\0';
+    char *rest;
+    *number = strtoll(text, &rest, 10);
+    return *rest == '\0';
+}
+
+/* ================ JSON OUTPUT ================ */
+void put_text(ByteWriter *out, const char *text)
+{
+    put_bytes(out, text, strlen(text));
+}
+
+void put_format(ByteWriter *out, const char *format, ...)
+{
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length > 0)
+        put_bytes(out, text, length < (int)sizeof(text) ? (size_t)length : sizeof(text) - 1);
+}
+
+void put_json_string(ByteWriter *out, const char *text, size_t length)
+{
+    put_u8(out, '"');
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+        {
+            put_u8(out, '\\');
+            put_u8(out, c);
+        }
+        else if (c < 0x20)
+            put_format(out, "\\u%04x", c);
+        else
+            put_u8(out, c);
+    }
+    put_u8(out, '"');
+}
@@ -0,0 +1,29 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include "wire.h"
+
+/* ================ DATA STRUCTURES ================ */
+// A value inside a message; nothing is copied until a caller asks for it.
+// Spans are only taken from text that json_skip already accepted as a whole.
+typedef struct
+{
+    const char *start; // First character of the value
+    const char *end;   // Just past its last character
+} JsonSpan;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+const char *json_space(const char *p, const char *end);
+const char *json_skip(const char *p, const char *end, int depth);
+int json_next(const char **cursor, const char *end, JsonSpan *key, JsonSpan *value);
+int json_member(const JsonSpan *object, const char *name, JsonSpan *value);
+int json_item(const JsonSpan *array, int index, JsonSpan *value);
+int json_text(const JsonSpan *value, char *text, size_t size);
+int json_integer(const JsonSpan *value, long long *number);
+
+void put_text(ByteWriter *out, const char *text);
+void put_format(ByteWriter *out, const char *format, ...);
+void put_json_string(ByteWriter *out, const char *text, size_t length);
+
+#endif
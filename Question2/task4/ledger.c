@@ -0,0 +1,446 @@
+#include <unistd.h>
+#include "ledger.h"
+#include "coindb.h"
+#include "metrics.h"
+#include "trace.h"
+
+/* ================ UNDO DATA ================ */
+// An array it outgrows stays in the arena until the whole undo is released
+static int undo_reserve(BlockUndo *undo, int capacity)
+{
+    if (capacity <= undo->capacity)
+        return 1;
+    Coin *coins = arena_alloc(&undo->arena, (size_t)capacity * sizeof(Coin));
+    if (!coins)
+        return 0;
+    if (undo->count > 0)
+        memcpy(coins, undo->coins, (size_t)undo->count * sizeof(Coin));
+    undo->coins = coins;
+    undo->capacity = capacity;
+    return 1;
+}
+
+static int undo_push(BlockUndo *undo, const Coin *coin)
+{
+    if (undo->count == undo->capacity && !undo_reserve(undo, undo->capacity ? undo->capacity * 2 : 16))
+        return 0;
+    undo->coins[undo->count++] = *coin;
+    return 1;
+}
+
+void block_undo_free(BlockUndo *undo)
+{
+    arena_release(&undo->arena);
+    memset(undo, 0, sizeof(*undo));
+}
+
+/* ================ TRANSACTIONS ================ */
+static void remove_outputs(UtxoSet *set, const unsigned char txid[TXID_SIZE], int count)
+{
+    OutPoint outpoint;
+    memcpy(outpoint.txid, txid, TXID_SIZE);
+    for (int i = count - 1; i >= 0; i--)
+    {
+        outpoint.index = (uint32_t)i;
+        utxo_set_spend(set, &outpoint, NULL);
+    }
+}
+
+static void restore_inputs(UtxoSet *set, BlockUndo *undo, int first)
+{
+    while (undo->count > first)
+    {
+        utxo_set_add(set, &undo->coins[--undo->count]);
+    }
+}
+
+static int sender_owns(const TxView *tx, const Coin *coin)
+{
+    return strlen(coin->address) == tx->sender_length && memcmp(coin->address, tx->sender, tx->sender_length) == 0;
+}
+
+// Spends every input and creates every output, or changes nothing and returns 0. A transaction
+// with inputs may only spend its sender's coins and may not create more than it spends; one
+// without inputs may create at most issuance, which is 0 for anything but a block's coinbase.
+static int connect_transaction(UtxoSet *set, const TxView *tx, int height, BlockUndo *undo, uint64_t issuance)
+{
+    TRACE_SCOPE("apply_transaction", "height", height);
+    unsigned char txid[TXID_SIZE];
+    const unsigned char *cursor = tx->inputs;
+    uint64_t spent = 0, created = 0;
+    int first_undo = undo->count;
+    int ok = 1;
+    uint64_t started = metrics_now_ns();
+    compute_txid(tx->data, tx->length, txid);
+
+    // Spending removes the coin, so a second spend of it in this block finds nothing
+    for (int i = 0; i < tx->input_count && ok; i++)
+    {
+        TxInputView input;
+        OutPoint outpoint;
+        Coin coin;
+        tx_next_input(&cursor, &input);
+        memcpy(outpoint.txid, input.prev_txid, TXID_SIZE);
+        outpoint.index = input.index;
+        if (!utxo_set_spend(set, &outpoint, &coin))
+        {
+            ok = 0;
+            break;
+        }
+        if (!undo_push(undo, &coin))
+        {
+            utxo_set_add(set, &coin);
+            ok = 0;
+            break;
+        }
+        ok = sender_owns(tx, &coin) && spent + coin.amount >= spent;
+        spent += coin.amount;
+    }
+
+    int added = 0;
+    cursor = tx->outputs;
+    for (int i = 0; i < tx->output_count && ok; i++)
+    {
+        TxOutputView output;
+        Coin coin = {0};
+        tx_next_output(&cursor, &output);
+        memcpy(coin.outpoint.txid, txid, TXID_SIZE);
+        coin.outpoint.index = (uint32_t)i;
+        coin.amount = output.amount;
+        memcpy(coin.address, output.address, output.address_length);
+        coin.height = height;
+        ok = created + output.amount >= created && utxo_set_add(set, &coin);
+        created += output.amount;
+        added += ok;
+    }
+    if (ok && created > (tx->input_count > 0 ? spent : issuance))
+        ok = 0;
+
+    if (!ok)
+    {
+        remove_outputs(set, txid, added);
+        restore_inputs(set, undo, first_undo);
+        return 0;
+    }
+    metrics_count(METRIC_TX_APPLIED, 1);
+    metrics_observe_ns(HISTOGRAM_TX_APPLY, metrics_now_ns() - started);
+    return 1;
+}
+
+// The mempool's rule: notes may go without inputs, but payments have to spend coins
+int ledger_connect_transaction(UtxoSet *set, const TxView *tx, int height, BlockUndo *undo)
+{
+    return connect_transaction(set, tx, height, undo, 0);
+}
+
+// The genesis block sets up the initial coins; after it, only a block's first transaction may
+// issue any, and no more than the reward
+static uint64_t issuance_limit(int height, int position)
+{
+    if (height == 0)
+        return UINT64_MAX;
+    return position == 0 ? BLOCK_REWARD : 0;
+}
+
+// Reverses the most recent ledger_connect_transaction that used this undo
+void ledger_disconnect_transaction(UtxoSet *set, const TxView *tx, BlockUndo *undo)
+{
+    unsigned char txid[TXID_SIZE];
+    compute_txid(tx->data, tx->length, txid);
+    remove_outputs(set, txid, tx->output_count);
+    restore_inputs(set, undo, undo->count - tx->input_count);
+}
+
+/* ================ BLOCKS ================ */
+// One pass in transaction order; each input is a hash lookup, so the cost follows the
+// block's size and not the set's. On failure the set is left as it was.
+int ledger_connect_block(UtxoSet *set, const Block *block, int height, BlockUndo *undo)
+{
+    // Sized from the block up front: one arena allocation instead of a chain of doublings
+    int inputs = 0;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView view;
+        if (block_transaction(block, i, &view))
+            inputs += view.input_count;
+    }
+    undo->count = 0;
+    if (!undo_reserve(undo, inputs))
+        return 0;
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView view;
+        if (!block_transaction(block, i, &view) ||
+            !connect_transaction(set, &view, height, undo, issuance_limit(height, i)))
+        {
+            while (--i >= 0)
+            {
+                block_transaction(block, i, &view);
+                ledger_disconnect_transaction(set, &view, undo);
+            }
+            block_undo_free(undo);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void ledger_disconnect_block(UtxoSet *set, const Block *block, BlockUndo *undo)
+{
+    for (int i = block->transaction_count - 1; i >= 0; i--)
+    {
+        TxView view;
+        block_transaction(block, i, &view);
+        ledger_disconnect_transaction(set, &view, undo);
+    }
+    block_undo_free(undo);
+}
+
+/* ================ PAYMENTS ================ */
+typedef struct
+{
+    Transaction *tx; // Receives the coins as inputs
+    uint64_t target; // Stop once the gathered coins reach this
+    uint64_t total;  // Sum gathered so far
+    CoinFilter skip; // Vetoes coins already promised elsewhere (may be NULL)
+    void *context;   // Passed to skip
+} FundScan;
+
+static int fund_coin(const Coin *coin, void *context)
+{
+    FundScan *scan = context;
+    if (strcmp(coin->address, scan->tx->sender) != 0 || (scan->skip && scan->skip(coin, scan->context)))
+        return 1;
+    if (scan->tx->input_count == TX_MAX_INPUTS)
+        return 0;
+    memcpy(scan->tx->inputs[scan->tx->input_count].prev_txid, coin->outpoint.txid, TXID_SIZE);
+    scan->tx->inputs[scan->tx->input_count++].index = coin->outpoint.index;
+    scan->total += coin->amount;
+    return scan->total < scan->target;
+}
+
+// Turns a payment into a spend of its sender's coins: gathers them until they cover the outputs,
+// and pays what they hold beyond that back to the sender as change. Returns what the gathered
+// coins add up to; if that is less than the outputs, the transaction cannot be funded.
+uint64_t ledger_fund_payment(UtxoSet *set, Transaction *tx, CoinFilter skip, void *context)
+{
+    FundScan scan = {tx, 0, 0, skip, context};
+    for (int i = 0; i < tx->output_count; i++)
+        scan.target += tx->outputs[i].amount;
+    tx->input_count = 0;
+    utxo_set_for_each(set, fund_coin, &scan);
+    if (scan.total > scan.target)
+    {
+        if (tx->output_count == TX_MAX_OUTPUTS)
+            return 0;
+        strcpy(tx->outputs[tx->output_count].address, tx->sender);
+        tx->outputs[tx->output_count++].amount = scan.total - scan.target;
+    }
+    return scan.total;
+}
+
+/* ================ BENCHMARK ================ */
+#define BENCH_OWNERS 500     // Distinct addresses coins are paid to
+#define BENCH_MINT_OUTPUTS 8 // Coins issued per block
+#define BENCH_RECENT 256     // Half the spends pick among this many newest coins
+
+static void bench_owner(int owner, char *address, size_t size)
+{
+    snprintf(address, size, "owner-%03d", owner);
+}
+
+static void bench_add(Block *block, const Transaction *tx, BenchCoin *coins, int *coin_count, const int *owners)
+{
+    unsigned char encoded[MAX_TX_SIZE];
+    size_t length = transaction_encode(tx, encoded, sizeof(encoded));
+    if (length == 0 || !block_add_transaction(block, encoded, length, NULL))
+        return;
+    unsigned char txid[TXID_SIZE];
+    compute_txid(encoded, length, txid);
+    for (int i = 0; i < tx->output_count; i++)
+    {
+        BenchCoin *coin = &coins[(*coin_count)++];
+        memcpy(coin->outpoint.txid, txid, TXID_SIZE);
+        coin->outpoint.index = (uint32_t)i;
+        coin->owner = owners[i];
+        coin->amount = tx->outputs[i].amount;
+    }
+}
+
+// One issuing transaction, then payments that each spend a coin and split it in two. Half the
+// spends take a coin made in the last few blocks, as wallets tend to, and half take any coin.
+void ledger_bench_block(Block *block, int height, BenchCoin *coins, int *coin_count, unsigned int *seed)
+{
+    Transaction tx = {0};
+    int owners[TX_MAX_OUTPUTS];
+    memset(block, 0, sizeof(*block));
+    block->index = height;
+    block_clear_transactions(block);
+
+    snprintf(tx.memo, sizeof(tx.memo), "mint %d", height);
+    tx.output_count = BENCH_MINT_OUTPUTS;
+    for (int i = 0; i < BENCH_MINT_OUTPUTS; i++)
+    {
+        owners[i] = rand_r(seed) % BENCH_OWNERS;
+        bench_owner(owners[i], tx.outputs[i].address, sizeof(tx.outputs[i].address));
+        tx.outputs[i].amount = BLOCK_REWARD / BENCH_MINT_OUTPUTS;
+    }
+    bench_add(block, &tx, coins, coin_count, owners);
+
+    for (int t = 1; t < MAX_TRANSACTIONS && *coin_count > 0; t++)
+    {
+        int recent = *coin_count < BENCH_RECENT ? *coin_count : BENCH_RECENT;
+        int pick = rand_r(seed) & 1 ? *coin_count - 1 - rand_r(seed) % recent : rand_r(seed) % *coin_count;
+        BenchCoin spent = coins[pick];
+        coins[pick] = coins[--*coin_count];
+
+        memset(&tx, 0, sizeof(tx));
+        bench_owner(spent.owner, tx.sender, sizeof(tx.sender));
+        memcpy(tx.inputs[0].prev_txid, spent.outpoint.txid, TXID_SIZE);
+        tx.inputs[0].index = spent.outpoint.index;
+        tx.input_count = 1;
+        tx.output_count = spent.amount > 1 ? 2 : 1;
+        for (int i = 0; i < tx.output_count; i++)
+        {
+            owners[i] = rand_r(seed) % BENCH_OWNERS;
+            bench_owner(owners[i], tx.outputs[i].address, sizeof(tx.outputs[i].address));
+        }
+        tx.outputs[0].amount = spent.amount - spent.amount / 2;
+        tx.outputs[1].amount = spent.amount / 2;
+        bench_add(block, &tx, coins, coin_count, owners);
+    }
+}
+
+static double elapsed_ms(struct timespec start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+typedef struct
+{
+    double ms;         // Connecting every block
+    size_t peak;       // Largest cache table seen
+    uint64_t db_reads; // Lookups the cache could not answer
+    uint64_t flushes;  // Batches written
+    uint64_t written;  // Entries those batches held
+    uint64_t skipped;  // Entries never written because they were spent first
+    int failures;      // Blocks that did not connect
+    int count;         // Final set size
+    uint64_t total;    // Final set value
+} LedgerRun;
+
+static void timed_connect(const Block *blocks, int block_count, UtxoSet *set, LedgerRun *run)
+{
+    BlockUndo undo = {0};
+    struct timespec start;
+    memset(run, 0, sizeof(*run));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int b = 0; b < block_count; b++)
+    {
+        run->failures += !ledger_connect_block(set, &blocks[b], b, &undo);
+        if (utxo_set_memory(set) > run->peak)
+            run->peak = utxo_set_memory(set);
+        if (utxo_set_over_budget(set))
+            utxo_set_flush(set);
+    }
+    run->ms = elapsed_ms(start);
+    block_undo_free(&undo);
+    run->db_reads = set->db_reads;
+    run->flushes = set->flushes;
+    run->written = set->written;
+    run->skipped = set->fresh_skips;
+    run->count = set->count;
+    run->total = set->total;
+}
+
+int run_utxo_benchmark(int block_count, int cache_kib)
+{
+    if (block_count < 1 || block_count > 200000 || cache_kib < 64)
+    {
+        print_error("Usage: --utxo-bench <blocks 1-200000> [cache KiB, at least 64]");
+        return 1;
+    }
+    print_header("UTXO CACHE BENCHMARK");
+
+    Block *blocks = calloc((size_t)block_count, sizeof(Block));
+    BenchCoin *coins = malloc((size_t)block_count * MAX_TRANSACTIONS * TX_MAX_OUTPUTS * sizeof(BenchCoin));
+    if (!blocks || !coins)
+    {
+        free(blocks);
+        free(coins);
+        print_error("Out of memory");
+        return 1;
+    }
+    unsigned int seed = 12345;
+    int coin_count = 0;
+    for (int b = 0; b < block_count; b++)
+        ledger_bench_block(&blocks[b], b, coins, &coin_count, &seed);
+    free(coins);
+
+    // Memory keeps the whole set in one table; Cached holds at most cache_kib and writes the
+    // rest to sorted runs on disk
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/utxo-bench-%d", (int)getpid());
+    CoinDB db;
+    UtxoSet sets[2];
+    LedgerRun runs[2];
+    utxo_set_init(&sets[0]);
+    utxo_set_init(&sets[1]);
+    if (!coindb_open(&db, dir))
+    {
+        free(blocks);
+        print_error("Could not create the coin database directory");
+        return 1;
+    }
+    utxo_set_attach(&sets[1], &db, (size_t)cache_kib * 1024);
+    for (int i = 0; i < 2; i++)
+    {
+        printf(COLOR_CYAN "Connecting %d blocks (%s)..." COLOR_RESET "\n", block_count, i ? "cached" : "in memory");
+        fflush(stdout);
+        timed_connect(blocks, block_count, &sets[i], &runs[i]);
+    }
+    free(blocks);
+
+    const char *modes[2] = {"Memory", "Cached"};
+    printf(COLOR_BLUE "┌────────┬────────────┬────────────┬──────────┬────────────┬─────────┬────────────┬────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-6s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-7s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │\n",
+           "Mode", "Peak KiB", "Time (ms)", "us/block", "DB lookups", "Flushes", "Written", "Skipped");
+    printf(COLOR_BLUE "├────────┼────────────┼────────────┼──────────┼────────────┼─────────┼────────────┼────────────┤\n");
+    for (int i = 0; i < 2; i++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-6s" COLOR_BLUE " │ " COLOR_CYAN "%-10zu" COLOR_BLUE " │ " COLOR_CYAN "%-10.1f" COLOR_BLUE
+                          " │ " COLOR_CYAN "%-8.1f" COLOR_BLUE " │ " COLOR_CYAN "%-10llu" COLOR_BLUE " │ " COLOR_CYAN "%-7llu" COLOR_BLUE
+                          " │ " COLOR_CYAN "%-10llu" COLOR_BLUE " │ " COLOR_CYAN "%-10llu" COLOR_BLUE " │\n",
+               modes[i], runs[i].peak / 1024, runs[i].ms, runs[i].ms * 1000.0 / block_count,
+               (unsigned long long)runs[i].db_reads, (unsigned long long)runs[i].flushes,
+               (unsigned long long)runs[i].written, (unsigned long long)runs[i].skipped);
+    }
+    printf(COLOR_BLUE "└────────┴────────────┴────────────┴──────────┴────────────┴─────────┴────────────┴────────────┘" COLOR_RESET "\n");
+
+    int same = runs[0].failures == 0 && runs[1].failures == 0 && runs[0].count == runs[1].count &&
+               runs[0].total == runs[1].total;
+    printf(COLOR_GREEN "\nThe set grew to %d coins; the cache stayed within %zu KiB instead of %zu KiB" COLOR_RESET "\n",
+           runs[1].count, runs[1].peak / 1024, runs[0].peak / 1024);
+    printf(COLOR_GREEN "%llu outputs were created and spent between flushes and never written" COLOR_RESET "\n",
+           (unsigned long long)runs[1].skipped);
+    printf(COLOR_GREEN "%d runs on disk, %.1f MiB written, %llu merges; Bloom filters skipped %llu run searches in %llu lookups" COLOR_RESET "\n",
+           db.run_count, db.bytes_written / 1048576.0, (unsigned long long)db.merges,
+           (unsigned long long)db.bloom_skips, (unsigned long long)db.lookups);
+
+    utxo_set_free(&sets[0]);
+    utxo_set_free(&sets[1]);
+    coindb_close(&db);
+    coindb_wipe(dir);
+    rmdir(dir);
+    if (!same)
+    {
+        print_error("The cached set does not match the in-memory one");
+        return 1;
+    }
+    print_success("Both runs ended with the same UTXO set");
+    return 0;
+}
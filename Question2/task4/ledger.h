@@ -0,0 +1,44 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include "alloc.h"
+#include "blockchain.h"
+#include "transaction.h"
+#include "utxo.h"
+
+/* ================ CONSTANTS ================ */
+#define BLOCK_REWARD (50 * AMOUNT_SCALE) // Most a block's first transaction may issue (after genesis)
+
+/* ================ DATA STRUCTURES ================ */
+// Undo data: every coin a block's inputs removed, in the order they were spent.
+// It lives in the block's own arena, so disconnecting the block frees it in one step.
+typedef struct
+{
+    Coin *coins;  // Spent coins
+    int count;    // Used entries in coins
+    int capacity; // Allocated length of coins
+    Arena arena;  // Holds coins (and any smaller array it outgrew)
+} BlockUndo;
+
+// Spendable output of a benchmark chain built by ledger_bench_block
+typedef struct
+{
+    OutPoint outpoint; // Spendable output
+    int owner;         // Which bench address holds it
+    uint64_t amount;   // Its value
+} BenchCoin;
+
+// Returns nonzero for a coin that must not be spent
+typedef int (*CoinFilter)(const Coin *coin, void *context);
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void block_undo_free(BlockUndo *undo);
+int ledger_connect_transaction(UtxoSet *set, const TxView *tx, int height, BlockUndo *undo);
+void ledger_disconnect_transaction(UtxoSet *set, const TxView *tx, BlockUndo *undo);
+int ledger_connect_block(UtxoSet *set, const Block *block, int height, BlockUndo *undo);
+void ledger_disconnect_block(UtxoSet *set, const Block *block, BlockUndo *undo);
+uint64_t ledger_fund_payment(UtxoSet *set, Transaction *tx, CoinFilter skip, void *context);
+void ledger_bench_block(Block *block, int height, BenchCoin *coins, int *coin_count, unsigned int *seed);
+int run_utxo_benchmark(int block_count, int cache_kib);
+
+#endif
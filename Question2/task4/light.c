@@ -0,0 +1,687 @@
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "light.h"
+#include "block_tree.h"
+#include "miner.h"
+#include "p2p.h"
+#include "retarget.h"
+#include "signature.h"
+#include "transaction.h"
+
+/* ================ HEADER CHAIN ================ */
+void light_chain_init(LightChain *chain)
+{
+    memset(chain, 0, sizeof(*chain));
+}
+
+void light_chain_free(LightChain *chain)
+{
+    free(chain->headers);
+    light_chain_init(chain);
+}
+
+void light_header_from_block(const Block *block, LightHeader *header)
+{
+    hex_to_bytes(block->previous_hash, header->previous, TXID_SIZE);
+    hex_to_bytes(block->merkle_root, header->merkle_root, TXID_SIZE);
+    header->timestamp = (int64_t)block->timestamp;
+    header->target_bits = block->target_bits;
+    header->nonce = block->nonce;
+}
+
+// Reads one serialize_block_header record; the height is returned apart since the chain implies it
+int light_header_read(ByteReader *reader, LightHeader *header, int *height)
+{
+    *height = (int)get_u32(reader);
+    header->timestamp = (int64_t)get_u64(reader);
+    header->target_bits = get_u32(reader);
+    header->nonce = (int32_t)get_u32(reader);
+    get_bytes(reader, header->previous, TXID_SIZE);
+    get_bytes(reader, header->merkle_root, TXID_SIZE);
+    return reader->ok;
+}
+
+// Same preimage as hash_block_header, rebuilt from the raw fields
+void light_header_hash(const LightHeader *header, int height, char hash[HASH_SIZE])
+{
+    char previous[HASH_SIZE], merkle_root[HASH_SIZE], data[256];
+    bytes_to_hex(header->previous, TXID_SIZE, previous);
+    bytes_to_hex(header->merkle_root, TXID_SIZE, merkle_root);
+    snprintf(data, sizeof(data), "%d%ld%s%s%u%d", height, (long)header->timestamp, merkle_root, previous,
+             header->target_bits, header->nonce);
+    calculate_sha256(data, hash);
+}
+
+// Appends header at height count if it builds on the tip and its hash meets its target
+int light_chain_append(LightChain *chain, const LightHeader *header)
+{
+    unsigned char tip[TXID_SIZE] = {0};
+    char hash[HASH_SIZE];
+    if (chain->count > 0 && !hex_to_bytes(chain->tip_hash, tip, TXID_SIZE))
+        return 0;
+    if (memcmp(header->previous, tip, TXID_SIZE) != 0 ||
+        target_work(header->target_bits) < target_work(target_bits_from_difficulty(POW_LIMIT_DIFFICULTY)))
+        return 0;
+    light_header_hash(header, chain->count, hash);
+    if (!hash_meets_target(hash, header->target_bits))
+        return 0;
+
+    if (chain->count == chain->capacity)
+    {
+        int capacity = chain->capacity ? chain->capacity * 2 : 1024;
+        LightHeader *grown = realloc(chain->headers, (size_t)capacity * sizeof(LightHeader));
+        if (!grown)
+            return 0;
+        chain->headers = grown;
+        chain->capacity = capacity;
+    }
+    chain->headers[chain->count++] = *header;
+    chain->chain_work += target_work(header->target_bits);
+    strcpy(chain->tip_hash, hash);
+    return 1;
+}
+
+// Drops every header from height count up, to step back over a reorg
+void light_chain_truncate(LightChain *chain, int count)
+{
+    if (count < 0)
+        count = 0;
+    for (int i = count; i < chain->count; i++)
+        chain->chain_work -= target_work(chain->headers[i].target_bits);
+    if (count < chain->count)
+        chain->count = count;
+    if (chain->count > 0)
+        light_header_hash(&chain->headers[chain->count - 1], chain->count - 1, chain->tip_hash);
+    else
+        chain->tip_hash[0] = '\0';
+}
+
+/* ================ MERKLE PROOFS ================ */
+// Collects the sibling of the transaction's node on each level while folding the tree as
+// compute_merkle_root does, including its pairing of an odd node with itself
+int merkle_proof_build(const Block *block, int index, MerkleProof *proof)
+{
+    unsigned char level[MAX_TRANSACTIONS][TXID_SIZE];
+    int count = block->transaction_count;
+    if (index < 0 || index >= count)
+        return 0;
+
+    size_t length;
+    const unsigned char *tx = block_transaction_bytes(block, index, &length);
+    strcpy(proof->block_hash, block->hash);
+    proof->height = block->index;
+    proof->index = index;
+    memcpy(proof->tx, tx, length);
+    proof->tx_length = length;
+    proof->witness = block->witnesses[index];
+    proof->branch_length = 0;
+    for (int i = 0; i < count; i++)
+    {
+        tx = block_transaction_bytes(block, i, &length);
+        compute_wtxid(tx, length, &block->witnesses[i], level[i]);
+    }
+    for (int position = index; count > 1; position /= 2)
+    {
+        int sibling = (position ^ 1) < count ? position ^ 1 : position;
+        memcpy(proof->branch[proof->branch_length++], level[sibling], TXID_SIZE);
+        int next = 0;
+        for (int i = 0; i < count; i += 2)
+        {
+            unsigned char pair[TXID_SIZE * 2];
+            memcpy(pair, level[i], TXID_SIZE);
+            memcpy(pair + TXID_SIZE, level[i + 1 < count ? i + 1 : i], TXID_SIZE);
+            SHA256(pair, sizeof(pair), level[next++]);
+        }
+        count = next;
+    }
+    return 1;
+}
+
+// {"blockhash","height","index","tx" (serialize_transaction in hex),"branch":[hex, ...]}
+void merkle_proof_write(ByteWriter *out, const MerkleProof *proof)
+{
+    ByteWriter tx;
+    char hex[TXID_SIZE * 2 + 1];
+    writer_init(&tx);
+    serialize_transaction(&tx, proof->tx, proof->tx_length, &proof->witness);
+    put_format(out, "{\"blockhash\":\"%s\",\"height\":%d,\"index\":%d,\"tx\":\"", proof->block_hash, proof->height,
+               proof->index);
+    for (size_t i = 0; i < tx.length; i += TXID_SIZE)
+    {
+        size_t chunk = tx.length - i < TXID_SIZE ? tx.length - i : TXID_SIZE;
+        bytes_to_hex(tx.data + i, chunk, hex);
+        put_text(out, hex);
+    }
+    put_text(out, "\",\"branch\":[");
+    for (int i = 0; i < proof->branch_length; i++)
+    {
+        bytes_to_hex(proof->branch[i], TXID_SIZE, hex);
+        put_format(out, "%s\"%s\"", i > 0 ? "," : "", hex);
+    }
+    put_text(out, "]}");
+    writer_free(&tx);
+}
+
+int merkle_proof_parse(const JsonSpan *object, MerkleProof *proof)
+{
+    JsonSpan value, branch;
+    long long number;
+    char text[(MAX_TX_SIZE + 128) * 2 + 1];
+    unsigned char encoded[MAX_TX_SIZE + 128];
+    memset(proof, 0, sizeof(*proof));
+    if (!json_member(object, "blockhash", &value) || !json_text(&value, proof->block_hash, HASH_SIZE) ||
+        strlen(proof->block_hash) != HASH_SIZE - 1)
+        return 0;
+    if (!json_member(object, "height", &value) || !json_integer(&value, &number) || number < 0 || number > INT32_MAX)
+        return 0;
+    proof->height = (int)number;
+    if (!json_member(object, "index", &value) || !json_integer(&value, &number) || number < 0 ||
+        number >= MAX_TRANSACTIONS)
+        return 0;
+    proof->index = (int)number;
+
+    size_t length;
+    if (!json_member(object, "tx", &value) || !json_text(&value, text, sizeof(text)) ||
+        (length = strlen(text)) % 2 != 0 || !hex_to_bytes(text, encoded, length / 2))
+        return 0;
+    ByteReader reader;
+    TxView view;
+    reader_init(&reader, encoded, length / 2);
+    if (!deserialize_transaction(&reader, &view, &proof->witness) || reader.offset != reader.length)
+        return 0;
+    memcpy(proof->tx, view.data, view.length);
+    proof->tx_length = view.length;
+
+    if (!json_member(object, "branch", &branch) || *branch.start != '[')
+        return 0;
+    while (json_item(&branch, proof->branch_length, &value))
+    {
+        if (proof->branch_length == LIGHT_MAX_BRANCH || !json_text(&value, text, sizeof(text)) ||
+            strlen(text) != TXID_SIZE * 2 || !hex_to_bytes(text, proof->branch[proof->branch_length], TXID_SIZE))
+            return 0;
+        proof->branch_length++;
+    }
+    return 1;
+}
+
+// The header at the proof's height must hash to its block hash, and the branch must lead
+// from the transaction's leaf to that header's Merkle root
+int light_verify_proof(const LightChain *chain, const MerkleProof *proof)
+{
+    char hash[HASH_SIZE];
+    unsigned char node[TXID_SIZE], pair[TXID_SIZE * 2];
+    if (proof->height < 0 || proof->height >= chain->count || proof->index < 0 || proof->branch_length < 0 ||
+        proof->branch_length > LIGHT_MAX_BRANCH)
+        return 0;
+    const LightHeader *header = &chain->headers[proof->height];
+    light_header_hash(header, proof->height, hash);
+    if (strcmp(hash, proof->block_hash) != 0)
+        return 0;
+
+    compute_wtxid(proof->tx, proof->tx_length, &proof->witness, node);
+    for (int level = 0; level < proof->branch_length; level++)
+    {
+        // Bit level of the index says whether this node is the right child
+        int right = (proof->index >> level) & 1;
+        memcpy(pair + (right ? TXID_SIZE : 0), node, TXID_SIZE);
+        memcpy(pair + (right ? 0 : TXID_SIZE), proof->branch[level], TXID_SIZE);
+        SHA256(pair, sizeof(pair), node);
+    }
+    return (proof->index >> proof->branch_length) == 0 && memcmp(node, header->merkle_root, TXID_SIZE) == 0;
+}
+
+/* ================ LIGHT CLIENT ================ */
+typedef struct
+{
+    struct sockaddr_in address; // Full node's RPC endpoint
+    LightChain chain;           // Headers synced so far
+    char *response;             // Last HTTP reply, which result spans point into
+    int next_id;                // JSON-RPC id of the next call
+} LightClient;
+
+// One blocking POST on a fresh connection; result spans the reply's "result" member
+static int light_call(LightClient *client, const char *method, const char *params, JsonSpan *result)
+{
+    char body[512], request[768];
+    int body_length = snprintf(body, sizeof(body), "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":%s}",
+                               client->next_id++, method, params);
+    int length = snprintf(request, sizeof(request),
+                          "POST / HTTP/1.1\r\nHost: light\r\nContent-Type: application/json\r\n"
+                          "Content-Length: %d\r\nConnection: close\r\n\r\n%s",
+                          body_length, body);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&client->address, sizeof(client->address)) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        print_error("Could not connect to the full node");
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    size_t received = 0;
+    ssize_t n;
+    int sent = send(fd, request, (size_t)length, MSG_NOSIGNAL) == length;
+    while (sent && received < LIGHT_MAX_RESPONSE - 1 &&
+           (n = recv(fd, client->response + received, LIGHT_MAX_RESPONSE - 1 - received, 0)) > 0)
+        received += (size_t)n;
+    close(fd);
+    client->response[received] = '\0';
+
+    const char *start = strstr(client->response, "\r\n\r\n");
+    const char *end = client->response + received;
+    JsonSpan reply, error, message;
+    char text[256];
+    if (!sent || !start || !(reply.end = json_skip(start + 4, end, 0)))
+    {
+        print_error("The full node sent no JSON reply");
+        return 0;
+    }
+    reply.start = json_space(start + 4, end);
+    if (json_member(&reply, "error", &error) && *error.start == '{')
+    {
+        if (json_member(&error, "message", &message) && json_text(&message, text, sizeof(text)))
+            printf(COLOR_RED "✗ %s: %s" COLOR_RESET "\n", method, text);
+        else
+            printf(COLOR_RED "✗ %s failed" COLOR_RESET "\n", method);
+        return 0;
+    }
+    if (!json_member(&reply, "result", result))
+    {
+        print_error("The full node's reply has no result");
+        return 0;
+    }
+    return 1;
+}
+
+// Fetches headers after the tip in batches; if they stop linking up, or the node's best block
+// differs once it has nothing more to send, the node reorganized and the client steps back
+static int light_sync(LightClient *client)
+{
+    LightChain *chain = &client->chain;
+    uint64_t started = monotonic_ns();
+    int fetched = 0, rewound = 0, step = 1;
+    for (;;)
+    {
+        char params[64], hex[LIGHT_WIRE_HEADER * 2 + 1], best[HASH_SIZE];
+        unsigned char raw[LIGHT_WIRE_HEADER];
+        JsonSpan result, item;
+        int count = 0, linked = 1;
+        snprintf(params, sizeof(params), "[%d,%d]", chain->count, LIGHT_HEADER_BATCH);
+        if (!light_call(client, "getheaders", params, &result))
+            return 0;
+        for (; json_item(&result, count, &item); count++)
+        {
+            LightHeader header;
+            ByteReader reader;
+            int height;
+            reader_init(&reader, raw, sizeof(raw));
+            if (!json_text(&item, hex, sizeof(hex)) || strlen(hex) != sizeof(hex) - 1 ||
+                !hex_to_bytes(hex, raw, sizeof(raw)) || !light_header_read(&reader, &header, &height) ||
+                height != chain->count)
+            {
+                print_error("The full node sent a malformed header");
+                return 0;
+            }
+            if (!light_chain_append(chain, &header))
+            {
+                linked = 0;
+                break;
+            }
+            fetched++;
+        }
+        if (linked && count > 0)
+            continue;
+        if (!linked && count > 0)
+        {
+            printf(COLOR_RED "✗ Header #%d does not build on #%d or misses its target" COLOR_RESET "\n", chain->count,
+                   chain->count - 1);
+            return 0;
+        }
+        if (linked)
+        {
+            // Nothing more to fetch: done once the node's best block is our tip
+            if (chain->count == 0)
+                break;
+            if (!light_call(client, "getbestblockhash", "[]", &result) || !json_text(&result, best, sizeof(best)))
+                return 0;
+            if (strcmp(best, chain->tip_hash) == 0)
+                break;
+        }
+        if (chain->count == 0)
+        {
+            print_error("The full node's genesis header is invalid");
+            return 0;
+        }
+        light_chain_truncate(chain, chain->count - step);
+        rewound += step;
+        step *= 2;
+    }
+    printf(COLOR_GREEN "✔ Synced %d headers in %.1f ms; tip #%d, %d rewound over reorgs, %zu KiB held" COLOR_RESET "\n",
+           fetched, (double)(monotonic_ns() - started) / 1e6, chain->count - 1, rewound,
+           (size_t)chain->capacity * sizeof(LightHeader) / 1024);
+    return 1;
+}
+
+static void light_prove(LightClient *client, const char *txid_hex)
+{
+    unsigned char txid[TXID_SIZE], computed[TXID_SIZE];
+    char params[TXID_SIZE * 2 + 5], text[TX_TEXT_SIZE];
+    JsonSpan result;
+    MerkleProof proof;
+    TxView view;
+    if (strlen(txid_hex) != TXID_SIZE * 2 || !hex_to_bytes(txid_hex, txid, TXID_SIZE))
+    {
+        print_error("Usage: prove <64-hex txid>");
+        return;
+    }
+    snprintf(params, sizeof(params), "[\"%.64s\"]", txid_hex);
+    if (!light_call(client, "gettxproof", params, &result))
+        return;
+    if (!merkle_proof_parse(&result, &proof))
+    {
+        print_error("The full node sent a malformed proof");
+        return;
+    }
+    compute_txid(proof.tx, proof.tx_length, computed);
+    if (memcmp(computed, txid, TXID_SIZE) != 0)
+    {
+        print_error("The proof is for a different transaction");
+        return;
+    }
+    if (proof.height >= client->chain.count && !light_sync(client))
+        return;
+    if (!light_verify_proof(&client->chain, &proof))
+    {
+        print_error("Proof rejected: it does not lead to the Merkle root of a header we hold");
+        return;
+    }
+    tx_view_parse(proof.tx, proof.tx_length, &view);
+    tx_view_format(&view, text, sizeof(text));
+    printf(COLOR_GREEN "✔ Included in block #%d (%d confirmations); Merkle branch of %d hashes" COLOR_RESET "\n",
+           proof.height, client->chain.count - proof.height, proof.branch_length);
+    printf(COLOR_GRAY "  %s%s" COLOR_RESET "\n", text, witness_is_empty(&proof.witness) ? "" : " (signed)");
+}
+
+static void print_light_status(const LightClient *client)
+{
+    const LightChain *chain = &client->chain;
+    char line[64];
+    printf(COLOR_BLUE "┌───────────────────────────────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24d " COLOR_BLUE "│\n", "Height:", chain->count - 1);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24llu " COLOR_BLUE "│\n", "Chain work:",
+           (unsigned long long)chain->chain_work);
+    snprintf(line, sizeof(line), "%zu KiB (%zu B/header)", (size_t)chain->capacity * sizeof(LightHeader) / 1024,
+             sizeof(LightHeader));
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Headers:", line);
+    if (chain->count > 0)
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %.12s...%.8s  " COLOR_BLUE "│\n", "Tip:",
+               chain->tip_hash, chain->tip_hash + 56);
+    printf(COLOR_BLUE "└───────────────────────────────────────┘" COLOR_RESET "\n");
+}
+
+// Headers-only client of a full node's JSON-RPC endpoint
+int run_light_client(const char *endpoint)
+{
+    char host[64], line[256];
+    int port;
+    LightClient client = {0};
+    client.address.sin_family = AF_INET;
+    if (sscanf(endpoint, "%63[^:]:%d", host, &port) != 2 || port < 1 || port > 65535 ||
+        inet_pton(AF_INET, host, &client.address.sin_addr) != 1)
+    {
+        print_error("Usage: --light <host:rpc port>");
+        return 1;
+    }
+    client.address.sin_port = htons((uint16_t)port);
+    client.response = malloc(LIGHT_MAX_RESPONSE);
+    if (!client.response)
+        return 1;
+    light_chain_init(&client.chain);
+
+    print_header("LIGHT CLIENT");
+    printf(COLOR_CYAN "Following %s:%d with headers only" COLOR_RESET "\n", host, port);
+    light_sync(&client);
+    printf(COLOR_PURPLE "light> " COLOR_RESET);
+    fflush(stdout);
+    while (fgets(line, sizeof(line), stdin))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (strcmp(line, "sync") == 0)
+            light_sync(&client);
+        else if (strncmp(line, "prove ", 6) == 0)
+            light_prove(&client, line + 6);
+        else if (strcmp(line, "status") == 0)
+            print_light_status(&client);
+        else if (strcmp(line, "quit") == 0)
+            break;
+        else if (line[0] != '\0')
+            print_error("Commands: sync | prove <txid> | status | quit");
+        printf(COLOR_PURPLE "light> " COLOR_RESET);
+        fflush(stdout);
+    }
+    light_chain_free(&client.chain);
+    free(client.response);
+    return 0;
+}
+
+/* ================ BENCHMARK ================ */
+// Tip block for the proof half: a full block of transactions, every other one signed
+static int bench_proof_block(Block *block, int height, const char *previous_hash)
+{
+    KeyPair keys[MAX_TRANSACTIONS];
+    memset(block, 0, sizeof(*block));
+    block->index = height;
+    block->timestamp = time(NULL);
+    strcpy(block->previous_hash, previous_hash);
+    for (int t = 0; t < MAX_TRANSACTIONS; t++)
+    {
+        Transaction tx = {0};
+        TxWitness witness = {0};
+        unsigned char encoded[MAX_TX_SIZE];
+        if (!keypair_generate(&keys[t]))
+            return 0;
+        strcpy(tx.sender, keys[t].address);
+        snprintf(tx.memo, sizeof(tx.memo), "light-%02d", t);
+        snprintf(tx.outputs[0].address, sizeof(tx.outputs[0].address), "merchant%d", t);
+        tx.outputs[0].amount = (uint64_t)(t + 1) * AMOUNT_SCALE;
+        tx.output_count = 1;
+        size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+        if (length == 0 || (t % 2 == 0 && !sign_transaction(&keys[t], encoded, length, &witness)) ||
+            !block_add_transaction(block, encoded, length, &witness))
+            return 0;
+    }
+    compute_merkle_root(block, block->merkle_root);
+    return 1;
+}
+
+// Proofs that must fail: each changes one thing the verifier checks
+static int bench_tampered_rejected(const LightChain *chain, const MerkleProof *proof)
+{
+    MerkleProof bad;
+    int rejected = 0;
+    bad = *proof;
+    bad.tx[bad.tx_length - 1] ^= 1;
+    rejected += !light_verify_proof(chain, &bad);
+    bad = *proof;
+    bad.branch[0][0] ^= 1;
+    rejected += !light_verify_proof(chain, &bad);
+    bad = *proof;
+    bad.index ^= 1;
+    rejected += !light_verify_proof(chain, &bad);
+    bad = *proof;
+    bad.height--;
+    rejected += !light_verify_proof(chain, &bad);
+    bad = *proof;
+    bad.witness.public_key[0] ^= 1;
+    rejected += !light_verify_proof(chain, &bad);
+    return rejected;
+}
+
+int run_light_benchmark(int header_count)
+{
+    if (header_count < 2 || header_count > 2000000)
+    {
+        print_error("Usage: --light-bench <headers 2-2000000>");
+        return 1;
+    }
+    print_header("LIGHT CLIENT BENCHMARK");
+    printf(COLOR_CYAN "Mining %d headers at the easiest target; the last block carries %d transactions..." COLOR_RESET "\n",
+           header_count, MAX_TRANSACTIONS);
+    fflush(stdout);
+
+    // What a full node would send: the wire encoding of every header
+    unsigned char *wire = malloc((size_t)header_count * LIGHT_WIRE_HEADER);
+    Block *block = malloc(sizeof(Block));
+    if (!wire || !block)
+    {
+        free(wire);
+        free(block);
+        return 1;
+    }
+    memset(block, 0, sizeof(*block));
+    uint32_t bits = target_bits_from_difficulty(POW_LIMIT_DIFFICULTY);
+    char previous[HASH_SIZE] = "0000000000000000000000000000000000000000000000000000000000000000";
+    uint64_t started = monotonic_ns();
+    int nonce_attempts;
+    for (int height = 0; height < header_count; height++)
+    {
+        if (height == header_count - 1)
+        {
+            if (!bench_proof_block(block, height, previous))
+            {
+                print_error("Could not build the proof block");
+                free(wire);
+                free(block);
+                return 1;
+            }
+        }
+        else
+        {
+            char memo[32];
+            block->index = height;
+            block->timestamp = 1700000000 + height;
+            block->transaction_count = 0;
+            strcpy(block->previous_hash, previous);
+            snprintf(memo, sizeof(memo), "light-bench-%d", height);
+            calculate_sha256(memo, block->merkle_root);
+        }
+        solve_block_header(block, bits, 1, &nonce_attempts);
+        strcpy(previous, block->hash);
+        ByteWriter header;
+        writer_init(&header);
+        serialize_block_header(&header, block);
+        memcpy(wire + (size_t)height * LIGHT_WIRE_HEADER, header.data, LIGHT_WIRE_HEADER);
+        writer_free(&header);
+    }
+    double mine_ms = (double)(monotonic_ns() - started) / 1e6;
+
+    // Parse, link, check proof-of-work and store, as light_sync does per batch
+    LightChain chain;
+    light_chain_init(&chain);
+    int ok = 1;
+    started = monotonic_ns();
+    for (int height = 0; height < header_count && ok; height++)
+    {
+        ByteReader reader;
+        LightHeader header;
+        int wire_height;
+        reader_init(&reader, wire + (size_t)height * LIGHT_WIRE_HEADER, LIGHT_WIRE_HEADER);
+        ok = light_header_read(&reader, &header, &wire_height) && wire_height == height &&
+             light_chain_append(&chain, &header);
+    }
+    double sync_ms = (double)(monotonic_ns() - started) / 1e6;
+    free(wire);
+    if (!ok || strcmp(chain.tip_hash, block->hash) != 0)
+    {
+        print_error("The light chain did not accept the mined headers");
+        light_chain_free(&chain);
+        free(block);
+        return 1;
+    }
+
+    // A header that links to the tip but misses its target, and one that links to nothing
+    LightHeader forged = chain.headers[chain.count - 1];
+    char hash[HASH_SIZE];
+    hex_to_bytes(chain.tip_hash, forged.previous, TXID_SIZE);
+    do
+    {
+        forged.nonce++;
+        light_header_hash(&forged, chain.count, hash);
+    } while (hash_meets_target(hash, forged.target_bits));
+    int forged_rejected = !light_chain_append(&chain, &forged);
+    forged.previous[0] ^= 1;
+    forged_rejected += !light_chain_append(&chain, &forged);
+
+    // Every transaction of the tip block, through the RPC encoding and back
+    MerkleProof *proofs = malloc(MAX_TRANSACTIONS * sizeof(MerkleProof));
+    MerkleProof *parsed = malloc(sizeof(MerkleProof));
+    ByteWriter encoded;
+    writer_init(&encoded);
+    size_t proof_bytes = 0;
+    int verified = 0, rejected = 0;
+    for (int i = 0; proofs && parsed && i < block->transaction_count; i++)
+    {
+        encoded.length = 0;
+        merkle_proof_build(block, i, parsed);
+        merkle_proof_write(&encoded, parsed);
+        JsonSpan object = {(const char *)encoded.data, (const char *)encoded.data + encoded.length};
+        if (!merkle_proof_parse(&object, &proofs[i]))
+            continue;
+        proof_bytes += encoded.length;
+        verified += light_verify_proof(&chain, &proofs[i]);
+        rejected += bench_tampered_rejected(&chain, &proofs[i]);
+    }
+    int rounds = 20000;
+    started = monotonic_ns();
+    for (int r = 0; proofs && r < rounds; r++)
+        ok &= light_verify_proof(&chain, &proofs[r % MAX_TRANSACTIONS]);
+    double verify_us = (double)(monotonic_ns() - started) / 1e3 / rounds;
+    encoded.length = 0;
+    serialize_block(&encoded, block);
+    size_t block_bytes = encoded.length;
+    writer_free(&encoded);
+    free(parsed);
+    free(proofs);
+
+    double light_mib = (double)chain.capacity * sizeof(LightHeader) / 1048576.0;
+    double full_mib = (double)header_count * sizeof(BlockNode) / 1048576.0;
+    printf(COLOR_BLUE "┌──────────────────────────┬───────────────────────────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-24s" COLOR_BLUE " │ " COLOR_YELLOW "%-33s" COLOR_BLUE " │\n", "Measure", "Result");
+    printf(COLOR_BLUE "├──────────────────────────┼───────────────────────────────────┤\n");
+    char value[64];
+    snprintf(value, sizeof(value), "%.0f ms (not part of syncing)", mine_ms);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Mining headers", value);
+    snprintf(value, sizeof(value), "%.1f ms, %.0f headers/s", sync_ms, header_count / (sync_ms / 1000.0));
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Header validation", value);
+    snprintf(value, sizeof(value), "%.1f MiB (%zu B/header)", light_mib, sizeof(LightHeader));
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Light chain memory", value);
+    snprintf(value, sizeof(value), "%.1f MiB (%zu B/node)", full_mib, sizeof(BlockNode));
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Full-node block tree", value);
+    snprintf(value, sizeof(value), "%.1f MiB light, %.0f MiB full", 1e6 * sizeof(LightHeader) / 1048576.0,
+             1e6 * sizeof(BlockNode) / 1048576.0);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "At 1,000,000 blocks", value);
+    snprintf(value, sizeof(value), "%zu B JSON vs %zu B block", verified ? proof_bytes / (size_t)verified : 0,
+             block_bytes);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Proof size", value);
+    snprintf(value, sizeof(value), "%.2f us", verify_us);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-24s" COLOR_BLUE " │ " COLOR_RESET "%-33s" COLOR_BLUE " │\n", "Proof verification", value);
+    printf(COLOR_BLUE "└──────────────────────────┴───────────────────────────────────┘" COLOR_RESET "\n");
+
+    int expected = block->transaction_count;
+    light_chain_free(&chain);
+    free(block);
+    if (!ok || verified != expected || rejected != expected * 5 || forged_rejected != 2)
+    {
+        printf(COLOR_RED "✗ %d/%d proofs verified, %d/%d tampered proofs and %d/2 forged headers rejected" COLOR_RESET "\n",
+               verified, expected, rejected, expected * 5, forged_rejected);
+        return 1;
+    }
+    printf(COLOR_GREEN "✔ All %d proofs verified; %d tampered proofs and both forged headers were rejected" COLOR_RESET "\n",
+           verified, rejected);
+    return 0;
+}
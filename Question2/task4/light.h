@@ -0,0 +1,66 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "json.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define LIGHT_HEADER_BATCH 2000                 // Headers per getheaders call (as many as one MSG_HEADERS)
+#define LIGHT_MAX_BRANCH 8                      // Merkle levels a proof may carry (MAX_TRANSACTIONS needs 4)
+#define LIGHT_WIRE_HEADER 84                    // Bytes of serialize_block_header, height included
+#define LIGHT_MAX_RESPONSE (1024 * 1024 + 8192) // Whole HTTP reply: RPC_MAX_OUTPUT plus headers
+
+/* ================ DATA STRUCTURES ================ */
+// What a light client keeps per block: 80 bytes, the height is the position in the array
+typedef struct
+{
+    unsigned char previous[TXID_SIZE];    // Raw hash of the parent header
+    unsigned char merkle_root[TXID_SIZE]; // Commits to the block's transactions
+    int64_t timestamp;                    // Block time
+    uint32_t target_bits;                 // Compact target the header hash meets
+    int32_t nonce;                        // Proof-of-work nonce
+} LightHeader;
+
+// Headers-only chain: no transactions, no UTXO set, no block tree
+typedef struct
+{
+    LightHeader *headers;     // Genesis first, one contiguous array
+    int count;                // Headers held; the tip is at count - 1
+    int capacity;             // Allocated length of headers
+    char tip_hash[HASH_SIZE]; // Hash of the last header, so an append hashes only the new one
+    uint64_t chain_work;      // Sum of block_work over the headers
+} LightChain;
+
+// Inclusion proof for one transaction, as a full node answers gettxproof
+typedef struct
+{
+    char block_hash[HASH_SIZE];                        // Block said to contain the transaction
+    int height;                                        // Its height
+    int index;                                         // Position of the transaction in the block
+    unsigned char tx[MAX_TX_SIZE];                     // Encoded transaction
+    size_t tx_length;                                  // Bytes used in tx
+    TxWitness witness;                                 // Its signature, part of the Merkle leaf
+    unsigned char branch[LIGHT_MAX_BRANCH][TXID_SIZE]; // Sibling of each node on the path, leaf level first
+    int branch_length;                                 // Levels in branch
+} MerkleProof;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void light_chain_init(LightChain *chain);
+void light_chain_free(LightChain *chain);
+void light_header_from_block(const Block *block, LightHeader *header);
+int light_header_read(ByteReader *reader, LightHeader *header, int *height);
+void light_header_hash(const LightHeader *header, int height, char hash[HASH_SIZE]);
+int light_chain_append(LightChain *chain, const LightHeader *header);
+void light_chain_truncate(LightChain *chain, int count);
+
+int merkle_proof_build(const Block *block, int index, MerkleProof *proof);
+void merkle_proof_write(ByteWriter *out, const MerkleProof *proof);
+int merkle_proof_parse(const JsonSpan *object, MerkleProof *proof);
+int light_verify_proof(const LightChain *chain, const MerkleProof *proof);
+
+int run_light_client(const char *endpoint);
+int run_light_benchmark(int header_count);
+
+#endif
@@ -0,0 +1,304 @@
+#include <stdint.h>
+#include "mempool.h"
+#include "transaction.h"
+#include "metrics.h"
+
+/* ================ HASH INDEX ================ */
+static uint64_t txid_key(const unsigned char txid[TXID_SIZE])
+{
+    uint64_t key;
+    memcpy(&key, txid, sizeof(key));
+    return key;
+}
+
+static int find_slot(const Mempool *pool, const unsigned char txid[TXID_SIZE])
+{
+    int mask = pool->slot_capacity - 1;
+    int slot = (int)(txid_key(txid) & (uint64_t)mask);
+    while (pool->slots[slot] >= 0)
+    {
+        if (memcmp(pool->entries[pool->slots[slot]].txid, txid, TXID_SIZE) == 0)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static void put_slot(int *slots, int capacity, const MempoolEntry *entries, int index)
+{
+    int mask = capacity - 1;
+    int slot = (int)(txid_key(entries[index].txid) & (uint64_t)mask);
+    while (slots[slot] >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = index;
+}
+
+static int grow(Mempool *pool)
+{
+    int capacity = pool->capacity ? pool->capacity * 2 : 64;
+    MempoolEntry *entries = realloc(pool->entries, (size_t)capacity * sizeof(MempoolEntry));
+    if (!entries)
+        return 0;
+    pool->entries = entries;
+    pool->capacity = capacity;
+
+    int slot_capacity = capacity * 2;
+    int *slots = malloc((size_t)slot_capacity * sizeof(int));
+    if (!slots)
+        return 0;
+    memset(slots, 0xff, (size_t)slot_capacity * sizeof(int));
+    for (int i = 0; i < pool->count; i++)
+    {
+        put_slot(slots, slot_capacity, pool->entries, i);
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_capacity = slot_capacity;
+    return 1;
+}
+
+/* ================ SPENT OUTPOINTS ================ */
+static int spend_home(const unsigned char txid[TXID_SIZE], uint32_t index, int mask)
+{
+    return (int)((txid_key(txid) + index * 0x9e3779b97f4a7c15ULL) & (uint64_t)mask);
+}
+
+static int find_spend(const Mempool *pool, const unsigned char txid[TXID_SIZE], uint32_t index)
+{
+    if (pool->spend_capacity == 0)
+        return -1;
+    int mask = pool->spend_capacity - 1;
+    int slot = spend_home(txid, index, mask);
+    while (pool->spends[slot].entry >= 0)
+    {
+        if (pool->spends[slot].index == index && memcmp(pool->spends[slot].txid, txid, TXID_SIZE) == 0)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static void put_spend(MempoolSpend *spends, int capacity, const unsigned char txid[TXID_SIZE], uint32_t index, int entry)
+{
+    int mask = capacity - 1;
+    int slot = spend_home(txid, index, mask);
+    while (spends[slot].entry >= 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+    memcpy(spends[slot].txid, txid, TXID_SIZE);
+    spends[slot].index = index;
+    spends[slot].entry = entry;
+}
+
+// Kept at most half full, so probe chains stay short
+static int reserve_spends(Mempool *pool, int extra)
+{
+    if ((pool->spend_count + extra) * 2 <= pool->spend_capacity)
+        return 1;
+    int capacity = pool->spend_capacity ? pool->spend_capacity : 256;
+    while ((pool->spend_count + extra) * 2 > capacity)
+        capacity *= 2;
+    MempoolSpend *spends = malloc((size_t)capacity * sizeof(MempoolSpend));
+    if (!spends)
+        return 0;
+    for (int i = 0; i < capacity; i++)
+        spends[i].entry = -1;
+    for (int i = 0; i < pool->spend_capacity; i++)
+    {
+        if (pool->spends[i].entry >= 0)
+            put_spend(spends, capacity, pool->spends[i].txid, pool->spends[i].index, pool->spends[i].entry);
+    }
+    free(pool->spends);
+    pool->spends = spends;
+    pool->spend_capacity = capacity;
+    return 1;
+}
+
+// Backward-shift deletion, as for the txid index
+static void delete_spend(Mempool *pool, int slot)
+{
+    int mask = pool->spend_capacity - 1;
+    int hole = slot;
+    int next = (hole + 1) & mask;
+    while (pool->spends[next].entry >= 0)
+    {
+        int home = spend_home(pool->spends[next].txid, pool->spends[next].index, mask);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pool->spends[hole] = pool->spends[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pool->spends[hole].entry = -1;
+    pool->spend_count--;
+}
+
+// Points every outpoint the entry spends at entry (-1: removes them)
+static void index_spends(Mempool *pool, const MempoolEntry *tx, int entry)
+{
+    TxView view;
+    const unsigned char *cursor;
+    if (!tx_view_parse(tx->tx, tx->length, &view))
+        return;
+    cursor = view.inputs;
+    for (int i = 0; i < view.input_count; i++)
+    {
+        TxInputView input;
+        tx_next_input(&cursor, &input);
+        int slot = find_spend(pool, input.prev_txid, input.index);
+        if (entry < 0)
+        {
+            if (slot >= 0)
+                delete_spend(pool, slot);
+        }
+        else if (slot >= 0)
+            pool->spends[slot].entry = entry;
+        else
+        {
+            put_spend(pool->spends, pool->spend_capacity, input.prev_txid, input.index, entry);
+            pool->spend_count++;
+        }
+    }
+}
+
+// Smallest size class that holds the transaction
+static SlabPool *tx_pool(Mempool *pool, size_t length)
+{
+    int size_class = 0;
+    while (size_class < MEMPOOL_SIZE_CLASSES - 1 && length > pool->tx_pools[size_class].record_size)
+        size_class++;
+    return &pool->tx_pools[size_class];
+}
+
+/* ================ MEMPOOL ================ */
+void mempool_init(Mempool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    for (int i = 0; i < MEMPOOL_SIZE_CLASSES; i++)
+        slab_pool_init(&pool->tx_pools[i], (size_t)MAX_TX_SIZE >> (MEMPOOL_SIZE_CLASSES - 1 - i), ALLOC_MEMPOOL_TX);
+}
+
+void mempool_free(Mempool *pool)
+{
+    for (int i = 0; i < MEMPOOL_SIZE_CLASSES; i++)
+        slab_pool_destroy(&pool->tx_pools[i]);
+    free(pool->entries);
+    free(pool->slots);
+    free(pool->spends);
+    mempool_init(pool);
+}
+
+const MempoolEntry *mempool_find(const Mempool *pool, const unsigned char txid[TXID_SIZE])
+{
+    if (pool->count == 0)
+        return NULL;
+    int slot = find_slot(pool, txid);
+    return slot >= 0 ? &pool->entries[pool->slots[slot]] : NULL;
+}
+
+// Copies the encoded transaction into a record of the smallest size class that holds it.
+// Refused if a pending transaction already spends one of its inputs.
+int mempool_add(Mempool *pool, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    unsigned char txid[TXID_SIZE];
+    TxView view;
+    const unsigned char *cursor;
+    compute_txid(tx, length, txid);
+    if (mempool_find(pool, txid))
+        return 0;
+    if (length > MAX_TX_SIZE || !tx_view_parse(tx, length, &view))
+        return 0;
+    cursor = view.inputs;
+    for (int i = 0; i < view.input_count; i++)
+    {
+        TxInputView input;
+        tx_next_input(&cursor, &input);
+        if (find_spend(pool, input.prev_txid, input.index) >= 0)
+            return 0;
+    }
+    if (pool->count == pool->capacity && !grow(pool))
+        return 0;
+    if (!reserve_spends(pool, view.input_count))
+        return 0;
+    unsigned char *copy = slab_alloc(tx_pool(pool, length));
+    if (!copy)
+        return 0;
+    memcpy(copy, tx, length);
+
+    MempoolEntry *entry = &pool->entries[pool->count];
+    memcpy(entry->txid, txid, TXID_SIZE);
+    entry->tx = copy;
+    entry->length = length;
+    entry->witness = *witness;
+    put_slot(pool->slots, pool->slot_capacity, pool->entries, pool->count);
+    index_spends(pool, entry, pool->count);
+    pool->count++;
+    metrics_gauge_set(GAUGE_MEMPOOL_SIZE, pool->count);
+    return 1;
+}
+
+int mempool_remove(Mempool *pool, const unsigned char txid[TXID_SIZE])
+{
+    if (pool->count == 0)
+        return 0;
+    int slot = find_slot(pool, txid);
+    if (slot < 0)
+        return 0;
+
+    int index = pool->slots[slot];
+    int mask = pool->slot_capacity - 1;
+    index_spends(pool, &pool->entries[index], -1);
+    slab_free(tx_pool(pool, pool->entries[index].length), pool->entries[index].tx);
+
+    // Backward-shift deletion keeps every probe chain unbroken without tombstones
+    int hole = slot;
+    int next = (hole + 1) & mask;
+    while (pool->slots[next] >= 0)
+    {
+        int home = (int)(txid_key(pool->entries[pool->slots[next]].txid) & (uint64_t)mask);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pool->slots[hole] = pool->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    pool->slots[hole] = -1;
+
+    // Keep entries dense by moving the last one into the freed position
+    int last = pool->count - 1;
+    if (index != last)
+    {
+        int moved_slot = find_slot(pool, pool->entries[last].txid);
+        pool->entries[index] = pool->entries[last];
+        pool->slots[moved_slot] = index;
+        index_spends(pool, &pool->entries[index], index);
+    }
+    pool->count--;
+    metrics_gauge_set(GAUGE_MEMPOOL_SIZE, pool->count);
+    return 1;
+}
+
+void mempool_remove_block(Mempool *pool, const Block *block)
+{
+    unsigned char txid[TXID_SIZE];
+    if (pool->count == 0)
+        return; // Common while syncing; skips hashing every transaction again
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        size_t length;
+        const unsigned char *tx = block_transaction_bytes(block, i, &length);
+        compute_txid(tx, length, txid);
+        mempool_remove(pool, txid);
+    }
+}
+
+// Whether a pending transaction already spends this output: one probe of the outpoint index
+int mempool_spends(const Mempool *pool, const unsigned char txid[TXID_SIZE], uint32_t index)
+{
+    return find_spend(pool, txid, index) >= 0;
+}
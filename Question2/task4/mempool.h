@@ -0,0 +1,49 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include "alloc.h"
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define MEMPOOL_SIZE_CLASSES 3 // Transaction pools of 128, 256 and MAX_TX_SIZE (512) bytes
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char txid[TXID_SIZE]; // Transaction identifier
+    unsigned char *tx;             // Encoded transaction (owned by the pool)
+    size_t length;                 // Bytes in tx
+    TxWitness witness;             // Its signature (all zero if unsigned)
+} MempoolEntry;
+
+// An output some pending transaction spends
+typedef struct
+{
+    unsigned char txid[TXID_SIZE]; // Transaction whose output is spent
+    uint32_t index;                // Which of its outputs
+    int entry;                     // Index of the spender in entries (-1 = empty slot)
+} MempoolSpend;
+
+typedef struct
+{
+    MempoolEntry *entries;                   // Dense array of pending transactions
+    int count;                               // Number of pending transactions
+    int capacity;                            // Allocated length of entries
+    int *slots;                              // Open-addressing index into entries (-1 = empty)
+    int slot_capacity;                       // Power of two
+    MempoolSpend *spends;                    // Open-addressing table of every outpoint spent
+    int spend_count;                         // Used slots in spends
+    int spend_capacity;                      // Power of two
+    SlabPool tx_pools[MEMPOOL_SIZE_CLASSES]; // Memory of the encoded transactions, by size
+} Mempool;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void mempool_init(Mempool *pool);
+void mempool_free(Mempool *pool);
+const MempoolEntry *mempool_find(const Mempool *pool, const unsigned char txid[TXID_SIZE]);
+int mempool_add(Mempool *pool, const unsigned char *tx, size_t length, const TxWitness *witness);
+int mempool_remove(Mempool *pool, const unsigned char txid[TXID_SIZE]);
+void mempool_remove_block(Mempool *pool, const Block *block);
+int mempool_spends(const Mempool *pool, const unsigned char txid[TXID_SIZE], uint32_t index);
+
+#endif
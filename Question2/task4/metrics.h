@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define METRICS_SHARDS 16     // Copies of every counter and histogram; each thread updates one
+#define METRICS_SUB_BUCKETS 4 // Linear steps inside each power of two of a histogram
+#define METRICS_BUCKETS 160   // Histogram buckets: exact below 4 ns, log-linear up to 2^40 ns
+
+#define METRIC_HASHES 0           // Block header hashes computed while mining
+#define METRIC_BLOCKS_CONNECTED 1 // Blocks connected to the active chain
+#define METRIC_TX_APPLIED 2       // Transactions applied to a UTXO set
+#define METRIC_UTXO_LOOKUPS 3     // Outpoints looked up in a UTXO set
+#define METRIC_UTXO_DB_READS 4    // Lookups the cache had to send to the coin database
+#define METRIC_RPC_REQUESTS 5     // JSON-RPC calls answered
+#define METRIC_COUNTERS 6
+
+#define GAUGE_MEMPOOL_SIZE 0     // Transactions waiting in the mempool
+#define GAUGE_CHAIN_HEIGHT 1     // Height of the active tip
+#define GAUGE_UTXO_COINS 2       // Unspent outputs of the active chain
+#define GAUGE_BLOCK_FILE_BYTES 3 // Block files on disk
+#define GAUGE_PRUNED_HEIGHT 4    // Highest height whose body may have been pruned
+#define METRIC_GAUGES 5
+
+#define HISTOGRAM_BLOCK_CONNECT 0 // Applying one block's transactions to the UTXO set
+#define HISTOGRAM_TX_APPLY 1      // Applying one transaction
+#define HISTOGRAM_RPC_REQUEST 2   // Answering one HTTP request
+#define METRIC_HISTOGRAMS 3
+
+/* ================ FUNCTION PROTOTYPES ================ */
+uint64_t metrics_now_ns(void);
+void metrics_count(int counter, uint64_t amount);
+void metrics_gauge_set(int gauge, int64_t value);
+void metrics_observe_ns(int histogram, uint64_t ns);
+uint64_t metrics_counter_value(int counter);
+void metrics_render(ByteWriter *out);
+int run_metrics_benchmark(int threads, int iterations);
+
+#endif
@@ -0,0 +1,107 @@
+#include <pthread.h>
+#include "miner.h"
+#include "metrics.h"
+#include "trace.h"
+#include "retarget.h"
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    const Block *templ;    // Header being solved (merkle root and bits already set)
+    uint32_t bits;         // Compact target
+    int step;              // Thread count; worker i tries nonces i, i + step, ...
+    int done;              // Set once any worker finds a solution
+    int winning_nonce;     // Nonce of the first solution found
+    char hash[HASH_SIZE];  // Its hash
+    pthread_mutex_t lock;  // Guards done/winning_nonce/hash
+} SearchState;
+
+typedef struct
+{
+    SearchState *search; // Shared by every worker
+    int first_nonce;     // This worker's starting nonce
+    int attempts;        // Hashes this worker computed
+} SearchWorker;
+
+/* ================ NONCE SEARCH ================ */
+static void *search_nonces(void *argument)
+{
+    SearchWorker *worker = argument;
+    SearchState *search = worker->search;
+    Block block = *search->templ;
+    char hash[HASH_SIZE];
+    uint64_t started = trace_begin();
+
+    for (block.nonce = worker->first_nonce; !__atomic_load_n(&search->done, __ATOMIC_RELAXED); block.nonce += search->step)
+    {
+        hash_block_header(&block, hash);
+        worker->attempts++;
+        if (!hash_meets_target(hash, search->bits))
+            continue;
+
+        pthread_mutex_lock(&search->lock);
+        if (!search->done)
+        {
+            search->winning_nonce = block.nonce;
+            strcpy(search->hash, hash);
+            __atomic_store_n(&search->done, 1, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&search->lock);
+        break;
+    }
+    // One span per worker per block: a span per hash would cost more than the hash and flood the ring
+    trace_end("search_nonces", "hashes", worker->attempts, started);
+    return NULL;
+}
+
+void solve_block_bits(Block *block, uint32_t bits, int threads, int *nonce_attempts)
+{
+    compute_merkle_root(block, block->merkle_root);
+    solve_block_header(block, bits, threads, nonce_attempts);
+}
+
+// Like solve_block_bits, for a template whose Merkle root was already computed
+void solve_block_header(Block *block, uint32_t bits, int threads, int *nonce_attempts)
+{
+    block->target_bits = bits;
+    block->difficulty = target_leading_zeros(bits);
+    block->nonce = 0;
+    *nonce_attempts = 0;
+    if (threads < 1)
+        threads = 1;
+    if (threads > MINER_MAX_THREADS)
+        threads = MINER_MAX_THREADS;
+
+    SearchState search = {0};
+    search.templ = block;
+    search.bits = bits;
+    search.step = threads;
+    pthread_mutex_init(&search.lock, NULL);
+
+    // Worker 0 runs on the calling thread, so single-threaded mining never spawns anything
+    SearchWorker workers[MINER_MAX_THREADS];
+    pthread_t handles[MINER_MAX_THREADS];
+    int started = 1;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].search = &search;
+        workers[i].first_nonce = i;
+        workers[i].attempts = 0;
+    }
+    // If a thread fails to start, its nonces are skipped; the others still cover infinitely many
+    for (int i = 1; i < threads; i++, started++)
+    {
+        if (pthread_create(&handles[i], NULL, search_nonces, &workers[i]) != 0)
+            break;
+    }
+    search_nonces(&workers[0]);
+    for (int i = 1; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    for (int i = 0; i < started; i++)
+        *nonce_attempts += workers[i].attempts;
+    metrics_count(METRIC_HASHES, (uint64_t)*nonce_attempts);
+    block->nonce = search.winning_nonce;
+    strcpy(block->hash, search.hash);
+    pthread_mutex_destroy(&search.lock);
+}
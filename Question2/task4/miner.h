@@ -0,0 +1,14 @@
+#ifndef MINER_H
+#define MINER_H
+
+#include <stdint.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define MINER_MAX_THREADS 64 // Upper bound for solve_block_bits threads
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void solve_block_bits(Block *block, uint32_t bits, int threads, int *nonce_attempts);
+void solve_block_header(Block *block, uint32_t bits, int threads, int *nonce_attempts);
+
+#endif
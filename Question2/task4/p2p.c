@@ -0,0 +1,1674 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "p2p.h"
+#include "alloc.h"
+#include "block_tree.h"
+#include "coindb.h"
+#include "sync.h"
+#include "miner.h"
+#include "rpc.h"
+#include "stratum.h"
+#include "trace.h"
+#include "txqueue.h"
+
+#define LISTEN_TAG ((uint64_t)-1) // epoll data for the listening socket
+#define STDIN_TAG ((uint64_t)-2)  // epoll data for the command line
+
+/* ================ TIME ================ */
+uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/* ================ SOCKETS ================ */
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static void tune_socket(int fd)
+{
+    // Small frames must leave immediately; Nagle would add up to 40ms per hop
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static Peer *find_peer(Node *node, uint64_t tag)
+{
+    for (int i = 0; i < node->peer_count; i++)
+    {
+        if ((uint64_t)node->peers[i]->id == tag)
+            return node->peers[i];
+    }
+    return NULL;
+}
+
+static void update_events(Node *node, Peer *peer, int want_write)
+{
+    if (peer->want_write == want_write)
+        return;
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+    event.data.u64 = (uint64_t)peer->id;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_MOD, peer->fd, &event);
+    peer->want_write = want_write;
+}
+
+static void drop_peer(Node *node, Peer *peer)
+{
+    for (int i = 0; i < node->peer_count; i++)
+    {
+        if (node->peers[i] == peer)
+        {
+            node->peers[i] = node->peers[--node->peer_count];
+            break;
+        }
+    }
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, peer->fd, NULL);
+    close(peer->fd);
+    sync_peer_dropped(node, peer);
+    free(peer->rbuf);
+    free(peer->wbuf);
+    free(peer);
+}
+
+static int flush_peer(Node *node, Peer *peer)
+{
+    size_t written = 0;
+    while (written < peer->wlen)
+    {
+        ssize_t n = send(peer->fd, peer->wbuf + written, peer->wlen - written, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            written += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return 0;
+    }
+    node->bytes_sent += written;
+    memmove(peer->wbuf, peer->wbuf + written, peer->wlen - written);
+    peer->wlen -= written;
+    update_events(node, peer, peer->wlen > 0);
+    return 1;
+}
+
+static Peer *add_peer(Node *node, int fd);
+
+/* ================ FRAMING ================ */
+// A peer that lets its queue reach P2P_MAX_SEND is only marked here, since callers may be walking
+// the peer list; node_poll disconnects it once the current events are handled
+static void queue_frame(Peer *peer, int type, const ByteWriter *payload)
+{
+    size_t frame = P2P_HEADER_SIZE + payload->length;
+    if (peer->overflowed || peer->wlen + frame > P2P_MAX_SEND)
+    {
+        peer->overflowed = 1;
+        return;
+    }
+    if (peer->wlen + frame > peer->wcap)
+    {
+        size_t capacity = peer->wcap ? peer->wcap : 4096;
+        while (capacity < peer->wlen + frame)
+            capacity *= 2;
+        unsigned char *wbuf = realloc(peer->wbuf, capacity);
+        if (!wbuf)
+            return;
+        peer->wbuf = wbuf;
+        peer->wcap = capacity;
+    }
+
+    unsigned char *out = peer->wbuf + peer->wlen;
+    uint32_t magic = P2P_MAGIC, length = (uint32_t)payload->length;
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (unsigned char)(magic >> (8 * i));
+        out[5 + i] = (unsigned char)(length >> (8 * i));
+    }
+    out[4] = (unsigned char)type;
+    if (payload->length)
+        memcpy(out + P2P_HEADER_SIZE, payload->data, payload->length);
+    peer->wlen += frame;
+}
+
+void node_send(Node *node, Peer *peer, int type, const ByteWriter *payload)
+{
+    queue_frame(peer, type, payload);
+
+    // Write straight away; only fall back to EPOLLOUT if the socket is full
+    if (!peer->want_write && !peer->overflowed)
+        flush_peer(node, peer);
+}
+
+void node_broadcast(Node *node, Peer *except, int type, const ByteWriter *payload)
+{
+    for (int i = 0; i < node->peer_count; i++)
+    {
+        if (node->peers[i] != except)
+            node_send(node, node->peers[i], type, payload);
+    }
+}
+
+static void send_item(Node *node, Peer *to, Peer *except, int message, int item_type, const unsigned char raw[32])
+{
+    ByteWriter payload;
+    writer_init(&payload);
+    put_u16(&payload, 1);
+    put_u8(&payload, (uint8_t)item_type);
+    put_bytes(&payload, raw, 32);
+    if (to)
+        node_send(node, to, message, &payload);
+    else
+        node_broadcast(node, except, message, &payload);
+    writer_free(&payload);
+}
+
+static void send_block_item(Node *node, Peer *to, Peer *except, int message, const char *hex_hash)
+{
+    unsigned char raw[32];
+    hex_to_bytes(hex_hash, raw, sizeof(raw));
+    send_item(node, to, except, message, INV_BLOCK, raw);
+}
+
+/* ================ BLOCK HANDLING ================ */
+static void remove_mined_transactions(Node *node, int connected)
+{
+    BlockNode *tip = node->chain->tree->active;
+    for (int i = 0; i < connected && tip; i++, tip = tip->parent)
+    {
+        mempool_remove_block(&node->mempool, &tip->block);
+    }
+}
+
+static void store_orphan(Node *node, const Block *block)
+{
+    for (int i = 0; i < node->orphan_count; i++)
+    {
+        if (strcmp(node->orphans[i].hash, block->hash) == 0)
+            return;
+    }
+    node->orphans[node->orphan_next] = *block;
+    node->orphan_next = (node->orphan_next + 1) % P2P_MAX_ORPHANS;
+    if (node->orphan_count < P2P_MAX_ORPHANS)
+        node->orphan_count++;
+}
+
+static void relay_compact_block(Node *node, Peer *from, const Block *block)
+{
+    // New tips are pushed without an inv round trip; peers rebuild them from their mempools
+    CompactBlock compact;
+    ByteWriter payload;
+    uint64_t salt = ((uint64_t)rand() << 32) ^ (uint64_t)rand() ^ monotonic_ns();
+    compact_block_from_block(&compact, block, salt);
+    writer_init(&payload);
+    serialize_compact_block(&payload, &compact);
+    node_broadcast(node, from, MSG_CMPCTBLOCK, &payload);
+    writer_free(&payload);
+}
+
+void node_process_block(Node *node, Peer *from, const Block *block, int validated)
+{
+    int disconnected = 0, connected = 0, status;
+    if (validated)
+    {
+        BlockNode *inserted;
+        status = block_tree_insert_validated(node->chain->tree, block, &inserted);
+        if (status == TREE_ACCEPTED && !block_tree_activate_best(node->chain->tree, node->chain, &disconnected, &connected))
+            status = TREE_INVALID;
+        else if (status == TREE_ACCEPTED && inserted->failed)
+            status = TREE_BAD_LEDGER;
+    }
+    else
+    {
+        status = submit_block(node->chain, block, &disconnected, &connected);
+    }
+
+    if (status == TREE_ORPHAN || status == TREE_NEED_DATA)
+    {
+        store_orphan(node, block);
+        if (from && !sync_in_progress(node))
+            send_block_item(node, from, NULL, MSG_GETDATA, block->previous_hash);
+        return;
+    }
+    if (status != TREE_ACCEPTED)
+        return;
+
+    if (connected > 0)
+    {
+        remove_mined_transactions(node, connected);
+        if (node->on_tip)
+            node->on_tip(node, node->callback_context);
+        // Work on the old tip is wasted from here on
+        stratum_new_job(node);
+    }
+    // A node still catching up has nothing new to tell its peers
+    if (connected > 0 && node->compact_relay && !sync_in_progress(node))
+        relay_compact_block(node, from, block);
+    else if (!sync_in_progress(node))
+        send_block_item(node, NULL, from, MSG_INV, block->hash);
+
+    // Any orphan waiting on this block can now be connected
+    for (int i = 0; i < node->orphan_count; i++)
+    {
+        if (strcmp(node->orphans[i].previous_hash, block->hash) == 0)
+        {
+            Block child = node->orphans[i];
+            node->orphans[i] = node->orphans[--node->orphan_count];
+            node->orphan_next = node->orphan_count;
+            node_process_block(node, NULL, &child, 0);
+            i = -1;
+        }
+    }
+}
+
+// Applied to the live UTXO set and undone straight away; nothing else touches the set in between
+static int ledger_accepts(Node *node, const TxView *tx)
+{
+    UtxoSet *utxos = &node->chain->tree->utxos;
+    const unsigned char *cursor = tx->inputs;
+    BlockUndo undo = {0};
+    for (int i = 0; i < tx->input_count; i++)
+    {
+        TxInputView input;
+        tx_next_input(&cursor, &input);
+        if (mempool_spends(&node->mempool, input.prev_txid, input.index))
+            return 0;
+    }
+    int ok = ledger_connect_transaction(utxos, tx, node->chain->block_count, &undo);
+    if (ok)
+        ledger_disconnect_transaction(utxos, tx, &undo);
+    block_undo_free(&undo);
+    return ok;
+}
+
+static int relay_transaction(Node *node, Peer *from, const TxView *tx, const TxWitness *witness)
+{
+    // Checked and cached on admission, so validating a block built from these skips the signatures
+    if (!ledger_accepts(node, tx) || !check_transaction_signature(tx, witness, 1) ||
+        !mempool_add(&node->mempool, tx->data, tx->length, witness))
+        return 0;
+
+    unsigned char txid[TXID_SIZE];
+    compute_txid(tx->data, tx->length, txid);
+    send_item(node, NULL, from, MSG_INV, INV_TX, txid);
+    return 1;
+}
+
+int node_submit_transaction(Node *node, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    TxView view;
+    TxWitness unsigned_witness = {0};
+    if (!tx_view_parse(tx, length, &view))
+        return 0;
+    return relay_transaction(node, NULL, &view, witness ? witness : &unsigned_witness);
+}
+
+/* ================ INGESTION ================ */
+// Producers on any thread feed the ring; the event loop admits what the workers validated
+int node_start_ingest(Node *node, int workers)
+{
+    TxIngest *ingest = malloc(sizeof(TxIngest));
+    int fd = eventfd(0, EFD_NONBLOCK);
+    if (!ingest || fd < 0 || !tx_ingest_start(ingest, TXQUEUE_DEFAULT_SLOTS, workers, fd))
+    {
+        free(ingest);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = INGEST_EVENT_TAG;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    node->ingest = ingest;
+    node->ingest_fd = fd;
+    return 1;
+}
+
+// Thread-safe: 1 if queued for validation, 0 if the pipeline is full (retry later), INGEST_TOO_LARGE or
+// INGEST_NO_RING. from (NULL: local) is remembered by ID, so admission does not echo the inv back to it.
+int node_ingest_transaction(Node *node, const unsigned char *tx, size_t length, const TxWitness *witness, Peer *from)
+{
+    if (!node->ingest)
+        return INGEST_NO_RING;
+    return tx_ingest_submit(node->ingest, tx, length, witness, from ? from->id : -1);
+}
+
+static void drain_ingest(Node *node)
+{
+    eventfd_t signalled;
+    eventfd_read(node->ingest_fd, &signalled);
+    tx_ingest_rearm(node->ingest);
+
+    TxSubmission submission;
+    while (tx_ingest_next(node->ingest, &submission))
+    {
+        // The origin may have disconnected since; its ID is never reused, so the lookup just misses
+        Peer *from = submission.origin >= 0 ? find_peer(node, (uint64_t)submission.origin) : NULL;
+        TxView view;
+        if (tx_view_parse(submission.tx, submission.length, &view) &&
+            relay_transaction(node, from, &view, &submission.witness))
+            node->ingest_admitted++;
+        else
+            node->ingest_dropped++;
+    }
+}
+
+static void stop_ingest(Node *node)
+{
+    if (!node->ingest)
+        return;
+    tx_ingest_stop(node->ingest);
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, node->ingest_fd, NULL);
+    close(node->ingest_fd);
+    free(node->ingest);
+    node->ingest = NULL;
+    node->ingest_fd = -1;
+}
+
+static void build_block_template(Node *node, Block *block)
+{
+    const Blockchain *chain = node->chain;
+    UtxoSet *utxos = &chain->tree->utxos;
+    BlockUndo undo = {0};
+    memset(block, 0, sizeof(*block));
+    block->timestamp = time(NULL);
+
+    if (chain->block_count == 0)
+    {
+        block->index = 0;
+        block_add_text_transaction(block, "Genesis Transaction");
+        strcpy(block->previous_hash, "0000000000000000000000000000000000000000000000000000000000000000");
+        return;
+    }
+
+    const Block *tip = &chain->blocks[chain->block_count - 1];
+    block->index = tip->index + 1;
+    strcpy(block->previous_hash, tip->hash);
+    // The reward goes to the wallet; the height in the memo keeps every coinbase's txid distinct
+    if (node->has_wallet)
+    {
+        Transaction coinbase = {0};
+        unsigned char encoded[MAX_TX_SIZE];
+        strcpy(coinbase.outputs[0].address, node->wallet.address);
+        coinbase.outputs[0].amount = BLOCK_REWARD;
+        coinbase.output_count = 1;
+        snprintf(coinbase.memo, sizeof(coinbase.memo), "block %d", block->index);
+        size_t length = transaction_encode(&coinbase, encoded, sizeof(encoded));
+        block_add_transaction(block, encoded, length, NULL);
+    }
+    // Oldest first until the block runs out of transaction slots or bytes. Each one is applied to
+    // the UTXO set as it goes in, so entries a reorg or a rival block made unspendable are skipped.
+    int first = block->transaction_count;
+    for (int i = 0; i < node->mempool.count && block->transaction_count < MAX_TRANSACTIONS; i++)
+    {
+        const MempoolEntry *entry = &node->mempool.entries[i];
+        TxView view;
+        if (!tx_view_parse(entry->tx, entry->length, &view) ||
+            !ledger_connect_transaction(utxos, &view, block->index, &undo))
+            continue;
+        if (!block_add_transaction(block, entry->tx, entry->length, &entry->witness))
+            ledger_disconnect_transaction(utxos, &view, &undo);
+    }
+    for (int i = block->transaction_count - 1; i >= first; i--)
+    {
+        TxView view;
+        block_transaction(block, i, &view);
+        ledger_disconnect_transaction(utxos, &view, &undo);
+    }
+    block_undo_free(&undo);
+}
+
+// Mempool transactions on top of the active tip; returns the target the block has to meet
+uint32_t node_block_template(Node *node, Block *block)
+{
+    build_block_template(node, block);
+    if (node->retarget.algorithm != RETARGET_FIXED && node->chain->block_count > 0)
+        return retarget_next_chain_bits(&node->retarget, node->chain);
+    return target_bits_from_difficulty(node->difficulty);
+}
+
+int node_mine_block(Node *node)
+{
+    Block block;
+    int nonce_attempts;
+    uint32_t bits = node_block_template(node, &block);
+    solve_block_bits(&block, bits, node->mining_threads, &nonce_attempts);
+
+    int before = node->chain->block_count;
+    node_process_block(node, NULL, &block, 0);
+    return node->chain->block_count > before;
+}
+
+/* ================ MESSAGE HANDLING ================ */
+static void handle_inv(Node *node, Peer *peer, ByteReader *reader)
+{
+    ByteWriter request;
+    writer_init(&request);
+    int count = get_u16(reader), wanted = 0;
+    put_u16(&request, 0);
+
+    for (int i = 0; i < count && reader->ok; i++)
+    {
+        int type = get_u8(reader);
+        unsigned char raw[32];
+        char hex[HASH_SIZE];
+        get_bytes(reader, raw, sizeof(raw));
+        bytes_to_hex(raw, sizeof(raw), hex);
+
+        // Blocks arrive through the download window until the initial sync is done
+        int known = type == INV_BLOCK ? block_tree_find_block(node->chain->tree, hex) != NULL || sync_in_progress(node)
+                                      : mempool_find(&node->mempool, raw) != NULL;
+        if (!known)
+        {
+            put_u8(&request, (uint8_t)type);
+            put_bytes(&request, raw, sizeof(raw));
+            wanted++;
+        }
+    }
+
+    if (wanted > 0 && reader->ok)
+    {
+        request.data[0] = (unsigned char)wanted;
+        request.data[1] = (unsigned char)(wanted >> 8);
+        node_send(node, peer, MSG_GETDATA, &request);
+    }
+    writer_free(&request);
+}
+
+static void handle_getdata(Node *node, Peer *peer, ByteReader *reader)
+{
+    int count = get_u16(reader);
+    for (int i = 0; i < count && reader->ok; i++)
+    {
+        int type = get_u8(reader);
+        unsigned char raw[32];
+        char hex[HASH_SIZE];
+        get_bytes(reader, raw, sizeof(raw));
+        bytes_to_hex(raw, sizeof(raw), hex);
+
+        ByteWriter reply;
+        writer_init(&reply);
+        if (type == INV_BLOCK)
+        {
+            // Batched requests go out in one write instead of one per block
+            // A pruned node still knows the header but no longer has the body to send
+            const BlockNode *found = block_tree_find_block(node->chain->tree, hex);
+            if (found && !found->pruned)
+            {
+                serialize_block(&reply, &found->block);
+                queue_frame(peer, MSG_BLOCK, &reply);
+            }
+        }
+        else if (type == INV_TX)
+        {
+            const MempoolEntry *entry = mempool_find(&node->mempool, raw);
+            if (entry)
+            {
+                serialize_transaction(&reply, entry->tx, entry->length, &entry->witness);
+                node_send(node, peer, MSG_TX, &reply);
+            }
+        }
+        writer_free(&reply);
+    }
+    if (peer->wlen > 0 && !peer->want_write)
+        flush_peer(node, peer);
+}
+
+static CompactBlock *find_pending(Node *node, const char *hash)
+{
+    for (int i = 0; i < P2P_MAX_PENDING; i++)
+    {
+        if (node->pending[i].block.hash[0] && strcmp(node->pending[i].block.hash, hash) == 0)
+            return &node->pending[i];
+    }
+    return NULL;
+}
+
+static void finish_compact_block(Node *node, Peer *peer, CompactBlock *compact)
+{
+    int valid = compact_block_is_valid(compact);
+    Block block = compact->block;
+    compact->block.hash[0] = '\0'; // Releases the pending slot
+    if (valid)
+        node_process_block(node, peer, &block, 0);
+    else
+        send_block_item(node, peer, NULL, MSG_GETDATA, block.hash);
+}
+
+static void handle_cmpctblock(Node *node, Peer *peer, ByteReader *reader)
+{
+    CompactBlock compact;
+    if (sync_in_progress(node) || !deserialize_compact_block(reader, &compact) ||
+        block_tree_find_block(node->chain->tree, compact.block.hash) || find_pending(node, compact.block.hash))
+        return;
+
+    // Without the parent we cannot connect it anyway, so fetch the whole block
+    if (!block_tree_find_block(node->chain->tree, compact.block.previous_hash) ||
+        compact_block_fill_from_mempool(&compact, &node->mempool) < 0)
+    {
+        send_block_item(node, peer, NULL, MSG_GETDATA, compact.block.hash);
+        return;
+    }
+    if (compact.missing == 0)
+    {
+        finish_compact_block(node, peer, &compact);
+        return;
+    }
+
+    ByteWriter request;
+    writer_init(&request);
+    put_hash(&request, compact.block.hash);
+    put_u8(&request, (uint8_t)compact.missing);
+    for (int i = 0; i < compact.block.transaction_count; i++)
+    {
+        if (!compact.have[i])
+            put_u8(&request, (uint8_t)i);
+    }
+    node_send(node, peer, MSG_GETBLOCKTXN, &request);
+    writer_free(&request);
+
+    node->pending[node->pending_next] = compact;
+    node->pending_next = (node->pending_next + 1) % P2P_MAX_PENDING;
+}
+
+static void handle_getblocktxn(Node *node, Peer *peer, ByteReader *reader)
+{
+    char hash[HASH_SIZE];
+    get_hash(reader, hash);
+    int count = get_u8(reader);
+    const BlockNode *found = block_tree_find_block(node->chain->tree, hash);
+    if (!reader->ok || !found || found->pruned)
+        return;
+
+    ByteWriter reply;
+    writer_init(&reply);
+    put_hash(&reply, hash);
+    put_u8(&reply, 0);
+    int sent = 0;
+    for (int i = 0; i < count && reader->ok; i++)
+    {
+        int position = get_u8(reader);
+        if (position >= found->block.transaction_count)
+            continue;
+        size_t length;
+        const unsigned char *tx = block_transaction_bytes(&found->block, position, &length);
+        put_u8(&reply, (uint8_t)position);
+        serialize_transaction(&reply, tx, length, &found->block.witnesses[position]);
+        sent++;
+    }
+    reply.data[32] = (unsigned char)sent;
+    node_send(node, peer, MSG_BLOCKTXN, &reply);
+    writer_free(&reply);
+}
+
+static void handle_blocktxn(Node *node, Peer *peer, ByteReader *reader)
+{
+    char hash[HASH_SIZE];
+    get_hash(reader, hash);
+    int count = get_u8(reader);
+    CompactBlock *compact = find_pending(node, hash);
+    if (!reader->ok || !compact)
+        return;
+
+    for (int i = 0; i < count; i++)
+    {
+        TxView tx;
+        TxWitness witness;
+        int position = get_u8(reader);
+        if (!deserialize_transaction(reader, &tx, &witness))
+            break;
+        compact_block_fill_transaction(compact, position, tx.data, tx.length, &witness);
+    }
+    if (compact->missing == 0)
+        finish_compact_block(node, peer, compact);
+    else
+    {
+        compact->block.hash[0] = '\0';
+        send_block_item(node, peer, NULL, MSG_GETDATA, hash);
+    }
+}
+
+static void handle_message(Node *node, Peer *peer, int type, const unsigned char *payload, size_t length)
+{
+    ByteReader reader;
+    reader_init(&reader, payload, length);
+
+    switch (type)
+    {
+    case MSG_INV:
+        handle_inv(node, peer, &reader);
+        break;
+    case MSG_GETDATA:
+        handle_getdata(node, peer, &reader);
+        break;
+    case MSG_BLOCK:
+    {
+        Block block;
+        if (deserialize_block(&reader, &block) && !sync_handle_block(node, peer, &block))
+            node_process_block(node, peer, &block, 0);
+        break;
+    }
+    case MSG_CMPCTBLOCK:
+        handle_cmpctblock(node, peer, &reader);
+        break;
+    case MSG_GETBLOCKTXN:
+        handle_getblocktxn(node, peer, &reader);
+        break;
+    case MSG_BLOCKTXN:
+        handle_blocktxn(node, peer, &reader);
+        break;
+    case MSG_GETHEADERS:
+        sync_handle_getheaders(node, peer, &reader);
+        break;
+    case MSG_HEADERS:
+        sync_handle_headers(node, peer, &reader);
+        break;
+    case MSG_TX:
+    {
+        TxView tx;
+        TxWitness witness;
+        // Signatures are checked on the ingest workers, not here; a full ring drops the relay like a busy peer
+        if (deserialize_transaction(&reader, &tx, &witness) &&
+            node_ingest_transaction(node, tx.data, tx.length, &witness, peer) == INGEST_NO_RING)
+            relay_transaction(node, peer, &tx, &witness);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static int is_block_relay(int type, const unsigned char *payload, size_t length)
+{
+    if (type == MSG_INV || type == MSG_GETDATA)
+        return length > 2 && payload[2] == INV_BLOCK;
+    return type == MSG_BLOCK || type == MSG_CMPCTBLOCK || type == MSG_GETBLOCKTXN || type == MSG_BLOCKTXN;
+}
+
+static int read_peer(Node *node, Peer *peer)
+{
+    for (;;)
+    {
+        if (peer->rcap - peer->rlen < 4096)
+        {
+            size_t capacity = peer->rcap ? peer->rcap * 2 : 8192;
+            unsigned char *rbuf = realloc(peer->rbuf, capacity);
+            if (!rbuf)
+                return 0;
+            peer->rbuf = rbuf;
+            peer->rcap = capacity;
+        }
+        ssize_t n = recv(peer->fd, peer->rbuf + peer->rlen, peer->rcap - peer->rlen, 0);
+        if (n > 0)
+        {
+            peer->rlen += (size_t)n;
+            node->bytes_received += (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return 0; // Closed or failed
+    }
+
+    size_t offset = 0;
+    while (peer->rlen - offset >= P2P_HEADER_SIZE)
+    {
+        const unsigned char *frame = peer->rbuf + offset;
+        uint32_t magic = 0, length = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            magic |= (uint32_t)frame[i] << (8 * i);
+            length |= (uint32_t)frame[5 + i] << (8 * i);
+        }
+        if (magic != P2P_MAGIC || length > P2P_MAX_PAYLOAD)
+            return 0;
+        if (peer->rlen - offset < P2P_HEADER_SIZE + length)
+            break;
+        if (is_block_relay(frame[4], frame + P2P_HEADER_SIZE, length))
+            node->block_bytes_received += P2P_HEADER_SIZE + length;
+        handle_message(node, peer, frame[4], frame + P2P_HEADER_SIZE, length);
+        offset += P2P_HEADER_SIZE + length;
+    }
+    memmove(peer->rbuf, peer->rbuf + offset, peer->rlen - offset);
+    peer->rlen -= offset;
+    return 1;
+}
+
+/* ================ NODE ================ */
+static Peer *add_peer(Node *node, int fd)
+{
+    if (node->peer_count >= P2P_MAX_PEERS || !set_nonblocking(fd))
+    {
+        close(fd);
+        return NULL;
+    }
+    tune_socket(fd);
+
+    Peer *peer = calloc(1, sizeof(Peer));
+    if (!peer)
+    {
+        close(fd);
+        return NULL;
+    }
+    peer->fd = fd;
+    peer->id = node->next_peer_id++;
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = (uint64_t)peer->id;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    node->peers[node->peer_count++] = peer;
+
+    // Let the new peer know where our chain ends; it will ask for what it lacks
+    if (node->chain->block_count > 0)
+        send_block_item(node, peer, NULL, MSG_INV, node->chain->blocks[node->chain->block_count - 1].hash);
+    sync_peer_added(node, peer);
+    return peer;
+}
+
+int node_init(Node *node, Blockchain *chain, int port, int difficulty)
+{
+    memset(node, 0, sizeof(*node));
+    node->chain = chain;
+    node->port = port;
+    node->difficulty = difficulty;
+    node->mining_threads = 1;
+    retarget_init(&node->retarget, RETARGET_FIXED, 1);
+    node->listen_fd = -1;
+    node->ingest_fd = -1;
+    node->compact_relay = 1;
+    mempool_init(&node->mempool);
+
+    node->epoll_fd = epoll_create1(0);
+    if (node->epoll_fd < 0)
+        return 0;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return 0;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 64) < 0 || !set_nonblocking(fd))
+    {
+        close(fd);
+        return 0;
+    }
+    node->listen_fd = fd;
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TAG;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    node->running = 1;
+    return 1;
+}
+
+void node_free(Node *node)
+{
+    sync_free(node);
+    stop_ingest(node);
+    rpc_stop(node);
+    stratum_stop(node);
+    while (node->peer_count > 0)
+        drop_peer(node, node->peers[0]);
+    if (node->listen_fd >= 0)
+        close(node->listen_fd);
+    if (node->epoll_fd >= 0)
+        close(node->epoll_fd);
+    mempool_free(&node->mempool);
+}
+
+int node_connect(Node *node, const char *host, int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return 0;
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(fd);
+        return 0;
+    }
+    return add_peer(node, fd) != NULL;
+}
+
+typedef struct
+{
+    Node *node;     // Owner of the wallet and mempool
+    uint64_t total; // Sum of the wallet's spendable coins
+} WalletScan;
+
+static int pending_spend(const Coin *coin, void *context)
+{
+    return mempool_spends(context, coin->outpoint.txid, coin->outpoint.index);
+}
+
+static int add_wallet_coin(const Coin *coin, void *context)
+{
+    WalletScan *scan = context;
+    if (strcmp(coin->address, scan->node->wallet.address) == 0 && !pending_spend(coin, &scan->node->mempool))
+        scan->total += coin->amount;
+    return 1;
+}
+
+// Unspent wallet coins that no pending transaction spends
+static uint64_t wallet_balance(Node *node)
+{
+    WalletScan scan = {node, 0};
+    utxo_set_for_each(&node->chain->tree->utxos, add_wallet_coin, &scan);
+    return scan.total;
+}
+
+// Funds a payment from its sender's coins, leaving out those a pending transaction already
+// spends. Returns what the gathered coins add up to (less than the outputs: not funded).
+uint64_t node_fund_payment(Node *node, Transaction *tx)
+{
+    return ledger_fund_payment(&node->chain->tree->utxos, tx, pending_spend, &node->mempool);
+}
+
+static void print_node_status(Node *node)
+{
+    const Blockchain *chain = node->chain;
+    printf(COLOR_BLUE "┌───────────────────────────────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24d " COLOR_BLUE "│\n", "Port:", node->port);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24d " COLOR_BLUE "│\n", "Peers:", node->peer_count);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24d " COLOR_BLUE "│\n", "Height:", chain->block_count - 1);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24d " COLOR_BLUE "│\n", "Mempool:", node->mempool.count);
+    char coins[64], amount[32];
+    format_amount(chain->tree->utxos.total, amount, sizeof(amount));
+    snprintf(coins, sizeof(coins), "%d coins, %s", chain->tree->utxos.count, amount);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "UTXO set:", coins);
+    snprintf(coins, sizeof(coins), "%d blocks, %.1f KiB", chain->tree->filters.count,
+             chain->tree->filters.bytes.length / 1024.0);
+    printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Filters:", coins);
+    if (chain->tree->addresses)
+    {
+        const AddressIndex *addresses = chain->tree->addresses;
+        snprintf(coins, sizeof(coins), "%d, %.1f KiB", addresses->count, addresses->bytes / 1024.0);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Addresses:", coins);
+    }
+    if (chain->tree->utxos.db)
+    {
+        const UtxoSet *utxos = &chain->tree->utxos;
+        snprintf(coins, sizeof(coins), "%zu KiB, %llu flushes", utxo_set_memory(utxos) / 1024,
+                 (unsigned long long)utxos->flushes);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Coin cache:", coins);
+        snprintf(coins, sizeof(coins), "%d runs, %llu lookups", utxos->db->run_count,
+                 (unsigned long long)utxos->db->lookups);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Coin DB:", coins);
+    }
+    if (chain->tree->store)
+    {
+        const BlockStore *store = chain->tree->store;
+        snprintf(coins, sizeof(coins), "%d files, %llu KiB", store->file_count,
+                 (unsigned long long)store->disk_bytes / 1024);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Block files:", coins);
+        if (store->pruned_height >= 0)
+        {
+            snprintf(coins, sizeof(coins), "to height %d, %llu files", store->pruned_height,
+                     (unsigned long long)store->pruned_files);
+            printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Pruned:", coins);
+        }
+    }
+    if (node->has_wallet)
+    {
+        format_amount(wallet_balance(node), amount, sizeof(amount));
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Wallet:", amount);
+    }
+    if (node->ingest)
+    {
+        char ingest[64];
+        snprintf(ingest, sizeof(ingest), "%llu in, %llu dropped", (unsigned long long)node->ingest_admitted,
+                 (unsigned long long)(node->ingest_dropped + node->ingest->rejected + node->ingest->dropped));
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Ingest:", ingest);
+    }
+    if (node->rpc)
+    {
+        char calls[64];
+        snprintf(calls, sizeof(calls), "%llu calls, %d open", (unsigned long long)node->rpc->requests,
+                 node->rpc->client_count);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "RPC:", calls);
+    }
+    if (node->stratum)
+    {
+        char work[64];
+        snprintf(work, sizeof(work), "%d workers, %llu shares", node->stratum->worker_count,
+                 (unsigned long long)node->stratum->accepted);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Stratum:", work);
+    }
+    SigCache *valid = signature_cache();
+    if (valid)
+    {
+        char hits[32];
+        uint64_t hit, miss, evicted;
+        sigcache_counts(valid, &hit, &miss, &evicted);
+        snprintf(hits, sizeof(hits), "%llu hit / %llu miss", (unsigned long long)hit, (unsigned long long)miss);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %-24s " COLOR_BLUE "│\n", "Sig cache:", hits);
+    }
+    if (chain->block_count > 0)
+    {
+        const char *tip = chain->blocks[chain->block_count - 1].hash;
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_RESET " %.12s...%.8s  " COLOR_BLUE "│\n", "Tip:", tip, tip + 56);
+    }
+    printf(COLOR_BLUE "└───────────────────────────────────────┘" COLOR_RESET "\n");
+}
+
+// Prints the first matches of a rescan and only counts the rest
+static int print_rescan_match(int height, int index, const TxView *tx, void *context)
+{
+    int *shown = context;
+    char text[TX_TEXT_SIZE];
+    if ((*shown)++ < 20)
+    {
+        tx_view_format(tx, text, sizeof(text));
+        printf(COLOR_GRAY "  #%-6d tx %-2d %s" COLOR_RESET "\n", height, index, text);
+    }
+    return 1;
+}
+
+static void handle_command(Node *node)
+{
+    char line[256];
+    if (!fgets(line, sizeof(line), stdin))
+    {
+        node->running = 0;
+        return;
+    }
+    line[strcspn(line, "\n")] = '\0';
+
+    if (strcmp(line, "mine") == 0)
+    {
+        if (node_mine_block(node))
+            printf(COLOR_GREEN "✔ Mined block #%d and announced it" COLOR_RESET "\n", node->chain->block_count - 1);
+        else
+            print_error("Mined block was not accepted");
+    }
+    else if (strncmp(line, "tx ", 3) == 0 && strlen(line + 3) > 0)
+    {
+        Transaction tx;
+        unsigned char encoded[MAX_TX_SIZE];
+        size_t length = 0;
+        int parsed = transaction_from_text(line + 3, &tx);
+        // A payment spends the sender's coins; a note needs none
+        int funded = !parsed || tx.output_count == 0 || node_fund_payment(node, &tx) >= tx.outputs[0].amount;
+        if (parsed && funded)
+            length = transaction_encode(&tx, encoded, sizeof(encoded));
+        if (!funded)
+            print_error("The sender does not hold enough unspent coins (new coins only come from block rewards)");
+        else if (length == 0)
+            print_error("Transaction too long");
+        else if (node_submit_transaction(node, encoded, length, NULL))
+            print_success("Transaction added to mempool and announced");
+        else
+            print_error("Transaction rejected (already in mempool, or its sender is a key address and must be signed)");
+    }
+    else if (strcmp(line, "keygen") == 0)
+    {
+        if (keypair_generate(&node->wallet))
+        {
+            node->has_wallet = 1;
+            printf(COLOR_GREEN "✔ New wallet address: %s" COLOR_RESET "\n", node->wallet.address);
+        }
+        else
+            print_error("Key generation failed");
+    }
+    else if (strncmp(line, "pay ", 4) == 0)
+    {
+        char amount[32], text[64];
+        Transaction tx = {0};
+        TxWitness witness;
+        unsigned char encoded[MAX_TX_SIZE];
+        size_t length;
+        uint64_t funds;
+        strcpy(tx.sender, node->wallet.address);
+        tx.output_count = 1;
+        if (!node->has_wallet)
+            print_error("No wallet yet; run keygen first");
+        else if (sscanf(line + 4, "%40s %31s", tx.outputs[0].address, amount) != 2 ||
+                 !parse_amount(amount, &tx.outputs[0].amount) || tx.outputs[0].amount == 0)
+            print_error("Usage: pay <receiver> <amount>");
+        else if ((funds = node_fund_payment(node, &tx)) < tx.outputs[0].amount)
+        {
+            format_amount(funds, text, sizeof(text));
+            printf(COLOR_RED "✗ Insufficient funds: %s spendable in at most %d coins (each block mined with a wallet pays it the reward)" COLOR_RESET "\n",
+                   text, TX_MAX_INPUTS);
+        }
+        else
+        {
+            length = transaction_encode(&tx, encoded, sizeof(encoded));
+            if (length > 0 && sign_transaction(&node->wallet, encoded, length, &witness) &&
+                node_submit_transaction(node, encoded, length, &witness))
+                printf(COLOR_GREEN "✔ Signed payment spending %d coin(s) added to mempool and announced" COLOR_RESET "\n",
+                       tx.input_count);
+            else
+                print_error("Payment rejected");
+        }
+    }
+    else if (strncmp(line, "rescan ", 7) == 0 && strlen(line + 7) > 0)
+    {
+        RescanStats stats;
+        int shown = 0;
+        uint64_t started = monotonic_ns();
+        blockfilter_rescan(node->chain, &node->chain->tree->filters, line + 7, print_rescan_match, &shown, &stats);
+        printf(COLOR_GREEN "✔ %d transaction(s)%s; tested %d filters and read %d blocks (%d false positives) in %.2f ms"
+                           COLOR_RESET "\n",
+               stats.transactions, stats.transactions > 20 ? ", first 20 shown" : "", stats.blocks, stats.matched,
+               stats.false_positives, (double)(monotonic_ns() - started) / 1e6);
+    }
+    else if (strcmp(line, "status") == 0)
+    {
+        print_node_status(node);
+    }
+    else if (strcmp(line, "view") == 0)
+    {
+        display_blockchain(node->chain);
+    }
+    else if (strcmp(line, "verify") == 0)
+    {
+        verify_blockchain(node->chain);
+    }
+    else if (strcmp(line, "trace") == 0 || strncmp(line, "trace ", 6) == 0)
+    {
+        // The first trace starts recording; each later one writes what the rings hold so far
+        const char *path = line[5] == ' ' && line[6] != '\0' ? line + 6 : TRACE_DEFAULT_FILE;
+        long spans;
+        if (!trace_is_enabled())
+        {
+            trace_enable(1);
+            print_success("Tracing started; run trace [file] again to write a Chrome trace");
+        }
+        else if ((spans = trace_dump(path)) < 0)
+            print_error("Could not write the trace file");
+        else
+            printf(COLOR_GREEN "✔ Wrote %ld spans to %s (open it in ui.perfetto.dev)" COLOR_RESET "\n", spans, path);
+    }
+    else if (strcmp(line, "quit") == 0)
+    {
+        node->running = 0;
+        return;
+    }
+    else if (line[0] != '\0')
+    {
+        print_error("Commands: mine | tx <sender->receiver:amount> | keygen | pay <receiver> <amount> | rescan <address> | status | view | verify | trace [file] | quit");
+    }
+    printf(COLOR_PURPLE "node> " COLOR_RESET);
+    fflush(stdout);
+}
+
+int node_poll(Node *node, int timeout_ms)
+{
+    struct epoll_event events[64];
+    int ready = epoll_wait(node->epoll_fd, events, 64, timeout_ms);
+    if (ready < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for (int i = 0; i < ready; i++)
+    {
+        uint64_t tag = events[i].data.u64;
+        if (tag == LISTEN_TAG)
+        {
+            int fd;
+            while ((fd = accept(node->listen_fd, NULL, NULL)) >= 0)
+                add_peer(node, fd);
+            continue;
+        }
+        if (tag == STDIN_TAG)
+        {
+            handle_command(node);
+            continue;
+        }
+        if (tag == SYNC_EVENT_TAG)
+        {
+            sync_handle_validated(node);
+            continue;
+        }
+        if (tag == INGEST_EVENT_TAG)
+        {
+            drain_ingest(node);
+            continue;
+        }
+        if (rpc_handle_event(node, tag, events[i].events) || stratum_handle_event(node, tag, events[i].events))
+            continue;
+
+        Peer *peer = find_peer(node, tag);
+        if (!peer)
+            continue;
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+        {
+            drop_peer(node, peer);
+            continue;
+        }
+        if ((events[i].events & EPOLLOUT) && !flush_peer(node, peer))
+        {
+            drop_peer(node, peer);
+            continue;
+        }
+        if ((events[i].events & EPOLLIN) && !read_peer(node, peer))
+            drop_peer(node, peer);
+    }
+    sync_tick(node);
+    // Backwards, since drop_peer moves the last peer into the freed place
+    for (int i = node->peer_count - 1; i >= 0; i--)
+    {
+        if (node->peers[i]->overflowed)
+            drop_peer(node, node->peers[i]);
+    }
+    return ready;
+}
+
+void node_run(Node *node)
+{
+    if (node->interactive)
+    {
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.u64 = STDIN_TAG;
+        epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event);
+        printf(COLOR_PURPLE "node> " COLOR_RESET);
+        fflush(stdout);
+    }
+    // Wake up periodically while syncing so stalled block requests time out
+    while (node->running && node_poll(node, sync_in_progress(node) ? 100 : -1) >= 0)
+        ;
+}
+
+/* ================ NODE MODE ================ */
+static int parse_endpoint(const char *text, char *host, size_t host_size, int *port)
+{
+    const char *colon = strrchr(text, ':');
+    if (!colon || (size_t)(colon - text) >= host_size)
+        return 0;
+    memcpy(host, text, (size_t)(colon - text));
+    host[colon - text] = '\0';
+    *port = atoi(colon + 1);
+    return *port > 0 && *port < 65536;
+}
+
+int run_node_mode(int argc, char **argv)
+{
+    int port = P2P_DEFAULT_PORT, difficulty = DEFAULT_DIFFICULTY, compact_relay = 1, header_sync = 0;
+    int algorithm = RETARGET_FIXED, block_time = 10, threads = 1, cache_mib = (int)(UTXO_DEFAULT_CACHE >> 20);
+    int rpc_port = -1, stratum_port = -1, prune_mib = 0, prune_depth = 0;
+    int address_index = 0;
+    const char *datadir = NULL, *assume_valid = NULL;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--difficulty") == 0 && i + 1 < argc)
+            difficulty = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--no-compact") == 0)
+            compact_relay = 0;
+        else if (strcmp(argv[i], "--sync") == 0)
+            header_sync = 1;
+        else if (strcmp(argv[i], "--retarget") == 0 && i + 1 < argc)
+            algorithm = retarget_parse_algorithm(argv[++i]);
+        else if (strcmp(argv[i], "--block-time") == 0 && i + 1 < argc)
+            block_time = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--datadir") == 0 && i + 1 < argc)
+            datadir = argv[++i];
+        else if (strcmp(argv[i], "--dbcache") == 0 && i + 1 < argc)
+            cache_mib = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--prune") == 0 && i + 1 < argc)
+            prune_mib = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--prune-depth") == 0 && i + 1 < argc)
+            prune_depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--assume-valid") == 0 && i + 1 < argc)
+            assume_valid = argv[++i];
+        else if (strcmp(argv[i], "--addrindex") == 0)
+            address_index = 1;
+        else if (strcmp(argv[i], "--rpc") == 0)
+            rpc_port = RPC_DEFAULT_PORT;
+        else if (strcmp(argv[i], "--rpc-port") == 0 && i + 1 < argc)
+            rpc_port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stratum") == 0)
+            stratum_port = STRATUM_DEFAULT_PORT;
+        else if (strcmp(argv[i], "--stratum-port") == 0 && i + 1 < argc)
+            stratum_port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0)
+            trace_enable(1);
+        else if (strcmp(argv[i], "--hugepages") == 0)
+            alloc_set_hugepages(1);
+    }
+    if (algorithm < 0 || block_time < 1 || threads < 1 || threads > MINER_MAX_THREADS)
+    {
+        print_error("Usage: --retarget <fixed|window|lwma|asert> --block-time <seconds> --threads <1-64>");
+        return 1;
+    }
+    if (cache_mib < 1)
+    {
+        print_error("Usage: --datadir <directory> --dbcache <MiB, at least 1>");
+        return 1;
+    }
+    if (prune_mib < 0 || prune_depth < 0 || (prune_depth > 0 && prune_depth < PRUNE_MIN_BLOCKS) ||
+        ((prune_mib || prune_depth) && !datadir))
+    {
+        printf(COLOR_RED "✗ Usage: --datadir <directory> --prune <MiB> | --prune-depth <blocks, at least %d>" COLOR_RESET "\n",
+               PRUNE_MIN_BLOCKS);
+        return 1;
+    }
+
+    Blockchain chain = {0};
+    BlockTree tree;
+    if (assume_valid && strlen(assume_valid) != HASH_SIZE - 1)
+    {
+        print_error("Usage: --assume-valid <block hash, 64 hex digits>");
+        return 1;
+    }
+    Node node;
+    CoinDB coins;
+    BlockStore blocks;
+    AddressIndex addresses;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    if (assume_valid)
+        strcpy(tree.assume_valid, assume_valid);
+
+    print_header("P2P NODE MODE");
+    if (datadir)
+    {
+        if (!coindb_open(&coins, datadir))
+        {
+            print_error("Could not open the data directory");
+            return 1;
+        }
+        utxo_set_attach(&tree.utxos, &coins, (size_t)cache_mib << 20);
+        printf(COLOR_GREEN "UTXO set cached in %d MiB over %s" COLOR_RESET "\n", cache_mib, datadir);
+        if (!blockstore_open(&blocks, datadir, BLOCKSTORE_FILE_BYTES))
+        {
+            print_error("Could not open the block files");
+            coindb_close(&coins);
+            return 1;
+        }
+        blockstore_set_prune(&blocks, (uint64_t)prune_mib << 20, prune_depth);
+        tree.store = &blocks;
+        if (prune_mib)
+            printf(COLOR_GREEN "Pruning block files to %d MiB (the last %d blocks are always kept)" COLOR_RESET "\n",
+                   prune_mib, PRUNE_MIN_BLOCKS);
+        if (prune_depth)
+            printf(COLOR_GREEN "Pruning block bodies more than %d blocks below the tip" COLOR_RESET "\n", prune_depth);
+    }
+    if (!node_init(&node, &chain, port, difficulty))
+    {
+        print_error("Could not listen on the requested port");
+        if (datadir)
+        {
+            blockstore_close(&blocks);
+            coindb_close(&coins);
+        }
+        return 1;
+    }
+    node.compact_relay = compact_relay;
+    node.mining_threads = threads;
+    retarget_init(&node.retarget, algorithm, block_time);
+    tree.retarget = &node.retarget;
+    printf(COLOR_GREEN "Listening on 127.0.0.1:%d (difficulty %d, %s relay)" COLOR_RESET "\n", port, difficulty,
+           compact_relay ? "compact" : "full-block");
+    if (assume_valid)
+        printf(COLOR_GREEN "Signatures assumed valid up to block %.12s...%s" COLOR_RESET "\n", assume_valid, assume_valid + 52);
+    if (algorithm != RETARGET_FIXED)
+        printf(COLOR_GREEN "Retargeting with %s toward one block every %d s, %d mining thread(s)" COLOR_RESET "\n",
+               retarget_algorithm_name(algorithm), block_time, threads);
+    if (address_index)
+    {
+        address_index = address_index_init(&addresses);
+        if (address_index)
+        {
+            tree.addresses = &addresses;
+            printf(COLOR_GREEN "Address index kept for getbalance and getaddresshistory" COLOR_RESET "\n");
+        }
+        else
+            print_error("Could not set up the address index");
+    }
+    if (node_start_ingest(&node, signature_default_threads()))
+        printf(COLOR_GREEN "Transaction ingestion ring open (%d slots, %d validation threads)" COLOR_RESET "\n",
+               TXQUEUE_DEFAULT_SLOTS, node.ingest->worker_count);
+    if (rpc_port >= 0)
+    {
+        if (rpc_start(&node, rpc_port))
+            printf(COLOR_GREEN "JSON-RPC over HTTP on 127.0.0.1:%d" COLOR_RESET "\n", node.rpc->port);
+        else
+            print_error("Could not open the RPC port");
+    }
+    if (stratum_port >= 0)
+    {
+        if (stratum_start(&node, stratum_port))
+            printf(COLOR_GREEN "Work server for --miner processes on 127.0.0.1:%d" COLOR_RESET "\n", node.stratum->port);
+        else
+            print_error("Could not open the work server port");
+    }
+    if (header_sync)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        int workers = cores < 1 ? 1 : cores > SYNC_MAX_WORKERS ? SYNC_MAX_WORKERS : (int)cores;
+        if (sync_start(&node, SYNC_WINDOW, SYNC_PEER_IN_FLIGHT, workers))
+            printf(COLOR_GREEN "Header-first sync enabled (%d validation threads)" COLOR_RESET "\n", workers);
+    }
+
+    for (int i = 0; i < argc; i++)
+    {
+        char host[64];
+        int peer_port;
+        if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc)
+        {
+            if (parse_endpoint(argv[++i], host, sizeof(host), &peer_port) && node_connect(&node, host, peer_port))
+                printf(COLOR_GREEN "Connected to %s:%d" COLOR_RESET "\n", host, peer_port);
+            else
+                printf(COLOR_RED "✗ Could not connect to %s" COLOR_RESET "\n", argv[i]);
+        }
+    }
+
+    trace_thread_name("node");
+    node.interactive = 1;
+    node_run(&node);
+    node_free(&node);
+    block_tree_free(&tree);
+    free(chain.blocks);
+    if (address_index)
+        address_index_free(&addresses);
+    if (datadir)
+    {
+        blockstore_close(&blocks);
+        coindb_close(&coins);
+    }
+    return 0;
+}
+
+/* ================ LOOPBACK RELAY BENCHMARK ================ */
+typedef struct
+{
+    int node_id;          // Reporting node
+    int height;           // Active height after the change
+    uint64_t time_ns;     // CLOCK_MONOTONIC when the block connected
+    uint64_t block_bytes; // Node.block_bytes_received at that moment
+} TipReport;
+
+typedef struct
+{
+    int node_id; // This process's position in the line
+    int fd;      // Write end of the report pipe
+} ReportContext;
+
+typedef struct
+{
+    double average_hop_us; // Mean of per-round propagation time / hops
+    double worst_hop_us;   // Slowest round
+    double bytes_per_hop;  // Block relay bytes received per peer per block
+    int measured;          // Rounds that completed
+} BenchResult;
+
+static void report_tip(Node *node, void *context)
+{
+    ReportContext *report = context;
+    TipReport message = {report->node_id, node->chain->block_count - 1, monotonic_ns(), node->block_bytes_received};
+    if (write(report->fd, &message, sizeof(message)) != (ssize_t)sizeof(message))
+        node->running = 0;
+}
+
+static void run_bench_child(int node_id, int base_port, int report_fd, int difficulty, int compact_relay)
+{
+    Blockchain chain = {0};
+    BlockTree tree;
+    Node node;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+
+    if (!node_init(&node, &chain, base_port + node_id, difficulty))
+        _exit(1);
+    node.compact_relay = compact_relay;
+
+    // Line topology: node i only talks to node i-1 and node i+1
+    for (int attempt = 0; !node_connect(&node, "127.0.0.1", base_port + node_id - 1); attempt++)
+    {
+        if (attempt > 500)
+            _exit(1);
+        usleep(2000);
+    }
+
+    ReportContext context = {node_id, report_fd};
+    TipReport ready = {node_id, -1, monotonic_ns(), 0};
+    if (write(report_fd, &ready, sizeof(ready)) != (ssize_t)sizeof(ready))
+        _exit(1);
+    node.on_tip = report_tip;
+    node.callback_context = &context;
+    node_run(&node);
+    _exit(0);
+}
+
+static int wait_for_reports(Node *node, int report_fd, int node_count, int height, uint64_t *arrival, uint64_t *bytes)
+{
+    int pending = node_count;
+    uint64_t deadline = monotonic_ns() + 10000000000ull;
+    while (pending > 0 && monotonic_ns() < deadline)
+    {
+        node_poll(node, 0);
+        TipReport report;
+        ssize_t n = read(report_fd, &report, sizeof(report));
+        if (n == (ssize_t)sizeof(report))
+        {
+            if (report.height == height && arrival[report.node_id] == 0)
+            {
+                arrival[report.node_id] = report.time_ns;
+                bytes[report.node_id] = report.block_bytes;
+                pending--;
+            }
+        }
+        else
+        {
+            node_poll(node, 1);
+        }
+    }
+    return pending == 0;
+}
+
+static void settle(Node *node, int milliseconds)
+{
+    uint64_t until = monotonic_ns() + (uint64_t)milliseconds * 1000000ull;
+    while (monotonic_ns() < until)
+        node_poll(node, 1);
+}
+
+static int bench_phase(int node_count, int rounds, int compact_relay, BenchResult *result)
+{
+    const int difficulty = 2;
+    memset(result, 0, sizeof(*result));
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0)
+        return 0;
+    set_nonblocking(pipe_fds[0]);
+    int base_port = 20000 + (int)((getpid() * 2 + compact_relay * 37) % 20000);
+
+    Blockchain chain = {0};
+    BlockTree tree;
+    Node node;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    if (!node_init(&node, &chain, base_port, difficulty))
+    {
+        print_error("Could not open the benchmark listening port");
+        return 0;
+    }
+    node.compact_relay = compact_relay;
+
+    printf(COLOR_CYAN "\n%s relay: %d peer process(es) in a line on 127.0.0.1:%d..." COLOR_RESET "\n",
+           compact_relay ? "Compact-block" : "Full-block", node_count, base_port + 1);
+
+    pid_t children[32];
+    fflush(stdout);
+    for (int i = 1; i <= node_count; i++)
+    {
+        children[i - 1] = fork();
+        if (children[i - 1] == 0)
+        {
+            close(pipe_fds[0]);
+            if (!freopen("/dev/null", "w", stdout))
+                _exit(1);
+            run_bench_child(i, base_port, pipe_fds[1], difficulty, compact_relay);
+        }
+    }
+    close(pipe_fds[1]);
+
+    uint64_t arrival[33], bytes[33], last_bytes[33];
+    memset(arrival, 0, sizeof(arrival));
+    memset(last_bytes, 0, sizeof(last_bytes));
+    int ok = wait_for_reports(&node, pipe_fds[0], node_count, -1, arrival, bytes);
+
+    // The genesis block has to reach everybody before the timed rounds. It funds one wallet per
+    // transaction slot, and in each round every wallet pays out of its last round's change.
+    if (ok)
+    {
+        Block genesis;
+        int nonce_attempts;
+        build_block_template(&node, &genesis);
+        for (int t = 0; t < MAX_TRANSACTIONS; t += TX_MAX_OUTPUTS)
+        {
+            Transaction tx = {0};
+            unsigned char encoded[MAX_TX_SIZE];
+            snprintf(tx.memo, sizeof(tx.memo), "faucet-%02d", t);
+            for (int w = t; w < MAX_TRANSACTIONS && w < t + TX_MAX_OUTPUTS; w++)
+            {
+                TxOutput *output = &tx.outputs[tx.output_count++];
+                snprintf(output->address, sizeof(output->address), "wallet-%02d", w);
+                output->amount = 1000000 * AMOUNT_SCALE;
+            }
+            size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+            block_add_transaction(&genesis, encoded, length, NULL);
+        }
+        solve_block(&genesis, difficulty, &nonce_attempts);
+        memset(arrival, 0, sizeof(arrival));
+        node_process_block(&node, NULL, &genesis, 0);
+        ok = wait_for_reports(&node, pipe_fds[0], node_count, 0, arrival, last_bytes);
+    }
+
+    if (ok)
+    {
+        printf(COLOR_BLUE "┌────────┬────────────────┬────────────────┬────────────────┐\n");
+        printf(COLOR_BLUE "│ " COLOR_YELLOW "%-6s" COLOR_BLUE " │ " COLOR_YELLOW "%-14s" COLOR_BLUE " │ " COLOR_YELLOW "%-14s" COLOR_BLUE " │ " COLOR_YELLOW "%-14s" COLOR_BLUE " │\n",
+               "Height", "Last peer (us)", "Per hop (us)", "Bytes per hop");
+        printf(COLOR_BLUE "├────────┼────────────────┼────────────────┼────────────────┤\n");
+    }
+    double total_hop_us = 0.0, total_bytes = 0.0;
+    for (int round = 1; ok && round <= rounds; round++)
+    {
+        // Fill every mempool first, as a live network would between blocks
+        for (int t = 0; t < MAX_TRANSACTIONS; t++)
+        {
+            Transaction tx = {0};
+            unsigned char encoded[MAX_TX_SIZE];
+            snprintf(tx.sender, sizeof(tx.sender), "wallet-%02d", t);
+            snprintf(tx.outputs[0].address, sizeof(tx.outputs[0].address), "merchant-%02d", (t * 7) % 50);
+            tx.outputs[0].amount = (uint64_t)(10 + t) * AMOUNT_SCALE + (uint64_t)(round % 100);
+            tx.output_count = 1;
+            snprintf(tx.memo, sizeof(tx.memo), "invoice-%08d-settlement-batch", round * 1000 + t);
+            if (node_fund_payment(&node, &tx) < tx.outputs[0].amount)
+                continue;
+            size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+            node_submit_transaction(&node, encoded, length, NULL);
+        }
+        settle(&node, 20 + 5 * node_count);
+
+        Block block;
+        int nonce_attempts;
+        build_block_template(&node, &block);
+        solve_block(&block, difficulty, &nonce_attempts);
+
+        // Clock starts once the block is solved, so only relay time is measured
+        memset(arrival, 0, sizeof(arrival));
+        uint64_t start = monotonic_ns();
+        node_process_block(&node, NULL, &block, 0);
+        ok = wait_for_reports(&node, pipe_fds[0], node_count, block.index, arrival, bytes);
+        if (!ok)
+            break;
+
+        uint64_t round_bytes = 0;
+        for (int i = 1; i <= node_count; i++)
+        {
+            round_bytes += bytes[i] - last_bytes[i];
+            last_bytes[i] = bytes[i];
+        }
+        double last_us = (double)(arrival[node_count] - start) / 1000.0;
+        double hop_us = last_us / node_count;
+        double hop_bytes = (double)round_bytes / node_count;
+        total_hop_us += hop_us;
+        total_bytes += hop_bytes;
+        result->worst_hop_us = hop_us > result->worst_hop_us ? hop_us : result->worst_hop_us;
+        result->measured++;
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-6d" COLOR_BLUE " │ " COLOR_CYAN "%-14.1f" COLOR_BLUE " │ " COLOR_CYAN "%-14.1f" COLOR_BLUE " │ " COLOR_CYAN "%-14.0f" COLOR_BLUE " │\n",
+               block.index, last_us, hop_us, hop_bytes);
+    }
+    if (result->measured > 0)
+    {
+        printf(COLOR_BLUE "└────────┴────────────────┴────────────────┴────────────────┘" COLOR_RESET "\n");
+        result->average_hop_us = total_hop_us / result->measured;
+        result->bytes_per_hop = total_bytes / result->measured;
+    }
+
+    for (int i = 0; i < node_count; i++)
+        kill(children[i], SIGTERM);
+    for (int i = 0; i < node_count; i++)
+        waitpid(children[i], NULL, 0);
+    close(pipe_fds[0]);
+    node_free(&node);
+    block_tree_free(&tree);
+    free(chain.blocks);
+    return ok && result->measured > 0;
+}
+
+int run_relay_benchmark(int node_count, int rounds)
+{
+    if (node_count < 1 || node_count > 32 || rounds < 1)
+    {
+        print_error("Usage: --relay-bench <peers 1-32> [rounds]");
+        return 1;
+    }
+
+    print_header("P2P RELAY BENCHMARK");
+    BenchResult full, compact;
+    if (!bench_phase(node_count, rounds, 0, &full) || !bench_phase(node_count, rounds, 1, &compact))
+    {
+        print_error("Relay benchmark did not complete (a peer never received a block)");
+        return 1;
+    }
+
+    double saved = full.bytes_per_hop > 0 ? 100.0 * (1.0 - compact.bytes_per_hop / full.bytes_per_hop) : 0.0;
+    printf(COLOR_GREEN "\nFull blocks:    %.1f us per hop (worst %.1f), %.0f bytes per hop" COLOR_RESET "\n",
+           full.average_hop_us, full.worst_hop_us, full.bytes_per_hop);
+    printf(COLOR_GREEN "Compact blocks: %.1f us per hop (worst %.1f), %.0f bytes per hop" COLOR_RESET "\n",
+           compact.average_hop_us, compact.worst_hop_us, compact.bytes_per_hop);
+    printf(COLOR_GREEN "Compact relay saved %.1f%% of block propagation bytes" COLOR_RESET "\n", saved);
+    if (compact.average_hop_us < 1000.0)
+        print_success("Block propagation is under 1 ms per hop");
+    else
+        print_error("Block propagation exceeded 1 ms per hop");
+    return compact.average_hop_us < 1000.0 ? 0 : 1;
+}
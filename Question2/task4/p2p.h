@@ -0,0 +1,114 @@
+#ifndef P2P_H
+#define P2P_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "mempool.h"
+#include "compact_block.h"
+#include "wire.h"
+#include "retarget.h"
+#include "signature.h"
+
+/* ================ CONSTANTS ================ */
+#define P2P_MAGIC 0xB10C4A1Du         // First four bytes of every frame
+#define P2P_HEADER_SIZE 9             // magic(4) + type(1) + payload length(4)
+#define P2P_MAX_PAYLOAD (1024 * 1024) // Larger frames drop the peer
+#define P2P_MAX_SEND (4096 * 1024)    // Bytes queued to a peer that is not reading before it is dropped
+#define P2P_MAX_PEERS 64              // Connections per node
+#define P2P_MAX_ORPHANS 32            // Blocks waiting for their parent
+#define P2P_MAX_PENDING 8             // Compact blocks waiting for missing transactions
+#define P2P_DEFAULT_PORT 8333         // Listening port for node mode
+
+#define MSG_INV 1         // Announce block/tx hashes
+#define MSG_GETDATA 2     // Request announced items
+#define MSG_BLOCK 3       // Full block
+#define MSG_TX 4          // Single transaction
+#define MSG_CMPCTBLOCK 5  // Header + short transaction IDs
+#define MSG_GETBLOCKTXN 6 // Request transactions missing from a compact block
+#define MSG_BLOCKTXN 7    // Transactions answering MSG_GETBLOCKTXN
+#define MSG_GETHEADERS 8  // Block locator; asks for the headers that follow it
+#define MSG_HEADERS 9     // Up to SYNC_MAX_HEADERS headers answering MSG_GETHEADERS
+
+#define INGEST_TOO_LARGE -1 // node_ingest_transaction: larger than MAX_TX_SIZE, refused
+#define INGEST_NO_RING -2   // node_ingest_transaction: no ring running, so the caller validates inline
+
+#define INV_BLOCK 1 // Inventory item is a block hash
+#define INV_TX 2    // Inventory item is a txid
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    int fd;                  // Non-blocking TCP socket
+    int id;                  // Local identifier for logs
+    unsigned char *rbuf;     // Bytes received but not yet parsed
+    size_t rlen, rcap;       // Used/allocated size of rbuf
+    unsigned char *wbuf;     // Bytes queued but not yet written
+    size_t wlen, wcap;       // Used/allocated size of wbuf
+    int want_write;          // EPOLLOUT currently armed
+    int overflowed;          // wbuf hit P2P_MAX_SEND: nothing more is queued and node_poll drops it
+} Peer;
+
+typedef struct Node Node;
+struct SyncState;
+struct TxIngest;
+struct RpcServer;
+struct StratumServer;
+typedef void (*TipCallback)(Node *node, void *context);
+
+struct Node
+{
+    int epoll_fd;                          // Event loop
+    int listen_fd;                         // Accepting socket (-1 if none)
+    int port;                              // Listening port
+    Peer *peers[P2P_MAX_PEERS];            // Open connections
+    int peer_count;                        // Number of open connections
+    int next_peer_id;                      // Counter for Peer.id
+    Blockchain *chain;                     // Block tree + active chain
+    Mempool mempool;                       // Transactions waiting for a block
+    Block orphans[P2P_MAX_ORPHANS];        // Ring of blocks with unknown parents
+    int orphan_count;                      // Valid entries in orphans
+    int orphan_next;                       // Next ring slot to overwrite
+    CompactBlock pending[P2P_MAX_PENDING]; // Compact blocks waiting on MSG_BLOCKTXN
+    int pending_next;                      // Next pending slot to overwrite
+    int difficulty;                        // Difficulty used when this node mines
+    RetargetParams retarget;               // Rule for the next target (RETARGET_FIXED uses difficulty)
+    int mining_threads;                    // Threads searching nonces in node_mine_block
+    KeyPair wallet;                        // Key that pay signs with
+    int has_wallet;                        // Set once keygen has run
+    int compact_relay;                     // Push new tips as compact blocks instead of inv
+    int interactive;                       // Read commands from stdin
+    int running;                           // Cleared to leave node_run
+    TipCallback on_tip;                    // Called after the active tip changes
+    void *callback_context;                // Passed to on_tip
+    uint64_t bytes_sent;                   // Wire bytes written to peers
+    uint64_t bytes_received;               // Wire bytes read from peers
+    uint64_t block_bytes_received;         // Part of bytes_received spent on block relay
+    struct SyncState *sync;                // Header-first download (NULL unless syncing)
+    struct TxIngest *ingest;               // Multi-producer submission pipeline (NULL unless started)
+    int ingest_fd;                         // eventfd its workers signal (-1 if none)
+    uint64_t ingest_admitted;              // Pipeline transactions that entered the mempool
+    uint64_t ingest_dropped;               // Pipeline transactions the ledger or mempool refused
+    struct RpcServer *rpc;                 // JSON-RPC over HTTP (NULL unless started)
+    struct StratumServer *stratum;         // Work server for miner processes (NULL unless started)
+};
+
+/* ================ FUNCTION PROTOTYPES ================ */
+uint64_t monotonic_ns(void);
+int node_init(Node *node, Blockchain *chain, int port, int difficulty);
+void node_free(Node *node);
+int node_connect(Node *node, const char *host, int port);
+int node_poll(Node *node, int timeout_ms);
+void node_run(Node *node);
+int node_submit_transaction(Node *node, const unsigned char *tx, size_t length, const TxWitness *witness);
+uint64_t node_fund_payment(Node *node, Transaction *tx);
+int node_start_ingest(Node *node, int workers);
+int node_ingest_transaction(Node *node, const unsigned char *tx, size_t length, const TxWitness *witness, Peer *from);
+uint32_t node_block_template(Node *node, Block *block);
+int node_mine_block(Node *node);
+void node_process_block(Node *node, Peer *from, const Block *block, int validated);
+void node_send(Node *node, Peer *peer, int type, const ByteWriter *payload);
+void node_broadcast(Node *node, Peer *except, int type, const ByteWriter *payload);
+int run_node_mode(int argc, char **argv);
+int run_relay_benchmark(int node_count, int rounds);
+
+#endif
@@ -0,0 +1,717 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pipeline.h"
+#include "block_tree.h"
+#include "miner.h"
+#include "retarget.h"
+#include "signature.h"
+#include "trace.h"
+#include "transaction.h"
+#include "wire.h"
+
+/* ================ HELPERS ================ */
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+/* ================ STAGE QUEUES ================ */
+static int stage_queue_init(StageQueue *queue, int capacity)
+{
+    memset(queue, 0, sizeof(*queue));
+    queue->items = malloc((size_t)capacity * sizeof(void *));
+    if (!queue->items)
+        return 0;
+    queue->capacity = capacity;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return 1;
+}
+
+static void stage_queue_free(StageQueue *queue)
+{
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
+
+// Blocks while the queue is full; the time spent blocked is added to wait_ms.
+// Returns 0 if the run was cancelled, in which case the item was not queued.
+static int stage_push(StageQueue *queue, void *item, double *wait_ms)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity && !queue->cancelled)
+    {
+        double start = now_ms();
+        uint64_t span = trace_begin();
+        while (queue->count == queue->capacity && !queue->cancelled)
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        trace_end("wait_for_room", NULL, 0, span);
+        *wait_ms += now_ms() - start;
+    }
+    int queued = !queue->cancelled;
+    if (queued)
+    {
+        queue->items[(queue->head + queue->count++) % queue->capacity] = item;
+        pthread_cond_signal(&queue->not_empty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return queued;
+}
+
+// NULL once the queue is closed and drained, or as soon as it is cancelled
+static void *stage_pop(StageQueue *queue, double *wait_ms)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0 && !queue->closed && !queue->cancelled)
+    {
+        double start = now_ms();
+        uint64_t span = trace_begin();
+        while (queue->count == 0 && !queue->closed && !queue->cancelled)
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        trace_end("wait_for_input", NULL, 0, span);
+        *wait_ms += now_ms() - start;
+    }
+    void *item = NULL;
+    if (queue->count > 0 && !queue->cancelled)
+    {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+static void stage_close(StageQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Wakes both sides so every stage still running returns
+static void stage_cancel(StageQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->cancelled = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Frees the blocks a cancelled run left queued
+static void stage_free_blocks(StageQueue *queue)
+{
+    for (int i = 0; i < queue->count; i++)
+        free(queue->items[(queue->head + i) % queue->capacity]);
+    queue->count = 0;
+}
+
+/* ================ BLOCK FILE ================ */
+// Each record is a little-endian u32 length followed by the wire encoding of the block
+int block_store_append(FILE *store, const Block *block)
+{
+    TRACE_SCOPE("block_store_append", "height", block->index);
+    ByteWriter writer;
+    writer_init(&writer);
+    serialize_block(&writer, block);
+    unsigned char length[4];
+    for (int i = 0; i < 4; i++)
+        length[i] = (unsigned char)(writer.length >> (8 * i));
+    int ok = fwrite(length, 1, 4, store) == 4 && fwrite(writer.data, 1, writer.length, store) == writer.length &&
+             fflush(store) == 0 && fsync(fileno(store)) == 0;
+    writer_free(&writer);
+    return ok;
+}
+
+// Reads the file from the start and checks every record against the active chain from first_height on
+int block_store_verify(FILE *store, const Blockchain *chain, int first_height)
+{
+    rewind(store);
+    int height = first_height;
+    unsigned char length_bytes[4];
+    unsigned char *record = NULL;
+    Block *block = malloc(sizeof(Block));
+    int ok = block != NULL;
+    while (ok && fread(length_bytes, 1, 4, store) == 4)
+    {
+        size_t length = length_bytes[0] | length_bytes[1] << 8 | length_bytes[2] << 16 | (size_t)length_bytes[3] << 24;
+        unsigned char *grown = realloc(record, length);
+        ByteReader reader;
+        char hash[HASH_SIZE];
+        ok = grown && fread(grown, 1, length, store) == length && height < chain->block_count;
+        record = grown;
+        if (!ok)
+            break;
+        reader_init(&reader, record, length);
+        ok = deserialize_block(&reader, block);
+        if (!ok)
+            break;
+        calculate_block_hash(block, hash);
+        ok = strcmp(hash, chain->blocks[height].hash) == 0;
+        height++;
+    }
+    free(record);
+    free(block);
+    return ok && height == chain->block_count;
+}
+
+/* ================ STAGE WORK ================ */
+static int validate_transaction(const TxSubmission *submission)
+{
+    TRACE_SCOPE("validate_transaction", NULL, 0);
+    // Stored in the signature cache, so connecting the block later skips the curve math
+    TxView view;
+    return tx_view_parse(submission->tx, submission->length, &view) &&
+           check_transaction_signature(&view, &submission->witness, 1);
+}
+
+static void start_template(Block *block, int height)
+{
+    memset(block, 0, sizeof(*block));
+    block->index = height;
+    block_clear_transactions(block);
+}
+
+static void finish_template(const BlockPipeline *pipeline, Block *block)
+{
+    TRACE_SCOPE("finish_template", "height", block->index);
+    compute_merkle_root(block, block->merkle_root);
+    block->target_bits = target_bits_from_difficulty(pipeline->difficulty);
+    block->difficulty = pipeline->difficulty;
+}
+
+// The only step that needs the previous block, so it is all the miner does between blocks
+static void mine_template(const BlockPipeline *pipeline, Block *block, const char *previous_hash)
+{
+    TRACE_SCOPE("mine_template", "height", block->index);
+    int attempts;
+    strcpy(block->previous_hash, previous_hash);
+    block->timestamp = time(NULL);
+    solve_block_header(block, block->target_bits, pipeline->mining_threads, &attempts);
+}
+
+static int store_block(BlockPipeline *pipeline, const Block *block)
+{
+    TRACE_SCOPE("store_block", "height", block->index);
+    int disconnected, connected;
+    if (submit_block(pipeline->chain, block, &disconnected, &connected) != TREE_ACCEPTED || connected == 0)
+        return 0;
+    if (pipeline->store && !block_store_append(pipeline->store, block))
+        return 0;
+    pipeline->blocks_stored++;
+    if (pipeline->on_block)
+        pipeline->on_block(block, pipeline->context);
+    return 1;
+}
+
+/* ================ SERIAL PRODUCTION ================ */
+// One block at a time on the calling thread, as add_block does
+int pipeline_run_serial(BlockPipeline *pipeline)
+{
+    memset(pipeline->stats, 0, sizeof(pipeline->stats));
+    pipeline->blocks_stored = 0;
+    pipeline->rejected = 0;
+    Block *block = malloc(sizeof(Block));
+    if (!block)
+        return 0;
+
+    // Validated transactions wait in chosen until a block has room; the ones that do not fit
+    // one block's bytes open the next
+    const TxSubmission *chosen[MAX_TRANSACTIONS];
+    int count = 0;
+    int next = 0;
+    while (next < pipeline->transaction_count || count > 0)
+    {
+        int validated = 0;
+        double start = now_ms();
+        while (count < pipeline->per_block && next < pipeline->transaction_count)
+        {
+            const TxSubmission *submission = &pipeline->transactions[next++];
+            if (validate_transaction(submission))
+            {
+                chosen[count++] = submission;
+                validated++;
+            }
+            else
+                pipeline->rejected++;
+        }
+        pipeline->stats[STAGE_VALIDATE].busy_ms += now_ms() - start;
+        pipeline->stats[STAGE_VALIDATE].items += validated;
+        if (count == 0)
+            continue;
+
+        start = now_ms();
+        start_template(block, pipeline->chain->block_count);
+        int added = 0;
+        while (added < count &&
+               block_add_transaction(block, chosen[added]->tx, chosen[added]->length, &chosen[added]->witness))
+            added++;
+        // One that does not fit even an empty block is dropped
+        pipeline->rejected += added == 0;
+        count -= added > 0 ? added : 1;
+        memmove(chosen, chosen + (added > 0 ? added : 1), (size_t)count * sizeof(chosen[0]));
+        if (added == 0)
+            continue;
+        finish_template(pipeline, block);
+        pipeline->stats[STAGE_ASSEMBLE].busy_ms += now_ms() - start;
+        pipeline->stats[STAGE_ASSEMBLE].items++;
+
+        start = now_ms();
+        mine_template(pipeline, block, pipeline->chain->blocks[pipeline->chain->block_count - 1].hash);
+        pipeline->stats[STAGE_MINE].busy_ms += now_ms() - start;
+        pipeline->stats[STAGE_MINE].items++;
+
+        start = now_ms();
+        if (store_block(pipeline, block))
+            pipeline->stats[STAGE_STORE].items++;
+        else
+            pipeline->rejected++;
+        pipeline->stats[STAGE_STORE].busy_ms += now_ms() - start;
+    }
+    free(block);
+    return pipeline->blocks_stored;
+}
+
+/* ================ PIPELINED PRODUCTION ================ */
+typedef struct
+{
+    BlockPipeline *pipeline; // Inputs, outputs and statistics
+    StageQueue validated;    // const TxSubmission * from validation to assembly
+    StageQueue templates;    // Block * from assembly to the miner
+    StageQueue mined;        // Block * from the miner to storage
+    int first_height;        // Height of the first block produced
+    char tip[HASH_SIZE];     // Chain tip when the run started, then where the miner restarts
+    int tip_height;          // Height of tip
+    int rebase;              // Storage refused a block: the miner stops chaining on what it mined
+    pthread_mutex_t lock;    // Guards tip, tip_height and rebase
+} PipelineRun;
+
+static void *validate_stage(void *argument)
+{
+    PipelineRun *run = argument;
+    trace_thread_name("validate");
+    BlockPipeline *pipeline = run->pipeline;
+    StageStats *stats = &pipeline->stats[STAGE_VALIDATE];
+    for (int i = 0; i < pipeline->transaction_count; i++)
+    {
+        double start = now_ms();
+        int valid = validate_transaction(&pipeline->transactions[i]);
+        stats->busy_ms += now_ms() - start;
+        if (!valid)
+        {
+            __atomic_fetch_add(&pipeline->rejected, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!stage_push(&run->validated, (void *)&pipeline->transactions[i], &stats->wait_ms))
+            break;
+        stats->items++;
+    }
+    stage_close(&run->validated);
+    return NULL;
+}
+
+static void *assemble_stage(void *argument)
+{
+    PipelineRun *run = argument;
+    trace_thread_name("assemble");
+    BlockPipeline *pipeline = run->pipeline;
+    StageStats *stats = &pipeline->stats[STAGE_ASSEMBLE];
+    int height = run->first_height;
+    int done = 0;
+    const TxSubmission *carried = NULL; // Did not fit the last template, so it opens the next
+    while (!done)
+    {
+        Block *block = malloc(sizeof(Block));
+        if (!block)
+            break;
+        start_template(block, height);
+        while (block->transaction_count < pipeline->per_block)
+        {
+            const TxSubmission *submission = carried ? carried : stage_pop(&run->validated, &stats->wait_ms);
+            carried = NULL;
+            if (!submission)
+            {
+                done = 1;
+                break;
+            }
+            double start = now_ms();
+            int added = block_add_transaction(block, submission->tx, submission->length, &submission->witness);
+            stats->busy_ms += now_ms() - start;
+            if (added)
+                continue;
+            // Out of bytes; one that does not fit even an empty block is dropped
+            if (block->transaction_count == 0)
+                __atomic_fetch_add(&pipeline->rejected, 1, __ATOMIC_RELAXED);
+            else
+                carried = submission;
+            break;
+        }
+        if (block->transaction_count == 0)
+        {
+            free(block);
+            break;
+        }
+        double start = now_ms();
+        finish_template(pipeline, block);
+        stats->busy_ms += now_ms() - start;
+        if (!stage_push(&run->templates, block, &stats->wait_ms))
+        {
+            free(block);
+            break;
+        }
+        stats->items++;
+        height++;
+    }
+    stage_close(&run->templates);
+    return NULL;
+}
+
+static void *mine_stage(void *argument)
+{
+    PipelineRun *run = argument;
+    trace_thread_name("mine");
+    BlockPipeline *pipeline = run->pipeline;
+    StageStats *stats = &pipeline->stats[STAGE_MINE];
+    char previous_hash[HASH_SIZE];
+    int previous_height;
+    pthread_mutex_lock(&run->lock);
+    strcpy(previous_hash, run->tip);
+    previous_height = run->tip_height;
+    pthread_mutex_unlock(&run->lock);
+    Block *block;
+    while ((block = stage_pop(&run->templates, &stats->wait_ms)) != NULL)
+    {
+        // After a refused block, the ones mined on top of it are lost too; this one goes on the tip
+        pthread_mutex_lock(&run->lock);
+        if (run->rebase)
+        {
+            strcpy(previous_hash, run->tip);
+            previous_height = run->tip_height;
+            run->rebase = 0;
+        }
+        pthread_mutex_unlock(&run->lock);
+        double start = now_ms();
+        block->index = previous_height + 1;
+        mine_template(pipeline, block, previous_hash);
+        strcpy(previous_hash, block->hash);
+        previous_height = block->index;
+        stats->busy_ms += now_ms() - start;
+        if (!stage_push(&run->mined, block, &stats->wait_ms))
+        {
+            free(block);
+            break;
+        }
+        stats->items++;
+    }
+    stage_close(&run->mined);
+    return NULL;
+}
+
+// Validation, assembly and mining get a thread each; storage runs on the calling thread,
+// which owns the chain, so on_block may touch anything the caller could
+int pipeline_run(BlockPipeline *pipeline)
+{
+    memset(pipeline->stats, 0, sizeof(pipeline->stats));
+    pipeline->blocks_stored = 0;
+    pipeline->rejected = 0;
+
+    PipelineRun run;
+    run.pipeline = pipeline;
+    run.first_height = pipeline->chain->block_count;
+    strcpy(run.tip, pipeline->chain->blocks[pipeline->chain->block_count - 1].hash);
+    run.tip_height = run.first_height - 1;
+    run.rebase = 0;
+    if (!stage_queue_init(&run.validated, PIPELINE_TX_DEPTH))
+        return 0;
+    if (!stage_queue_init(&run.templates, PIPELINE_TEMPLATE_DEPTH))
+    {
+        stage_queue_free(&run.validated);
+        return 0;
+    }
+    if (!stage_queue_init(&run.mined, PIPELINE_STORE_DEPTH))
+    {
+        stage_queue_free(&run.templates);
+        stage_queue_free(&run.validated);
+        return 0;
+    }
+
+    pthread_mutex_init(&run.lock, NULL);
+
+    void *(*stages[3])(void *) = {validate_stage, assemble_stage, mine_stage};
+    pthread_t threads[3];
+    int started = 0;
+    while (started < 3 && pthread_create(&threads[started], NULL, stages[started], &run) == 0)
+        started++;
+    if (started < 3)
+    {
+        // A stage run inline would fill its output queue before anything drains it, so the run is
+        // abandoned: nothing has been stored yet, and the serial path produces the same blocks
+        stage_cancel(&run.validated);
+        stage_cancel(&run.templates);
+        stage_cancel(&run.mined);
+        for (int i = 0; i < started; i++)
+            pthread_join(threads[i], NULL);
+        stage_free_blocks(&run.templates);
+        stage_free_blocks(&run.mined);
+        stage_queue_free(&run.validated);
+        stage_queue_free(&run.templates);
+        stage_queue_free(&run.mined);
+        pthread_mutex_destroy(&run.lock);
+        return pipeline_run_serial(pipeline);
+    }
+
+    StageStats *stats = &pipeline->stats[STAGE_STORE];
+    const Blockchain *chain = pipeline->chain;
+    Block *block;
+    while ((block = stage_pop(&run.mined, &stats->wait_ms)) != NULL)
+    {
+        double start = now_ms();
+        if (store_block(pipeline, block))
+            stats->items++;
+        else
+        {
+            __atomic_fetch_add(&pipeline->rejected, 1, __ATOMIC_RELAXED);
+            // Only a block built on the tip sends the miner back to it; one built on a refused
+            // block comes from before the miner heard about that refusal
+            const char *tip = chain->blocks[chain->block_count - 1].hash;
+            if (strcmp(block->previous_hash, tip) == 0)
+            {
+                pthread_mutex_lock(&run.lock);
+                strcpy(run.tip, tip);
+                run.tip_height = chain->block_count - 1;
+                run.rebase = 1;
+                pthread_mutex_unlock(&run.lock);
+            }
+        }
+        stats->busy_ms += now_ms() - start;
+        free(block);
+    }
+
+    for (int i = 0; i < 3; i++)
+        pthread_join(threads[i], NULL);
+    stage_queue_free(&run.validated);
+    stage_queue_free(&run.templates);
+    stage_queue_free(&run.mined);
+    pthread_mutex_destroy(&run.lock);
+    return pipeline->blocks_stored;
+}
+
+/* ================ PIPELINE BENCHMARK ================ */
+#define BENCH_FUNDS ((uint64_t)1000000000 * AMOUNT_SCALE) // Given to each key by the genesis block
+
+// Funds every key; salt makes the funding, and so every payment after it, differ between runs
+static int bench_genesis(Blockchain *chain, int difficulty, const KeyPair *keys, int key_count, int salt,
+                         OutPoint *coins)
+{
+    Block genesis;
+    int attempts, disconnected, connected;
+    start_template(&genesis, 0);
+    genesis.timestamp = time(NULL);
+    block_add_text_transaction(&genesis, "Genesis Transaction");
+    for (int k = 0; k < key_count; k += TX_MAX_OUTPUTS)
+    {
+        Transaction tx = {0};
+        unsigned char encoded[MAX_TX_SIZE];
+        snprintf(tx.memo, sizeof(tx.memo), "faucet %d/%d", salt, k);
+        for (int i = k; i < key_count && i < k + TX_MAX_OUTPUTS; i++)
+        {
+            strcpy(tx.outputs[tx.output_count].address, keys[i].address);
+            tx.outputs[tx.output_count++].amount = BENCH_FUNDS;
+        }
+        size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+        if (!block_add_transaction(&genesis, encoded, length, NULL))
+            return 0;
+        for (int i = k; i < key_count && i < k + TX_MAX_OUTPUTS; i++)
+        {
+            compute_txid(encoded, length, coins[i].txid);
+            coins[i].index = (uint32_t)(i - k);
+        }
+    }
+    strcpy(genesis.previous_hash, "0000000000000000000000000000000000000000000000000000000000000000");
+    solve_block(&genesis, difficulty, &attempts);
+    return submit_block(chain, &genesis, &disconnected, &connected) == TREE_ACCEPTED;
+}
+
+// Signed payments that each spend the change of their key's last one, so a block only depends
+// on the blocks before it
+static TxSubmission *bench_transactions(const KeyPair *keys, int key_count, int count, int salt, OutPoint *coins)
+{
+    TxSubmission *transactions = calloc((size_t)count, sizeof(TxSubmission));
+    uint64_t *balances = malloc((size_t)key_count * sizeof(uint64_t));
+    if (!transactions || !balances)
+    {
+        free(transactions);
+        free(balances);
+        return NULL;
+    }
+    for (int k = 0; k < key_count; k++)
+        balances[k] = BENCH_FUNDS;
+    for (int i = 0; i < count; i++)
+    {
+        Transaction tx = {0};
+        int k = i % key_count;
+        const KeyPair *key = &keys[k];
+        strcpy(tx.sender, key->address);
+        memcpy(tx.inputs[0].prev_txid, coins[k].txid, TXID_SIZE);
+        tx.inputs[0].index = coins[k].index;
+        tx.input_count = 1;
+        strcpy(tx.outputs[0].address, keys[(i + 1) % key_count].address);
+        tx.outputs[0].amount = (uint64_t)salt * 1000000 + (uint64_t)i + 1;
+        strcpy(tx.outputs[1].address, key->address);
+        tx.outputs[1].amount = balances[k] - tx.outputs[0].amount;
+        tx.output_count = 2;
+        transactions[i].length = transaction_encode(&tx, transactions[i].tx, sizeof(transactions[i].tx));
+        sign_transaction(key, transactions[i].tx, transactions[i].length, &transactions[i].witness);
+        compute_txid(transactions[i].tx, transactions[i].length, coins[k].txid);
+        coins[k].index = 1;
+        balances[k] = tx.outputs[1].amount;
+    }
+    free(balances);
+    return transactions;
+}
+
+int run_pipeline_benchmark(int block_count, int difficulty, const char *directory, const char *trace_path)
+{
+    if (block_count < 1 || difficulty < 1 || difficulty > 6)
+    {
+        print_error("Usage: --pipeline-bench [blocks] [difficulty 1-6] [directory] [trace file]");
+        return 1;
+    }
+    char default_directory[64];
+    if (!directory)
+    {
+        snprintf(default_directory, sizeof(default_directory), "/tmp/pipeline-bench-%d", (int)getpid());
+        directory = default_directory;
+    }
+    mkdir(directory, 0755);
+
+    print_header("BLOCK PRODUCTION PIPELINE BENCHMARK");
+    printf(COLOR_CYAN "%d blocks of %d signed transactions at difficulty %d, fsync'd to %s" COLOR_RESET "\n\n",
+           block_count, MAX_TRANSACTIONS, difficulty, directory);
+
+    KeyPair keys[MAX_TRANSACTIONS];
+    for (int i = 0; i < MAX_TRANSACTIONS; i++)
+    {
+        if (!keypair_generate(&keys[i]))
+        {
+            print_error("Could not generate keys");
+            return 1;
+        }
+    }
+
+    // Both runs land in one trace, the serial one first, so their timelines can be compared
+    if (trace_path)
+    {
+        trace_thread_name("main / store");
+        trace_enable(1);
+    }
+    const char *modes[2] = {"Serial", "Pipelined"};
+    const char *stage_names[STAGE_COUNT] = {"Validate", "Assemble", "Mine", "Store"};
+    StageStats stats[2][STAGE_COUNT];
+    double total_ms[2];
+    int stored[2], intact[2];
+    for (int run = 0; run < 2; run++)
+    {
+        // Fresh transactions per run, so the second one cannot reuse the first one's cached signatures
+        int count = block_count * MAX_TRANSACTIONS;
+        OutPoint coins[MAX_TRANSACTIONS];
+        Blockchain chain = {0};
+        BlockTree tree;
+        block_tree_init(&tree);
+        chain.tree = &tree;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/blocks-%s.dat", directory, run == 0 ? "serial" : "pipelined");
+        FILE *store = fopen(path, "w+b");
+        int funded = bench_genesis(&chain, difficulty, keys, MAX_TRANSACTIONS, run + 1, coins);
+        TxSubmission *transactions = funded ? bench_transactions(keys, MAX_TRANSACTIONS, count, run + 1, coins) : NULL;
+        if (!transactions || !store)
+        {
+            print_error("Could not set up the benchmark chain");
+            free(transactions);
+            if (store)
+                fclose(store);
+            block_tree_free(&tree);
+            free(chain.blocks);
+            return 1;
+        }
+
+        BlockPipeline pipeline = {0};
+        pipeline.chain = &chain;
+        pipeline.transactions = transactions;
+        pipeline.transaction_count = count;
+        pipeline.per_block = MAX_TRANSACTIONS;
+        pipeline.difficulty = difficulty;
+        pipeline.mining_threads = 1;
+        pipeline.store = store;
+
+        double start = now_ms();
+        stored[run] = run == 0 ? pipeline_run_serial(&pipeline) : pipeline_run(&pipeline);
+        total_ms[run] = now_ms() - start;
+        memcpy(stats[run], pipeline.stats, sizeof(pipeline.stats));
+        intact[run] = stored[run] == block_count && pipeline.rejected == 0 && block_store_verify(store, &chain, 1);
+
+        fclose(store);
+        unlink(path);
+        free(transactions);
+        block_tree_free(&tree);
+        free(chain.blocks);
+    }
+    if (directory == default_directory)
+        rmdir(directory);
+    long spans = trace_path ? trace_dump(trace_path) : 0;
+    trace_enable(0);
+
+    printf(COLOR_BLUE "┌───────────┬──────────┬─────────────────┬─────────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-9s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-15s" COLOR_BLUE " │ " COLOR_YELLOW "%-15s" COLOR_BLUE " │\n",
+           "Stage", "Items", "Serial busy ms", "Pipelined wait");
+    printf(COLOR_BLUE "├───────────┼──────────┼─────────────────┼─────────────────┤\n");
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-9s" COLOR_BLUE " │ " COLOR_CYAN "%-8d" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-15.1f" COLOR_BLUE " │ " COLOR_CYAN "%-15.1f" COLOR_BLUE " │\n",
+               stage_names[s], stats[1][s].items, stats[0][s].busy_ms, stats[1][s].wait_ms);
+    }
+    printf(COLOR_BLUE "└───────────┴──────────┴─────────────────┴─────────────────┘" COLOR_RESET "\n\n");
+
+    printf(COLOR_BLUE "┌───────────┬────────────┬──────────┬──────────────────┬────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-9s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-16s" COLOR_BLUE " │ " COLOR_YELLOW "%-6s" COLOR_BLUE " │\n",
+           "Mode", "Total (ms)", "Blocks/s", "Miner idle (ms)", "Intact");
+    printf(COLOR_BLUE "├───────────┼────────────┼──────────┼──────────────────┼────────┤\n");
+    for (int run = 0; run < 2; run++)
+    {
+        // Wall time the nonce search was not running: the gap a pipeline is meant to close
+        double idle = total_ms[run] - stats[run][STAGE_MINE].busy_ms;
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-9s" COLOR_BLUE " │ " COLOR_CYAN "%-10.1f" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-8.1f" COLOR_BLUE " │ " COLOR_CYAN "%-16.1f" COLOR_BLUE " │ %s%-6s" COLOR_BLUE " │\n",
+               modes[run], total_ms[run], stored[run] / (total_ms[run] / 1000.0), idle,
+               intact[run] ? COLOR_GREEN : COLOR_RED, intact[run] ? "yes" : "no");
+    }
+    printf(COLOR_BLUE "└───────────┴────────────┴──────────┴──────────────────┴────────┘" COLOR_RESET "\n");
+
+    if (!intact[0] || !intact[1])
+    {
+        print_error("A run lost blocks or wrote a block file that does not match its chain");
+        return 1;
+    }
+    printf(COLOR_GREEN "\nPipelining finished %.2fx faster; the miner waited %.1f ms for templates in total" COLOR_RESET
+                       "\n",
+           total_ms[0] / total_ms[1], stats[1][STAGE_MINE].wait_ms);
+    if (spans < 0)
+    {
+        printf(COLOR_RED "✗ Could not write the trace to %s" COLOR_RESET "\n", trace_path);
+        return 1;
+    }
+    if (trace_path)
+        printf(COLOR_GREEN "✔ Wrote %ld spans to %s" COLOR_RESET "\n", spans, trace_path);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include "blockchain.h"
+#include "txqueue.h"
+
+/* ================ CONSTANTS ================ */
+#define PIPELINE_TX_DEPTH 64      // Validated transactions waiting for assembly
+#define PIPELINE_TEMPLATE_DEPTH 1 // Templates assembled ahead of the one being mined
+#define PIPELINE_STORE_DEPTH 4    // Mined blocks waiting to be connected and written
+
+#define STAGE_VALIDATE 0 // Parse and check signatures
+#define STAGE_ASSEMBLE 1 // Fill a template and compute its Merkle root
+#define STAGE_MINE 2     // Link to the last block found and search nonces
+#define STAGE_STORE 3    // Connect to the chain, append to the block file, announce
+#define STAGE_COUNT 4
+
+/* ================ DATA STRUCTURES ================ */
+// Bounded blocking queue between two stages; closing it lets the consumer drain and stop
+typedef struct
+{
+    void **items;             // Ring of pointers
+    int capacity;             // Slots in items
+    int head;                 // Oldest item
+    int count;                // Items queued
+    int closed;               // Producer is done
+    int cancelled;            // Run abandoned: pushes are refused and pops return NULL at once
+    pthread_mutex_t lock;     // Guards everything above
+    pthread_cond_t not_empty; // Signalled on push, close and cancel
+    pthread_cond_t not_full;  // Signalled on pop and cancel
+} StageQueue;
+
+typedef struct
+{
+    double busy_ms; // Doing the stage's own work
+    double wait_ms; // Blocked on its input queue (or on a full output queue)
+    int items;      // Transactions or blocks it passed on
+} StageStats;
+
+typedef void (*BlockCallback)(const Block *block, void *context);
+
+typedef struct
+{
+    Blockchain *chain;                    // Extended from its current tip
+    const TxSubmission *transactions;     // Everything to include, in order
+    int transaction_count;                // Entries in transactions
+    int per_block;                        // Transactions per block (<= MAX_TRANSACTIONS)
+    int difficulty;                       // Leading hex zeros each block must meet
+    int mining_threads;                   // Threads per nonce search
+    FILE *store;                          // Append-only block file (NULL: not persisted)
+    BlockCallback on_block;               // Called once a block is connected and stored (may be NULL)
+    void *context;                        // Passed to on_block
+    StageStats stats[STAGE_COUNT];        // Filled in by the run
+    int blocks_stored;                    // Blocks connected to the chain
+    int rejected;                         // Transactions or blocks refused along the way
+} BlockPipeline;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int block_store_append(FILE *store, const Block *block);
+int block_store_verify(FILE *store, const Blockchain *chain, int first_height);
+int pipeline_run_serial(BlockPipeline *pipeline);
+int pipeline_run(BlockPipeline *pipeline);
+int run_pipeline_benchmark(int block_count, int difficulty, const char *directory, const char *trace_path);
+
+#endif
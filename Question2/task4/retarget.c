@@ -0,0 +1,492 @@
+#include "retarget.h"
+#include "miner.h"
+#include "transaction.h"
+
+static const char *const algorithm_names[] = {"fixed", "window", "lwma", "asert"}; // Indexed by RETARGET_*
+
+/* ================ 256-BIT ARITHMETIC ================ */
+static int target_is_zero(const Target *target)
+{
+    for (int i = 0; i < TARGET_WORDS; i++)
+    {
+        if (target->words[i])
+            return 0;
+    }
+    return 1;
+}
+
+static int target_compare(const Target *a, const Target *b)
+{
+    for (int i = TARGET_WORDS - 1; i >= 0; i--)
+    {
+        if (a->words[i] != b->words[i])
+            return a->words[i] < b->words[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static int target_bit_length(const Target *target)
+{
+    for (int i = TARGET_WORDS - 1; i >= 0; i--)
+    {
+        if (target->words[i])
+            return 32 * i + 32 - __builtin_clz(target->words[i]);
+    }
+    return 0;
+}
+
+static void target_shift_right(Target *target, int bits)
+{
+    Target result = {{0}};
+    int words = bits / 32, rest = bits % 32;
+    for (int i = 0; i + words < TARGET_WORDS; i++)
+    {
+        uint64_t pair = target->words[i + words];
+        if (i + words + 1 < TARGET_WORDS)
+            pair |= (uint64_t)target->words[i + words + 1] << 32;
+        result.words[i] = (uint32_t)(pair >> rest);
+    }
+    *target = result;
+}
+
+static int target_shift_left(Target *target, int bits)
+{
+    // Returns 0 if set bits would be shifted out of the top
+    if (bits > 0 && target_bit_length(target) + bits > 256)
+        return 0;
+    Target result = {{0}};
+    int words = bits / 32, rest = bits % 32;
+    for (int i = TARGET_WORDS - 1; i >= words; i--)
+    {
+        uint64_t pair = (uint64_t)target->words[i - words] << 32;
+        if (i - words - 1 >= 0)
+            pair |= target->words[i - words - 1];
+        result.words[i] = (uint32_t)((pair << rest) >> 32);
+    }
+    *target = result;
+    return 1;
+}
+
+static int target_multiply(Target *target, uint64_t factor)
+{
+    unsigned __int128 carry = 0;
+    for (int i = 0; i < TARGET_WORDS; i++)
+    {
+        carry += (unsigned __int128)target->words[i] * factor;
+        target->words[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    return carry == 0;
+}
+
+static void target_divide(Target *target, uint64_t divisor)
+{
+    unsigned __int128 remainder = 0;
+    for (int i = TARGET_WORDS - 1; i >= 0; i--)
+    {
+        remainder = (remainder << 32) | target->words[i];
+        target->words[i] = (uint32_t)(remainder / divisor);
+        remainder %= divisor;
+    }
+}
+
+static void target_add(Target *target, const Target *other)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < TARGET_WORDS; i++)
+    {
+        carry += (uint64_t)target->words[i] + other->words[i];
+        target->words[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+static void target_scale(Target *target, uint64_t numerator, uint64_t denominator)
+{
+    // Multiply first for precision; divide first if that would overflow 256 bits
+    Target product = *target;
+    if (target_multiply(&product, numerator))
+    {
+        target_divide(&product, denominator);
+        *target = product;
+        return;
+    }
+    target_divide(target, denominator);
+    if (!target_multiply(target, numerator))
+        memset(target->words, 0xff, sizeof(target->words));
+}
+
+/* ================ COMPACT ENCODING ================ */
+void target_from_bits(uint32_t bits, Target *target)
+{
+    // Bitcoin nBits: size byte, then a 23-bit mantissa; bit 23 is a sign and makes the target invalid
+    memset(target, 0, sizeof(*target));
+    int size = (int)(bits >> 24);
+    uint32_t mantissa = bits & 0x007fffff;
+    if ((bits & 0x00800000) || size > 32)
+        return;
+    if (size <= 3)
+    {
+        target->words[0] = mantissa >> (8 * (3 - size));
+        return;
+    }
+    target->words[0] = mantissa;
+    target_shift_left(target, 8 * (size - 3));
+}
+
+uint32_t target_to_bits(const Target *target)
+{
+    int size = (target_bit_length(target) + 7) / 8;
+    uint32_t mantissa;
+    if (size <= 3)
+    {
+        mantissa = target->words[0] << (8 * (3 - size));
+    }
+    else
+    {
+        Target shifted = *target;
+        target_shift_right(&shifted, 8 * (size - 3));
+        mantissa = shifted.words[0];
+    }
+    if (mantissa & 0x00800000)
+    {
+        mantissa >>= 8;
+        size++;
+    }
+    return (uint32_t)size << 24 | mantissa;
+}
+
+uint32_t target_bits_from_difficulty(int difficulty)
+{
+    Target target;
+    if (difficulty < POW_LIMIT_DIFFICULTY)
+        difficulty = POW_LIMIT_DIFFICULTY;
+    if (difficulty > 63)
+        difficulty = 63;
+    memset(target.words, 0xff, sizeof(target.words));
+    target_shift_right(&target, 4 * difficulty);
+    return target_to_bits(&target);
+}
+
+int target_leading_zeros(uint32_t bits)
+{
+    Target target;
+    target_from_bits(bits, &target);
+    return (256 - target_bit_length(&target)) / 4;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int hash_meets_target(const char *hash, uint32_t bits)
+{
+    Target value, target;
+    target_from_bits(bits, &target);
+    if (target_is_zero(&target))
+        return 0;
+
+    // Almost every mining attempt fails on its first digits, before any 256-bit work
+    int zeros = (256 - target_bit_length(&target)) / 4;
+    for (int i = 0; i < zeros; i++)
+    {
+        if (hash[i] != '0')
+            return 0;
+    }
+
+    for (int i = 0; i < TARGET_WORDS; i++)
+    {
+        const char *digits = hash + 8 * (TARGET_WORDS - 1 - i);
+        uint32_t word = 0;
+        for (int d = 0; d < 8; d++)
+        {
+            int nibble = hex_digit(digits[d]);
+            if (nibble < 0)
+                return 0;
+            word = word << 4 | (uint32_t)nibble;
+        }
+        value.words[i] = word;
+    }
+    return target_compare(&value, &target) <= 0;
+}
+
+uint64_t target_work(uint32_t bits)
+{
+    // Expected hashes per block: 2^256 / (target + 1), from the target's top 64 bits
+    Target target;
+    target_from_bits(bits, &target);
+    int leading = 256 - target_bit_length(&target);
+    if (target_is_zero(&target) || leading >= 63)
+        return UINT64_MAX;
+
+    Target top = target;
+    target_shift_right(&top, 192 - leading);
+    uint64_t mantissa = (uint64_t)top.words[1] << 32 | top.words[0];
+    unsigned __int128 work = ((unsigned __int128)1 << (64 + leading)) / mantissa;
+    return work > UINT64_MAX ? UINT64_MAX : (uint64_t)work;
+}
+
+/* ================ RETARGETING ================ */
+void retarget_init(RetargetParams *params, int algorithm, int64_t target_spacing)
+{
+    params->algorithm = algorithm;
+    params->target_spacing = target_spacing > 0 ? target_spacing : 1;
+    params->window = algorithm == RETARGET_WINDOW ? 10 : 20;
+    params->half_life = params->target_spacing * 10;
+    params->pow_limit = target_bits_from_difficulty(POW_LIMIT_DIFFICULTY);
+}
+
+int retarget_parse_algorithm(const char *name)
+{
+    for (int i = 0; i < (int)(sizeof(algorithm_names) / sizeof(algorithm_names[0])); i++)
+    {
+        if (strcmp(name, algorithm_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *retarget_algorithm_name(int algorithm)
+{
+    int known = algorithm >= 0 && algorithm < (int)(sizeof(algorithm_names) / sizeof(algorithm_names[0]));
+    return known ? algorithm_names[algorithm] : "unknown";
+}
+
+static uint32_t clamp_to_limit(const RetargetParams *params, Target *target)
+{
+    Target limit;
+    target_from_bits(params->pow_limit, &limit);
+    if (target_compare(target, &limit) > 0)
+        return params->pow_limit;
+    if (target_is_zero(target))
+        target->words[0] = 1;
+    return target_to_bits(target);
+}
+
+static uint32_t next_window(const RetargetParams *params, const int64_t *timestamps, const uint32_t *bits, int count)
+{
+    if (count % params->window != 0)
+        return bits[count - 1];
+
+    int first = count - 1 - params->window < 0 ? 0 : count - 1 - params->window;
+    int64_t intervals = count - 1 - first;
+    if (intervals <= 0)
+        return bits[count - 1];
+    int64_t expected = params->target_spacing * intervals;
+    int64_t actual = timestamps[count - 1] - timestamps[first];
+    if (actual < expected / WINDOW_MAX_ADJUST)
+        actual = expected / WINDOW_MAX_ADJUST;
+    if (actual > expected * WINDOW_MAX_ADJUST)
+        actual = expected * WINDOW_MAX_ADJUST;
+    if (actual < 1)
+        actual = 1;
+
+    Target target;
+    target_from_bits(bits[count - 1], &target);
+    target_scale(&target, (uint64_t)actual, (uint64_t)expected);
+    return clamp_to_limit(params, &target);
+}
+
+static uint32_t next_lwma(const RetargetParams *params, const int64_t *timestamps, const uint32_t *bits, int count)
+{
+    int n = count - 1 < params->window ? count - 1 : params->window;
+    if (n < 1)
+        return bits[count - 1];
+
+    // Recent solve times weigh more, so the target reacts within a few blocks
+    uint64_t weighted = 0;
+    Target average = {{0}};
+    for (int i = 1; i <= n; i++)
+    {
+        int index = count - n - 1 + i;
+        int64_t solve_time = timestamps[index] - timestamps[index - 1];
+        if (solve_time < 1)
+            solve_time = 1;
+        if (solve_time > LWMA_MAX_SOLVE * params->target_spacing)
+            solve_time = LWMA_MAX_SOLVE * params->target_spacing;
+        weighted += (uint64_t)solve_time * (uint64_t)i;
+
+        Target share;
+        target_from_bits(bits[index], &share);
+        target_divide(&share, (uint64_t)n);
+        target_add(&average, &share);
+    }
+    uint64_t expected = (uint64_t)n * (uint64_t)(n + 1) / 2 * (uint64_t)params->target_spacing;
+    target_scale(&average, weighted, expected);
+    return clamp_to_limit(params, &average);
+}
+
+static uint32_t next_asert(const RetargetParams *params, const int64_t *timestamps, const uint32_t *bits, int count)
+{
+    // Target = anchor * 2^((time ahead of schedule) / half_life), anchored at the first block
+    int64_t time_delta = timestamps[count - 1] - timestamps[0];
+    int64_t height_delta = count - 1;
+    int64_t drift = time_delta - params->target_spacing * height_delta;
+    int64_t exponent = drift * 65536 / params->half_life;
+    if (drift * 65536 % params->half_life != 0 && drift < 0)
+        exponent--; // Floor division
+    int64_t shifts = exponent >> 16;
+    uint64_t fraction = (uint64_t)(exponent & 0xffff);
+
+    // Cubic approximation of 2^fraction in 16.16 fixed point (aserti3-2d)
+    unsigned __int128 polynomial = (unsigned __int128)195766423245049ull * fraction +
+                                   (unsigned __int128)971821376ull * fraction * fraction +
+                                   (unsigned __int128)5127ull * fraction * fraction * fraction +
+                                   ((unsigned __int128)1 << 47);
+    uint64_t factor = 65536 + (uint64_t)(polynomial >> 48);
+
+    // factor carries 16 fractional bits; drop them up front when the product would not fit
+    Target target;
+    target_from_bits(bits[0], &target);
+    shifts -= 16;
+    if (target_bit_length(&target) + 17 > 256)
+    {
+        target_shift_right(&target, 16);
+        shifts += 16;
+    }
+    target_multiply(&target, factor);
+    if (shifts >= 256 || (shifts > 0 && !target_shift_left(&target, (int)shifts)))
+        return params->pow_limit;
+    if (shifts < 0)
+        target_shift_right(&target, shifts < -256 ? 256 : (int)-shifts);
+    return clamp_to_limit(params, &target);
+}
+
+uint32_t retarget_next_bits(const RetargetParams *params, const int64_t *timestamps, const uint32_t *bits, int count)
+{
+    if (count < 1)
+        return params->pow_limit;
+    switch (params->algorithm)
+    {
+    case RETARGET_WINDOW:
+        return next_window(params, timestamps, bits, count);
+    case RETARGET_LWMA:
+        return next_lwma(params, timestamps, bits, count);
+    case RETARGET_ASERT:
+        return next_asert(params, timestamps, bits, count);
+    default:
+        return bits[count - 1];
+    }
+}
+
+uint32_t retarget_next_chain_bits(const RetargetParams *params, const Blockchain *chain)
+{
+    int count = chain->block_count;
+    int64_t *timestamps = malloc((size_t)(count > 0 ? count : 1) * sizeof(int64_t));
+    uint32_t *bits = malloc((size_t)(count > 0 ? count : 1) * sizeof(uint32_t));
+    uint32_t next = params->pow_limit;
+    if (timestamps && bits)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            timestamps[i] = (int64_t)chain->blocks[i].timestamp;
+            bits[i] = chain->blocks[i].target_bits;
+        }
+        next = retarget_next_bits(params, timestamps, bits, count);
+    }
+    free(timestamps);
+    free(bits);
+    return next;
+}
+
+/* ================ RETARGET SIMULATION ================ */
+static int64_t monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int run_retarget_simulation(int algorithm, int spacing_ms, int blocks_per_phase)
+{
+    const int phase_threads[] = {1, 2, 4, 2, 1};
+    const int phase_count = (int)(sizeof(phase_threads) / sizeof(phase_threads[0]));
+    if (algorithm < 0 || spacing_ms < 1 || blocks_per_phase < 2)
+    {
+        print_error("Usage: --retarget-sim <fixed|window|lwma|asert> [block time ms] [blocks per phase]");
+        return 1;
+    }
+
+    RetargetParams params;
+    retarget_init(&params, algorithm, spacing_ms);
+    int total = phase_count * blocks_per_phase + 1;
+    int64_t *timestamps = malloc((size_t)total * sizeof(int64_t));
+    uint32_t *bits = malloc((size_t)total * sizeof(uint32_t));
+    if (!timestamps || !bits)
+    {
+        free(timestamps);
+        free(bits);
+        print_error("Out of memory");
+        return 1;
+    }
+
+    print_header("DIFFICULTY RETARGET SIMULATION");
+    printf(COLOR_CYAN "Algorithm %s, goal %d ms per block, %d blocks per phase" COLOR_RESET "\n",
+           retarget_algorithm_name(algorithm), spacing_ms, blocks_per_phase);
+    printf(COLOR_BLUE "┌───────┬─────────┬──────────────┬──────────────┬──────────────┬──────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-5s" COLOR_BLUE " │ " COLOR_YELLOW "%-7s" COLOR_BLUE " │ " COLOR_YELLOW "%-12s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-12s" COLOR_BLUE " │ " COLOR_YELLOW "%-12s" COLOR_BLUE " │ " COLOR_YELLOW "%-12s" COLOR_BLUE " │\n",
+           "Phase", "Threads", "Avg gap (ms)", "Off goal", "Hashes/block", "kH/s");
+    printf(COLOR_BLUE "├───────┼─────────┼──────────────┼──────────────┼──────────────┼──────────────┤\n");
+
+    // The anchor block stands in for genesis: starting difficulty, mined "now"
+    Block block;
+    memset(&block, 0, sizeof(block));
+    strcpy(block.hash, "0000000000000000000000000000000000000000000000000000000000000000");
+    timestamps[0] = monotonic_ms();
+    bits[0] = target_bits_from_difficulty(DEFAULT_DIFFICULTY - 1);
+    int count = 1;
+
+    for (int phase = 0; phase < phase_count; phase++)
+    {
+        int64_t phase_start = timestamps[count - 1];
+        uint64_t phase_attempts = 0, phase_work = 0;
+        for (int b = 0; b < blocks_per_phase; b++)
+        {
+            Block next;
+            int nonce_attempts;
+            memset(&next, 0, sizeof(next));
+            next.index = count;
+            next.timestamp = time(NULL);
+            strcpy(next.previous_hash, block.hash);
+            char coinbase[TX_TEXT_SIZE];
+            snprintf(coinbase, sizeof(coinbase), "coinbase->miner:%d", count);
+            block_add_text_transaction(&next, coinbase);
+
+            uint32_t next_bits = retarget_next_bits(&params, timestamps, bits, count);
+            solve_block_bits(&next, next_bits, phase_threads[phase], &nonce_attempts);
+            timestamps[count] = monotonic_ms();
+            bits[count] = next_bits;
+            phase_attempts += (uint64_t)nonce_attempts;
+            phase_work += target_work(next_bits);
+            block = next;
+            count++;
+        }
+
+        double elapsed_ms = (double)(timestamps[count - 1] - phase_start);
+        double gap_ms = elapsed_ms / blocks_per_phase;
+        double off_goal = 100.0 * (gap_ms - spacing_ms) / spacing_ms;
+        char off_text[16];
+        snprintf(off_text, sizeof(off_text), "%+.1f%%", off_goal);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-5d" COLOR_BLUE " │ " COLOR_CYAN "%-7d" COLOR_BLUE " │ " COLOR_CYAN "%-12.1f" COLOR_BLUE
+                          " │ %s%-12s" COLOR_BLUE " │ " COLOR_CYAN "%-12.0f" COLOR_BLUE " │ " COLOR_CYAN "%-12.1f" COLOR_BLUE " │\n",
+               phase + 1, phase_threads[phase], gap_ms, off_goal < 25.0 && off_goal > -25.0 ? COLOR_GREEN : COLOR_ORANGE,
+               off_text, (double)phase_work / blocks_per_phase,
+               elapsed_ms > 0 ? (double)phase_attempts / elapsed_ms : 0.0);
+    }
+    printf(COLOR_BLUE "└───────┴─────────┴──────────────┴──────────────┴──────────────┴──────────────┘" COLOR_RESET "\n");
+
+    double overall = (double)(timestamps[count - 1] - timestamps[0]) / (count - 1);
+    printf(COLOR_GREEN "\nOverall: %.1f ms per block against a %d ms goal; final target 0x%08x (%d leading zeros)" COLOR_RESET "\n",
+           overall, spacing_ms, bits[count - 1], target_leading_zeros(bits[count - 1]));
+    free(timestamps);
+    free(bits);
+    return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef RETARGET_H
+#define RETARGET_H
+
+#include <stdint.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define TARGET_WORDS 8         // 32-bit words in a 256-bit target
+#define POW_LIMIT_DIFFICULTY 1 // Easiest target allowed: one leading hex zero
+
+#define RETARGET_FIXED 0  // Target never changes
+#define RETARGET_WINDOW 1 // Bitcoin-style: rescale once every window blocks
+#define RETARGET_LWMA 2   // Linearly weighted moving average, every block
+#define RETARGET_ASERT 3  // Absolutely scheduled exponential rule, every block
+
+#define WINDOW_MAX_ADJUST 4 // Window retarget moves at most 4x per step
+#define LWMA_MAX_SOLVE 6    // LWMA clamps each solve time to 6 spacings
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    uint32_t words[TARGET_WORDS]; // 256-bit unsigned value, least significant word first
+} Target;
+
+typedef struct
+{
+    int algorithm;          // RETARGET_*
+    int64_t target_spacing; // Desired time between blocks, in the timestamps' unit
+    int window;             // WINDOW: blocks per step, LWMA: blocks averaged
+    int64_t half_life;      // ASERT: schedule drift that doubles or halves the target
+    uint32_t pow_limit;     // Compact form of the easiest allowed target
+} RetargetParams;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void target_from_bits(uint32_t bits, Target *target);
+uint32_t target_to_bits(const Target *target);
+uint32_t target_bits_from_difficulty(int difficulty);
+int target_leading_zeros(uint32_t bits);
+int hash_meets_target(const char *hash, uint32_t bits);
+uint64_t target_work(uint32_t bits);
+
+void retarget_init(RetargetParams *params, int algorithm, int64_t target_spacing);
+int retarget_parse_algorithm(const char *name);
+const char *retarget_algorithm_name(int algorithm);
+uint32_t retarget_next_bits(const RetargetParams *params, const int64_t *timestamps, const uint32_t *bits,
+                            int count);
+uint32_t retarget_next_chain_bits(const RetargetParams *params, const Blockchain *chain);
+int run_retarget_simulation(int algorithm, int spacing_ms, int blocks_per_phase);
+
+#endif
@@ -0,0 +1,1166 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "rpc.h"
+#include "block_tree.h"
+#include "json.h"
+#include "light.h"
+#include "metrics.h"
+#include "miner.h"
+#include "transaction.h"
+
+/* ================ METHODS ================ */
+// Each method writes its result to out and returns 0, or returns an error code and sets message
+typedef int (*RpcMethod)(Node *node, const JsonSpan *params, ByteWriter *out, const char **message);
+
+typedef struct
+{
+    const char *name;  // JSON-RPC method name
+    RpcMethod handler; // Implementation
+} RpcEntry;
+
+static int param_count(const JsonSpan *params)
+{
+    JsonSpan value;
+    int count = 0;
+    while (json_item(params, count, &value))
+        count++;
+    return count;
+}
+
+static int param_text(const JsonSpan *params, int index, char *text, size_t size)
+{
+    JsonSpan value;
+    return json_item(params, index, &value) && json_text(&value, text, size);
+}
+
+static int rpc_getblockcount(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    (void)params;
+    (void)message;
+    put_format(out, "%d", node->chain->block_count - 1);
+    return 0;
+}
+
+static int rpc_getbestblockhash(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    (void)params;
+    if (node->chain->block_count == 0)
+    {
+        *message = "No blocks yet";
+        return RPC_NOT_FOUND;
+    }
+    put_format(out, "\"%s\"", node->chain->blocks[node->chain->block_count - 1].hash);
+    return 0;
+}
+
+// params: [height] or ["block hash"]; blocks off the active chain report -1 confirmations
+static int rpc_getblock(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    const Blockchain *chain = node->chain;
+    const Block *block = NULL;
+    int height = -1;
+    JsonSpan value;
+    long long number;
+    char hash[HASH_SIZE];
+    if (!json_item(params, 0, &value))
+    {
+        *message = "Expected [height] or [\"hash\"]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (json_integer(&value, &number))
+    {
+        if (number >= 0 && number < chain->block_count)
+        {
+            block = &chain->blocks[number];
+            height = (int)number;
+        }
+    }
+    else if (json_text(&value, hash, sizeof(hash)))
+    {
+        BlockNode *found = block_tree_find_block(chain->tree, hash);
+        if (found)
+        {
+            block = &found->block;
+            height = found->height;
+        }
+    }
+    else
+    {
+        *message = "Expected [height] or [\"hash\"]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (!block)
+    {
+        *message = "Block not found";
+        return RPC_NOT_FOUND;
+    }
+    const BlockNode *stored = block_tree_find(chain->tree, block->hash);
+    if (stored && stored->pruned)
+    {
+        *message = "Block not available (pruned data)";
+        return RPC_NOT_FOUND;
+    }
+
+    int active = height < chain->block_count && strcmp(chain->blocks[height].hash, block->hash) == 0;
+    put_format(out, "{\"hash\":\"%s\",\"height\":%d,\"confirmations\":%d,\"previousblockhash\":\"%s\",", block->hash,
+               height, active ? chain->block_count - height : -1, block->previous_hash);
+    put_format(out, "\"merkleroot\":\"%s\",\"time\":%lld,\"nonce\":%d,\"bits\":\"%08x\",\"difficulty\":%d,\"tx\":[",
+               block->merkle_root, (long long)block->timestamp, block->nonce, block->target_bits, block->difficulty);
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        TxView view;
+        unsigned char txid[TXID_SIZE];
+        char txid_hex[TXID_SIZE * 2 + 1], text[TX_TEXT_SIZE];
+        if (!block_transaction(block, i, &view))
+            continue;
+        compute_txid(view.data, view.length, txid);
+        bytes_to_hex(txid, TXID_SIZE, txid_hex);
+        tx_view_format(&view, text, sizeof(text));
+        put_format(out, "%s{\"txid\":\"%s\",\"signed\":%s,\"text\":", i > 0 ? "," : "", txid_hex,
+                   witness_is_empty(&block->witnesses[i]) ? "false" : "true");
+        put_json_string(out, text, strlen(text));
+        put_u8(out, '}');
+    }
+    put_text(out, "]}");
+    return 0;
+}
+
+typedef struct
+{
+    const char *address; // Owner being looked up
+    ByteWriter *out;     // Receives listunspent entries (NULL for getbalance)
+    int tip;             // Active height, for confirmations
+    int count;           // Coins found
+    uint64_t total;      // Their sum
+} CoinQuery;
+
+static int visit_coin(const Coin *coin, void *context)
+{
+    CoinQuery *query = context;
+    if (strcmp(coin->address, query->address) != 0)
+        return 1;
+    if (query->out)
+    {
+        char txid[TXID_SIZE * 2 + 1], amount[32];
+        bytes_to_hex(coin->outpoint.txid, TXID_SIZE, txid);
+        format_amount(coin->amount, amount, sizeof(amount));
+        put_format(query->out, "%s{\"txid\":\"%s\",\"vout\":%u,\"amount\":%s,\"height\":%d,\"confirmations\":%d}",
+                   query->count > 0 ? "," : "", txid, coin->outpoint.index, amount, coin->height,
+                   query->tip - coin->height + 1);
+    }
+    query->count++;
+    query->total += coin->amount;
+    return 1;
+}
+
+static int rpc_getbalance(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    char address[TX_MAX_ADDRESS + 1], amount[32];
+    if (!param_text(params, 0, address, sizeof(address)))
+    {
+        *message = "Expected [\"address\"]";
+        return RPC_INVALID_PARAMS;
+    }
+    // The address index keeps every balance current; without it the UTXO set is scanned
+    const AddressIndex *index = node->chain->tree->addresses;
+    if (index)
+    {
+        const AddressRecord *record = address_index_find(index, address);
+        format_amount(record ? record->balance : 0, amount, sizeof(amount));
+        put_text(out, amount);
+        return 0;
+    }
+    CoinQuery query = {address, NULL, node->chain->block_count - 1, 0, 0};
+    utxo_set_for_each(&node->chain->tree->utxos, visit_coin, &query);
+    format_amount(query.total, amount, sizeof(amount));
+    put_text(out, amount);
+    return 0;
+}
+
+// params: ["address"] or ["address", count]; the newest count transactions touching it, oldest first
+static int rpc_getaddresshistory(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    const Blockchain *chain = node->chain;
+    char address[TX_MAX_ADDRESS + 1], amount[32];
+    JsonSpan value;
+    long long count = ADDRINDEX_HISTORY;
+    if (!param_text(params, 0, address, sizeof(address)) ||
+        (json_item(params, 1, &value) && (!json_integer(&value, &count) || count < 1)))
+    {
+        *message = "Expected [\"address\"] or [\"address\", count]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (!chain->tree->addresses)
+    {
+        *message = "Address index not kept (start the node with --addrindex)";
+        return RPC_NOT_FOUND;
+    }
+    if (count > ADDRINDEX_MAX_HISTORY)
+        count = ADDRINDEX_MAX_HISTORY;
+
+    const AddressRecord *record = address_index_find(chain->tree->addresses, address);
+    int entries = record ? record->entries : 0;
+    format_amount(record ? record->balance : 0, amount, sizeof(amount));
+    put_text(out, "{\"address\":");
+    put_json_string(out, address, strlen(address));
+    put_format(out, ",\"balance\":%s,\"transactions\":%d,\"history\":[", amount, entries);
+    if (record)
+    {
+        AddressCursor cursor;
+        AddressEntry entry;
+        int skip = entries > count ? entries - (int)count : 0, shown = 0;
+        address_cursor_init(&cursor, record);
+        for (int i = 0; address_cursor_next(&cursor, &entry); i++)
+        {
+            size_t length;
+            unsigned char txid[TXID_SIZE];
+            char txid_hex[TXID_SIZE * 2 + 1];
+            if (i < skip || entry.height >= chain->block_count ||
+                entry.position >= chain->blocks[entry.height].transaction_count)
+                continue;
+            const unsigned char *tx = block_transaction_bytes(&chain->blocks[entry.height], entry.position, &length);
+            compute_txid(tx, length, txid);
+            bytes_to_hex(txid, TXID_SIZE, txid_hex);
+            format_amount(entry.delta < 0 ? (uint64_t)-entry.delta : (uint64_t)entry.delta, amount, sizeof(amount));
+            put_format(out, "%s{\"txid\":\"%s\",\"height\":%d,\"index\":%d,\"delta\":%s%s}", shown++ > 0 ? "," : "",
+                       txid_hex, entry.height, entry.position, entry.delta < 0 ? "-" : "", amount);
+        }
+    }
+    put_text(out, "]}");
+    return 0;
+}
+
+static int rpc_listunspent(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    char address[TX_MAX_ADDRESS + 1];
+    if (!param_text(params, 0, address, sizeof(address)))
+    {
+        *message = "Expected [\"address\"]";
+        return RPC_INVALID_PARAMS;
+    }
+    CoinQuery query = {address, out, node->chain->block_count - 1, 0, 0};
+    put_u8(out, '[');
+    utxo_set_for_each(&node->chain->tree->utxos, visit_coin, &query);
+    put_u8(out, ']');
+    return 0;
+}
+
+// params: ["hex transaction", "hex public key + signature"] or ["sender->receiver:amount"], paid from the sender's coins
+static int rpc_sendtransaction(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    char text[MAX_TX_SIZE * 2 + 1], witness_hex[(PUBLIC_KEY_SIZE + SIGNATURE_SIZE) * 2 + 1];
+    unsigned char encoded[MAX_TX_SIZE];
+    size_t length = 0;
+    TxWitness witness = {0};
+    Transaction tx;
+    *message = "Expected [\"hex transaction\", \"hex witness\"] or [\"sender->receiver:amount\"]";
+    if (!param_text(params, 0, text, sizeof(text)))
+        return RPC_INVALID_PARAMS;
+    if (strstr(text, "->"))
+    {
+        if (!transaction_from_text(text, &tx))
+            return RPC_INVALID_PARAMS;
+        if (tx.output_count > 0 && node_fund_payment(node, &tx) < tx.outputs[0].amount)
+        {
+            *message = "Transaction rejected (the sender does not hold enough unspent coins)";
+            return RPC_REJECTED;
+        }
+        if ((length = transaction_encode(&tx, encoded, sizeof(encoded))) == 0)
+            return RPC_INVALID_PARAMS;
+    }
+    else
+    {
+        length = strlen(text) / 2;
+        if (length == 0 || strlen(text) % 2 != 0 || !hex_to_bytes(text, encoded, length))
+            return RPC_INVALID_PARAMS;
+    }
+    if (param_count(params) > 1)
+    {
+        if (!param_text(params, 1, witness_hex, sizeof(witness_hex)) || strlen(witness_hex) != sizeof(witness_hex) - 1 ||
+            !hex_to_bytes(witness_hex, witness.public_key, PUBLIC_KEY_SIZE) ||
+            !hex_to_bytes(witness_hex + PUBLIC_KEY_SIZE * 2, witness.signature, SIGNATURE_SIZE))
+            return RPC_INVALID_PARAMS;
+    }
+    TxView view;
+    if (!tx_view_parse(encoded, length, &view))
+    {
+        *message = "Transaction rejected (malformed)";
+        return RPC_REJECTED;
+    }
+
+    // The signature is checked on an ingest worker and the mempool admits it from the event loop
+    // later, so the answer is "queued"; without the ring the checks run here and it is "accepted"
+    int queued = node_ingest_transaction(node, encoded, length, &witness, NULL);
+    if (queued == 0)
+    {
+        *message = "Node busy: transaction ingestion ring is full, retry later";
+        return RPC_BUSY;
+    }
+    if (queued == INGEST_TOO_LARGE)
+    {
+        *message = "Transaction rejected (too large)";
+        return RPC_REJECTED;
+    }
+    if (queued == INGEST_NO_RING && !node_submit_transaction(node, encoded, length, &witness))
+    {
+        *message = "Transaction rejected (already pending, spends unavailable coins or badly signed)";
+        return RPC_REJECTED;
+    }
+
+    unsigned char txid[TXID_SIZE];
+    char txid_hex[TXID_SIZE * 2 + 1];
+    compute_txid(encoded, length, txid);
+    bytes_to_hex(txid, TXID_SIZE, txid_hex);
+    put_format(out, "{\"txid\":\"%s\",\"status\":\"%s\"}", txid_hex, queued > 0 ? "queued" : "accepted");
+    return 0;
+}
+
+static int rpc_getmempoolinfo(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    (void)params;
+    (void)message;
+    size_t bytes = 0;
+    for (int i = 0; i < node->mempool.count; i++)
+        bytes += node->mempool.entries[i].length;
+    put_format(out, "{\"size\":%d,\"bytes\":%zu}", node->mempool.count, bytes);
+    return 0;
+}
+
+// params: [start height, count]; each header is serialize_block_header in hex, for light clients
+static int rpc_getheaders(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    const Blockchain *chain = node->chain;
+    JsonSpan value;
+    long long start, count = LIGHT_HEADER_BATCH;
+    if (!json_item(params, 0, &value) || !json_integer(&value, &start) || start < 0 ||
+        (json_item(params, 1, &value) && (!json_integer(&value, &count) || count < 1)))
+    {
+        *message = "Expected [start height, count]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (count > LIGHT_HEADER_BATCH)
+        count = LIGHT_HEADER_BATCH;
+
+    ByteWriter header;
+    char hex[LIGHT_WIRE_HEADER * 2 + 1];
+    writer_init(&header);
+    put_u8(out, '[');
+    for (long long height = start; height < chain->block_count && height < start + count; height++)
+    {
+        header.length = 0;
+        serialize_block_header(&header, &chain->blocks[height]);
+        bytes_to_hex(header.data, header.length, hex);
+        put_format(out, "%s\"%s\"", height > start ? "," : "", hex);
+    }
+    put_u8(out, ']');
+    writer_free(&header);
+    return 0;
+}
+
+// An unspent output of the transaction names its block; otherwise the active chain is searched from the tip
+static int find_transaction_height(Node *node, const unsigned char txid[TXID_SIZE])
+{
+    OutPoint outpoint;
+    memcpy(outpoint.txid, txid, TXID_SIZE);
+    for (outpoint.index = 0; outpoint.index < TX_MAX_OUTPUTS; outpoint.index++)
+    {
+        const Coin *coin = utxo_set_find(&node->chain->tree->utxos, &outpoint);
+        if (coin && coin->height < node->chain->block_count)
+            return coin->height;
+    }
+    return -1;
+}
+
+// params: ["txid"] or ["txid", height]; answers a Merkle branch a light client checks against its headers
+static int rpc_gettxproof(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    const Blockchain *chain = node->chain;
+    char txid_hex[TXID_SIZE * 2 + 1];
+    unsigned char txid[TXID_SIZE], computed[TXID_SIZE];
+    JsonSpan value;
+    long long number;
+    int low = 0, high = chain->block_count - 1;
+    if (!param_text(params, 0, txid_hex, sizeof(txid_hex)) || strlen(txid_hex) != TXID_SIZE * 2 ||
+        !hex_to_bytes(txid_hex, txid, TXID_SIZE) ||
+        (json_item(params, 1, &value) && !json_integer(&value, &number)))
+    {
+        *message = "Expected [\"txid\"] or [\"txid\", height]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (json_item(params, 1, &value))
+        low = high = number >= 0 && number < chain->block_count ? (int)number : -1;
+    else
+    {
+        int height = find_transaction_height(node, txid);
+        if (height >= 0)
+            low = high = height;
+    }
+
+    for (int height = high; height >= low && height >= 0; height--)
+    {
+        const Block *block = &chain->blocks[height];
+        for (int i = 0; i < block->transaction_count; i++)
+        {
+            size_t length;
+            const unsigned char *tx = block_transaction_bytes(block, i, &length);
+            compute_txid(tx, length, computed);
+            if (memcmp(computed, txid, TXID_SIZE) != 0)
+                continue;
+            const BlockNode *stored = block_tree_find(chain->tree, block->hash);
+            if (stored && stored->pruned)
+            {
+                *message = "Block not available (pruned data)";
+                return RPC_NOT_FOUND;
+            }
+            MerkleProof proof;
+            merkle_proof_build(block, i, &proof);
+            merkle_proof_write(out, &proof);
+            return 0;
+        }
+    }
+    *message = "Transaction not found in the active chain";
+    return RPC_NOT_FOUND;
+}
+
+// params: [height]; the active block's Golomb-coded filter, for wallets that scan without the blocks
+static int rpc_getblockfilter(Node *node, const JsonSpan *params, ByteWriter *out, const char **message)
+{
+    const FilterIndex *filters = &node->chain->tree->filters;
+    JsonSpan value;
+    long long height;
+    char hex[TXID_SIZE * 2 + 1];
+    if (!json_item(params, 0, &value) || !json_integer(&value, &height))
+    {
+        *message = "Expected [height]";
+        return RPC_INVALID_PARAMS;
+    }
+    if (height < 0 || height >= filters->count || height >= node->chain->block_count)
+    {
+        *message = "Block not found";
+        return RPC_NOT_FOUND;
+    }
+    const FilterEntry *entry = &filters->entries[height];
+    put_format(out, "{\"blockhash\":\"%s\",\"height\":%lld,\"elements\":%d,\"filter\":\"",
+               node->chain->blocks[height].hash, height, entry->elements);
+    for (size_t i = 0; i < entry->length; i += TXID_SIZE)
+    {
+        size_t chunk = entry->length - i < TXID_SIZE ? entry->length - i : TXID_SIZE;
+        bytes_to_hex(filters->bytes.data + entry->offset + i, chunk, hex);
+        put_text(out, hex);
+    }
+    put_text(out, "\"}");
+    return 0;
+}
+
+static const RpcEntry rpc_methods[] = {
+    {"getblockcount", rpc_getblockcount},
+    {"getbestblockhash", rpc_getbestblockhash},
+    {"getblock", rpc_getblock},
+    {"getbalance", rpc_getbalance},
+    {"getaddresshistory", rpc_getaddresshistory},
+    {"listunspent", rpc_listunspent},
+    {"sendtransaction", rpc_sendtransaction},
+    {"getmempoolinfo", rpc_getmempoolinfo},
+    {"getheaders", rpc_getheaders},
+    {"gettxproof", rpc_gettxproof},
+    {"getblockfilter", rpc_getblockfilter},
+};
+
+/* ================ DISPATCH ================ */
+static void put_error(RpcServer *server, ByteWriter *out, int code, const char *message)
+{
+    put_format(out, "\"error\":{\"code\":%d,\"message\":", code);
+    put_json_string(out, message, strlen(message));
+    put_u8(out, '}');
+    server->errors++;
+}
+
+// One request object; the answer carries the same id ("null" if it had none)
+static void dispatch_call(Node *node, const JsonSpan *call, ByteWriter *out)
+{
+    RpcServer *server = node->rpc;
+    JsonSpan method_span, params, id;
+    static const char empty_params[] = "[]";
+    char method[32];
+    int have_id = json_member(call, "id", &id);
+
+    put_text(out, "{\"jsonrpc\":\"2.0\",");
+    server->requests++;
+    metrics_count(METRIC_RPC_REQUESTS, 1);
+    if (!json_member(call, "method", &method_span) || !json_text(&method_span, method, sizeof(method)))
+        put_error(server, out, RPC_INVALID_REQUEST, "Missing method");
+    else if (json_member(call, "params", &params) && *params.start != '[')
+        put_error(server, out, RPC_INVALID_PARAMS, "params must be an array");
+    else
+    {
+        if (!json_member(call, "params", &params))
+        {
+            params.start = empty_params;
+            params.end = empty_params + 2;
+        }
+        const RpcEntry *entry = NULL;
+        for (size_t i = 0; i < sizeof(rpc_methods) / sizeof(rpc_methods[0]); i++)
+        {
+            if (strcmp(rpc_methods[i].name, method) == 0)
+                entry = &rpc_methods[i];
+        }
+        if (!entry)
+            put_error(server, out, RPC_METHOD_NOT_FOUND, "Method not found");
+        else
+        {
+            // Written in place; an error rolls the partial result back
+            size_t mark = out->length;
+            const char *message = "";
+            put_text(out, "\"result\":");
+            int code = entry->handler(node, &params, out, &message);
+            if (code != 0)
+            {
+                out->length = mark;
+                put_error(server, out, code, message);
+            }
+        }
+    }
+    put_text(out, ",\"id\":");
+    if (have_id)
+        put_bytes(out, id.start, (size_t)(id.end - id.start));
+    else
+        put_text(out, "null");
+    put_u8(out, '}');
+}
+
+// A request object or a batch array of them
+static void dispatch_body(Node *node, const char *body, size_t length, ByteWriter *out)
+{
+    JsonSpan request;
+    request.start = json_space(body, body + length);
+    request.end = json_skip(body, body + length, 0);
+    if (!request.end || json_space(request.end, body + length) != body + length ||
+        (*request.start != '{' && *request.start != '['))
+    {
+        node->rpc->requests++;
+        put_text(out, "{\"jsonrpc\":\"2.0\",");
+        put_error(node->rpc, out, RPC_PARSE_ERROR, "Parse error");
+        put_text(out, ",\"id\":null}");
+        return;
+    }
+    if (*request.start == '{')
+    {
+        dispatch_call(node, &request, out);
+        return;
+    }
+
+    JsonSpan call;
+    int count = 0;
+    put_u8(out, '[');
+    while (json_item(&request, count, &call))
+    {
+        if (count++ > 0)
+            put_u8(out, ',');
+        dispatch_call(node, &call, out);
+    }
+    put_u8(out, ']');
+}
+
+/* ================ HTTP ================ */
+static RpcClient *find_client(RpcServer *server, uint64_t tag)
+{
+    for (int i = 0; i < server->client_count; i++)
+    {
+        if (RPC_CLIENT_TAG + (uint64_t)server->clients[i]->id == tag)
+            return server->clients[i];
+    }
+    return NULL;
+}
+
+static void drop_client(Node *node, RpcClient *client)
+{
+    RpcServer *server = node->rpc;
+    for (int i = 0; i < server->client_count; i++)
+    {
+        if (server->clients[i] == client)
+        {
+            server->clients[i] = server->clients[--server->client_count];
+            break;
+        }
+    }
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client->rbuf);
+    writer_free(&client->out);
+    free(client);
+}
+
+// Reading stops while the client is closing or has too much unread output
+static void update_client_events(Node *node, RpcClient *client)
+{
+    size_t pending = client->out.length - client->sent;
+    uint32_t events = (pending > 0 ? EPOLLOUT : 0) | (!client->closing && pending < RPC_MAX_OUTPUT ? EPOLLIN : 0);
+    if (events == client->events)
+        return;
+    struct epoll_event event = {0};
+    event.events = events;
+    event.data.u64 = RPC_CLIENT_TAG + (uint64_t)client->id;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+    client->events = events;
+}
+
+static int flush_client(RpcClient *client)
+{
+    while (client->sent < client->out.length)
+    {
+        ssize_t n = send(client->fd, client->out.data + client->sent, client->out.length - client->sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            client->sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return 0;
+    }
+    memmove(client->out.data, client->out.data + client->sent, client->out.length - client->sent);
+    client->out.length -= client->sent;
+    client->sent = 0;
+    return 1;
+}
+
+static void queue_typed_response(RpcClient *client, const char *status, const char *type, int keep_alive,
+                                 const ByteWriter *body)
+{
+    put_format(&client->out, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+               status, type, body ? body->length : 0, keep_alive ? "keep-alive" : "close");
+    if (body)
+        put_bytes(&client->out, body->data, body->length);
+    if (!keep_alive)
+        client->closing = 1;
+}
+
+static void queue_response(RpcClient *client, const char *status, int keep_alive, const ByteWriter *body)
+{
+    queue_typed_response(client, status, "application/json", keep_alive, body);
+}
+
+// Value of a header in a null-terminated header block, matched case-insensitively
+static int header_value(const char *headers, const char *name, char *value, size_t size)
+{
+    size_t length = strlen(name);
+    for (const char *line = strstr(headers, "\r\n"); line; line = strstr(line, "\r\n"))
+    {
+        line += 2;
+        if (strncasecmp(line, name, length) == 0 && line[length] == ':')
+        {
+            const char *start = line + length + 1;
+            while (*start == ' ' || *start == '\t')
+                start++;
+            size_t span = strcspn(start, "\r\n");
+            if (span >= size)
+                span = size - 1;
+            memcpy(value, start, span);
+            value[span] = '\0';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static size_t find_header_end(const unsigned char *data, size_t length)
+{
+    for (size_t i = 3; i < length; i++)
+    {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+            return i + 1;
+    }
+    return 0;
+}
+
+// Answers every complete request in rbuf, in order; pipelined requests queue their responses back to back
+static void answer_requests(Node *node, RpcClient *client)
+{
+    RpcServer *server = node->rpc;
+    size_t offset = 0;
+    while (!client->closing && client->out.length - client->sent < RPC_MAX_OUTPUT)
+    {
+        const unsigned char *request = client->rbuf + offset;
+        size_t available = client->rlen - offset;
+        size_t header_length = find_header_end(request, available < RPC_MAX_HEADER ? available : RPC_MAX_HEADER);
+        if (header_length == 0)
+        {
+            if (available >= RPC_MAX_HEADER)
+                queue_response(client, "431 Request Header Fields Too Large", 0, NULL);
+            break;
+        }
+
+        char headers[RPC_MAX_HEADER + 1], method[8], path[256], version[16], value[32];
+        memcpy(headers, request, header_length);
+        headers[header_length] = '\0';
+        if (sscanf(headers, "%7s %255s %15s", method, path, version) != 3 || strncmp(version, "HTTP/1.", 7) != 0)
+        {
+            queue_response(client, "400 Bad Request", 0, NULL);
+            break;
+        }
+        // HTTP/1.1 keeps the connection by default, HTTP/1.0 only when asked to
+        int keep_alive = strcmp(version, "HTTP/1.0") != 0;
+        if (header_value(headers, "Connection", value, sizeof(value)))
+        {
+            if (strcasecmp(value, "close") == 0)
+                keep_alive = 0;
+            else if (strcasecmp(value, "keep-alive") == 0)
+                keep_alive = 1;
+        }
+        if (header_value(headers, "Transfer-Encoding", value, sizeof(value)))
+        {
+            queue_response(client, "501 Not Implemented", 0, NULL);
+            break;
+        }
+        size_t body_length = 0;
+        if (header_value(headers, "Content-Length", value, sizeof(value)))
+        {
+            char *rest;
+            unsigned long parsed = strtoul(value, &rest, 10);
+            if (*rest != '\0' || parsed > RPC_MAX_BODY)
+            {
+                queue_response(client, "413 Payload Too Large", 0, NULL);
+                break;
+            }
+            body_length = parsed;
+        }
+        if (available < header_length + body_length)
+            break;
+
+        uint64_t started = metrics_now_ns();
+        server->body.length = 0;
+        // The one GET the server answers: a Prometheus scrape of the metrics registry
+        if (strcmp(method, "GET") == 0 && strcmp(path, "/metrics") == 0)
+        {
+            metrics_render(&server->body);
+            queue_typed_response(client, "200 OK", "text/plain; version=0.0.4", keep_alive, &server->body);
+        }
+        else if (strcmp(method, "POST") != 0)
+            queue_response(client, "405 Method Not Allowed", keep_alive, NULL);
+        else
+        {
+            dispatch_body(node, (const char *)request + header_length, body_length, &server->body);
+            queue_response(client, "200 OK", keep_alive, &server->body);
+        }
+        metrics_observe_ns(HISTOGRAM_RPC_REQUEST, metrics_now_ns() - started);
+        offset += header_length + body_length;
+    }
+    memmove(client->rbuf, client->rbuf + offset, client->rlen - offset);
+    client->rlen -= offset;
+}
+
+// 1 while open, 0 once the client has closed its side, -1 on error
+static int read_client(RpcClient *client)
+{
+    // Bounded so one fast client cannot pile up more than a full request between answers
+    while (client->rlen < RPC_MAX_HEADER + RPC_MAX_BODY)
+    {
+        if (client->rcap - client->rlen < 4096)
+        {
+            size_t capacity = client->rcap ? client->rcap * 2 : 8192;
+            unsigned char *rbuf = realloc(client->rbuf, capacity);
+            if (!rbuf)
+                return -1;
+            client->rbuf = rbuf;
+            client->rcap = capacity;
+        }
+        ssize_t n = recv(client->fd, client->rbuf + client->rlen, client->rcap - client->rlen, 0);
+        if (n > 0)
+        {
+            client->rlen += (size_t)n;
+            continue;
+        }
+        if (n == 0)
+            return 0;
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 1 : -1;
+    }
+    return 1;
+}
+
+// Writes what it can, answers what output room allows and writes again; 0 once the client is done
+static int service_client(Node *node, RpcClient *client)
+{
+    if (!flush_client(client))
+        return 0;
+    answer_requests(node, client);
+    if (!flush_client(client))
+        return 0;
+    if (client->closing && client->out.length == 0)
+        return 0;
+    update_client_events(node, client);
+    return 1;
+}
+
+static void accept_clients(Node *node)
+{
+    RpcServer *server = node->rpc;
+    int fd;
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        RpcClient *client = NULL;
+        if (server->client_count == RPC_MAX_CLIENTS || flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            !(client = calloc(1, sizeof(RpcClient))))
+        {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        client->fd = fd;
+        client->id = server->next_client_id++;
+        client->events = EPOLLIN;
+        writer_init(&client->out);
+
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.u64 = RPC_CLIENT_TAG + (uint64_t)client->id;
+        epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        server->clients[server->client_count++] = client;
+        server->connections++;
+    }
+}
+
+/* ================ SERVER ================ */
+// Listens on 127.0.0.1 (port 0 picks a free one); requests are served from the node's event loop
+int rpc_start(Node *node, int port)
+{
+    RpcServer *server = calloc(1, sizeof(RpcServer));
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!server || fd < 0)
+    {
+        free(server);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address = {0};
+    socklen_t address_length = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    int flags;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 128) < 0 ||
+        (flags = fcntl(fd, F_GETFL, 0)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &address_length) < 0)
+    {
+        close(fd);
+        free(server);
+        return 0;
+    }
+    server->listen_fd = fd;
+    server->port = ntohs(address.sin_port);
+    writer_init(&server->body);
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = RPC_LISTEN_TAG;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    node->rpc = server;
+    return 1;
+}
+
+void rpc_stop(Node *node)
+{
+    RpcServer *server = node->rpc;
+    if (!server)
+        return;
+    while (server->client_count > 0)
+        drop_client(node, server->clients[0]);
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, server->listen_fd, NULL);
+    close(server->listen_fd);
+    writer_free(&server->body);
+    free(server);
+    node->rpc = NULL;
+}
+
+// Called by node_poll for every event; returns 0 if the tag is not the server's
+int rpc_handle_event(Node *node, uint64_t tag, uint32_t events)
+{
+    RpcServer *server = node->rpc;
+    if (!server || (tag != RPC_LISTEN_TAG && (tag < RPC_CLIENT_TAG || tag >= RPC_CLIENT_TAG + INT32_MAX)))
+        return 0;
+    if (tag == RPC_LISTEN_TAG)
+    {
+        accept_clients(node);
+        return 1;
+    }
+
+    RpcClient *client = find_client(server, tag);
+    if (!client)
+        return 1;
+    if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN))
+    {
+        drop_client(node, client);
+        return 1;
+    }
+    if (events & EPOLLIN)
+    {
+        int open = read_client(client);
+        if (open < 0)
+        {
+            drop_client(node, client);
+            return 1;
+        }
+        if (open == 0)
+        {
+            // Answer what arrived before the close, then hang up
+            answer_requests(node, client);
+            client->closing = 1;
+        }
+    }
+    if (!service_client(node, client))
+        drop_client(node, client);
+    return 1;
+}
+
+/* ================ RPC BENCHMARK ================ */
+#define RPC_BENCH_MIX 4 // Request kinds the load generator cycles through
+
+typedef struct
+{
+    int port;            // Server port
+    int requests;        // Calls this connection makes
+    int depth;           // Requests written before reading their responses
+    int keep_alive;      // 0 opens a new connection per request
+    const char *batch;   // depth requests back to back (one when keep_alive is 0)
+    size_t batch_length; // Bytes in batch
+    int completed;       // Responses with a result
+    int failed;          // Errors, bad responses or dropped connections
+    int *finished;       // Shared count of finished clients
+} RpcBenchClient;
+
+static int bench_connect(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Reads count responses; returns how many carried a result, or -1 if the connection broke
+static int bench_read_responses(int fd, int count, char *buffer, size_t size)
+{
+    size_t length = 0;
+    int results = 0;
+    while (count > 0)
+    {
+        size_t header = find_header_end((unsigned char *)buffer, length);
+        if (header > 0)
+        {
+            buffer[header - 1] = '\0';
+            const char *field = strstr(buffer, "Content-Length: ");
+            size_t body = field ? strtoul(field + 16, NULL, 10) : 0;
+            if (length >= header + body)
+            {
+                int ok = strncmp(buffer, "HTTP/1.1 200", 12) == 0 && body > 0;
+                for (size_t i = header; ok && i + 8 < header + body; i++)
+                {
+                    if (memcmp(buffer + i, "\"error\":", 8) == 0)
+                        ok = 0;
+                }
+                results += ok;
+                memmove(buffer, buffer + header + body, length - header - body);
+                length -= header + body;
+                count--;
+                continue;
+            }
+            buffer[header - 1] = '\n';
+        }
+        ssize_t n = recv(fd, buffer + length, size - length, 0);
+        if (n <= 0)
+            return -1;
+        length += (size_t)n;
+    }
+    return results;
+}
+
+static void *bench_client(void *argument)
+{
+    RpcBenchClient *client = argument;
+    char *buffer = malloc(RPC_MAX_OUTPUT);
+    int fd = client->keep_alive ? bench_connect(client->port) : -1;
+    for (int done = 0; done < client->requests;)
+    {
+        int count = client->keep_alive ? client->depth : 1;
+        if (!client->keep_alive)
+            fd = bench_connect(client->port);
+        int results = -1;
+        if (buffer && fd >= 0 && send(fd, client->batch, client->batch_length, MSG_NOSIGNAL) == (ssize_t)client->batch_length)
+            results = bench_read_responses(fd, count, buffer, RPC_MAX_OUTPUT);
+        if (!client->keep_alive && fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (results < 0)
+        {
+            client->failed += client->requests - done;
+            break;
+        }
+        client->completed += results;
+        client->failed += count - results;
+        done += count;
+    }
+    if (fd >= 0)
+        close(fd);
+    free(buffer);
+    __atomic_fetch_add(client->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int bench_chain(Blockchain *chain)
+{
+    Block genesis = {0};
+    int attempts, disconnected, connected;
+    genesis.timestamp = time(NULL);
+    block_clear_transactions(&genesis);
+    for (int i = 0; i < 8; i++)
+    {
+        char text[TX_TEXT_SIZE];
+        snprintf(text, sizeof(text), "faucet->alice:%d", 10 + i);
+        block_add_text_transaction(&genesis, text);
+    }
+    strcpy(genesis.previous_hash, "0000000000000000000000000000000000000000000000000000000000000000");
+    solve_block(&genesis, 1, &attempts);
+    return submit_block(chain, &genesis, &disconnected, &connected) == TREE_ACCEPTED;
+}
+
+int run_rpc_benchmark(int connections, int requests, int depth)
+{
+    if (connections < 1 || connections > 64 || requests < connections || depth < 1 || depth > 1024)
+    {
+        print_error("Usage: --rpc-bench [connections 1-64] [requests] [pipeline depth 1-1024]");
+        return 1;
+    }
+    print_header("JSON-RPC SERVER BENCHMARK");
+
+    Blockchain chain = {0};
+    BlockTree tree;
+    Node node;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    if (!bench_chain(&chain) || !node_init(&node, &chain, 0, 1) || !rpc_start(&node, 0))
+    {
+        print_error("Could not start a node with an RPC server on loopback");
+        block_tree_free(&tree);
+        free(chain.blocks);
+        return 1;
+    }
+    printf(COLOR_CYAN "%d connections, %d requests per mode, pipeline depth %d, server on 127.0.0.1:%d" COLOR_RESET
+                      "\n\n",
+           connections, requests, depth, node.rpc->port);
+
+    // Every response is checked for a result, so these also exercise the chain and UTXO lookups
+    const char *bodies[RPC_BENCH_MIX] = {
+        "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"getblockcount\"}",
+        "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"getbalance\",\"params\":[\"alice\"]}",
+        "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"getblock\",\"params\":[0]}",
+        "{\"jsonrpc\":\"2.0\",\"id\":4,\"method\":\"listunspent\",\"params\":[\"alice\"]}",
+    };
+    const char *modes[3] = {"New connection", "Keep-alive", "Pipelined"};
+    double rates[3] = {0}, round_trips[3] = {0};
+    int totals[3] = {0}, failures[3] = {0};
+    for (int mode = 0; mode < 3; mode++)
+    {
+        int keep_alive = mode > 0, mode_depth = mode == 2 ? depth : 1;
+        // A fresh TCP handshake per call is much slower, so that mode gets a tenth of the requests
+        int per_client = (mode == 0 ? requests / 10 : requests) / connections;
+        per_client = per_client < mode_depth ? mode_depth : per_client - per_client % mode_depth;
+
+        ByteWriter batch;
+        writer_init(&batch);
+        for (int i = 0; i < mode_depth; i++)
+        {
+            const char *body = bodies[i % RPC_BENCH_MIX];
+            put_format(&batch, "POST / HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n"
+                               "Content-Length: %zu\r\nConnection: %s\r\n\r\n%s",
+                       strlen(body), keep_alive ? "keep-alive" : "close", body);
+        }
+
+        RpcBenchClient clients[64];
+        pthread_t threads[64];
+        int finished = 0;
+        uint64_t start = monotonic_ns();
+        for (int c = 0; c < connections; c++)
+        {
+            RpcBenchClient setup = {node.rpc->port, per_client, mode_depth, keep_alive, (const char *)batch.data,
+                                    batch.length, 0, 0, &finished};
+            clients[c] = setup;
+            if (pthread_create(&threads[c], NULL, bench_client, &clients[c]) != 0)
+            {
+                clients[c].failed = per_client;
+                finished++;
+                threads[c] = 0;
+            }
+        }
+        while (__atomic_load_n(&finished, __ATOMIC_ACQUIRE) < connections)
+            node_poll(&node, 10);
+        double elapsed = (monotonic_ns() - start) / 1e9;
+        for (int c = 0; c < connections; c++)
+        {
+            if (threads[c])
+                pthread_join(threads[c], NULL);
+            totals[mode] += clients[c].completed;
+            failures[mode] += clients[c].failed;
+        }
+        writer_free(&batch);
+        rates[mode] = totals[mode] / elapsed;
+        round_trips[mode] = elapsed * 1e6 / ((double)per_client / mode_depth);
+    }
+
+    printf(COLOR_BLUE "┌────────────────┬──────────┬────────────┬───────────────┬────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-14s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-13s" COLOR_BLUE " │ " COLOR_YELLOW "%-6s" COLOR_BLUE " │\n",
+           "Mode", "Requests", "Requests/s", "Round trip us", "Failed");
+    printf(COLOR_BLUE "├────────────────┼──────────┼────────────┼───────────────┼────────┤\n");
+    for (int mode = 0; mode < 3; mode++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-14s" COLOR_BLUE " │ " COLOR_CYAN "%-8d" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-10.0f" COLOR_BLUE " │ " COLOR_CYAN "%-13.1f" COLOR_BLUE " │ %s%-6d" COLOR_BLUE " │\n",
+               modes[mode], totals[mode], rates[mode], round_trips[mode], failures[mode] ? COLOR_RED : COLOR_GREEN,
+               failures[mode]);
+    }
+    printf(COLOR_BLUE "└────────────────┴──────────┴────────────┴───────────────┴────────┘" COLOR_RESET "\n");
+    printf(COLOR_CYAN "\nServer answered %llu calls (%llu errors) over %llu connections" COLOR_RESET "\n",
+           (unsigned long long)node.rpc->requests, (unsigned long long)node.rpc->errors,
+           (unsigned long long)node.rpc->connections);
+
+    node_free(&node);
+    block_tree_free(&tree);
+    free(chain.blocks);
+    if (failures[0] + failures[1] + failures[2] > 0)
+    {
+        print_error("Some requests failed");
+        return 1;
+    }
+    printf(COLOR_GREEN "✔ Pipelining served %.1fx the requests per second of one connection per request" COLOR_RESET
+                       "\n",
+           rates[2] / rates[0]);
+    return 0;
+}
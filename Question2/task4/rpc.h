@@ -0,0 +1,57 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <stdint.h>
+#include "p2p.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define RPC_DEFAULT_PORT 8332                 // Listening port when --rpc is given without one
+#define RPC_MAX_CLIENTS 256                   // Open HTTP connections
+#define RPC_MAX_HEADER 8192                   // Request line plus headers
+#define RPC_MAX_BODY (64 * 1024)              // Largest JSON-RPC request body
+#define RPC_MAX_OUTPUT (1024 * 1024)          // Queued response bytes before a client stops being read
+#define RPC_LISTEN_TAG ((uint64_t)-5)         // epoll data for the listening socket
+#define RPC_CLIENT_TAG ((uint64_t)1 << 32)    // epoll data for client n is RPC_CLIENT_TAG + n
+
+#define RPC_PARSE_ERROR -32700      // Body is not JSON
+#define RPC_INVALID_REQUEST -32600  // JSON, but not a request object
+#define RPC_METHOD_NOT_FOUND -32601 // Unknown method
+#define RPC_INVALID_PARAMS -32602   // Wrong number or type of params
+#define RPC_NOT_FOUND -5            // Block or transaction does not exist
+#define RPC_REJECTED -26            // Transaction refused by the ledger, signature check or mempool
+#define RPC_BUSY -9                 // Ingestion ring full: retry later
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    int fd;               // Non-blocking TCP socket
+    int id;               // Tag offset for epoll
+    unsigned char *rbuf;  // Bytes received but not yet answered
+    size_t rlen, rcap;    // Used/allocated size of rbuf
+    ByteWriter out;       // Responses not yet written
+    size_t sent;          // Part of out already written
+    uint32_t events;      // epoll events currently armed
+    int closing;          // Close once out is written (Connection: close or a bad request)
+} RpcClient;
+
+typedef struct RpcServer
+{
+    int listen_fd;                         // Accepting socket
+    int port;                              // Port actually bound
+    RpcClient *clients[RPC_MAX_CLIENTS];   // Open connections
+    int client_count;                      // Entries in clients
+    int next_client_id;                    // Counter for RpcClient.id
+    ByteWriter body;                       // Scratch space for one response body
+    uint64_t requests;                     // JSON-RPC calls answered
+    uint64_t errors;                       // Calls answered with an error object
+    uint64_t connections;                  // Clients accepted since start
+} RpcServer;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int rpc_start(Node *node, int port);
+void rpc_stop(Node *node);
+int rpc_handle_event(Node *node, uint64_t tag, uint32_t events);
+int run_rpc_benchmark(int connections, int requests, int depth);
+
+#endif
@@ -0,0 +1,117 @@
+#include <openssl/rand.h>
+#include "sigcache.h"
+#include "siphash.h"
+
+/* ================ HELPERS ================ */
+static uint64_t slot_hash(const SigCache *cache, const unsigned char id[TXID_SIZE])
+{
+    return siphash24(cache->k0, cache->k1, id, TXID_SIZE);
+}
+
+static SigCacheShard *shard_for(SigCache *cache, uint64_t hash)
+{
+    return &cache->shards[hash & (SIGCACHE_SHARDS - 1)];
+}
+
+static int home_slot(const SigCache *cache, uint64_t hash)
+{
+    return (int)((hash / SIGCACHE_SHARDS) & (uint64_t)(cache->shard_capacity - 1));
+}
+
+/* ================ SIGNATURE CACHE ================ */
+// entries is rounded up to a power of two and split evenly across the shards
+int sigcache_init(SigCache *cache, int entries)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->shard_capacity = SIGCACHE_PROBES;
+    while (cache->shard_capacity * SIGCACHE_SHARDS < entries)
+        cache->shard_capacity *= 2;
+    if (RAND_bytes((unsigned char *)&cache->k0, sizeof(cache->k0)) != 1 ||
+        RAND_bytes((unsigned char *)&cache->k1, sizeof(cache->k1)) != 1)
+        return 0;
+
+    for (int s = 0; s < SIGCACHE_SHARDS; s++)
+    {
+        cache->shards[s].entries = calloc((size_t)cache->shard_capacity, sizeof(SigCacheEntry));
+        if (!cache->shards[s].entries)
+        {
+            sigcache_free(cache);
+            return 0;
+        }
+        pthread_rwlock_init(&cache->shards[s].lock, NULL);
+    }
+    return 1;
+}
+
+void sigcache_free(SigCache *cache)
+{
+    for (int s = 0; s < SIGCACHE_SHARDS; s++)
+    {
+        if (!cache->shards[s].entries)
+            continue;
+        free(cache->shards[s].entries);
+        cache->shards[s].entries = NULL;
+        pthread_rwlock_destroy(&cache->shards[s].lock);
+    }
+}
+
+int sigcache_contains(SigCache *cache, const unsigned char id[TXID_SIZE])
+{
+    uint64_t hash = slot_hash(cache, id);
+    SigCacheShard *shard = shard_for(cache, hash);
+    int slot = home_slot(cache, hash);
+    int found = 0;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    for (int p = 0; p < SIGCACHE_PROBES && !found; p++)
+    {
+        const SigCacheEntry *entry = &shard->entries[(slot + p) & (cache->shard_capacity - 1)];
+        found = entry->used && memcmp(entry->id, id, TXID_SIZE) == 0;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    __atomic_fetch_add(found ? &shard->hits : &shard->misses, 1, __ATOMIC_RELAXED);
+    return found;
+}
+
+void sigcache_insert(SigCache *cache, const unsigned char id[TXID_SIZE])
+{
+    uint64_t hash = slot_hash(cache, id);
+    SigCacheShard *shard = shard_for(cache, hash);
+    int slot = home_slot(cache, hash);
+    SigCacheEntry *target = NULL;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    for (int p = 0; p < SIGCACHE_PROBES; p++)
+    {
+        SigCacheEntry *entry = &shard->entries[(slot + p) & (cache->shard_capacity - 1)];
+        if (entry->used && memcmp(entry->id, id, TXID_SIZE) == 0)
+        {
+            pthread_rwlock_unlock(&shard->lock);
+            return;
+        }
+        if (!entry->used && !target)
+            target = entry;
+    }
+    // Every probe slot is taken: overwrite one picked by hash bits the shard and slot did not use
+    if (!target)
+    {
+        target = &shard->entries[(slot + (int)((hash >> 48) % SIGCACHE_PROBES)) & (cache->shard_capacity - 1)];
+        __atomic_fetch_add(&shard->evictions, 1, __ATOMIC_RELAXED);
+    }
+    memcpy(target->id, id, TXID_SIZE);
+    target->used = 1;
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+// Sums the shards; approximate while lookups are running
+void sigcache_counts(const SigCache *cache, uint64_t *hits, uint64_t *misses, uint64_t *evictions)
+{
+    *hits = *misses = *evictions = 0;
+    for (int s = 0; s < SIGCACHE_SHARDS; s++)
+    {
+        *hits += __atomic_load_n(&cache->shards[s].hits, __ATOMIC_RELAXED);
+        *misses += __atomic_load_n(&cache->shards[s].misses, __ATOMIC_RELAXED);
+        *evictions += __atomic_load_n(&cache->shards[s].evictions, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef SIGCACHE_H
+#define SIGCACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define SIGCACHE_SHARDS 16     // Independently locked partitions (power of two)
+#define SIGCACHE_ENTRIES 65536 // Default total capacity (power of two)
+#define SIGCACHE_PROBES 8      // Slots an entry may occupy; a full run evicts one at random
+#define SIGCACHE_CACHE_LINE 64 // Shards start on separate lines, so their counters do not share one
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char id[TXID_SIZE]; // Witness-committing txid of a transaction whose signature checked out
+    int used;                    // Slot holds an entry
+} SigCacheEntry;
+
+// Counters live with the shard they describe: a lookup only writes to its own shard's line
+typedef struct
+{
+    SigCacheEntry *entries; // Open-addressing table
+    pthread_rwlock_t lock;  // Readers look up in parallel; inserts are exclusive
+    uint64_t hits;          // Lookups that found their entry
+    uint64_t misses;        // Lookups that did not
+    uint64_t evictions;     // Entries overwritten to make room
+} __attribute__((aligned(SIGCACHE_CACHE_LINE))) SigCacheShard;
+
+typedef struct
+{
+    SigCacheShard shards[SIGCACHE_SHARDS]; // Picked by the low bits of the slot hash
+    int shard_capacity;                    // Slots per shard (power of two)
+    uint64_t k0, k1;                       // Secret SipHash key, so peers cannot aim at one slot
+} SigCache;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int sigcache_init(SigCache *cache, int entries);
+void sigcache_free(SigCache *cache);
+int sigcache_contains(SigCache *cache, const unsigned char id[TXID_SIZE]);
+void sigcache_insert(SigCache *cache, const unsigned char id[TXID_SIZE]);
+void sigcache_counts(const SigCache *cache, uint64_t *hits, uint64_t *misses, uint64_t *evictions);
+
+#endif
@@ -0,0 +1,350 @@
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include "signature.h"
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    const TxView *transactions; // Transactions being checked
+    const TxWitness *witnesses; // Their witnesses, same order
+    const int *pending;         // Indices that missed the cache
+    int pending_count;          // Length of pending
+    int next;                   // Next pending position to claim (atomic)
+    int first_failure;          // Lowest failing index found so far (INT_MAX = none)
+} SignatureBatch;
+
+/* ================ GLOBAL STATE ================ */
+static SigCache cache;                                // Valid signatures seen by this process
+static int cache_ready;                               // sigcache_init succeeded
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT; // Guards the lazy initialization
+
+/* ================ KEYS AND ADDRESSES ================ */
+int keypair_generate(KeyPair *key)
+{
+    EVP_PKEY *pkey = NULL;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, NULL);
+    size_t private_length = PRIVATE_KEY_SIZE;
+    size_t public_length = PUBLIC_KEY_SIZE;
+    int ok = ctx && EVP_PKEY_keygen_init(ctx) == 1 && EVP_PKEY_keygen(ctx, &pkey) == 1 &&
+             EVP_PKEY_get_raw_private_key(pkey, key->private_key, &private_length) == 1 &&
+             EVP_PKEY_get_raw_public_key(pkey, key->public_key, &public_length) == 1;
+    EVP_PKEY_free(pkey);
+    EVP_PKEY_CTX_free(ctx);
+    if (ok)
+        address_from_public_key(key->public_key, key->address);
+    return ok;
+}
+
+// First 20 bytes of SHA-256(public key), hex encoded
+void address_from_public_key(const unsigned char public_key[PUBLIC_KEY_SIZE], char address[ADDRESS_SIZE])
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(public_key, PUBLIC_KEY_SIZE, digest);
+    bytes_to_hex(digest, (ADDRESS_SIZE - 1) / 2, address);
+}
+
+int witness_is_empty(const TxWitness *witness)
+{
+    for (int i = 0; i < PUBLIC_KEY_SIZE; i++)
+    {
+        if (witness->public_key[i])
+            return 0;
+    }
+    return 1;
+}
+
+// True if the sender is a key address; only those senders must sign
+int transaction_sender_is_key(const TxView *tx)
+{
+    if (tx->sender_length != ADDRESS_SIZE - 1)
+        return 0;
+    for (size_t i = 0; i < tx->sender_length; i++)
+    {
+        char c = tx->sender[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return 0;
+    }
+    return 1;
+}
+
+/* ================ SIGNING AND VERIFICATION ================ */
+int sign_transaction(const KeyPair *key, const unsigned char *tx, size_t length, TxWitness *witness)
+{
+    unsigned char txid[TXID_SIZE];
+    size_t signature_length = SIGNATURE_SIZE;
+    compute_txid(tx, length, txid);
+
+    EVP_PKEY *pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, NULL, key->private_key, PRIVATE_KEY_SIZE);
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = pkey && ctx && EVP_DigestSignInit(ctx, NULL, NULL, NULL, pkey) == 1 &&
+             EVP_DigestSign(ctx, witness->signature, &signature_length, txid, TXID_SIZE) == 1;
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    if (ok)
+        memcpy(witness->public_key, key->public_key, PUBLIC_KEY_SIZE);
+    return ok;
+}
+
+// Key-address senders need a signature by the key behind the address; other senders must carry none
+int verify_transaction_signature(const TxView *tx, const TxWitness *witness)
+{
+    if (!transaction_sender_is_key(tx))
+        return witness_is_empty(witness);
+    if (witness_is_empty(witness))
+        return 0;
+
+    char address[ADDRESS_SIZE];
+    address_from_public_key(witness->public_key, address);
+    if (memcmp(tx->sender, address, ADDRESS_SIZE - 1) != 0)
+        return 0;
+
+    unsigned char txid[TXID_SIZE];
+    compute_txid(tx->data, tx->length, txid);
+    EVP_PKEY *pkey = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, witness->public_key, PUBLIC_KEY_SIZE);
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = pkey && ctx && EVP_DigestVerifyInit(ctx, NULL, NULL, NULL, pkey) == 1 &&
+             EVP_DigestVerify(ctx, witness->signature, SIGNATURE_SIZE, txid, TXID_SIZE) == 1;
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+/* ================ SIGNATURE CACHE ================ */
+static void init_cache(void)
+{
+    cache_ready = sigcache_init(&cache, SIGCACHE_ENTRIES);
+}
+
+SigCache *signature_cache(void)
+{
+    pthread_once(&cache_once, init_cache);
+    return cache_ready ? &cache : NULL;
+}
+
+// Like verify_transaction_signature, but a signature already proven valid is not checked again.
+// store: remember a newly verified signature (mempool admission does, block validation does not)
+int check_transaction_signature(const TxView *tx, const TxWitness *witness, int store)
+{
+    if (witness_is_empty(witness))
+        return verify_transaction_signature(tx, witness);
+
+    SigCache *valid = signature_cache();
+    unsigned char id[TXID_SIZE];
+    compute_wtxid(tx->data, tx->length, witness, id);
+    if (valid && sigcache_contains(valid, id))
+        return 1;
+    if (!verify_transaction_signature(tx, witness))
+        return 0;
+    if (valid && store)
+        sigcache_insert(valid, id);
+    return 1;
+}
+
+/* ================ BATCH VERIFICATION ================ */
+int signature_default_threads(void)
+{
+    static int threads;
+    if (threads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores < 1 ? 1 : cores > SIGNATURE_MAX_THREADS ? SIGNATURE_MAX_THREADS : (int)cores;
+    }
+    return threads;
+}
+
+static void record_failure(SignatureBatch *batch, int index)
+{
+    int seen = __atomic_load_n(&batch->first_failure, __ATOMIC_RELAXED);
+    while (index < seen &&
+           !__atomic_compare_exchange_n(&batch->first_failure, &seen, index, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void *verify_batch_worker(void *argument)
+{
+    SignatureBatch *batch = argument;
+    for (;;)
+    {
+        int position = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (position >= batch->pending_count)
+            break;
+        // Stop claiming work once a lower index has already failed
+        int i = batch->pending[position];
+        if (i >= __atomic_load_n(&batch->first_failure, __ATOMIC_RELAXED))
+            break;
+        if (!verify_transaction_signature(&batch->transactions[i], &batch->witnesses[i]))
+            record_failure(batch, i);
+    }
+    return NULL;
+}
+
+// Returns the index of the first transaction whose signature fails, or -1 if all pass
+int verify_signature_batch(const TxView *transactions, const TxWitness *witnesses, int count, int threads)
+{
+    int *pending = malloc((size_t)(count > 0 ? count : 1) * sizeof(int));
+    if (!pending)
+        return 0;
+    SignatureBatch batch = {transactions, witnesses, pending, 0, 0, INT_MAX};
+    if (threads < 1)
+        threads = signature_default_threads();
+    if (threads > SIGNATURE_MAX_THREADS)
+        threads = SIGNATURE_MAX_THREADS;
+
+    // Unsigned transactions and cache hits are cheap, so only the remaining signatures are worth a thread
+    SigCache *valid = signature_cache();
+    for (int i = 0; i < count && i < batch.first_failure; i++)
+    {
+        unsigned char id[TXID_SIZE];
+        if (witness_is_empty(&witnesses[i]))
+        {
+            if (!verify_transaction_signature(&transactions[i], &witnesses[i]))
+                batch.first_failure = i;
+            continue;
+        }
+        compute_wtxid(transactions[i].data, transactions[i].length, &witnesses[i], id);
+        if (!valid || !sigcache_contains(valid, id))
+            pending[batch.pending_count++] = i;
+    }
+    if (threads > batch.pending_count)
+        threads = batch.pending_count > 0 ? batch.pending_count : 1;
+
+    // The calling thread is one of the workers, as in solve_block_bits
+    pthread_t handles[SIGNATURE_MAX_THREADS];
+    int started = 1;
+    for (int i = 1; i < threads; i++, started++)
+    {
+        if (pthread_create(&handles[i], NULL, verify_batch_worker, &batch) != 0)
+            break;
+    }
+    verify_batch_worker(&batch);
+    for (int i = 1; i < started; i++)
+        pthread_join(handles[i], NULL);
+
+    free(pending);
+    return batch.first_failure < count ? batch.first_failure : -1;
+}
+
+int verify_block_signatures(const Block *block, int threads)
+{
+    TxView views[MAX_TRANSACTIONS];
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        if (!block_transaction(block, i, &views[i]))
+            return i;
+    }
+    return verify_signature_batch(views, block->witnesses, block->transaction_count, threads);
+}
+
+/* ================ BENCHMARK ================ */
+static double elapsed_ms(struct timespec start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+int run_signature_benchmark(int block_count, int threads)
+{
+    if (block_count < 1 || block_count > 100000 || threads < 0 || threads > SIGNATURE_MAX_THREADS)
+    {
+        print_error("Usage: --sig-bench <blocks 1-100000> [threads 1-16]");
+        return 1;
+    }
+    if (threads == 0)
+        threads = signature_default_threads();
+
+    print_header("SIGNATURE VERIFICATION BENCHMARK");
+    KeyPair keys[MAX_TRANSACTIONS];
+    for (int i = 0; i < MAX_TRANSACTIONS; i++)
+    {
+        if (!keypair_generate(&keys[i]))
+        {
+            print_error("Ed25519 key generation failed");
+            return 1;
+        }
+    }
+
+    Block *blocks = calloc((size_t)block_count, sizeof(Block));
+    if (!blocks)
+    {
+        print_error("Out of memory");
+        return 1;
+    }
+    printf(COLOR_CYAN "Signing %d transactions..." COLOR_RESET "\n", block_count * MAX_TRANSACTIONS);
+    fflush(stdout);
+    for (int b = 0; b < block_count; b++)
+    {
+        for (int t = 0; t < MAX_TRANSACTIONS; t++)
+        {
+            Transaction tx = {0};
+            TxWitness witness;
+            unsigned char encoded[MAX_TX_SIZE];
+            strcpy(tx.sender, keys[t].address);
+            strcpy(tx.outputs[0].address, keys[(t + 1) % MAX_TRANSACTIONS].address);
+            tx.outputs[0].amount = (uint64_t)(1 + b) * AMOUNT_SCALE + (uint64_t)t;
+            tx.output_count = 1;
+            size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+            sign_transaction(&keys[t], encoded, length, &witness);
+            block_add_transaction(&blocks[b], encoded, length, &witness);
+        }
+    }
+
+    // Serial checks each block on the calling thread and Batched spreads it over threads, both with a
+    // cold cache. Cached repeats Batched after every transaction went through mempool admission.
+    const char *modes[3] = {"Serial", "Batched", "Cached"};
+    int thread_counts[3] = {1, threads, threads};
+    double times[3];
+    int failures[3] = {0, 0, 0};
+    for (int run = 0; run < 3; run++)
+    {
+        if (run == 2)
+        {
+            for (int b = 0; b < block_count; b++)
+            {
+                for (int t = 0; t < MAX_TRANSACTIONS; t++)
+                {
+                    TxView view;
+                    block_transaction(&blocks[b], t, &view);
+                    check_transaction_signature(&view, &blocks[b].witnesses[t], 1);
+                }
+            }
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int b = 0; b < block_count; b++)
+            failures[run] += verify_block_signatures(&blocks[b], thread_counts[run]) != -1;
+        times[run] = elapsed_ms(start);
+    }
+    free(blocks);
+
+    int signatures = block_count * MAX_TRANSACTIONS;
+    printf(COLOR_BLUE "┌──────────┬─────────┬────────────┬────────────┬──────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-7s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │\n",
+           "Mode", "Threads", "Time (ms)", "Sigs/s", "Failures");
+    printf(COLOR_BLUE "├──────────┼─────────┼────────────┼────────────┼──────────┤\n");
+    for (int run = 0; run < 3; run++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-8s" COLOR_BLUE " │ " COLOR_CYAN "%-7d" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-10.1f" COLOR_BLUE " │ " COLOR_CYAN "%-10.0f" COLOR_BLUE " │ " COLOR_CYAN "%-8d" COLOR_BLUE " │\n",
+               modes[run], thread_counts[run], times[run], signatures / (times[run] / 1000.0), failures[run]);
+    }
+    printf(COLOR_BLUE "└──────────┴─────────┴────────────┴────────────┴──────────┘" COLOR_RESET "\n");
+    if (failures[0] || failures[1] || failures[2])
+    {
+        print_error("Some freshly signed blocks failed verification");
+        return 1;
+    }
+    SigCache *valid = signature_cache();
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    if (valid)
+        sigcache_counts(valid, &hits, &misses, &evictions);
+    printf(COLOR_GREEN "\nBatched verification was %.1fx faster than one signature at a time" COLOR_RESET "\n",
+           times[0] / times[1]);
+    printf(COLOR_GREEN "Signatures cached at admission made block validation %.1fx faster (%llu evictions)" COLOR_RESET
+                       "\n",
+           times[1] / times[2], (unsigned long long)evictions);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include "blockchain.h"
+#include "sigcache.h"
+#include "transaction.h"
+
+/* ================ CONSTANTS ================ */
+#define PRIVATE_KEY_SIZE 32      // Raw Ed25519 private key (seed)
+#define SIGNATURE_MAX_THREADS 16 // Upper bound for verify_signature_batch threads
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char private_key[PRIVATE_KEY_SIZE]; // Ed25519 seed, never leaves the node
+    unsigned char public_key[PUBLIC_KEY_SIZE];   // Matching public key
+    char address[ADDRESS_SIZE];                  // Hex address that transactions spend from
+} KeyPair;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int keypair_generate(KeyPair *key);
+void address_from_public_key(const unsigned char public_key[PUBLIC_KEY_SIZE], char address[ADDRESS_SIZE]);
+int witness_is_empty(const TxWitness *witness);
+int transaction_sender_is_key(const TxView *tx);
+int sign_transaction(const KeyPair *key, const unsigned char *tx, size_t length, TxWitness *witness);
+int verify_transaction_signature(const TxView *tx, const TxWitness *witness);
+SigCache *signature_cache(void);
+int check_transaction_signature(const TxView *tx, const TxWitness *witness, int store);
+int signature_default_threads(void);
+int verify_signature_batch(const TxView *transactions, const TxWitness *witnesses, int count, int threads);
+int verify_block_signatures(const Block *block, int threads);
+int run_signature_benchmark(int block_count, int threads);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ================ FUNCTION PROTOTYPES ================ */
+uint64_t siphash24(uint64_t k0, uint64_t k1, const void *data, size_t length);
+
+#endif
@@ -0,0 +1,716 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "stratum.h"
+#include "block_tree.h"
+#include "json.h"
+#include "retarget.h"
+
+/* ================ CONNECTIONS ================ */
+static StratumWorker *find_worker(StratumServer *server, uint64_t tag)
+{
+    for (int i = 0; i < server->worker_count; i++)
+    {
+        if (STRATUM_CLIENT_TAG + (uint64_t)server->workers[i]->id == tag)
+            return server->workers[i];
+    }
+    return NULL;
+}
+
+static void drop_worker(Node *node, StratumWorker *worker)
+{
+    StratumServer *server = node->stratum;
+    for (int i = 0; i < server->worker_count; i++)
+    {
+        if (server->workers[i] == worker)
+        {
+            server->workers[i] = server->workers[--server->worker_count];
+            break;
+        }
+    }
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, worker->fd, NULL);
+    close(worker->fd);
+    free(worker->rbuf);
+    writer_free(&worker->out);
+    free(worker);
+}
+
+// A closing worker only waits for its output; with none left, the next EPOLLOUT drops it
+static void update_worker_events(Node *node, StratumWorker *worker)
+{
+    uint32_t events = worker->closing ? EPOLLOUT : EPOLLIN | (worker->out.length > worker->sent ? EPOLLOUT : 0);
+    if (events == worker->events)
+        return;
+    struct epoll_event event = {0};
+    event.events = events;
+    event.data.u64 = STRATUM_CLIENT_TAG + (uint64_t)worker->id;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_MOD, worker->fd, &event);
+    worker->events = events;
+}
+
+static int flush_worker(StratumWorker *worker)
+{
+    while (worker->sent < worker->out.length)
+    {
+        ssize_t n = send(worker->fd, worker->out.data + worker->sent, worker->out.length - worker->sent, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            worker->sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return 0;
+    }
+    memmove(worker->out.data, worker->out.data + worker->sent, worker->out.length - worker->sent);
+    worker->out.length -= worker->sent;
+    worker->sent = 0;
+    return 1;
+}
+
+// Writes queued messages straight away; a broken socket is dropped from the event loop later
+static void send_queued(Node *node, StratumWorker *worker)
+{
+    if (!flush_worker(worker))
+    {
+        worker->out.length = 0;
+        worker->closing = 1;
+    }
+    update_worker_events(node, worker);
+}
+
+/* ================ JOBS ================ */
+// Hands the worker the next unused nonce range of the current job
+static void notify_worker(Node *node, StratumWorker *worker, int clean)
+{
+    StratumJob *job = &node->stratum->job;
+    if (job->next_slice == STRATUM_SLICES)
+    {
+        // Every range was searched without a block; new work with a later timestamp for everyone
+        stratum_new_job(node);
+        return;
+    }
+    worker->slice = job->next_slice++;
+    uint32_t first = (uint32_t)worker->slice << STRATUM_SLICE_BITS;
+    put_format(&worker->out, "{\"id\":null,\"method\":\"mining.notify\",\"params\":[%d,", job->id);
+    put_json_string(&worker->out, job->prefix, strlen(job->prefix));
+    put_format(&worker->out, ",\"%08x\",\"%08x\",%u,%u,%s]}\n", job->share_bits, job->block.target_bits, first,
+               first + (1u << STRATUM_SLICE_BITS), clean ? "true" : "false");
+    send_queued(node, worker);
+}
+
+// Builds a template on the current tip and sends every subscribed worker its own nonce range
+void stratum_new_job(Node *node)
+{
+    StratumServer *server = node->stratum;
+    if (!server)
+        return;
+    StratumJob *job = &server->job;
+    Block *block = &job->block;
+    char previous_hash[HASH_SIZE];
+    time_t previous_time = block->timestamp;
+    strcpy(previous_hash, block->previous_hash);
+
+    block->target_bits = node_block_template(node, block);
+    // Same parent within the same second would repeat the preimage, and with it every range
+    if (server->jobs > 0 && strcmp(previous_hash, block->previous_hash) == 0 && block->timestamp <= previous_time)
+        block->timestamp = previous_time + 1;
+    compute_merkle_root(block, block->merkle_root);
+    block->difficulty = target_leading_zeros(block->target_bits);
+    block_header_prefix(block, job->prefix, sizeof(job->prefix));
+    int share_zeros = block->difficulty - STRATUM_SHARE_SHIFT;
+    if (share_zeros < POW_LIMIT_DIFFICULTY)
+        share_zeros = POW_LIMIT_DIFFICULTY;
+    job->share_bits = target_bits_from_difficulty(share_zeros);
+    job->id = (int)++server->jobs;
+    job->next_slice = 0;
+    memset(job->submitted, 0, sizeof(job->submitted));
+    job->submitted_count = 0;
+
+    for (int i = 0; i < server->worker_count; i++)
+    {
+        if (server->workers[i]->subscribed && !server->workers[i]->closing)
+            notify_worker(node, server->workers[i], 1);
+    }
+}
+
+// 1 if the nonce was new for this job (and is now recorded), 0 if it was seen before
+static int record_share(StratumJob *job, uint32_t nonce)
+{
+    uint32_t slot = (nonce * 2654435761u) & (STRATUM_SHARE_SLOTS - 1);
+    while (job->submitted[slot] != 0)
+    {
+        if (job->submitted[slot] == nonce + 1)
+            return 0;
+        slot = (slot + 1) & (STRATUM_SHARE_SLOTS - 1);
+    }
+    job->submitted[slot] = nonce + 1;
+    job->submitted_count++;
+    return 1;
+}
+
+/* ================ MESSAGES ================ */
+static void reply(StratumWorker *worker, const JsonSpan *id, int code, const char *message)
+{
+    put_text(&worker->out, "{\"id\":");
+    if (id)
+        put_bytes(&worker->out, id->start, (size_t)(id->end - id->start));
+    else
+        put_text(&worker->out, "null");
+    if (code == 0)
+        put_text(&worker->out, ",\"result\":true,\"error\":null}\n");
+    else
+    {
+        put_format(&worker->out, ",\"result\":null,\"error\":[%d,", code);
+        put_json_string(&worker->out, message, strlen(message));
+        put_text(&worker->out, ",null]}\n");
+    }
+}
+
+// params: [job id, nonce]. One SHA-256 decides the share; a share that is also a block goes to the chain.
+static void handle_submit(Node *node, StratumWorker *worker, const JsonSpan *id, const JsonSpan *params)
+{
+    StratumServer *server = node->stratum;
+    StratumJob *job = &server->job;
+    JsonSpan value;
+    long long job_id, nonce;
+    if (!worker->subscribed)
+    {
+        reply(worker, id, STRATUM_UNAUTHORIZED, "Subscribe first");
+        worker->rejected++;
+        server->rejected++;
+        return;
+    }
+    if (!json_item(params, 0, &value) || !json_integer(&value, &job_id) || !json_item(params, 1, &value) ||
+        !json_integer(&value, &nonce))
+    {
+        reply(worker, id, STRATUM_OTHER, "Expected [job id, nonce]");
+        worker->rejected++;
+        server->rejected++;
+        return;
+    }
+    if (job_id != job->id)
+    {
+        reply(worker, id, STRATUM_STALE, "Stale job");
+        worker->stale++;
+        server->stale++;
+        return;
+    }
+    if (worker->slice < 0 || nonce >> STRATUM_SLICE_BITS != worker->slice)
+    {
+        reply(worker, id, STRATUM_OTHER, "Nonce outside the assigned range");
+        worker->rejected++;
+        server->rejected++;
+        return;
+    }
+
+    char preimage[sizeof(job->prefix) + 16], hash[HASH_SIZE];
+    snprintf(preimage, sizeof(preimage), "%s%d", job->prefix, (int)nonce);
+    calculate_sha256(preimage, hash);
+    if (!hash_meets_target(hash, job->share_bits))
+    {
+        reply(worker, id, STRATUM_LOW_DIFFICULTY, "Low difficulty share");
+        worker->rejected++;
+        server->rejected++;
+        return;
+    }
+    if (!record_share(job, (uint32_t)nonce))
+    {
+        reply(worker, id, STRATUM_DUPLICATE, "Duplicate share");
+        worker->rejected++;
+        server->rejected++;
+        return;
+    }
+    reply(worker, id, 0, NULL);
+    worker->accepted++;
+    server->accepted++;
+
+    if (hash_meets_target(hash, job->block.target_bits))
+    {
+        // Connecting it changes the tip, which publishes the next job before this returns
+        Block block = job->block;
+        block.nonce = (int)nonce;
+        strcpy(block.hash, hash);
+        int before = node->chain->block_count;
+        node_process_block(node, NULL, &block, 0);
+        if (node->chain->block_count > before)
+        {
+            worker->blocks++;
+            server->blocks++;
+        }
+    }
+    else if (job->submitted_count >= STRATUM_SHARE_SLOTS / 2)
+        stratum_new_job(node);
+    send_queued(node, worker);
+}
+
+static void handle_line(Node *node, StratumWorker *worker, const char *line, size_t length)
+{
+    JsonSpan message, method_span, params, id, name;
+    char method[32];
+    message.start = json_space(line, line + length);
+    message.end = json_skip(line, line + length, 0);
+    if (message.start == line + length)
+        return;
+    if (!message.end || *message.start != '{' || !json_member(&message, "method", &method_span) ||
+        !json_text(&method_span, method, sizeof(method)))
+    {
+        reply(worker, NULL, STRATUM_OTHER, "Malformed message");
+        return;
+    }
+    int have_id = json_member(&message, "id", &id);
+    if (!json_member(&message, "params", &params) || *params.start != '[')
+        params.start = params.end = NULL;
+
+    if (strcmp(method, "mining.subscribe") == 0)
+    {
+        if (!params.start || !json_item(&params, 0, &name) || !json_text(&name, worker->name, sizeof(worker->name)))
+            snprintf(worker->name, sizeof(worker->name), "worker-%d", worker->id);
+        put_text(&worker->out, "{\"id\":");
+        if (have_id)
+            put_bytes(&worker->out, id.start, (size_t)(id.end - id.start));
+        else
+            put_text(&worker->out, "null");
+        put_format(&worker->out, ",\"result\":{\"worker\":%d,\"slice_bits\":%d},\"error\":null}\n", worker->id,
+                   STRATUM_SLICE_BITS);
+        worker->subscribed = 1;
+        notify_worker(node, worker, 1);
+    }
+    else if (strcmp(method, "mining.submit") == 0 && params.start)
+        handle_submit(node, worker, have_id ? &id : NULL, &params);
+    else if (strcmp(method, "mining.extend") == 0 && worker->subscribed)
+    {
+        // The worker finished its range; an old job id just gets the current job
+        JsonSpan value;
+        long long job_id;
+        int current = params.start && json_item(&params, 0, &value) && json_integer(&value, &job_id) &&
+                      job_id == node->stratum->job.id;
+        reply(worker, have_id ? &id : NULL, 0, NULL);
+        notify_worker(node, worker, !current);
+    }
+    else
+        reply(worker, have_id ? &id : NULL, STRATUM_OTHER, "Unknown method");
+}
+
+static int read_worker(Node *node, StratumWorker *worker)
+{
+    for (;;)
+    {
+        if (worker->rcap - worker->rlen < 1024)
+        {
+            size_t capacity = worker->rcap ? worker->rcap * 2 : STRATUM_MAX_LINE;
+            unsigned char *rbuf = realloc(worker->rbuf, capacity);
+            if (!rbuf)
+                return 0;
+            worker->rbuf = rbuf;
+            worker->rcap = capacity;
+        }
+        ssize_t n = recv(worker->fd, worker->rbuf + worker->rlen, worker->rcap - worker->rlen, 0);
+        if (n > 0)
+        {
+            worker->rlen += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return 0;
+    }
+
+    size_t offset = 0;
+    unsigned char *newline;
+    while (!worker->closing && (newline = memchr(worker->rbuf + offset, '\n', worker->rlen - offset)) != NULL)
+    {
+        size_t length = (size_t)(newline - (worker->rbuf + offset));
+        handle_line(node, worker, (const char *)worker->rbuf + offset, length);
+        offset += length + 1;
+    }
+    memmove(worker->rbuf, worker->rbuf + offset, worker->rlen - offset);
+    worker->rlen -= offset;
+    if (worker->rlen > STRATUM_MAX_LINE)
+        worker->closing = 1;
+    return 1;
+}
+
+static void accept_workers(Node *node)
+{
+    StratumServer *server = node->stratum;
+    int fd;
+    while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        StratumWorker *worker = NULL;
+        if (server->worker_count == STRATUM_MAX_WORKERS || flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            !(worker = calloc(1, sizeof(StratumWorker))))
+        {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        worker->fd = fd;
+        worker->id = server->next_worker_id++;
+        worker->slice = -1;
+        worker->events = EPOLLIN;
+        writer_init(&worker->out);
+
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.u64 = STRATUM_CLIENT_TAG + (uint64_t)worker->id;
+        epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        server->workers[server->worker_count++] = worker;
+    }
+}
+
+/* ================ SERVER ================ */
+// Listens on 127.0.0.1 (port 0 picks a free one) and publishes the first job
+int stratum_start(Node *node, int port)
+{
+    StratumServer *server = calloc(1, sizeof(StratumServer));
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!server || fd < 0)
+    {
+        free(server);
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address = {0};
+    socklen_t address_length = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    int flags;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 64) < 0 ||
+        (flags = fcntl(fd, F_GETFL, 0)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &address_length) < 0)
+    {
+        close(fd);
+        free(server);
+        return 0;
+    }
+    server->listen_fd = fd;
+    server->port = ntohs(address.sin_port);
+
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = STRATUM_LISTEN_TAG;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    node->stratum = server;
+    stratum_new_job(node);
+    return 1;
+}
+
+void stratum_stop(Node *node)
+{
+    StratumServer *server = node->stratum;
+    if (!server)
+        return;
+    while (server->worker_count > 0)
+        drop_worker(node, server->workers[0]);
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, server->listen_fd, NULL);
+    close(server->listen_fd);
+    free(server);
+    node->stratum = NULL;
+}
+
+// Called by node_poll for every event; returns 0 if the tag is not the server's
+int stratum_handle_event(Node *node, uint64_t tag, uint32_t events)
+{
+    StratumServer *server = node->stratum;
+    if (!server || (tag != STRATUM_LISTEN_TAG && (tag < STRATUM_CLIENT_TAG || tag >= STRATUM_CLIENT_TAG + INT32_MAX)))
+        return 0;
+    if (tag == STRATUM_LISTEN_TAG)
+    {
+        accept_workers(node);
+        return 1;
+    }
+
+    StratumWorker *worker = find_worker(server, tag);
+    if (!worker)
+        return 1;
+    if (((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) || ((events & EPOLLIN) && !read_worker(node, worker)) ||
+        !flush_worker(worker) || (worker->closing && worker->out.length == 0))
+    {
+        drop_worker(node, worker);
+        return 1;
+    }
+    update_worker_events(node, worker);
+    return 1;
+}
+
+/* ================ MINER WORKER ================ */
+typedef struct
+{
+    int id;                   // Job being searched (0 before the first notify)
+    char preimage[256 + 16];  // Prefix followed by room for the nonce
+    size_t prefix_length;     // Bytes of preimage that stay fixed
+    uint32_t share_bits;      // Target a hash must meet to be submitted
+    uint32_t next;            // Next nonce to try
+    uint32_t end;             // End of the assigned range
+    int active;               // A range is left to search
+} MinerJob;
+
+static void miner_handle_line(MinerJob *job, const char *line, size_t length, uint64_t *accepted, uint64_t *refused)
+{
+    JsonSpan message, member, value;
+    char method[32], text[16];
+    long long number;
+    message.start = json_space(line, line + length);
+    message.end = json_skip(line, line + length, 0);
+    if (!message.end || *message.start != '{')
+        return;
+    if (!json_member(&message, "method", &member))
+    {
+        // Only submits (id 3) are counted; the subscribe and extend answers carry nothing new
+        if (json_member(&message, "id", &value) && json_integer(&value, &number) && number == 3)
+        {
+            if (json_member(&message, "result", &value) && value.end - value.start == 4 &&
+                memcmp(value.start, "true", 4) == 0)
+                (*accepted)++;
+            else
+                (*refused)++;
+        }
+        return;
+    }
+    if (!json_text(&member, method, sizeof(method)) || strcmp(method, "mining.notify") != 0 ||
+        !json_member(&message, "params", &member))
+        return;
+
+    long long id, first, end;
+    if (!json_item(&member, 0, &value) || !json_integer(&value, &id) || !json_item(&member, 1, &value) ||
+        !json_text(&value, job->preimage, 256) || !json_item(&member, 2, &value) ||
+        !json_text(&value, text, sizeof(text)) || !json_item(&member, 4, &value) || !json_integer(&value, &first) ||
+        !json_item(&member, 5, &value) || !json_integer(&value, &end))
+        return;
+    // A new range always replaces the current one: either it extends it or the old job went stale
+    job->id = (int)id;
+    job->prefix_length = strlen(job->preimage);
+    job->share_bits = (uint32_t)strtoul(text, NULL, 16);
+    job->next = (uint32_t)first;
+    job->end = (uint32_t)end;
+    job->active = job->next < job->end;
+}
+
+// Connects to a work server and searches whatever range it hands out until the server hangs up
+int run_stratum_miner(const char *endpoint, const char *name, int quiet)
+{
+    char host[64], hash[HASH_SIZE];
+    int port;
+    if (sscanf(endpoint, "%63[^:]:%d", host, &port) != 2 || port < 1 || port > 65535)
+    {
+        print_error("Usage: --miner <host:port> [name]");
+        return 1;
+    }
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        print_error("Could not connect to the work server");
+        return 1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    ByteWriter out;
+    writer_init(&out);
+    put_text(&out, "{\"id\":1,\"method\":\"mining.subscribe\",\"params\":[");
+    put_json_string(&out, name, strlen(name));
+    put_text(&out, "]}\n");
+
+    char buffer[STRATUM_MAX_LINE * 4];
+    size_t length = 0;
+    MinerJob job = {0};
+    uint64_t hashes = 0, shares = 0, accepted = 0, refused = 0;
+    if (!quiet)
+        printf(COLOR_GREEN "Mining for %s as %s" COLOR_RESET "\n", endpoint, name);
+    for (;;)
+    {
+        if (out.length > 0 && send(fd, out.data, out.length, MSG_NOSIGNAL) != (ssize_t)out.length)
+            break;
+        out.length = 0;
+
+        // Block on the socket only while there is nothing to hash
+        ssize_t n = recv(fd, buffer + length, sizeof(buffer) - length, job.active ? MSG_DONTWAIT : 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            break;
+        if (n > 0)
+        {
+            length += (size_t)n;
+            size_t offset = 0;
+            char *newline;
+            while ((newline = memchr(buffer + offset, '\n', length - offset)) != NULL)
+            {
+                miner_handle_line(&job, buffer + offset, (size_t)(newline - (buffer + offset)), &accepted, &refused);
+                offset = (size_t)(newline - buffer) + 1;
+            }
+            memmove(buffer, buffer + offset, length - offset);
+            length -= offset;
+            if (length == sizeof(buffer))
+                break;
+        }
+        if (!job.active)
+            continue;
+
+        for (int i = 0; i < STRATUM_POLL_HASHES && job.next < job.end; i++, job.next++)
+        {
+            snprintf(job.preimage + job.prefix_length, sizeof(job.preimage) - job.prefix_length, "%u", job.next);
+            calculate_sha256(job.preimage, hash);
+            hashes++;
+            if (hash_meets_target(hash, job.share_bits))
+            {
+                put_format(&out, "{\"id\":3,\"method\":\"mining.submit\",\"params\":[%d,%u]}\n", job.id, job.next);
+                shares++;
+            }
+        }
+        if (job.next == job.end)
+        {
+            put_format(&out, "{\"id\":2,\"method\":\"mining.extend\",\"params\":[%d]}\n", job.id);
+            job.active = 0;
+        }
+    }
+    close(fd);
+    writer_free(&out);
+    if (!quiet)
+        printf(COLOR_CYAN "Server closed the connection: %llu hashes, %llu shares (%llu accepted, %llu refused)" COLOR_RESET
+                          "\n",
+               (unsigned long long)hashes, (unsigned long long)shares, (unsigned long long)accepted,
+               (unsigned long long)refused);
+    return 0;
+}
+
+/* ================ STRATUM BENCHMARK ================ */
+typedef struct
+{
+    double seconds;    // Until the last block connected
+    int blocks;        // Height reached + 1
+    uint64_t accepted; // Shares accepted
+    uint64_t stale;    // Shares for replaced jobs
+    uint64_t rejected; // Duplicates, out-of-range and low-difficulty shares
+    uint64_t jobs;     // Jobs published
+} StratumBenchResult;
+
+static int stratum_bench_phase(int workers, int blocks, int difficulty, StratumBenchResult *result)
+{
+    Blockchain chain = {0};
+    BlockTree tree;
+    Node node;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    memset(result, 0, sizeof(*result));
+    int started = node_init(&node, &chain, 0, difficulty);
+    if (!started || !stratum_start(&node, 0))
+    {
+        if (started)
+            node_free(&node);
+        block_tree_free(&tree);
+        free(chain.blocks);
+        return 0;
+    }
+
+    char endpoint[32];
+    pid_t children[STRATUM_MAX_WORKERS];
+    snprintf(endpoint, sizeof(endpoint), "127.0.0.1:%d", node.stratum->port);
+    fflush(stdout);
+    for (int i = 0; i < workers; i++)
+    {
+        children[i] = fork();
+        if (children[i] == 0)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "bench-%d", i);
+            _exit(run_stratum_miner(endpoint, name, 1));
+        }
+    }
+
+    uint64_t start = monotonic_ns(), deadline = start + 300ull * 1000000000ull;
+    while (chain.block_count < blocks && monotonic_ns() < deadline && node_poll(&node, 100) >= 0)
+        ;
+    result->seconds = (monotonic_ns() - start) / 1e9;
+    result->blocks = chain.block_count;
+    result->accepted = node.stratum->accepted;
+    result->stale = node.stratum->stale;
+    result->rejected = node.stratum->rejected;
+    result->jobs = node.stratum->jobs;
+
+    // Closing the server ends every worker's connection, and with it the worker
+    node_free(&node);
+    for (int i = 0; i < workers; i++)
+    {
+        if (children[i] > 0)
+            waitpid(children[i], NULL, 0);
+    }
+    block_tree_free(&tree);
+    free(chain.blocks);
+    return result->blocks >= blocks;
+}
+
+int run_stratum_benchmark(int workers, int blocks, int difficulty)
+{
+    if (workers < 1 || workers > STRATUM_MAX_WORKERS || blocks < 1 || difficulty < 2 || difficulty > 6)
+    {
+        print_error("Usage: --stratum-bench [workers 1-64] [blocks] [difficulty 2-6]");
+        return 1;
+    }
+    print_header("STRATUM WORK DISTRIBUTION BENCHMARK");
+    printf(COLOR_CYAN "%d blocks at difficulty %d (shares at %d), mined by worker processes over loopback" COLOR_RESET
+                      "\n\n",
+           blocks, difficulty, difficulty - STRATUM_SHARE_SHIFT);
+
+    int counts[2] = {1, workers};
+    StratumBenchResult results[2];
+    int ok = 1;
+    for (int run = 0; run < 2; run++)
+        ok &= stratum_bench_phase(counts[run], blocks, difficulty, &results[run]);
+
+    // Each accepted share stands for about 16^(share zeros) hashes
+    double hashes_per_share = 1;
+    for (int i = 0; i < difficulty - STRATUM_SHARE_SHIFT; i++)
+        hashes_per_share *= 16;
+
+    printf(COLOR_BLUE "┌─────────┬────────┬──────────┬──────────┬──────────┬────────┬───────┬──────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-7s" COLOR_BLUE " │ " COLOR_YELLOW "%-6s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s"
+                      COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-6s" COLOR_BLUE " │ " COLOR_YELLOW "%-5s" COLOR_BLUE " │ " COLOR_YELLOW "%-8s" COLOR_BLUE " │\n",
+           "Workers", "Blocks", "Time (s)", "Blocks/s", "Shares", "Stale", "Bad", "kH/s est");
+    printf(COLOR_BLUE "├─────────┼────────┼──────────┼──────────┼──────────┼────────┼───────┼──────────┤\n");
+    for (int run = 0; run < 2; run++)
+    {
+        const StratumBenchResult *r = &results[run];
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-7d" COLOR_BLUE " │ " COLOR_CYAN "%-6d" COLOR_BLUE " │ " COLOR_CYAN "%-8.2f"
+                          COLOR_BLUE " │ " COLOR_CYAN "%-8.2f" COLOR_BLUE " │ " COLOR_CYAN "%-8llu" COLOR_BLUE " │ "
+                          COLOR_CYAN "%-6llu" COLOR_BLUE " │ %s%-5llu" COLOR_BLUE " │ " COLOR_CYAN "%-8.0f" COLOR_BLUE " │\n",
+               counts[run], r->blocks, r->seconds, r->blocks / r->seconds, (unsigned long long)r->accepted,
+               (unsigned long long)r->stale, r->rejected ? COLOR_RED : COLOR_GREEN, (unsigned long long)r->rejected,
+               r->accepted * hashes_per_share / r->seconds / 1000);
+    }
+    printf(COLOR_BLUE "└─────────┴────────┴──────────┴──────────┴──────────┴────────┴───────┴──────────┘" COLOR_RESET
+                      "\n");
+
+    if (!ok || results[0].rejected + results[1].rejected > 0)
+    {
+        print_error("A run stalled, or a worker submitted a duplicate or out-of-range share");
+        return 1;
+    }
+    printf(COLOR_GREEN "\n✔ No duplicate nonces across %d workers; %.1f%% of shares arrived after their job went stale"
+                       COLOR_RESET "\n",
+           workers, 100.0 * results[1].stale / (results[1].accepted + results[1].stale));
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef STRATUM_H
+#define STRATUM_H
+
+#include <stdint.h>
+#include "p2p.h"
+#include "wire.h"
+
+/* ================ CONSTANTS ================ */
+#define STRATUM_DEFAULT_PORT 3333                       // Listening port when --stratum is given without one
+#define STRATUM_MAX_WORKERS 64                          // Connected miner processes
+#define STRATUM_MAX_LINE 4096                           // Longest message line
+#define STRATUM_SLICE_BITS 24                           // A worker's nonce range holds 2^24 nonces
+#define STRATUM_SLICES (1 << (31 - STRATUM_SLICE_BITS)) // Ranges per job: the non-negative nonces, split up
+#define STRATUM_SHARE_SHIFT 1                           // Shares need this many fewer leading hex zeros than a block
+#define STRATUM_SHARE_SLOTS 8192                        // Per-job table of submitted nonces (power of two)
+#define STRATUM_POLL_HASHES 1024                        // Hashes a worker tries between checks for new jobs
+#define STRATUM_LISTEN_TAG ((uint64_t)-6)               // epoll data for the listening socket
+#define STRATUM_CLIENT_TAG ((uint64_t)2 << 32)          // epoll data for worker n is STRATUM_CLIENT_TAG + n
+
+#define STRATUM_OTHER 20          // Malformed request or nonce outside the worker's range
+#define STRATUM_STALE 21          // Share for a job that is no longer current
+#define STRATUM_DUPLICATE 22      // Nonce already submitted for this job
+#define STRATUM_LOW_DIFFICULTY 23 // Hash does not meet the share target
+#define STRATUM_UNAUTHORIZED 24   // mining.submit before mining.subscribe
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    int fd;              // Non-blocking TCP socket
+    int id;              // Tag offset for epoll
+    unsigned char *rbuf; // Bytes received but not yet handled
+    size_t rlen, rcap;   // Used/allocated size of rbuf
+    ByteWriter out;      // Messages not yet written
+    size_t sent;         // Part of out already written
+    uint32_t events;     // epoll events currently armed
+    int closing;         // Close once out is written
+    char name[32];       // Name given in mining.subscribe
+    int subscribed;      // Receives mining.notify
+    int slice;           // Nonce range assigned for the current job (-1 if none)
+    uint64_t accepted;   // Shares that met the share target
+    uint64_t stale;      // Shares for an old job
+    uint64_t rejected;   // Duplicate, out-of-range or low-difficulty shares
+    int blocks;          // Shares that were also blocks and extended the chain
+} StratumWorker;
+
+// The work every worker is searching, differing only in the nonce range each one was handed
+typedef struct
+{
+    int id;                                  // Sent with every notify and echoed in every submit
+    Block block;                             // Template with its Merkle root and target set
+    char prefix[256];                        // Hash preimage up to the nonce
+    uint32_t share_bits;                     // Easier target that proves work was done
+    int next_slice;                          // First nonce range not handed out yet
+    uint32_t submitted[STRATUM_SHARE_SLOTS]; // Nonce + 1 of every accepted share (0 = empty)
+    int submitted_count;                     // Entries in submitted
+} StratumJob;
+
+typedef struct StratumServer
+{
+    int listen_fd;                               // Accepting socket
+    int port;                                    // Port actually bound
+    StratumWorker *workers[STRATUM_MAX_WORKERS]; // Open connections
+    int worker_count;                            // Entries in workers
+    int next_worker_id;                          // Counter for StratumWorker.id
+    StratumJob job;                              // Current work
+    uint64_t jobs;                               // Jobs published since start
+    uint64_t accepted;                           // Shares accepted from every worker
+    uint64_t stale;                              // Shares that arrived after their job was replaced
+    uint64_t rejected;                           // Every other refused share
+    int blocks;                                  // Blocks found by workers
+} StratumServer;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int stratum_start(Node *node, int port);
+void stratum_stop(Node *node);
+void stratum_new_job(Node *node);
+int stratum_handle_event(Node *node, uint64_t tag, uint32_t events);
+int run_stratum_miner(const char *endpoint, const char *name, int quiet);
+int run_stratum_benchmark(int workers, int blocks, int difficulty);
+
+#endif
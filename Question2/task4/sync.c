@@ -0,0 +1,721 @@
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include "sync.h"
+#include "signature.h"
+#include "trace.h"
+#include "transaction.h"
+
+/* ================ VALIDATION POOL ================ */
+static void *validation_worker(void *argument)
+{
+    SyncState *sync = argument;
+    trace_thread_name("sync validation");
+    pthread_mutex_lock(&sync->lock);
+    for (;;)
+    {
+        while (sync->job_count == 0 && !sync->stopping)
+            pthread_cond_wait(&sync->wake, &sync->lock);
+        if (sync->stopping)
+            break;
+        int index = sync->jobs[sync->job_head];
+        sync->job_head = (sync->job_head + 1) % SYNC_WINDOW;
+        sync->job_count--;
+        const Block *block = sync->slots[index].block;
+        int assumed = sync->slots[index].assumed;
+        pthread_mutex_unlock(&sync->lock);
+
+        // Hashing runs unlocked, so bodies are checked in parallel and in any order; the pool
+        // already spans the cores, so each block's signatures stay on this worker
+        int valid = validate_block_header(block) &&
+                    (assumed ? validate_block_structure(block) : validate_block_body(block, 1));
+
+        pthread_mutex_lock(&sync->lock);
+        // The event loop drains every result per wakeup, so only the first one needs a signal
+        sync->results[(sync->result_head + sync->result_count) % SYNC_WINDOW] = index * 2 + valid;
+        if (sync->result_count++ == 0)
+            eventfd_write(sync->event_fd, 1);
+    }
+    pthread_mutex_unlock(&sync->lock);
+    return NULL;
+}
+
+static void release_slot(SyncSlot *slot)
+{
+    free(slot->block);
+    slot->block = NULL;
+    slot->state = SLOT_EMPTY;
+}
+
+static void finish_validation(SyncState *sync, int index, int valid)
+{
+    SyncSlot *slot = &sync->slots[index];
+    if (valid)
+    {
+        slot->state = SLOT_VALID;
+        return;
+    }
+    sync->invalid++;
+    release_slot(slot); // Asked for again, most likely from another peer
+}
+
+/* ================ DOWNLOAD WINDOW ================ */
+static int peer_position(const Node *node, int peer_id)
+{
+    for (int i = 0; i < node->peer_count; i++)
+    {
+        if (node->peers[i]->id == peer_id)
+            return i;
+    }
+    return -1;
+}
+
+static int first_missing_height(const BlockTree *tree)
+{
+    if (!tree->active || !tree->best_header)
+        return 0;
+    return block_tree_fork_point(tree->active, tree->best_header)->height + 1;
+}
+
+static void check_complete(Node *node)
+{
+    SyncState *sync = node->sync;
+    const BlockTree *tree = node->chain->tree;
+    if (sync->complete || !sync->headers_done || tree->active != tree->best_header)
+        return;
+
+    sync->complete = 1;
+    sync->finished_ns = monotonic_ns();
+    if (!sync->quiet)
+    {
+        printf(COLOR_GREEN "✔ Synced to height %d in %.1f ms (%d blocks downloaded, %d re-requested)" COLOR_RESET "\n",
+               node->chain->block_count - 1, (double)(sync->finished_ns - sync->started_ns) / 1e6,
+               sync->blocks_downloaded, sync->re_requests);
+        if (sync->assumed > 0)
+            printf(COLOR_GREEN "  %d of them were under the assume-valid block and skipped signature checks" COLOR_RESET "\n",
+                   sync->assumed);
+        fflush(stdout);
+    }
+}
+
+static void connect_ready(Node *node)
+{
+    SyncState *sync = node->sync;
+    BlockTree *tree = node->chain->tree;
+    BlockNode *target = tree->best_header;
+
+    // Bodies validate out of order but join the chain strictly by height
+    for (int height = first_missing_height(tree); target && height <= target->height; height++)
+    {
+        BlockNode *want = block_node_ancestor(target, height);
+        if (want->have_data)
+            continue;
+        SyncSlot *slot = &sync->slots[height % sync->window];
+        if (slot->height != height || slot->target != want || slot->state != SLOT_VALID)
+            break;
+        node_process_block(node, NULL, slot->block, 1);
+        release_slot(slot);
+        if (!want->have_data)
+            break;
+    }
+    check_complete(node);
+}
+
+static int pick_peer(Node *node, const int in_flight[P2P_MAX_PEERS], const int refill[P2P_MAX_PEERS])
+{
+    SyncState *sync = node->sync;
+    for (int tries = 0; tries < node->peer_count; tries++)
+    {
+        int position = sync->next_peer++ % node->peer_count;
+        if (refill[position] && in_flight[position] < sync->peer_in_flight)
+            return position;
+    }
+    return -1;
+}
+
+static void schedule_downloads(Node *node)
+{
+    SyncState *sync = node->sync;
+    BlockTree *tree = node->chain->tree;
+    BlockNode *target = tree->best_header;
+    if (!target || node->peer_count == 0 || sync->complete)
+        return;
+
+    int start = first_missing_height(tree);
+    int end = start + sync->window - 1 < target->height ? start + sync->window - 1 : target->height;
+    if (end < start)
+        return;
+
+    // One walk down the header chain instead of an ancestor lookup per height
+    BlockNode *path[SYNC_WINDOW];
+    BlockNode *at = block_node_ancestor(target, end);
+    for (int height = end; height >= start; height--, at = at->parent)
+        path[height - start] = at;
+
+    int in_flight[P2P_MAX_PEERS] = {0};
+    for (int i = 0; i < sync->window; i++)
+    {
+        int position = sync->slots[i].state == SLOT_REQUESTED ? peer_position(node, sync->slots[i].peer_id) : -1;
+        if (position >= 0)
+            in_flight[position]++;
+    }
+
+    // Top a peer up only once half its requests are answered, so GETDATA goes out in batches
+    int refill[P2P_MAX_PEERS];
+    for (int i = 0; i < node->peer_count; i++)
+        refill[i] = in_flight[i] <= sync->peer_in_flight / 2;
+
+    ByteWriter batches[P2P_MAX_PEERS];
+    int batch_counts[P2P_MAX_PEERS] = {0};
+    uint64_t now = monotonic_ns();
+    for (int height = start; height <= end; height++)
+    {
+        BlockNode *want = path[height - start];
+        SyncSlot *slot = &sync->slots[height % sync->window];
+        if (want->have_data)
+            continue;
+        if (slot->height != height || slot->target != want)
+        {
+            if (slot->state == SLOT_VALIDATING)
+                continue; // A worker still owns the old body
+            release_slot(slot);
+            slot->height = height;
+            slot->target = want;
+        }
+        if (slot->state != SLOT_EMPTY)
+            continue;
+
+        int position = pick_peer(node, in_flight, refill);
+        if (position < 0)
+            break;
+        if (batch_counts[position] == 0)
+        {
+            writer_init(&batches[position]);
+            put_u16(&batches[position], 0);
+        }
+        put_u8(&batches[position], INV_BLOCK);
+        put_hash(&batches[position], want->block.hash);
+        batch_counts[position]++;
+        in_flight[position]++;
+
+        slot->state = SLOT_REQUESTED;
+        slot->peer_id = node->peers[position]->id;
+        slot->requested_ns = now;
+    }
+
+    for (int i = 0; i < node->peer_count; i++)
+    {
+        if (batch_counts[i] == 0)
+            continue;
+        batches[i].data[0] = (unsigned char)batch_counts[i];
+        batches[i].data[1] = (unsigned char)(batch_counts[i] >> 8);
+        node_send(node, node->peers[i], MSG_GETDATA, &batches[i]);
+        writer_free(&batches[i]);
+    }
+}
+
+/* ================ HEADERS ================ */
+static void send_getheaders(Node *node, Peer *peer)
+{
+    // Dense near the tip, then exponentially sparser back to genesis
+    ByteWriter payload;
+    writer_init(&payload);
+    put_u16(&payload, 0);
+    int count = 0, step = 1;
+    BlockNode *at = node->chain->tree->best_header;
+    while (at && count < SYNC_MAX_LOCATOR)
+    {
+        put_hash(&payload, at->block.hash);
+        count++;
+        if (at->height == 0)
+            break;
+        if (count >= 10)
+            step *= 2;
+        at = block_node_ancestor(at, at->height > step ? at->height - step : 0);
+    }
+    payload.data[0] = (unsigned char)count;
+    payload.data[1] = (unsigned char)(count >> 8);
+    node_send(node, peer, MSG_GETHEADERS, &payload);
+    writer_free(&payload);
+    node->sync->header_peer = peer->id;
+}
+
+void sync_handle_getheaders(Node *node, Peer *peer, ByteReader *reader)
+{
+    const Blockchain *chain = node->chain;
+    int count = get_u16(reader), start = 0;
+    for (int i = 0; i < count && reader->ok; i++)
+    {
+        char hash[HASH_SIZE];
+        get_hash(reader, hash);
+        const BlockNode *found = block_tree_find_block(chain->tree, hash);
+        if (reader->ok && found && found->height < chain->block_count &&
+            strcmp(chain->blocks[found->height].hash, hash) == 0)
+        {
+            start = found->height + 1;
+            break;
+        }
+    }
+    if (!reader->ok)
+        return;
+
+    ByteWriter reply;
+    writer_init(&reply);
+    put_u16(&reply, 0);
+    int sent = 0;
+    for (int height = start; height < chain->block_count && sent < SYNC_MAX_HEADERS; height++, sent++)
+    {
+        serialize_block_header(&reply, &chain->blocks[height]);
+    }
+    reply.data[0] = (unsigned char)sent;
+    reply.data[1] = (unsigned char)(sent >> 8);
+    node_send(node, peer, MSG_HEADERS, &reply);
+    writer_free(&reply);
+}
+
+void sync_handle_headers(Node *node, Peer *peer, ByteReader *reader)
+{
+    SyncState *sync = node->sync;
+    if (!sync || sync->complete)
+        return;
+
+    int count = get_u16(reader), usable = 1;
+    for (int i = 0; i < count && usable; i++)
+    {
+        Block header;
+        if (!deserialize_block_header(reader, &header))
+            return;
+        int status = block_tree_insert_header(node->chain->tree, &header, NULL);
+        usable = status != TREE_INVALID && status != TREE_ORPHAN;
+    }
+
+    // A full batch means the peer has more; keep asking the same peer
+    if (usable && count == SYNC_MAX_HEADERS)
+        send_getheaders(node, peer);
+    else
+        sync->headers_done = 1;
+
+    if (sync->headers_done && !sync->quiet && node->chain->tree->best_header)
+    {
+        printf(COLOR_CYAN "Headers synced to height %d, downloading blocks..." COLOR_RESET "\n",
+               node->chain->tree->best_header->height);
+        fflush(stdout);
+    }
+    connect_ready(node);
+    schedule_downloads(node);
+}
+
+/* ================ BLOCKS ================ */
+int sync_handle_block(Node *node, Peer *peer, const Block *block)
+{
+    SyncState *sync = node->sync;
+    (void)peer;
+    if (!sync || sync->complete || block->index < 0)
+        return 0;
+
+    int index = block->index % sync->window;
+    SyncSlot *slot = &sync->slots[index];
+    if (slot->height != block->index || !slot->target || strcmp(slot->target->block.hash, block->hash) != 0)
+        return 0;
+    if (slot->state != SLOT_REQUESTED && slot->state != SLOT_EMPTY)
+        return 1; // Late copy of a block that was re-requested elsewhere
+
+    slot->block = malloc(sizeof(Block));
+    if (!slot->block)
+        return 0;
+    *slot->block = *block;
+    sync->blocks_downloaded++;
+    // Decided here because workers may not touch the tree
+    slot->assumed = block_tree_assumes_valid(node->chain->tree, block->hash, block->index);
+    sync->assumed += slot->assumed;
+
+    if (sync->worker_count == 0)
+    {
+        finish_validation(sync, index,
+                          validate_block_header(block) &&
+                              (slot->assumed ? validate_block_structure(block) : validate_block_body(block, 0)));
+        connect_ready(node);
+    }
+    else
+    {
+        pthread_mutex_lock(&sync->lock);
+        slot->state = SLOT_VALIDATING;
+        sync->jobs[(sync->job_head + sync->job_count) % SYNC_WINDOW] = index;
+        sync->job_count++;
+        pthread_cond_signal(&sync->wake);
+        pthread_mutex_unlock(&sync->lock);
+    }
+    schedule_downloads(node);
+    return 1;
+}
+
+void sync_handle_validated(Node *node)
+{
+    SyncState *sync = node->sync;
+    eventfd_t signalled;
+    int results[SYNC_WINDOW], count = 0;
+    if (!sync)
+        return;
+    eventfd_read(sync->event_fd, &signalled);
+
+    pthread_mutex_lock(&sync->lock);
+    while (sync->result_count > 0)
+    {
+        results[count++] = sync->results[sync->result_head];
+        sync->result_head = (sync->result_head + 1) % SYNC_WINDOW;
+        sync->result_count--;
+    }
+    pthread_mutex_unlock(&sync->lock);
+
+    for (int i = 0; i < count; i++)
+        finish_validation(sync, results[i] / 2, results[i] % 2);
+    connect_ready(node);
+    schedule_downloads(node);
+}
+
+void sync_tick(Node *node)
+{
+    SyncState *sync = node->sync;
+    if (!sync || sync->complete)
+        return;
+
+    uint64_t now = monotonic_ns(), timeout = (uint64_t)SYNC_TIMEOUT_MS * 1000000ull;
+    int expired = 0;
+    for (int i = 0; i < sync->window; i++)
+    {
+        if (sync->slots[i].state == SLOT_REQUESTED && now - sync->slots[i].requested_ns > timeout)
+        {
+            sync->slots[i].state = SLOT_EMPTY;
+            sync->re_requests++;
+            expired++;
+        }
+    }
+    if (expired > 0)
+        schedule_downloads(node);
+}
+
+/* ================ PEERS ================ */
+void sync_peer_added(Node *node, Peer *peer)
+{
+    SyncState *sync = node->sync;
+    if (!sync || sync->complete)
+        return;
+    if (sync->header_peer < 0)
+        send_getheaders(node, peer);
+    schedule_downloads(node);
+}
+
+void sync_peer_dropped(Node *node, Peer *peer)
+{
+    SyncState *sync = node->sync;
+    if (!sync || sync->complete)
+        return;
+
+    for (int i = 0; i < sync->window; i++)
+    {
+        if (sync->slots[i].state == SLOT_REQUESTED && sync->slots[i].peer_id == peer->id)
+        {
+            sync->slots[i].state = SLOT_EMPTY;
+            sync->re_requests++;
+        }
+    }
+    if (sync->header_peer == peer->id)
+    {
+        sync->header_peer = -1;
+        for (int i = 0; i < node->peer_count; i++)
+        {
+            if (node->peers[i] != peer)
+            {
+                send_getheaders(node, node->peers[i]);
+                break;
+            }
+        }
+    }
+    schedule_downloads(node);
+}
+
+/* ================ LIFECYCLE ================ */
+int sync_start(Node *node, int window, int peer_in_flight, int worker_count)
+{
+    SyncState *sync = calloc(1, sizeof(SyncState));
+    if (!sync)
+        return 0;
+    sync->window = window < 1 ? 1 : window > SYNC_WINDOW ? SYNC_WINDOW : window;
+    sync->peer_in_flight = peer_in_flight < 1 ? 1 : peer_in_flight;
+    sync->header_peer = -1;
+    sync->started_ns = monotonic_ns();
+    for (int i = 0; i < SYNC_WINDOW; i++)
+        sync->slots[i].height = -1;
+
+    sync->event_fd = eventfd(0, EFD_NONBLOCK);
+    if (sync->event_fd < 0)
+    {
+        free(sync);
+        return 0;
+    }
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.u64 = SYNC_EVENT_TAG;
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_ADD, sync->event_fd, &event);
+
+    pthread_mutex_init(&sync->lock, NULL);
+    pthread_cond_init(&sync->wake, NULL);
+    if (worker_count > SYNC_MAX_WORKERS)
+        worker_count = SYNC_MAX_WORKERS;
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (pthread_create(&sync->workers[i], NULL, validation_worker, sync) != 0)
+            break;
+        sync->worker_count++;
+    }
+    node->sync = sync;
+
+    // Already-open connections are asked straight away
+    for (int i = 0; i < node->peer_count; i++)
+        sync_peer_added(node, node->peers[i]);
+    return 1;
+}
+
+void sync_free(Node *node)
+{
+    SyncState *sync = node->sync;
+    if (!sync)
+        return;
+    node->sync = NULL;
+
+    pthread_mutex_lock(&sync->lock);
+    sync->stopping = 1;
+    pthread_cond_broadcast(&sync->wake);
+    pthread_mutex_unlock(&sync->lock);
+    for (int i = 0; i < sync->worker_count; i++)
+        pthread_join(sync->workers[i], NULL);
+
+    epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, sync->event_fd, NULL);
+    close(sync->event_fd);
+    for (int i = 0; i < SYNC_WINDOW; i++)
+        free(sync->slots[i].block);
+    pthread_mutex_destroy(&sync->lock);
+    pthread_cond_destroy(&sync->wake);
+    free(sync);
+}
+
+int sync_in_progress(const Node *node)
+{
+    return node->sync && !node->sync->complete;
+}
+
+/* ================ SYNC BENCHMARK ================ */
+typedef struct
+{
+    const char *mode;  // Row label
+    int peers;         // Peers the syncing node downloads from
+    int window;        // Download window
+    int in_flight;     // Requests per peer
+    int workers;       // Validation threads (0 = inline)
+    int assume_valid;  // The tip is given as the assume-valid block
+    double elapsed_ms; // sync_start until the last block connected
+    int height;        // Height reached
+    int re_requests;   // Timeouts/drops during the run
+    int assumed;       // Bodies validated without their signatures
+} SyncRun;
+
+// Every transaction is signed, so validating a body costs what it would on a real chain. The
+// genesis block funds every key, and after it each key pays out of the change of its last payment.
+static int build_bench_chain(Blockchain *chain, int block_count)
+{
+    KeyPair keys[MAX_TRANSACTIONS];
+    OutPoint coins[MAX_TRANSACTIONS];
+    uint64_t balances[MAX_TRANSACTIONS];
+    for (int t = 0; t < MAX_TRANSACTIONS; t++)
+    {
+        if (!keypair_generate(&keys[t]))
+            return 0;
+    }
+    for (int i = 0; i < block_count; i++)
+    {
+        Block block;
+        int nonce_attempts, disconnected, connected;
+        memset(&block, 0, sizeof(block));
+        block.index = i;
+        block.timestamp = time(NULL);
+        if (i == 0)
+            strcpy(block.previous_hash, "0000000000000000000000000000000000000000000000000000000000000000");
+        else
+            strcpy(block.previous_hash, chain->blocks[i - 1].hash);
+        for (int t = 0; t < MAX_TRANSACTIONS; t++)
+        {
+            Transaction tx = {0};
+            TxWitness witness;
+            unsigned char encoded[MAX_TX_SIZE];
+            strcpy(tx.sender, keys[t].address);
+            snprintf(tx.memo, sizeof(tx.memo), "wallet-%06d-%02d", i, t);
+            if (i == 0)
+            {
+                strcpy(tx.outputs[0].address, keys[t].address);
+                tx.outputs[0].amount = 10000000 * (uint64_t)AMOUNT_SCALE;
+                tx.output_count = 1;
+            }
+            else
+            {
+                memcpy(tx.inputs[0].prev_txid, coins[t].txid, TXID_SIZE);
+                tx.inputs[0].index = coins[t].index;
+                tx.input_count = 1;
+                strcpy(tx.outputs[0].address, keys[(t + 1) % MAX_TRANSACTIONS].address);
+                tx.outputs[0].amount = (uint64_t)(1 + t) * AMOUNT_SCALE + (uint64_t)(i % 100);
+                strcpy(tx.outputs[1].address, keys[t].address);
+                tx.outputs[1].amount = balances[t] - tx.outputs[0].amount;
+                tx.output_count = 2;
+            }
+            size_t length = transaction_encode(&tx, encoded, sizeof(encoded));
+            sign_transaction(&keys[t], encoded, length, &witness);
+            if (!block_add_transaction(&block, encoded, length, &witness))
+                return 0;
+            compute_txid(encoded, length, coins[t].txid);
+            coins[t].index = (uint32_t)(tx.output_count - 1);
+            balances[t] = tx.outputs[tx.output_count - 1].amount;
+        }
+        solve_block(&block, 1, &nonce_attempts);
+        if (submit_block(chain, &block, &disconnected, &connected) != TREE_ACCEPTED)
+            return 0;
+    }
+    return 1;
+}
+
+static int timed_sync(int base_port, int port, SyncRun *run, const char *tip_hash)
+{
+    Blockchain chain = {0};
+    BlockTree tree;
+    Node node;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    if (run->assume_valid)
+        strcpy(tree.assume_valid, tip_hash);
+
+    int ok = node_init(&node, &chain, port, 1) && sync_start(&node, run->window, run->in_flight, run->workers);
+    if (ok)
+        node.sync->quiet = 1;
+    for (int i = 0; ok && i < run->peers; i++)
+    {
+        for (int attempt = 0; !node_connect(&node, "127.0.0.1", base_port + i); attempt++)
+        {
+            if (attempt > 500)
+            {
+                ok = 0;
+                break;
+            }
+            usleep(2000);
+        }
+    }
+
+    uint64_t deadline = monotonic_ns() + 120000000000ull;
+    while (ok && !node.sync->complete && monotonic_ns() < deadline)
+        node_poll(&node, 10);
+
+    if (ok && node.sync->complete)
+    {
+        run->elapsed_ms = (double)(node.sync->finished_ns - node.sync->started_ns) / 1e6;
+        run->height = chain.block_count - 1;
+        run->re_requests = node.sync->re_requests;
+        run->assumed = node.sync->assumed;
+    }
+    else
+    {
+        ok = 0;
+    }
+    node_free(&node);
+    block_tree_free(&tree);
+    free(chain.blocks);
+    return ok;
+}
+
+int run_sync_benchmark(int block_count, int peer_count)
+{
+    if (block_count < 1 || block_count > 200000 || peer_count < 1 || peer_count > 16)
+    {
+        print_error("Usage: --sync-bench <blocks 1-200000> [peers 1-16]");
+        return 1;
+    }
+
+    print_header("HEADER-FIRST SYNC BENCHMARK");
+    Blockchain chain = {0};
+    BlockTree tree;
+    block_tree_init(&tree);
+    chain.tree = &tree;
+    printf(COLOR_CYAN "Mining %d blocks of signed transactions at difficulty 1..." COLOR_RESET "\n", block_count);
+    fflush(stdout);
+    if (!build_bench_chain(&chain, block_count))
+    {
+        print_error("Could not build the benchmark chain");
+        block_tree_free(&tree);
+        free(chain.blocks);
+        return 1;
+    }
+
+    // Every serving peer inherits the finished chain through fork()
+    int base_port = 20000 + (int)((getpid() * 3) % 20000);
+    pid_t children[16];
+    for (int i = 0; i < peer_count; i++)
+    {
+        children[i] = fork();
+        if (children[i] == 0)
+        {
+            Node server;
+            if (!freopen("/dev/null", "w", stdout) || !node_init(&server, &chain, base_port + i, 1))
+                _exit(1);
+            node_run(&server);
+            _exit(0);
+        }
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cores < 1 ? 1 : cores > SYNC_MAX_WORKERS ? SYNC_MAX_WORKERS : (int)cores;
+    // Assumed repeats Parallel with the tip as the assume-valid block, as a release would ship it
+    SyncRun runs[3] = {
+        {"Serial", 1, 1, 1, 0, 0, 0.0, 0, 0, 0},
+        {"Parallel", peer_count, SYNC_WINDOW, SYNC_PEER_IN_FLIGHT, workers, 0, 0.0, 0, 0, 0},
+        {"Assumed", peer_count, SYNC_WINDOW, SYNC_PEER_IN_FLIGHT, workers, 1, 0.0, 0, 0, 0},
+    };
+
+    int ok = 1;
+    for (int i = 0; i < 3 && ok; i++)
+    {
+        ok = timed_sync(base_port, base_port + peer_count + i, &runs[i], chain.blocks[block_count - 1].hash) &&
+             runs[i].height == block_count - 1;
+    }
+
+    for (int i = 0; i < peer_count; i++)
+        kill(children[i], SIGTERM);
+    for (int i = 0; i < peer_count; i++)
+        waitpid(children[i], NULL, 0);
+    block_tree_free(&tree);
+    free(chain.blocks);
+
+    if (!ok)
+    {
+        print_error("Sync benchmark did not complete (the syncing node never reached the tip)");
+        return 1;
+    }
+
+    printf(COLOR_BLUE "┌──────────┬───────┬────────┬─────────┬────────────┬────────────┬────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-8s" COLOR_BLUE " │ " COLOR_YELLOW "%-5s" COLOR_BLUE " │ " COLOR_YELLOW "%-6s" COLOR_BLUE
+                      " │ " COLOR_YELLOW "%-7s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-10s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │\n",
+           "Mode", "Peers", "Window", "Workers", "Time (ms)", "Blocks/s", "Re-request");
+    printf(COLOR_BLUE "├──────────┼───────┼────────┼─────────┼────────────┼────────────┼────────────┤\n");
+    for (int i = 0; i < 3; i++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-8s" COLOR_BLUE " │ " COLOR_CYAN "%-5d" COLOR_BLUE " │ " COLOR_CYAN "%-6d" COLOR_BLUE
+                          " │ " COLOR_CYAN "%-7d" COLOR_BLUE " │ " COLOR_CYAN "%-10.1f" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-10.0f" COLOR_BLUE " │ " COLOR_CYAN "%-10d" COLOR_BLUE " │\n",
+               runs[i].mode, runs[i].peers, runs[i].window, runs[i].workers, runs[i].elapsed_ms,
+               block_count / (runs[i].elapsed_ms / 1000.0), runs[i].re_requests);
+    }
+    printf(COLOR_BLUE "└──────────┴───────┴────────┴─────────┴────────────┴────────────┴────────────┘" COLOR_RESET "\n");
+    printf(COLOR_GREEN "\nParallel header-first sync was %.1fx faster than one-block-at-a-time download" COLOR_RESET "\n",
+           runs[0].elapsed_ms / runs[1].elapsed_ms);
+    printf(COLOR_GREEN "Assume-valid skipped the signatures of %d blocks and synced %.1fx faster than Parallel" COLOR_RESET "\n",
+           runs[2].assumed, runs[1].elapsed_ms / runs[2].elapsed_ms);
+    return 0;
+}
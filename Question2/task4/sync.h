@@ -0,0 +1,77 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "blockchain.h"
+#include "block_tree.h"
+#include "p2p.h"
+
+/* ================ CONSTANTS ================ */
+#define SYNC_MAX_HEADERS 2000         // Headers per MSG_HEADERS reply
+#define SYNC_MAX_LOCATOR 32           // Hashes in a MSG_GETHEADERS locator
+#define SYNC_WINDOW 1024              // Heights that may be in flight or waiting to connect
+#define SYNC_PEER_IN_FLIGHT 32        // Outstanding block requests per peer
+#define SYNC_TIMEOUT_MS 2000          // A block not delivered by then is asked of another peer
+#define SYNC_MAX_WORKERS 16           // Validation threads
+#define SYNC_EVENT_TAG ((uint64_t)-3) // epoll data for the validation eventfd
+
+#define SLOT_EMPTY 0      // Height not requested yet
+#define SLOT_REQUESTED 1  // GETDATA sent, waiting for the block
+#define SLOT_VALIDATING 2 // Body handed to a worker
+#define SLOT_VALID 3      // Checked, waiting for its parent to connect
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    int height;            // Height this slot currently tracks (-1 if unused)
+    int state;             // SLOT_*
+    int peer_id;           // Peer the block was requested from
+    uint64_t requested_ns; // When the request went out
+    BlockNode *target;     // Header of the block this slot downloads
+    Block *block;          // Downloaded body (owned while VALIDATING/VALID)
+    int assumed;           // Under the assume-valid block: signatures are not checked
+} SyncSlot;
+
+typedef struct SyncState
+{
+    SyncSlot slots[SYNC_WINDOW];         // Download window, indexed by height % window
+    int window;                          // Active window size (<= SYNC_WINDOW)
+    int peer_in_flight;                  // Request cap per peer
+    int next_peer;                       // Round-robin cursor over Node.peers
+    int header_peer;                     // Peer id serving headers (-1 if none)
+    int headers_done;                    // Last MSG_HEADERS was short, headers are caught up
+    int complete;                        // Active tip reached the best header
+    int quiet;                           // Suppress progress output
+    int blocks_downloaded;               // Bodies received for window slots
+    int re_requests;                     // Requests reassigned after a timeout or drop
+    int invalid;                         // Bodies that failed validation
+    int assumed;                         // Bodies validated without their signatures
+    uint64_t started_ns;                 // sync_start time
+    uint64_t finished_ns;                // When complete was set
+    int event_fd;                        // Workers signal finished jobs here
+    pthread_t workers[SYNC_MAX_WORKERS]; // Validation pool
+    int worker_count;                    // 0 validates inline on the event loop
+    pthread_mutex_t lock;                // Guards the two queues and stopping
+    pthread_cond_t wake;                 // Signals workers that jobs arrived
+    int jobs[SYNC_WINDOW];               // Ring of slot indexes to validate
+    int job_head, job_count;             // Ring position/length of jobs
+    int results[SYNC_WINDOW];            // Ring of slot index * 2 + valid
+    int result_head, result_count;       // Ring position/length of results
+    int stopping;                        // Tells workers to exit
+} SyncState;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int sync_start(Node *node, int window, int peer_in_flight, int worker_count);
+void sync_free(Node *node);
+int sync_in_progress(const Node *node);
+void sync_peer_added(Node *node, Peer *peer);
+void sync_peer_dropped(Node *node, Peer *peer);
+int sync_handle_block(Node *node, Peer *peer, const Block *block);
+void sync_handle_getheaders(Node *node, Peer *peer, ByteReader *reader);
+void sync_handle_headers(Node *node, Peer *peer, ByteReader *reader);
+void sync_handle_validated(Node *node);
+void sync_tick(Node *node);
+int run_sync_benchmark(int block_count, int peer_count);
+
+#endif
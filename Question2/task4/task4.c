@@ -1,59 +1,23 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include <openssl/sha.h>
-
-/* ================ CONSTANTS ================ */
-#define HASH_SIZE 65         // Size of SHA-256 hash string (64 chars + null terminator)
-#define MAX_TRANSACTIONS 10  // Maximum transactions per block
-#define TRANSACTION_SIZE 100 // Maximum size of each transaction
-#define MAX_BLOCKS 100       // Maximum blocks in blockchain
-#define DEFAULT_DIFFICULTY 4 // Default mining difficulty (number of leading zeros)
-
-/* ================ COLOR SCHEME ================ */
-#define COLOR_BRIGHT "\033[1m"
-#define COLOR_RESET "\033[0m"
-#define COLOR_RED "\033[38;5;203m"
-#define COLOR_GREEN "\033[38;5;84m"
-#define COLOR_YELLOW "\033[38;5;227m"
-#define COLOR_BLUE "\033[38;5;75m"
-#define COLOR_PURPLE "\033[38;5;141m"
-#define COLOR_CYAN "\033[38;5;87m"
-#define COLOR_GRAY "\033[38;5;245m"
-#define COLOR_ORANGE "\033[38;5;214m"
-
-/* ================ DATA STRUCTURES ================ */
-typedef struct
-{
-    int index;                                             // Block index in the chain
-    time_t timestamp;                                      // Time when block was created
-    char transactions[MAX_TRANSACTIONS][TRANSACTION_SIZE]; // Transaction data
-    int transaction_count;                                 // Number of transactions in block
-    char previous_hash[HASH_SIZE];                         // Hash of previous block in chain
-    int nonce;                                             // Proof-of-work nonce
-    char hash[HASH_SIZE];                                  // Current block's hash
-} Block;
-
-typedef struct
-{
-    Block blocks[MAX_BLOCKS]; // Array of blocks
-    int block_count;          // Number of blocks in chain
-} Blockchain;
-
-/* ================ FUNCTION PROTOTYPES ================ */
-void calculate_sha256(const char *input, char output[HASH_SIZE]);
-void calculate_block_hash(const Block *block, char *output_hash);
-int validate_hash_difficulty(const char *hash, int difficulty);
-void mine_block(Block *block, int difficulty, double *time_taken, int *nonce_attempts);
-void initialize_genesis_block(Blockchain *chain, int difficulty);
-void add_block(Blockchain *chain, const char transactions[][TRANSACTION_SIZE],
-               int transaction_count, const char *prev_hash, int difficulty);
-int verify_blockchain(const Blockchain *chain);
-void add_block_from_input(Blockchain *chain, int difficulty);
-void display_blockchain(const Blockchain *chain);
-void simulate_mining(Blockchain *chain, int start_difficulty, int end_difficulty);
-void show_menu(Blockchain *chain);
+#include "addrindex.h"
+#include "alloc.h"
+#include "blockchain.h"
+#include "block_tree.h"
+#include "blockfilter.h"
+#include "blockstore.h"
+#include "ledger.h"
+#include "light.h"
+#include "metrics.h"
+#include "miner.h"
+#include "p2p.h"
+#include "pipeline.h"
+#include "retarget.h"
+#include "rpc.h"
+#include "signature.h"
+#include "trace.h"
+#include "stratum.h"
+#include "sync.h"
+#include "transaction.h"
+#include "txqueue.h"
 
 /* ================ UTILITY FUNCTIONS ================ */
 void print_header(const char *text)
@@ -71,6 +35,29 @@ void print_error(const char *text)
     printf(COLOR_RED "✗ %s" COLOR_RESET "\n", text);
 }
 
+void bytes_to_hex(const unsigned char *bytes, size_t length, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++)
+    {
+        hex[i * 2] = digits[bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[bytes[i] & 0x0f];
+    }
+    hex[length * 2] = '\0';
+}
+
+int hex_to_bytes(const char *hex, unsigned char *bytes, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        unsigned int byte;
+        if (sscanf(hex + i * 2, "%2x", &byte) != 1)
+            return 0;
+        bytes[i] = (unsigned char)byte;
+    }
+    return 1;
+}
+
 /* ================ CORE FUNCTIONS ================ */
 void calculate_sha256(const char *input, char output[HASH_SIZE])
 {
@@ -83,62 +70,95 @@ void calculate_sha256(const char *input, char output[HASH_SIZE])
     output[HASH_SIZE - 1] = '\0';
 }
 
-void calculate_block_hash(const Block *block, char *output_hash)
+void compute_txid(const unsigned char *tx, size_t length, unsigned char txid[TXID_SIZE])
 {
-    char block_data[2048] = {0};
-    char temp_buffer[128];
+    SHA256(tx, length, txid);
+}
 
-    snprintf(temp_buffer, sizeof(temp_buffer), "%d", block->index);
-    strncat(block_data, temp_buffer, sizeof(block_data) - strlen(block_data) - 1);
-    snprintf(temp_buffer, sizeof(temp_buffer), "%ld", block->timestamp);
-    strncat(block_data, temp_buffer, sizeof(block_data) - strlen(block_data) - 1);
-    for (int i = 0; i < block->transaction_count; i++)
+// Merkle leaf: the txid alone for unsigned transactions, otherwise it also commits to the witness
+void compute_wtxid(const unsigned char *tx, size_t length, const TxWitness *witness, unsigned char wtxid[TXID_SIZE])
+{
+    compute_txid(tx, length, wtxid);
+    if (witness_is_empty(witness))
+        return;
+
+    unsigned char leaf[TXID_SIZE + sizeof(TxWitness)];
+    memcpy(leaf, wtxid, TXID_SIZE);
+    memcpy(leaf + TXID_SIZE, witness, sizeof(TxWitness));
+    SHA256(leaf, sizeof(leaf), wtxid);
+}
+
+void compute_merkle_root(const Block *block, char merkle_root[HASH_SIZE])
+{
+    TRACE_SCOPE("compute_merkle_root", "transactions", block->transaction_count);
+    unsigned char level[MAX_TRANSACTIONS][TXID_SIZE];
+    int count = block->transaction_count;
+    if (count == 0)
     {
-        if (strlen(block->transactions[i]) > 0)
+        memset(merkle_root, '0', HASH_SIZE - 1);
+        merkle_root[HASH_SIZE - 1] = '\0';
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        size_t length;
+        const unsigned char *tx = block_transaction_bytes(block, i, &length);
+        compute_wtxid(tx, length, &block->witnesses[i], level[i]);
+    }
+    // Pairwise SHA-256 up to the root; an odd node out is paired with itself
+    while (count > 1)
+    {
+        int next = 0;
+        for (int i = 0; i < count; i += 2)
         {
-            strncat(block_data, block->transactions[i], sizeof(block_data) - strlen(block_data) - 1);
+            unsigned char pair[TXID_SIZE * 2];
+            memcpy(pair, level[i], TXID_SIZE);
+            memcpy(pair + TXID_SIZE, level[i + 1 < count ? i + 1 : i], TXID_SIZE);
+            SHA256(pair, sizeof(pair), level[next++]);
         }
+        count = next;
     }
-    strncat(block_data, block->previous_hash, sizeof(block_data) - strlen(block_data) - 1);
-    snprintf(temp_buffer, sizeof(temp_buffer), "%d", block->nonce);
-    strncat(block_data, temp_buffer, sizeof(block_data) - strlen(block_data) - 1);
+    bytes_to_hex(level[0], TXID_SIZE, merkle_root);
+}
 
+// Everything the block hash covers except the nonce, which is appended in decimal
+int block_header_prefix(const Block *block, char *prefix, size_t size)
+{
+    return snprintf(prefix, size, "%d%ld%s%s%u", block->index, (long)block->timestamp, block->merkle_root,
+                    block->previous_hash, block->target_bits);
+}
+
+void hash_block_header(const Block *block, char *output_hash)
+{
+    // Only the header is hashed; the Merkle root commits to the transactions
+    char block_data[256];
+    int length = block_header_prefix(block, block_data, sizeof(block_data));
+    snprintf(block_data + length, sizeof(block_data) - (size_t)length, "%d", block->nonce);
     calculate_sha256(block_data, output_hash);
 }
 
-int validate_hash_difficulty(const char *hash, int difficulty)
+// Every hash outside the nonce search, which calls hash_block_header and traces itself in bulk
+void calculate_block_hash(const Block *block, char *output_hash)
 {
-    for (int i = 0; i < difficulty; i++)
-    {
-        if (hash[i] != '0')
-            return 0;
-    }
-    return 1;
+    TRACE_SCOPE("calculate_block_hash", "height", block->index);
+    hash_block_header(block, output_hash);
 }
 
-void mine_block(Block *block, int difficulty, double *time_taken, int *nonce_attempts)
+void solve_block(Block *block, int difficulty, int *nonce_attempts)
 {
-    char current_hash[HASH_SIZE];
-    block->nonce = 0;
-    *nonce_attempts = 0;
+    solve_block_bits(block, target_bits_from_difficulty(difficulty), 1, nonce_attempts);
+}
 
+void mine_block(Block *block, int difficulty, double *time_taken, int *nonce_attempts)
+{
+    TRACE_SCOPE("mine_block", "height", block->index);
     print_header("MINING PROCESS");
     printf(COLOR_PURPLE "⛏ Mining Block #%d" COLOR_RESET "\n", block->index);
     printf(COLOR_GRAY "Target Difficulty: %d leading zeros" COLOR_RESET "\n", difficulty);
 
     clock_t start = clock();
-    do
-    {
-        calculate_block_hash(block, current_hash);
-        (*nonce_attempts)++;
-        if (validate_hash_difficulty(current_hash, difficulty))
-        {
-            strcpy(block->hash, current_hash);
-            break;
-        }
-        block->nonce++;
-    } while (1);
-
+    solve_block(block, difficulty, nonce_attempts);
     clock_t end = clock();
     *time_taken = ((double)(end - start)) / CLOCKS_PER_SEC;
     printf(COLOR_GREEN "✔ Successfully mined after %.2f seconds!" COLOR_RESET "\n", *time_taken);
@@ -146,6 +166,56 @@ void mine_block(Block *block, int difficulty, double *time_taken, int *nonce_att
     printf(COLOR_YELLOW "Hash: %.12s...%s" COLOR_RESET "\n\n", block->hash, block->hash + 52);
 }
 
+int ensure_chain_capacity(Blockchain *chain, int block_count)
+{
+    if (block_count <= chain->block_capacity)
+        return 1;
+    int capacity = chain->block_capacity ? chain->block_capacity : 64;
+    while (capacity < block_count)
+        capacity *= 2;
+    Block *blocks = realloc(chain->blocks, (size_t)capacity * sizeof(Block));
+    if (!blocks)
+        return 0;
+    chain->blocks = blocks;
+    chain->block_capacity = capacity;
+    return 1;
+}
+
+int submit_block(Blockchain *chain, const Block *block, int *disconnected, int *connected)
+{
+    *disconnected = 0;
+    *connected = 0;
+    BlockNode *node;
+    int status = block_tree_insert(chain->tree, block, &node);
+    if (status == TREE_ACCEPTED && !block_tree_activate_best(chain->tree, chain, disconnected, connected))
+        return TREE_INVALID;
+    return status == TREE_ACCEPTED && node->failed ? TREE_BAD_LEDGER : status;
+}
+
+static void accept_block(Blockchain *chain, const Block *block)
+{
+    int disconnected, connected;
+    int status = submit_block(chain, block, &disconnected, &connected);
+    if (status != TREE_ACCEPTED)
+    {
+        print_error(status == TREE_DUPLICATE    ? "Block already known!"
+                    : status == TREE_BAD_LEDGER ? "Block rejected: its transactions do not apply to the UTXO set!"
+                                                : "Block rejected by the block tree!");
+        return;
+    }
+
+    if (disconnected > 0)
+    {
+        printf(COLOR_ORANGE "⟲ Reorganized: %d block(s) disconnected, %d connected" COLOR_RESET "\n",
+               disconnected, connected);
+    }
+    else if (connected == 0)
+    {
+        printf(COLOR_YELLOW "⚠ Block #%d stored on a side branch (less work than the active chain)" COLOR_RESET "\n",
+               block->index);
+    }
+}
+
 void initialize_genesis_block(Blockchain *chain, int difficulty)
 {
     if (chain->block_count > 0)
@@ -154,15 +224,12 @@ void initialize_genesis_block(Blockchain *chain, int difficulty)
         return;
     }
 
-    Block *block = &chain->blocks[0];
+    Block genesis;
+    Block *block = &genesis;
     block->index = 0;
     block->timestamp = time(NULL);
-    block->transaction_count = 1;
-    strcpy(block->transactions[0], "Genesis Transaction");
-    for (int i = 1; i < MAX_TRANSACTIONS; i++)
-    {
-        block->transactions[i][0] = '\0';
-    }
+    block_clear_transactions(block);
+    block_add_text_transaction(block, "Genesis Transaction");
     strcpy(block->previous_hash, "0000000000000000000000000000000000000000000000000000000000000000");
     block->nonce = 0;
 
@@ -170,32 +237,87 @@ void initialize_genesis_block(Blockchain *chain, int difficulty)
     double time_taken;
     int nonce_attempts;
     mine_block(block, difficulty, &time_taken, &nonce_attempts);
-    chain->block_count = 1;
+    accept_block(chain, block);
     print_success("Genesis block initialized successfully!");
 }
 
-void add_block(Blockchain *chain, const char transactions[][TRANSACTION_SIZE],
-               int transaction_count, const char *prev_hash, int difficulty)
+// A coin an earlier payment in the block already spends is left alone
+static int spent_in_block(const Coin *coin, void *context)
 {
-    if (chain->block_count >= MAX_BLOCKS)
+    const Block *block = context;
+    for (int i = 0; i < block->transaction_count; i++)
     {
-        print_error("Blockchain capacity reached!");
-        return;
+        TxView view;
+        const unsigned char *cursor;
+        if (!block_transaction(block, i, &view))
+            continue;
+        cursor = view.inputs;
+        for (int j = 0; j < view.input_count; j++)
+        {
+            TxInputView input;
+            tx_next_input(&cursor, &input);
+            if (input.index == coin->outpoint.index && memcmp(input.prev_txid, coin->outpoint.txid, TXID_SIZE) == 0)
+                return 1;
+        }
     }
+    return 0;
+}
 
-    Block *block = &chain->blocks[chain->block_count];
-    block->index = chain->block_count;
-    block->timestamp = time(NULL);
-    block->transaction_count = transaction_count < MAX_TRANSACTIONS ? transaction_count : MAX_TRANSACTIONS;
+// Payments spend their sender's coins, which the UTXO set only knows for the active tip; notes
+// and the coinbase (coinbase->receiver:amount) need no coins
+static int add_text_to_block(Blockchain *chain, const BlockNode *parent, Block *block, const char *text, int number)
+{
+    Transaction tx;
+    unsigned char encoded[MAX_TX_SIZE];
+    size_t length;
+    if (!transaction_from_text(text, &tx))
+    {
+        printf(COLOR_RED "✗ Transaction %d is not valid" COLOR_RESET "\n", number);
+        return 0;
+    }
+    if (tx.output_count > 0 && tx.sender[0] != '\0')
+    {
+        if (parent != chain->tree->active)
+        {
+            printf(COLOR_RED "✗ Transaction %d: payments can only extend the active tip" COLOR_RESET "\n", number);
+            return 0;
+        }
+        if (ledger_fund_payment(&chain->tree->utxos, &tx, spent_in_block, block) < tx.outputs[0].amount)
+        {
+            printf(COLOR_RED "✗ Transaction %d: %s does not hold enough unspent coins" COLOR_RESET "\n", number, tx.sender);
+            return 0;
+        }
+    }
+    if ((length = transaction_encode(&tx, encoded, sizeof(encoded))) == 0 ||
+        !block_add_transaction(block, encoded, length, NULL))
+    {
+        printf(COLOR_RED "✗ Transaction %d does not fit (block limit: %d transactions, %d bytes)" COLOR_RESET "\n",
+               number, MAX_TRANSACTIONS, BLOCK_TX_BYTES);
+        return 0;
+    }
+    return 1;
+}
 
-    for (int i = 0; i < block->transaction_count; i++)
+void add_block(Blockchain *chain, const char transactions[][TX_TEXT_SIZE],
+               int transaction_count, const char *prev_hash, int difficulty)
+{
+    TRACE_SCOPE("add_block", "transactions", transaction_count);
+    BlockNode *parent = block_tree_find(chain->tree, prev_hash);
+    if (!parent)
     {
-        strncpy(block->transactions[i], transactions[i], TRANSACTION_SIZE - 1);
-        block->transactions[i][TRANSACTION_SIZE - 1] = '\0';
+        print_error("Unknown parent block!");
+        return;
     }
-    for (int i = block->transaction_count; i < MAX_TRANSACTIONS; i++)
+
+    Block new_block;
+    Block *block = &new_block;
+    block->index = parent->height + 1;
+    block->timestamp = time(NULL);
+    block_clear_transactions(block);
+    for (int i = 0; i < transaction_count; i++)
     {
-        block->transactions[i][0] = '\0';
+        if (!add_text_to_block(chain, parent, block, transactions[i], i + 1))
+            return;
     }
 
     strcpy(block->previous_hash, prev_hash);
@@ -203,12 +325,13 @@ void add_block(Blockchain *chain, const char transactions[][TRANSACTION_SIZE],
     double time_taken;
     int nonce_attempts;
     mine_block(block, difficulty, &time_taken, &nonce_attempts);
-    chain->block_count++;
+    accept_block(chain, block);
     print_success("New block added to the blockchain!");
 }
 
 int verify_blockchain(const Blockchain *chain)
 {
+    TRACE_SCOPE("verify_blockchain", "blocks", chain->block_count);
     print_header("BLOCKCHAIN VERIFICATION");
 
     if (chain->block_count == 0)
@@ -217,6 +340,14 @@ int verify_blockchain(const Blockchain *chain)
         return 0;
     }
 
+    // Fast mode: blocks up to the assume-valid block keep their hash, Merkle and linkage checks only
+    int assumed_height = -1;
+    const BlockNode *anchor = NULL;
+    if (chain->tree && chain->tree->assume_valid[0] != '\0')
+        anchor = block_tree_find(chain->tree, chain->tree->assume_valid);
+    if (anchor && anchor->height < chain->block_count && strcmp(chain->blocks[anchor->height].hash, anchor->block.hash) == 0)
+        assumed_height = anchor->height;
+
     for (int i = 0; i < chain->block_count; i++)
     {
         const Block *block = &chain->blocks[i];
@@ -234,6 +365,34 @@ int verify_blockchain(const Blockchain *chain)
             return 0;
         }
 
+        char computed_root[HASH_SIZE];
+        compute_merkle_root(block, computed_root);
+        if (strcmp(block->merkle_root, computed_root) != 0)
+        {
+            printf(COLOR_BLUE "┌───────────────────────────────┐\n");
+            printf(COLOR_BLUE "│ " COLOR_RED "Invalid merkle root %-2d       " COLOR_BLUE "│\n", block->index);
+            printf(COLOR_BLUE "├───────────────────────────────┤\n");
+            printf(COLOR_BLUE "│ " COLOR_CYAN "Expected: %.12s...%s " COLOR_BLUE "│\n", computed_root, computed_root + 52);
+            printf(COLOR_BLUE "│ " COLOR_RED "Found:    %.12s...%s " COLOR_BLUE "│\n", block->merkle_root, block->merkle_root + 52);
+            printf(COLOR_BLUE "└───────────────────────────────┘\n");
+            return 0;
+        }
+
+        int bad_signature = i <= assumed_height ? -1 : verify_block_signatures(block, 0);
+        if (bad_signature != -1)
+        {
+            printf(COLOR_BLUE "┌───────────────────────────────┐\n");
+            printf(COLOR_BLUE "│ " COLOR_RED "Invalid signature %-2d          " COLOR_BLUE "│\n", block->index);
+            printf(COLOR_BLUE "├───────────────────────────────┤\n");
+            printf(COLOR_BLUE "│ " COLOR_CYAN "Transaction: %-17d" COLOR_BLUE "│\n", bad_signature + 1);
+            TxView view;
+            block_transaction(block, bad_signature, &view);
+            printf(COLOR_BLUE "│ " COLOR_RED "Sender:      %-17.*s" COLOR_BLUE "│\n",
+                   (int)(view.sender_length < 17 ? view.sender_length : 17), view.sender ? view.sender : "");
+            printf(COLOR_BLUE "└───────────────────────────────┘\n");
+            return 0;
+        }
+
         if (i > 0)
         {
             char prev_hash[HASH_SIZE];
@@ -254,51 +413,115 @@ int verify_blockchain(const Blockchain *chain)
     printf(COLOR_BLUE "┌───────────────────────────────┐\n");
     printf(COLOR_BLUE "│ " COLOR_GREEN "Blockchain verification passed! " COLOR_BLUE "│\n");
     printf(COLOR_BLUE "│ " COLOR_GREEN "All %d blocks are valid.       " COLOR_BLUE "│\n", chain->block_count);
+    if (assumed_height >= 0)
+        printf(COLOR_BLUE "│ " COLOR_YELLOW "Signatures assumed to #%-7d" COLOR_BLUE "│\n", assumed_height);
     printf(COLOR_BLUE "└───────────────────────────────┘\n");
     return 1;
 }
 
-void add_block_from_input(Blockchain *chain, int difficulty)
+int read_transactions_from_input(char transactions[][TX_TEXT_SIZE])
 {
-    if (chain->block_count == 0)
-    {
-        print_error("Create genesis block first!");
-        return;
-    }
-
     int txn_count;
-    char transactions[MAX_TRANSACTIONS][TRANSACTION_SIZE];
 
     printf(COLOR_CYAN "\nEnter number of transactions (1-%d): " COLOR_RESET, MAX_TRANSACTIONS);
     if (scanf("%d", &txn_count) != 1 || txn_count <= 0 || txn_count > MAX_TRANSACTIONS)
     {
         print_error("Invalid number of transactions");
         while (getchar() != '\n');
-        return;
+        return 0;
     }
     while (getchar() != '\n');
 
-    printf(COLOR_CYAN "Enter %d transactions (format: sender->receiver:amount):\n" COLOR_RESET, txn_count);
+    printf(COLOR_CYAN "Enter %d transactions (format: sender->receiver:amount; the first may be coinbase->receiver:amount, up to %d):\n" COLOR_RESET,
+           txn_count, BLOCK_REWARD / AMOUNT_SCALE);
     for (int i = 0; i < txn_count; i++)
     {
         printf(COLOR_YELLOW "  Transaction %d: " COLOR_RESET, i + 1);
-        if (!fgets(transactions[i], TRANSACTION_SIZE, stdin))
+        if (!fgets(transactions[i], TX_TEXT_SIZE, stdin))
         {
             print_error("Error reading transaction");
-            return;
+            return 0;
+        }
+        if (!strchr(transactions[i], '\n') && !feof(stdin))
+        {
+            // Rejected rather than cut short, so the block never holds a different transaction than typed
+            print_error("Transaction too long");
+            while (getchar() != '\n');
+            return 0;
         }
         transactions[i][strcspn(transactions[i], "\n")] = '\0';
         if (strlen(transactions[i]) == 0)
         {
             print_error("Transaction cannot be empty");
-            return;
+            return 0;
         }
     }
+    return txn_count;
+}
+
+void add_block_from_input(Blockchain *chain, int difficulty)
+{
+    if (chain->block_count == 0)
+    {
+        print_error("Create genesis block first!");
+        return;
+    }
+
+    char transactions[MAX_TRANSACTIONS][TX_TEXT_SIZE];
+    int txn_count = read_transactions_from_input(transactions);
+    if (txn_count == 0)
+        return;
 
     add_block(chain, transactions, txn_count, chain->blocks[chain->block_count - 1].hash, difficulty);
     verify_blockchain(chain);
 }
 
+void add_fork_block_from_input(Blockchain *chain, int difficulty)
+{
+    if (chain->block_count == 0)
+    {
+        print_error("Create genesis block first!");
+        return;
+    }
+
+    display_chain_tips(chain->tree);
+
+    char prefix[HASH_SIZE];
+    printf(COLOR_CYAN "\nEnter parent block hash (or a unique prefix): " COLOR_RESET);
+    if (scanf("%64s", prefix) != 1)
+    {
+        print_error("Invalid parent hash");
+        while (getchar() != '\n');
+        return;
+    }
+    BlockNode *parent = block_tree_find_prefix(chain->tree, prefix);
+    if (!parent)
+    {
+        print_error("No unique block matches that hash");
+        while (getchar() != '\n');
+        return;
+    }
+
+    int fork_difficulty;
+    printf(COLOR_CYAN "Enter difficulty for this block (1-6, default %d): " COLOR_RESET, difficulty);
+    if (scanf("%d", &fork_difficulty) != 1 || fork_difficulty < 1 || fork_difficulty > 6)
+    {
+        print_error("Invalid difficulty");
+        while (getchar() != '\n');
+        return;
+    }
+    while (getchar() != '\n');
+
+    char transactions[MAX_TRANSACTIONS][TX_TEXT_SIZE];
+    int txn_count = read_transactions_from_input(transactions);
+    if (txn_count == 0)
+        return;
+
+    add_block(chain, transactions, txn_count, parent->block.hash, fork_difficulty);
+    display_chain_tips(chain->tree);
+    verify_blockchain(chain);
+}
+
 void display_blockchain(const Blockchain *chain)
 {
     print_header("BLOCKCHAIN CONTENTS");
@@ -326,9 +549,16 @@ void display_blockchain(const Blockchain *chain)
         printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " %-40d │\n", "Transactions:", block->transaction_count);
         for (int j = 0; j < block->transaction_count; j++)
         {
-            printf(COLOR_BLUE "│   " COLOR_YELLOW "%-12d" COLOR_BLUE " %-37s │\n", j + 1, block->transactions[j]);
+            TxView view;
+            char text[TX_TEXT_SIZE] = "(malformed)";
+            if (block_transaction(block, j, &view))
+                tx_view_format(&view, text, sizeof(text));
+            printf(COLOR_BLUE "│   " COLOR_YELLOW "%-12d" COLOR_BLUE " %-37s │\n", j + 1, text);
         }
         printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " %.12s...%s │\n", "Prev Hash:", block->previous_hash, block->previous_hash + 52);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " %.12s...%s │\n", "Merkle Root:", block->merkle_root, block->merkle_root + 52);
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " 0x%08x (%d leading zeros)%-12s │\n", "Target Bits:",
+               block->target_bits, block->difficulty, "");
         printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " %-40d │\n", "Nonce:", block->nonce);
         printf(COLOR_BLUE "│ " COLOR_CYAN "%-15s" COLOR_BLUE " %.12s...%s │\n", "Hash:", block->hash, block->hash + 52);
         if (i < chain->block_count - 1)
@@ -368,7 +598,7 @@ void simulate_mining(Blockchain *chain, int start_difficulty, int end_difficulty
 
     for (int difficulty = start_difficulty; difficulty <= end_difficulty; difficulty++)
     {
-        char transactions[1][TRANSACTION_SIZE] = {"Simulation Transaction"};
+        char transactions[1][TX_TEXT_SIZE] = {"Simulation Transaction"};
         add_block(chain, transactions, 1, chain->blocks[chain->block_count - 1].hash, difficulty);
 
         // Get time and nonce from the last block
@@ -407,7 +637,9 @@ void show_menu(Blockchain *chain)
         printf(COLOR_BLUE "│ " COLOR_YELLOW "4. " COLOR_RESET "Verify Blockchain        " COLOR_BLUE "│\n");
         printf(COLOR_BLUE "│ " COLOR_YELLOW "5. " COLOR_RESET "Set Difficulty Range     " COLOR_BLUE "│\n");
         printf(COLOR_BLUE "│ " COLOR_YELLOW "6. " COLOR_RESET "Simulate Mining          " COLOR_BLUE "│\n");
-        printf(COLOR_BLUE "│ " COLOR_YELLOW "7. " COLOR_RESET "Exit                     " COLOR_BLUE "│\n");
+        printf(COLOR_BLUE "│ " COLOR_YELLOW "7. " COLOR_RESET "Add Competing Block      " COLOR_BLUE "│\n");
+        printf(COLOR_BLUE "│ " COLOR_YELLOW "8. " COLOR_RESET "View Chain Tips          " COLOR_BLUE "│\n");
+        printf(COLOR_BLUE "│ " COLOR_YELLOW "9. " COLOR_RESET "Exit                     " COLOR_BLUE "│\n");
         printf(COLOR_BLUE "└───────────────────────────────┘\n");
         printf(COLOR_PURPLE "Select option: " COLOR_RESET);
 
@@ -422,6 +654,7 @@ void show_menu(Blockchain *chain)
         switch (option)
         {
         case 1:
+            block_tree_free(chain->tree);
             chain->block_count = 0;
             initialize_genesis_block(chain, DEFAULT_DIFFICULTY);
             verify_blockchain(chain);
@@ -457,19 +690,73 @@ void show_menu(Blockchain *chain)
             simulate_mining(chain, start_difficulty, end_difficulty);
             break;
         case 7:
+            add_fork_block_from_input(chain, DEFAULT_DIFFICULTY);
+            break;
+        case 8:
+            display_chain_tips(chain->tree);
+            break;
+        case 9:
             print_success("Exiting program. Goodbye!");
             break;
         default:
             print_error("Invalid option");
         }
-    } while (option != 7);
+    } while (option != 9);
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    Blockchain chain;
-    chain.block_count = 0;
+    if (argc > 1 && strcmp(argv[1], "--node") == 0)
+        return run_node_mode(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--relay-bench") == 0)
+        return run_relay_benchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 5);
+    if (argc > 1 && strcmp(argv[1], "--retarget-sim") == 0)
+        return run_retarget_simulation(argc > 2 ? retarget_parse_algorithm(argv[2]) : RETARGET_LWMA,
+                                       argc > 3 ? atoi(argv[3]) : 250, argc > 4 ? atoi(argv[4]) : 20);
+    if (argc > 1 && strcmp(argv[1], "--sync-bench") == 0)
+        return run_sync_benchmark(argc > 2 ? atoi(argv[2]) : 5000, argc > 3 ? atoi(argv[3]) : 4);
+    if (argc > 1 && strcmp(argv[1], "--utxo-bench") == 0)
+        return run_utxo_benchmark(argc > 2 ? atoi(argv[2]) : 10000, argc > 3 ? atoi(argv[3]) : 1024);
+    if (argc > 1 && strcmp(argv[1], "--sig-bench") == 0)
+        return run_signature_benchmark(argc > 2 ? atoi(argv[2]) : 500, argc > 3 ? atoi(argv[3]) : 0);
+    if (argc > 1 && strcmp(argv[1], "--ingest-bench") == 0)
+        return run_ingest_benchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 2,
+                                    argc > 4 ? atoi(argv[4]) : 2000000);
+    if (argc > 1 && strcmp(argv[1], "--pipeline-bench") == 0)
+        return run_pipeline_benchmark(argc > 2 ? atoi(argv[2]) : 20, argc > 3 ? atoi(argv[3]) : 3,
+                                      argc > 4 ? argv[4] : NULL, argc > 5 ? argv[5] : NULL);
+    if (argc > 1 && strcmp(argv[1], "--rpc-bench") == 0)
+        return run_rpc_benchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 200000,
+                                 argc > 4 ? atoi(argv[4]) : 32);
+    if (argc > 1 && strcmp(argv[1], "--stratum-bench") == 0)
+        return run_stratum_benchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 20,
+                                     argc > 4 ? atoi(argv[4]) : 4);
+    if (argc > 1 && strcmp(argv[1], "--metrics-bench") == 0)
+        return run_metrics_benchmark(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 10000000);
+    if (argc > 1 && strcmp(argv[1], "--alloc-bench") == 0)
+        return run_alloc_benchmark(argc > 2 ? atoi(argv[2]) : 2000000, argc > 3 ? atoi(argv[3]) : 0);
+    if (argc > 1 && strcmp(argv[1], "--prune-bench") == 0)
+        return run_prune_benchmark(argc > 2 ? atoi(argv[2]) : 3000, argc > 3 ? atoi(argv[3]) : 1024);
+    if (argc > 1 && strcmp(argv[1], "--trace-bench") == 0)
+        return run_trace_benchmark(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? argv[3] : NULL);
+    if (argc > 1 && strcmp(argv[1], "--filter-bench") == 0)
+        return run_filter_benchmark(argc > 2 ? atoi(argv[2]) : 5000, argc > 3 ? atoi(argv[3]) : 100);
+    if (argc > 1 && strcmp(argv[1], "--addrindex-bench") == 0)
+        return run_addrindex_benchmark(argc > 2 ? atoi(argv[2]) : 5000, argc > 3 ? atoi(argv[3]) : 200);
+    if (argc > 1 && strcmp(argv[1], "--light-bench") == 0)
+        return run_light_benchmark(argc > 2 ? atoi(argv[2]) : 100000);
+    if (argc > 2 && strcmp(argv[1], "--light") == 0)
+        return run_light_client(argv[2]);
+    if (argc > 2 && strcmp(argv[1], "--miner") == 0)
+        return run_stratum_miner(argv[2], argc > 3 ? argv[3] : "miner", 0);
+
+    Blockchain chain = {0};
+    BlockTree tree;
+    block_tree_init(&tree);
+    chain.tree = &tree;
     print_header("BLOCKCHAIN PROOF OF WORK SYSTEM");
     show_menu(&chain);
+    block_tree_free(&tree);
+    free(chain.blocks);
     return 0;
 }
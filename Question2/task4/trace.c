@@ -0,0 +1,328 @@
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+#include "blockchain.h"
+#include "json.h"
+
+/* ================ DATA STRUCTURES ================ */
+// Written only by the thread that owns it; a dump reads it without stopping that thread
+typedef struct
+{
+    TraceEvent events[TRACE_RING_EVENTS]; // events[i % TRACE_RING_EVENTS] is the i-th span
+    uint64_t head;                        // Spans ever written, published with a release store
+    int owner;                            // 1 while a live thread records into it
+} TraceRing;
+
+typedef struct
+{
+    int tid;       // Kernel thread id
+    char name[24]; // Track title in the viewer
+    int ready;     // Set once the fields above are written
+} TraceName;
+
+static int enabled;
+static TraceRing *rings[TRACE_MAX_RINGS];
+static int ring_count;
+static TraceName names[TRACE_MAX_NAMES];
+static int name_count;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static __thread TraceRing *my_ring;
+static __thread int my_tid;
+static __thread int no_ring;
+
+/* ================ RINGS ================ */
+static uint64_t trace_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int current_tid(void)
+{
+    if (my_tid == 0)
+        my_tid = (int)syscall(SYS_gettid);
+    return my_tid;
+}
+
+// Runs at thread exit; the spans stay in the ring for the next dump until a new thread reuses it
+static void release_ring(void *ring)
+{
+    __atomic_store_n(&((TraceRing *)ring)->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void create_ring_key(void)
+{
+    pthread_key_create(&ring_key, release_ring);
+}
+
+// Threads that exited hand their ring on, so the miner's short-lived workers do not use them all up
+static TraceRing *claim_ring(void)
+{
+    pthread_once(&ring_key_once, create_ring_key);
+    int count = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+    if (count > TRACE_MAX_RINGS)
+        count = TRACE_MAX_RINGS;
+    TraceRing *ring = NULL;
+    for (int i = 0; i < count && !ring; i++)
+    {
+        TraceRing *candidate = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        int expected = 0;
+        if (candidate && __atomic_compare_exchange_n(&candidate->owner, &expected, 1, 0, __ATOMIC_ACQUIRE,
+                                                     __ATOMIC_RELAXED))
+            ring = candidate;
+    }
+    if (!ring)
+    {
+        int index = __atomic_fetch_add(&ring_count, 1, __ATOMIC_RELAXED);
+        if (index >= TRACE_MAX_RINGS || !(ring = calloc(1, sizeof(TraceRing))))
+            return NULL;
+        ring->owner = 1;
+        __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+    }
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+/* ================ RECORDING ================ */
+void trace_enable(int on)
+{
+    __atomic_store_n(&enabled, on, __ATOMIC_RELAXED);
+}
+
+int trace_is_enabled(void)
+{
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+// 0 when tracing is off, which makes the matching trace_end a no-op
+uint64_t trace_begin(void)
+{
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED) ? trace_now_ns() : 0;
+}
+
+void trace_end(const char *name, const char *arg_name, int64_t arg, uint64_t start_ns)
+{
+    if (start_ns == 0 || no_ring)
+        return;
+    if (!my_ring && !(my_ring = claim_ring()))
+    {
+        no_ring = 1;
+        return;
+    }
+    uint64_t head = my_ring->head;
+    TraceEvent *event = &my_ring->events[head & (TRACE_RING_EVENTS - 1)];
+    event->name = name;
+    event->arg_name = arg_name;
+    event->start_ns = start_ns;
+    event->duration_ns = trace_now_ns() - start_ns;
+    event->arg = arg;
+    event->tid = current_tid();
+    __atomic_store_n(&my_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_scope_end(TraceScope *scope)
+{
+    trace_end(scope->name, scope->arg_name, scope->arg, scope->start_ns);
+}
+
+// Titles the calling thread's track; recorded even while tracing is off so later dumps have it
+void trace_thread_name(const char *name)
+{
+    int index = __atomic_fetch_add(&name_count, 1, __ATOMIC_RELAXED);
+    if (index >= TRACE_MAX_NAMES)
+        return;
+    names[index].tid = current_tid();
+    snprintf(names[index].name, sizeof(names[index].name), "%s", name);
+    __atomic_store_n(&names[index].ready, 1, __ATOMIC_RELEASE);
+}
+
+/* ================ CHROME TRACE EXPORT ================ */
+// Copies a ring, then drops whatever its owner may have overwritten during the copy
+static int snapshot_ring(TraceRing *ring, TraceEvent *copy)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+    for (uint64_t i = first; i < head; i++)
+        copy[i - first] = ring->events[i & (TRACE_RING_EVENTS - 1)];
+    // The owner may be writing span number `after` right now, into the slot of after - TRACE_RING_EVENTS
+    uint64_t after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t safe = after >= TRACE_RING_EVENTS ? after - TRACE_RING_EVENTS + 1 : 0;
+    int skip = safe > first ? (int)(safe - first) : 0;
+    int count = (int)(head - first);
+    if (skip >= count)
+        return 0;
+    memmove(copy, copy + skip, (size_t)(count - skip) * sizeof(TraceEvent));
+    return count - skip;
+}
+
+// Chrome's JSON trace format ("X" complete events), which Perfetto and chrome://tracing both open.
+// Threads keep recording while this runs. Returns the number of spans written, -1 on failure.
+long trace_dump(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    TraceEvent *copy = malloc(sizeof(TraceEvent) * TRACE_RING_EVENTS);
+    if (!file || !copy)
+    {
+        if (file)
+            fclose(file);
+        free(copy);
+        return -1;
+    }
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"task4\"}}", pid);
+
+    int named = __atomic_load_n(&name_count, __ATOMIC_RELAXED);
+    for (int i = 0; i < named && i < TRACE_MAX_NAMES; i++)
+    {
+        if (!__atomic_load_n(&names[i].ready, __ATOMIC_ACQUIRE))
+            continue;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                pid, names[i].tid, names[i].name);
+    }
+
+    long written = 0;
+    int count = __atomic_load_n(&ring_count, __ATOMIC_ACQUIRE);
+    for (int r = 0; r < count && r < TRACE_MAX_RINGS; r++)
+    {
+        TraceRing *ring = __atomic_load_n(&rings[r], __ATOMIC_ACQUIRE);
+        int events = ring ? snapshot_ring(ring, copy) : 0;
+        for (int i = 0; i < events; i++)
+        {
+            const TraceEvent *event = &copy[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"task4\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    event->name, pid, event->tid, event->start_ns / 1e3, event->duration_ns / 1e3);
+            if (event->arg_name)
+                fprintf(file, ",\"args\":{\"%s\":%lld}", event->arg_name, (long long)event->arg);
+            fputc('}', file);
+        }
+        written += events;
+    }
+    fprintf(file, "\n]}\n");
+    free(copy);
+    return fclose(file) == 0 ? written : -1;
+}
+
+/* ================ TRACE BENCHMARK ================ */
+typedef struct
+{
+    int spans;         // Spans to record
+    double elapsed_ns; // CPU time spent recording them
+} TraceBenchWorker;
+
+static double thread_cpu_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static void *trace_bench_thread(void *argument)
+{
+    TraceBenchWorker *worker = argument;
+    trace_thread_name("bench");
+    double start = thread_cpu_ns();
+    for (int i = 0; i < worker->spans; i++)
+    {
+        TRACE_SCOPE("bench_span", "i", i);
+    }
+    worker->elapsed_ns = thread_cpu_ns() - start;
+    return NULL;
+}
+
+// Checks the dump by reading it back with the RPC server's JSON parser
+static int dump_is_valid_json(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = length > 0 ? malloc((size_t)length) : NULL;
+    int valid = text && fread(text, 1, (size_t)length, file) == (size_t)length;
+    fclose(file);
+    if (valid)
+    {
+        const char *end = text + length;
+        const char *after = json_skip(json_space(text, end), end, 0);
+        valid = after && json_space(after, end) == end;
+    }
+    *size = (size_t)(length > 0 ? length : 0);
+    free(text);
+    return valid;
+}
+
+int run_trace_benchmark(int spans, const char *path)
+{
+    if (spans < 1)
+    {
+        print_error("Usage: --trace-bench [spans] [file]");
+        return 1;
+    }
+    if (!path)
+        path = TRACE_DEFAULT_FILE;
+    print_header("TRACE SPAN BENCHMARK");
+    printf(COLOR_CYAN "%d spans per measurement, %d-span ring per thread" COLOR_RESET "\n\n", spans,
+           TRACE_RING_EVENTS);
+
+    const char *modes[3] = {"Tracing off", "Tracing on", "4 threads on"};
+    double per_span[3];
+    trace_thread_name("main");
+    for (int mode = 0; mode < 3; mode++)
+    {
+        trace_enable(mode > 0);
+        int threads = mode == 2 ? 4 : 1;
+        TraceBenchWorker workers[4];
+        pthread_t handles[4];
+        int started = 0;
+        for (int t = 0; t < threads; t++)
+        {
+            workers[t].spans = spans;
+            workers[t].elapsed_ns = 0;
+            if (mode < 2)
+                trace_bench_thread(&workers[t]);
+            else if (pthread_create(&handles[t], NULL, trace_bench_thread, &workers[t]) != 0)
+                break;
+            started++;
+        }
+        double total = 0;
+        for (int t = 0; t < started; t++)
+        {
+            if (mode == 2)
+                pthread_join(handles[t], NULL);
+            total += workers[t].elapsed_ns;
+        }
+        per_span[mode] = started > 0 ? total / ((double)started * spans) : 0;
+    }
+
+    printf(COLOR_BLUE "┌──────────────┬──────────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-12s" COLOR_BLUE " │ " COLOR_YELLOW "%-12s" COLOR_BLUE " │\n", "Mode",
+           "ns / span");
+    printf(COLOR_BLUE "├──────────────┼──────────────┤\n");
+    for (int mode = 0; mode < 3; mode++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-12s" COLOR_BLUE " │ " COLOR_CYAN "%-12.2f" COLOR_BLUE " │\n", modes[mode],
+               per_span[mode]);
+    }
+    printf(COLOR_BLUE "└──────────────┴──────────────┘" COLOR_RESET "\n");
+
+    double start = thread_cpu_ns();
+    long written = trace_dump(path);
+    double dump_ms = (thread_cpu_ns() - start) / 1e6;
+    trace_enable(0);
+    size_t size = 0;
+    if (written < 0 || !dump_is_valid_json(path, &size))
+    {
+        printf(COLOR_RED "✗ Could not write a valid trace to %s" COLOR_RESET "\n", path);
+        return 1;
+    }
+    printf(COLOR_GREEN "\n✔ Wrote %ld spans (%zu KiB) to %s in %.1f ms; open it in ui.perfetto.dev" COLOR_RESET
+                       "\n",
+           written, size >> 10, path, dump_ms);
+    return 0;
+}
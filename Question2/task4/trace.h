@@ -0,0 +1,46 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* ================ CONSTANTS ================ */
+#define TRACE_RING_EVENTS 16384               // Spans each thread keeps; older ones are overwritten (power of two)
+#define TRACE_MAX_RINGS 64                    // Threads that can record at the same time
+#define TRACE_MAX_NAMES 256                   // Thread names kept for the dump
+#define TRACE_DEFAULT_FILE "task4-trace.json" // Written by the node's trace command when no file is given
+
+/* ================ DATA STRUCTURES ================ */
+// Names must be string literals: only the pointer is stored, and the dump writes them unescaped
+typedef struct
+{
+    const char *name;     // Phase, shown as the slice title
+    const char *arg_name; // Label of arg (NULL: no argument)
+    uint64_t start_ns;    // Monotonic clock at the start
+    uint64_t duration_ns; // Length of the span
+    int64_t arg;          // Block height, transaction count, hashes tried...
+    int tid;              // Kernel thread id, so recycled rings keep each span on its own track
+} TraceEvent;
+
+typedef struct
+{
+    const char *name;     // As in TraceEvent
+    const char *arg_name; // As in TraceEvent
+    int64_t arg;          // May be changed before the scope ends
+    uint64_t start_ns;    // 0 when tracing was off at the start
+} TraceScope;
+
+// Records a span from here to the end of the enclosing block, whichever way it is left
+#define TRACE_SCOPE(name, arg_name, arg) \
+    TraceScope trace_scope __attribute__((cleanup(trace_scope_end))) = {name, arg_name, arg, trace_begin()}
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void trace_enable(int enabled);
+int trace_is_enabled(void);
+uint64_t trace_begin(void);
+void trace_end(const char *name, const char *arg_name, int64_t arg, uint64_t start_ns);
+void trace_scope_end(TraceScope *scope);
+void trace_thread_name(const char *name);
+long trace_dump(const char *path);
+int run_trace_benchmark(int spans, const char *path);
+
+#endif
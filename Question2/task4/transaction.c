@@ -0,0 +1,301 @@
+#include "transaction.h"
+
+/* ================ VARINTS ================ */
+// LEB128: seven bits per byte, low bits first, high bit set on every byte but the last
+size_t varint_encode(uint64_t value, unsigned char *out)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+// Rejects overlong encodings, so every value has exactly one form and one txid
+int varint_decode(const unsigned char **cursor, const unsigned char *end, uint64_t *value)
+{
+    const unsigned char *p = *cursor;
+    *value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *p++;
+        if (shift == 63 && byte > 1)
+            return 0;
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (byte & 0x80)
+            continue;
+        if (byte == 0 && shift > 0)
+            return 0;
+        *cursor = p;
+        return 1;
+    }
+    return 0;
+}
+
+/* ================ AMOUNTS ================ */
+// "12", "12.5" or "12.50" -> 1250 hundredths
+int parse_amount(const char *text, uint64_t *amount)
+{
+    uint64_t whole = 0;
+    int digits = 0;
+    for (; *text >= '0' && *text <= '9'; text++, digits++)
+    {
+        if (whole > (UINT64_MAX / AMOUNT_SCALE - 9) / 10)
+            return 0;
+        whole = whole * 10 + (uint64_t)(*text - '0');
+    }
+    uint64_t cents = 0;
+    if (*text == '.')
+    {
+        text++;
+        for (int scale = AMOUNT_SCALE / 10; *text >= '0' && *text <= '9'; text++, scale /= 10)
+        {
+            if (scale == 0)
+                return 0;
+            cents += (uint64_t)(*text - '0') * (uint64_t)scale;
+        }
+    }
+    *amount = whole * AMOUNT_SCALE + cents;
+    return digits > 0 && *text == '\0';
+}
+
+void format_amount(uint64_t amount, char *text, size_t size)
+{
+    if (amount % AMOUNT_SCALE == 0)
+        snprintf(text, size, "%llu", (unsigned long long)(amount / AMOUNT_SCALE));
+    else
+        snprintf(text, size, "%llu.%02llu", (unsigned long long)(amount / AMOUNT_SCALE),
+                 (unsigned long long)(amount % AMOUNT_SCALE));
+}
+
+/* ================ BUILDING ================ */
+// "sender->receiver:amount" becomes a payment ("coinbase->..." one without a sender); any other
+// text is kept as a memo
+int transaction_from_text(const char *text, Transaction *tx)
+{
+    memset(tx, 0, sizeof(*tx));
+    const char *arrow = strstr(text, "->");
+    const char *colon = arrow ? strrchr(arrow + 2, ':') : NULL;
+    size_t sender_length = arrow ? (size_t)(arrow - text) : 0;
+    size_t receiver_length = colon ? (size_t)(colon - arrow - 2) : 0;
+    uint64_t amount;
+
+    if (colon && sender_length > 0 && sender_length <= TX_MAX_ADDRESS && receiver_length > 0 &&
+        receiver_length <= TX_MAX_ADDRESS && parse_amount(colon + 1, &amount))
+    {
+        // Read back the way tx_view_format writes an issuing transaction: without a sender
+        if (sender_length != 8 || memcmp(text, "coinbase", 8) != 0)
+            memcpy(tx->sender, text, sender_length);
+        memcpy(tx->outputs[0].address, arrow + 2, receiver_length);
+        tx->outputs[0].amount = amount;
+        tx->output_count = 1;
+        return 1;
+    }
+
+    size_t length = strlen(text);
+    if (length == 0 || length > TX_MAX_MEMO)
+        return 0;
+    memcpy(tx->memo, text, length);
+    return 1;
+}
+
+static size_t put_string(unsigned char *out, const char *text)
+{
+    size_t length = strlen(text);
+    size_t header = varint_encode(length, out);
+    memcpy(out + header, text, length);
+    return header + length;
+}
+
+// Returns the encoded size, or 0 if the transaction is malformed or does not fit in capacity
+size_t transaction_encode(const Transaction *tx, unsigned char *out, size_t capacity)
+{
+    unsigned char buffer[MAX_TX_SIZE + TX_MAX_MEMO + (TX_MAX_INPUTS + TX_MAX_OUTPUTS) * (TXID_SIZE + 64)];
+    size_t length = 0;
+    if (tx->input_count < 0 || tx->input_count > TX_MAX_INPUTS || tx->output_count < 0 ||
+        tx->output_count > TX_MAX_OUTPUTS || (tx->output_count == 0 && tx->memo[0] == '\0'))
+        return 0;
+
+    buffer[length++] = TX_VERSION;
+    length += put_string(buffer + length, tx->sender);
+    length += varint_encode((uint64_t)tx->input_count, buffer + length);
+    for (int i = 0; i < tx->input_count; i++)
+    {
+        memcpy(buffer + length, tx->inputs[i].prev_txid, TXID_SIZE);
+        length += TXID_SIZE;
+        length += varint_encode(tx->inputs[i].index, buffer + length);
+    }
+    length += varint_encode((uint64_t)tx->output_count, buffer + length);
+    for (int i = 0; i < tx->output_count; i++)
+    {
+        if (tx->outputs[i].address[0] == '\0')
+            return 0;
+        length += varint_encode(tx->outputs[i].amount, buffer + length);
+        length += put_string(buffer + length, tx->outputs[i].address);
+    }
+    length += put_string(buffer + length, tx->memo);
+
+    if (length > MAX_TX_SIZE || length > capacity)
+        return 0;
+    memcpy(out, buffer, length);
+    return length;
+}
+
+/* ================ PARSING ================ */
+static int get_string(const unsigned char **cursor, const unsigned char *end, size_t limit, const char **text,
+                      size_t *length)
+{
+    uint64_t value;
+    if (!varint_decode(cursor, end, &value) || value > limit || value > (uint64_t)(end - *cursor))
+        return 0;
+    *text = (const char *)*cursor;
+    *length = (size_t)value;
+    *cursor += value;
+    return 1;
+}
+
+// Checks the whole encoding once; afterwards tx_next_input/tx_next_output walk it without bounds checks
+int tx_view_parse(const unsigned char *data, size_t length, TxView *view)
+{
+    const unsigned char *cursor = data + 1;
+    const unsigned char *end = data + length;
+    uint64_t count, value;
+    memset(view, 0, sizeof(*view));
+    if (length < 1 || length > MAX_TX_SIZE || data[0] != TX_VERSION)
+        return 0;
+    view->data = data;
+    view->length = length;
+
+    if (!get_string(&cursor, end, TX_MAX_ADDRESS, &view->sender, &view->sender_length))
+        return 0;
+
+    if (!varint_decode(&cursor, end, &count) || count > TX_MAX_INPUTS)
+        return 0;
+    view->input_count = (int)count;
+    view->inputs = cursor;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if ((size_t)(end - cursor) < TXID_SIZE)
+            return 0;
+        cursor += TXID_SIZE;
+        if (!varint_decode(&cursor, end, &value) || value > UINT32_MAX)
+            return 0;
+    }
+
+    if (!varint_decode(&cursor, end, &count) || count > TX_MAX_OUTPUTS)
+        return 0;
+    view->output_count = (int)count;
+    view->outputs = cursor;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        const char *address;
+        size_t address_length;
+        if (!varint_decode(&cursor, end, &value) ||
+            !get_string(&cursor, end, TX_MAX_ADDRESS, &address, &address_length) || address_length == 0)
+            return 0;
+    }
+
+    if (!get_string(&cursor, end, TX_MAX_MEMO, &view->memo, &view->memo_length))
+        return 0;
+    // Trailing bytes would give one transaction many txids; an empty one says nothing
+    return cursor == end && (view->output_count > 0 || view->memo_length > 0);
+}
+
+void tx_next_input(const unsigned char **cursor, TxInputView *input)
+{
+    uint64_t index;
+    input->prev_txid = *cursor;
+    *cursor += TXID_SIZE;
+    varint_decode(cursor, *cursor + VARINT_MAX_SIZE, &index);
+    input->index = (uint32_t)index;
+}
+
+void tx_next_output(const unsigned char **cursor, TxOutputView *output)
+{
+    uint64_t length;
+    varint_decode(cursor, *cursor + VARINT_MAX_SIZE, &output->amount);
+    varint_decode(cursor, *cursor + VARINT_MAX_SIZE, &length);
+    output->address = (const char *)*cursor;
+    output->address_length = (size_t)length;
+    *cursor += length;
+}
+
+// Inverse of transaction_from_text for payments and memos; spent inputs are summarized as a count
+void tx_view_format(const TxView *view, char *text, size_t size)
+{
+    size_t used = 0;
+    const unsigned char *cursor = view->outputs;
+    text[0] = '\0';
+    if (view->output_count > 0)
+    {
+        if (view->sender_length > 0)
+            used += (size_t)snprintf(text, size, "%.*s->", (int)view->sender_length, view->sender);
+        else
+            used += (size_t)snprintf(text, size, "coinbase->");
+        for (int i = 0; i < view->output_count && used < size; i++)
+        {
+            TxOutputView output;
+            char amount[32];
+            tx_next_output(&cursor, &output);
+            format_amount(output.amount, amount, sizeof(amount));
+            used += (size_t)snprintf(text + used, size - used, "%s%.*s:%s", i ? "," : "", (int)output.address_length,
+                                     output.address, amount);
+        }
+    }
+    if (view->input_count > 0 && used < size)
+        used += (size_t)snprintf(text + used, size - used, " [%d in]", view->input_count);
+    if (view->memo_length > 0 && used < size)
+        snprintf(text + used, size - used, used ? " (%.*s)" : "%.*s", (int)view->memo_length, view->memo);
+}
+
+/* ================ BLOCK STORAGE ================ */
+void block_clear_transactions(Block *block)
+{
+    block->transaction_count = 0;
+    block->tx_offsets[0] = 0;
+    memset(block->witnesses, 0, sizeof(block->witnesses));
+}
+
+const unsigned char *block_transaction_bytes(const Block *block, int index, size_t *length)
+{
+    *length = (size_t)(block->tx_offsets[index + 1] - block->tx_offsets[index]);
+    return block->tx_data + block->tx_offsets[index];
+}
+
+int block_transaction(const Block *block, int index, TxView *view)
+{
+    size_t length;
+    const unsigned char *data = block_transaction_bytes(block, index, &length);
+    return tx_view_parse(data, length, view);
+}
+
+// Appends one encoded transaction; fails once the block is out of slots or bytes
+int block_add_transaction(Block *block, const unsigned char *data, size_t length, const TxWitness *witness)
+{
+    int count = block->transaction_count;
+    size_t used = block->tx_offsets[count];
+    if (count >= MAX_TRANSACTIONS || length > BLOCK_TX_BYTES - used)
+        return 0;
+
+    memcpy(block->tx_data + used, data, length);
+    block->tx_offsets[count + 1] = (uint16_t)(used + length);
+    if (witness)
+        block->witnesses[count] = *witness;
+    else
+        memset(&block->witnesses[count], 0, sizeof(TxWitness));
+    block->transaction_count++;
+    return 1;
+}
+
+int block_add_text_transaction(Block *block, const char *text)
+{
+    Transaction tx;
+    unsigned char encoded[MAX_TX_SIZE];
+    size_t length;
+    if (!transaction_from_text(text, &tx) || (length = transaction_encode(&tx, encoded, sizeof(encoded))) == 0)
+        return 0;
+    return block_add_transaction(block, encoded, length, NULL);
+}
@@ -0,0 +1,88 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <stdint.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define TX_VERSION 1       // First byte of every encoded transaction
+#define TX_MAX_INPUTS 8    // Inputs per transaction
+#define TX_MAX_OUTPUTS 8   // Outputs per transaction
+#define TX_MAX_ADDRESS 40  // Longest sender or receiver (a key address is exactly this long)
+#define TX_MAX_MEMO 200    // Longest free-text note
+#define AMOUNT_SCALE 100   // Amounts are stored in hundredths
+#define VARINT_MAX_SIZE 10 // Bytes in the longest 64-bit varint
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char prev_txid[TXID_SIZE]; // Transaction whose output is spent
+    uint32_t index;                     // Which of its outputs
+} TxInput;
+
+typedef struct
+{
+    uint64_t amount;                  // In 1/AMOUNT_SCALE units
+    char address[TX_MAX_ADDRESS + 1]; // Receiver
+} TxOutput;
+
+// Decoded form, used to build transactions; blocks and the mempool only hold the encoding
+typedef struct
+{
+    char sender[TX_MAX_ADDRESS + 1];  // Paying address ("" for notes and coinbase)
+    int input_count;                  // Used entries in inputs
+    TxInput inputs[TX_MAX_INPUTS];    // Outputs being spent
+    int output_count;                 // Used entries in outputs
+    TxOutput outputs[TX_MAX_OUTPUTS]; // Payments
+    char memo[TX_MAX_MEMO + 1];       // Free text
+} Transaction;
+
+// Zero-copy view of an encoded transaction; every pointer aims into data
+typedef struct
+{
+    const unsigned char *data;    // Whole encoding
+    size_t length;                // Its size in bytes
+    const char *sender;           // Not null-terminated
+    size_t sender_length;         // 0 if none
+    int input_count;              // Inputs, walked with tx_next_input
+    const unsigned char *inputs;  // First encoded input
+    int output_count;             // Outputs, walked with tx_next_output
+    const unsigned char *outputs; // First encoded output
+    const char *memo;             // Not null-terminated
+    size_t memo_length;           // 0 if none
+} TxView;
+
+typedef struct
+{
+    const unsigned char *prev_txid; // TXID_SIZE bytes inside the encoding
+    uint32_t index;                 // Output index
+} TxInputView;
+
+typedef struct
+{
+    uint64_t amount;       // In 1/AMOUNT_SCALE units
+    const char *address;   // Not null-terminated
+    size_t address_length; // Bytes in address
+} TxOutputView;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+size_t varint_encode(uint64_t value, unsigned char *out);
+int varint_decode(const unsigned char **cursor, const unsigned char *end, uint64_t *value);
+
+int parse_amount(const char *text, uint64_t *amount);
+void format_amount(uint64_t amount, char *text, size_t size);
+int transaction_from_text(const char *text, Transaction *tx);
+size_t transaction_encode(const Transaction *tx, unsigned char *out, size_t capacity);
+
+int tx_view_parse(const unsigned char *data, size_t length, TxView *view);
+void tx_next_input(const unsigned char **cursor, TxInputView *input);
+void tx_next_output(const unsigned char **cursor, TxOutputView *output);
+void tx_view_format(const TxView *view, char *text, size_t size);
+
+void block_clear_transactions(Block *block);
+const unsigned char *block_transaction_bytes(const Block *block, int index, size_t *length);
+int block_transaction(const Block *block, int index, TxView *view);
+int block_add_transaction(Block *block, const unsigned char *data, size_t length, const TxWitness *witness);
+int block_add_text_transaction(Block *block, const char *text);
+
+#endif
@@ -0,0 +1,578 @@
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "txqueue.h"
+#include "signature.h"
+#include "trace.h"
+#include "transaction.h"
+
+/* ================ HELPERS ================ */
+// Yield first so a descheduled peer can make progress; sleep once the queue has stayed idle
+static void backoff(unsigned *spins)
+{
+    if ((*spins)++ < TXQUEUE_YIELD_SPINS)
+    {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = {0, TXQUEUE_IDLE_SLEEP_NS};
+    nanosleep(&pause, NULL);
+}
+
+static void futex_wait(uint32_t *word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* ================ LOCK-FREE RING ================ */
+// slots is rounded up to a power of two
+int txqueue_init(TxQueue *queue, int slots)
+{
+    memset(queue, 0, sizeof(*queue));
+    uint64_t capacity = 2;
+    while (capacity < (uint64_t)slots)
+        capacity *= 2;
+    queue->cells = malloc(capacity * sizeof(TxQueueCell));
+    if (!queue->cells)
+        return 0;
+    for (uint64_t i = 0; i < capacity; i++)
+        queue->cells[i].sequence = i;
+    queue->mask = capacity - 1;
+    return 1;
+}
+
+void txqueue_free(TxQueue *queue)
+{
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// 1 if queued, 0 if the ring is full (back off and retry, or tell the sender to), -1 if too large
+int txqueue_push(TxQueue *queue, const unsigned char *tx, size_t length, const TxWitness *witness, int origin)
+{
+    if (length > MAX_TX_SIZE)
+        return -1;
+    uint64_t position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    TxQueueCell *cell;
+    for (;;)
+    {
+        cell = &queue->cells[position & queue->mask];
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t lag = (int64_t)(sequence - position);
+        if (lag == 0)
+        {
+            if (__atomic_compare_exchange_n(&queue->head, &position, position + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if (lag < 0)
+        {
+            // The cell still holds the item from one lap ago
+            __atomic_fetch_add(&queue->full, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        else
+            position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    }
+
+    cell->submission.length = length;
+    cell->submission.origin = origin;
+    memcpy(cell->submission.tx, tx, length);
+    if (witness)
+        cell->submission.witness = *witness;
+    else
+        memset(&cell->submission.witness, 0, sizeof(cell->submission.witness));
+    __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// 1 with the oldest submission copied to out, 0 if the ring is empty
+int txqueue_pop(TxQueue *queue, TxSubmission *out)
+{
+    uint64_t position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    TxQueueCell *cell;
+    for (;;)
+    {
+        cell = &queue->cells[position & queue->mask];
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int64_t lag = (int64_t)(sequence - (position + 1));
+        if (lag == 0)
+        {
+            if (__atomic_compare_exchange_n(&queue->tail, &position, position + 1, 1, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if (lag < 0)
+            return 0;
+        else
+            position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    }
+
+    out->length = cell->submission.length;
+    out->origin = cell->submission.origin;
+    out->witness = cell->submission.witness;
+    memcpy(out->tx, cell->submission.tx, cell->submission.length);
+    // Hand the cell to the producer one lap ahead
+    __atomic_store_n(&cell->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Approximate while other threads are pushing or popping
+uint64_t txqueue_depth(const TxQueue *queue)
+{
+    uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    return head > tail ? head - tail : 0;
+}
+
+int txqueue_capacity(const TxQueue *queue)
+{
+    return (int)(queue->mask + 1);
+}
+
+/* ================ VALIDATION WORKERS ================ */
+// Blocks until a producer bumps wake; the pop retried after registering closes the race with a push
+static int wait_for_input(TxIngest *ingest, TxSubmission *submission)
+{
+    uint32_t seen = __atomic_load_n(&ingest->wake, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ingest->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int found = txqueue_pop(&ingest->input, submission);
+    if (!found && !__atomic_load_n(&ingest->stopping, __ATOMIC_SEQ_CST))
+        futex_wait(&ingest->wake, seen);
+    __atomic_fetch_sub(&ingest->sleepers, 1, __ATOMIC_SEQ_CST);
+    return found;
+}
+
+static void *ingest_worker(void *argument)
+{
+    TxIngest *ingest = argument;
+    TxSubmission submission;
+    unsigned idle = 0;
+    trace_thread_name("ingest validation");
+    for (;;)
+    {
+        if (!txqueue_pop(&ingest->input, &submission))
+        {
+            if (__atomic_load_n(&ingest->stopping, __ATOMIC_SEQ_CST))
+                break;
+            // A short burst of yields catches back-to-back submissions; after that the worker sleeps
+            if (idle++ < TXQUEUE_YIELD_SPINS)
+            {
+                sched_yield();
+                continue;
+            }
+            if (!wait_for_input(ingest, &submission))
+                continue;
+        }
+        idle = 0;
+
+        // Signatures checked here are cached, so the mempool owner's own check is a lookup
+        TxView view;
+        if (!tx_view_parse(submission.tx, submission.length, &view) ||
+            !check_transaction_signature(&view, &submission.witness, 1))
+        {
+            __atomic_fetch_add(&ingest->rejected, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        // Once stopping, nobody drains output any more: a full ring drops the rest instead of waiting
+        unsigned waited = 0;
+        int pushed;
+        while (!(pushed = txqueue_push(&ingest->output, submission.tx, submission.length, &submission.witness,
+                                       submission.origin)) &&
+               !__atomic_load_n(&ingest->stopping, __ATOMIC_SEQ_CST))
+        {
+            __atomic_fetch_add(&ingest->stalls, 1, __ATOMIC_RELAXED);
+            backoff(&waited);
+        }
+        if (!pushed)
+        {
+            __atomic_fetch_add(&ingest->dropped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_fetch_add(&ingest->validated, 1, __ATOMIC_RELAXED);
+
+        // One wakeup per idle-to-busy transition rather than one syscall per transaction
+        if (ingest->event_fd >= 0 && !__atomic_exchange_n(&ingest->signalled, 1, __ATOMIC_SEQ_CST))
+            eventfd_write(ingest->event_fd, 1);
+    }
+    return NULL;
+}
+
+// event_fd may be -1 when the consumer polls tx_ingest_next instead of waiting on it
+int tx_ingest_start(TxIngest *ingest, int slots, int workers, int event_fd)
+{
+    memset(ingest, 0, sizeof(*ingest));
+    ingest->event_fd = event_fd;
+    if (workers < 1)
+        workers = 1;
+    if (workers > INGEST_MAX_WORKERS)
+        workers = INGEST_MAX_WORKERS;
+    if (!txqueue_init(&ingest->input, slots) || !txqueue_init(&ingest->output, slots))
+    {
+        txqueue_free(&ingest->input);
+        return 0;
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        if (pthread_create(&ingest->workers[i], NULL, ingest_worker, ingest) != 0)
+            break;
+        ingest->worker_count++;
+    }
+    if (ingest->worker_count == 0)
+    {
+        tx_ingest_stop(ingest);
+        return 0;
+    }
+    return 1;
+}
+
+// Workers finish whatever is already in the input ring before exiting; what no longer fits in
+// output is dropped, since its consumer has stopped draining it
+void tx_ingest_stop(TxIngest *ingest)
+{
+    __atomic_store_n(&ingest->stopping, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ingest->wake, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ingest->wake, INT32_MAX);
+    for (int i = 0; i < ingest->worker_count; i++)
+        pthread_join(ingest->workers[i], NULL);
+    ingest->worker_count = 0;
+    txqueue_free(&ingest->input);
+    txqueue_free(&ingest->output);
+}
+
+// Safe from any thread; same results as txqueue_push
+int tx_ingest_submit(TxIngest *ingest, const unsigned char *tx, size_t length, const TxWitness *witness, int origin)
+{
+    int pushed = txqueue_push(&ingest->input, tx, length, witness, origin);
+    // The push's release store must be visible before sleepers is read, or a worker that has just
+    // registered and found the ring empty could sleep through this submission; the fence pairs with
+    // the one in wait_for_input. The syscall is only paid when a worker is actually asleep.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (pushed == 1 && __atomic_load_n(&ingest->sleepers, __ATOMIC_SEQ_CST) > 0)
+    {
+        __atomic_fetch_add(&ingest->wake, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&ingest->wake, 1);
+    }
+    return pushed;
+}
+
+// Called by the single thread that owns the mempool
+int tx_ingest_next(TxIngest *ingest, TxSubmission *out)
+{
+    return txqueue_pop(&ingest->output, out);
+}
+
+// Call after reading the eventfd and before draining, so the next push signals again
+void tx_ingest_rearm(TxIngest *ingest)
+{
+    __atomic_exchange_n(&ingest->signalled, 0, __ATOMIC_SEQ_CST);
+}
+
+/* ================ INGESTION BENCHMARK ================ */
+#define BENCH_DISTINCT 1024 // Pre-encoded transactions the producers cycle through
+
+typedef struct
+{
+    TxSubmission *items;  // Ring storage
+    int capacity;         // Slots
+    int head;             // Oldest item
+    int count;            // Items queued
+    pthread_mutex_t lock; // Guards everything above
+} MutexRing;
+
+typedef struct
+{
+    void *queue;                                // MutexRing, TxQueue or TxIngest
+    int (*push)(void *queue, const unsigned char *tx, size_t length, const TxWitness *witness);
+    int (*pop)(void *queue, TxSubmission *out); // NULL: main drains TxIngest
+} BenchQueue;
+
+typedef struct
+{
+    const BenchQueue *queue; // Shared by every thread of a run
+    const TxSubmission *txs; // BENCH_DISTINCT encodings
+    int first, count;        // Producer: which submissions to send
+    int *producers_left;     // Consumers stop once this is 0 and the queue is empty
+    uint64_t checksum;       // Sum over sent or received submissions
+    uint64_t stalls;         // Producer: pushes refused by a full queue
+    uint64_t consumed;       // Consumer: submissions taken and parsed
+} BenchThread;
+
+static int mutex_ring_push(void *queue, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    MutexRing *ring = queue;
+    pthread_mutex_lock(&ring->lock);
+    if (ring->count == ring->capacity)
+    {
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+    TxSubmission *item = &ring->items[(ring->head + ring->count++) % ring->capacity];
+    item->length = length;
+    item->origin = -1;
+    memcpy(item->tx, tx, length);
+    item->witness = *witness;
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+}
+
+static int mutex_ring_pop(void *queue, TxSubmission *out)
+{
+    MutexRing *ring = queue;
+    pthread_mutex_lock(&ring->lock);
+    if (ring->count == 0)
+    {
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+    const TxSubmission *item = &ring->items[ring->head];
+    out->length = item->length;
+    out->origin = item->origin;
+    out->witness = item->witness;
+    memcpy(out->tx, item->tx, item->length);
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->count--;
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+}
+
+static int lockfree_push(void *queue, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    return txqueue_push(queue, tx, length, witness, -1);
+}
+
+static int lockfree_pop(void *queue, TxSubmission *out)
+{
+    return txqueue_pop(queue, out);
+}
+
+static int ingest_push(void *queue, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    return tx_ingest_submit(queue, tx, length, witness, -1);
+}
+
+static uint64_t submission_checksum(const unsigned char *tx, size_t length)
+{
+    return length * 31 + tx[length - 1];
+}
+
+static void *bench_producer(void *argument)
+{
+    BenchThread *thread = argument;
+    for (int i = thread->first; i < thread->first + thread->count; i++)
+    {
+        const TxSubmission *item = &thread->txs[i % BENCH_DISTINCT];
+        unsigned spins = 0;
+        while (thread->queue->push(thread->queue->queue, item->tx, item->length, &item->witness) != 1)
+        {
+            thread->stalls++;
+            backoff(&spins);
+        }
+        thread->checksum += submission_checksum(item->tx, item->length);
+    }
+    __atomic_fetch_sub(thread->producers_left, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *bench_consumer(void *argument)
+{
+    BenchThread *thread = argument;
+    TxSubmission item;
+    unsigned spins = 0;
+    for (;;)
+    {
+        if (!thread->queue->pop(thread->queue->queue, &item))
+        {
+            // Producers finished before this check, so a second empty pop means nothing is left
+            if (__atomic_load_n(thread->producers_left, __ATOMIC_ACQUIRE) > 0)
+            {
+                backoff(&spins);
+                continue;
+            }
+            if (!thread->queue->pop(thread->queue->queue, &item))
+                break;
+        }
+        spins = 0;
+        TxView view;
+        if (tx_view_parse(item.tx, item.length, &view))
+            thread->checksum += submission_checksum(item.tx, item.length);
+        thread->consumed++;
+    }
+    return NULL;
+}
+
+// Runs producers against consumers (or against TxIngest's workers, drained here) and checks nothing was lost
+static int bench_run(const BenchQueue *queue, const TxSubmission *txs, int producers, int consumers, int count,
+                     double *ms, uint64_t *stalls)
+{
+    BenchThread *threads = calloc((size_t)(producers + consumers), sizeof(BenchThread));
+    pthread_t *handles = calloc((size_t)(producers + consumers), sizeof(pthread_t));
+    int producers_left = producers;
+    if (!threads || !handles)
+    {
+        free(threads);
+        free(handles);
+        return 0;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next = 0;
+    for (int i = 0; i < producers + consumers; i++)
+    {
+        threads[i].queue = queue;
+        threads[i].txs = txs;
+        threads[i].producers_left = &producers_left;
+        if (i < producers)
+        {
+            threads[i].first = next;
+            threads[i].count = count / producers + (i < count % producers);
+            next += threads[i].count;
+        }
+        pthread_create(&handles[i], NULL, i < producers ? bench_producer : bench_consumer, &threads[i]);
+    }
+
+    uint64_t received = 0, consumed = 0;
+    if (!queue->pop)
+    {
+        // Ingestion pipeline: this thread plays the mempool owner
+        TxIngest *ingest = queue->queue;
+        TxSubmission item;
+        unsigned spins = 0;
+        while (consumed + __atomic_load_n(&ingest->rejected, __ATOMIC_RELAXED) < (uint64_t)count)
+        {
+            if (!tx_ingest_next(ingest, &item))
+            {
+                backoff(&spins);
+                continue;
+            }
+            spins = 0;
+            received += submission_checksum(item.tx, item.length);
+            consumed++;
+        }
+    }
+    uint64_t sent = 0;
+    *stalls = 0;
+    for (int i = 0; i < producers + consumers; i++)
+    {
+        pthread_join(handles[i], NULL);
+        if (i < producers)
+        {
+            sent += threads[i].checksum;
+            *stalls += threads[i].stalls;
+        }
+        else
+        {
+            received += threads[i].checksum;
+            consumed += threads[i].consumed;
+        }
+    }
+    *ms = elapsed_ms(&start);
+    free(threads);
+    free(handles);
+    return consumed == (uint64_t)count && sent == received;
+}
+
+int run_ingest_benchmark(int producers, int workers, int count)
+{
+    if (producers < 1 || workers < 1 || workers > INGEST_MAX_WORKERS || count < 1)
+    {
+        print_error("Usage: --ingest-bench [producers] [workers <= 16] [transactions]");
+        return 1;
+    }
+    print_header("TRANSACTION INGESTION BENCHMARK");
+
+    TxSubmission *txs = calloc(BENCH_DISTINCT, sizeof(TxSubmission));
+    MutexRing ring = {0};
+    TxQueue queue;
+    TxIngest ingest;
+    if (!txs || !(ring.items = malloc(TXQUEUE_DEFAULT_SLOTS * sizeof(TxSubmission))) ||
+        !txqueue_init(&queue, TXQUEUE_DEFAULT_SLOTS))
+    {
+        print_error("Out of memory");
+        free(txs);
+        free(ring.items);
+        return 1;
+    }
+    ring.capacity = TXQUEUE_DEFAULT_SLOTS;
+    pthread_mutex_init(&ring.lock, NULL);
+
+    for (int i = 0; i < BENCH_DISTINCT; i++)
+    {
+        Transaction tx = {0};
+        strcpy(tx.sender, "loadgen");
+        tx.output_count = 1;
+        tx.outputs[0].amount = (uint64_t)(i + 1);
+        snprintf(tx.outputs[0].address, sizeof(tx.outputs[0].address), "sink%d", i);
+        txs[i].length = transaction_encode(&tx, txs[i].tx, sizeof(txs[i].tx));
+    }
+
+    printf(COLOR_CYAN "%d producers, %d consumers, %d transactions, %d-slot rings" COLOR_RESET "\n\n", producers,
+           workers, count, TXQUEUE_DEFAULT_SLOTS);
+    const char *names[3] = {"Mutex ring", "Lock-free ring", "Ingest + validation"};
+    BenchQueue queues[3] = {
+        {&ring, mutex_ring_push, mutex_ring_pop},
+        {&queue, lockfree_push, lockfree_pop},
+        {&ingest, ingest_push, NULL},
+    };
+    double ms[3];
+    uint64_t stalls[3];
+    int ok[3];
+    for (int run = 0; run < 3; run++)
+    {
+        if (run == 2 && !tx_ingest_start(&ingest, TXQUEUE_DEFAULT_SLOTS, workers, -1))
+        {
+            print_error("Could not start the validation workers");
+            ok[run] = 0;
+            ms[run] = 0;
+            stalls[run] = 0;
+            continue;
+        }
+        // The pipeline's consumers are TxIngest's own workers
+        ok[run] = bench_run(&queues[run], txs, producers, run == 2 ? 0 : workers, count, &ms[run], &stalls[run]);
+        if (run == 2)
+            tx_ingest_stop(&ingest);
+    }
+
+    printf(COLOR_BLUE "┌─────────────────────┬────────────┬──────────────┬─────────────┬────────┐\n");
+    printf(COLOR_BLUE "│ " COLOR_YELLOW "%-19s" COLOR_BLUE " │ " COLOR_YELLOW "%-10s" COLOR_BLUE " │ " COLOR_YELLOW
+                      "%-12s" COLOR_BLUE " │ " COLOR_YELLOW "%-11s" COLOR_BLUE " │ " COLOR_YELLOW "%-6s" COLOR_BLUE " │\n",
+           "Queue", "Time (ms)", "Tx/s", "Full stalls", "Intact");
+    printf(COLOR_BLUE "├─────────────────────┼────────────┼──────────────┼─────────────┼────────┤\n");
+    for (int run = 0; run < 3; run++)
+    {
+        printf(COLOR_BLUE "│ " COLOR_CYAN "%-19s" COLOR_BLUE " │ " COLOR_CYAN "%-10.1f" COLOR_BLUE " │ " COLOR_CYAN
+                          "%-12.0f" COLOR_BLUE " │ " COLOR_CYAN "%-11llu" COLOR_BLUE " │ %s%-6s" COLOR_BLUE " │\n",
+               names[run], ms[run], ms[run] > 0 ? count / (ms[run] / 1000.0) : 0.0, (unsigned long long)stalls[run],
+               ok[run] ? COLOR_GREEN : COLOR_RED, ok[run] ? "yes" : "no");
+    }
+    printf(COLOR_BLUE "└─────────────────────┴────────────┴──────────────┴─────────────┴────────┘" COLOR_RESET "\n");
+
+    pthread_mutex_destroy(&ring.lock);
+    free(ring.items);
+    txqueue_free(&queue);
+    free(txs);
+    if (!ok[0] || !ok[1] || !ok[2])
+    {
+        print_error("Some transactions were lost or corrupted in a queue");
+        return 1;
+    }
+    printf(COLOR_GREEN "\nLock-free ring moved %.1fx the transactions per second of the mutex ring" COLOR_RESET "\n",
+           ms[1] > 0 ? ms[0] / ms[1] : 0.0);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef TXQUEUE_H
+#define TXQUEUE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "blockchain.h"
+
+/* ================ CONSTANTS ================ */
+#define TXQUEUE_DEFAULT_SLOTS 4096      // Ring size for node ingestion (power of two)
+#define TXQUEUE_CACHE_LINE 64           // Head and tail live on separate lines
+#define TXQUEUE_YIELD_SPINS 64          // Empty/full polls that yield before sleeping (workers block instead)
+#define TXQUEUE_IDLE_SLEEP_NS 1000000   // Sleep between polls once idle
+#define INGEST_MAX_WORKERS 16           // Validation threads
+#define INGEST_EVENT_TAG ((uint64_t)-4) // epoll data for the ingestion eventfd
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    size_t length;                 // Bytes used in tx
+    int origin;                    // Peer ID that relayed it (-1: submitted locally)
+    TxWitness witness;             // Signature (all zero if unsigned)
+    unsigned char tx[MAX_TX_SIZE]; // Encoded transaction
+} TxSubmission;
+
+typedef struct
+{
+    uint64_t sequence;       // Position this cell expects next: writable at pos, readable at pos + 1
+    TxSubmission submission; // Payload, copied in and out
+} TxQueueCell;
+
+// Bounded multi-producer multi-consumer ring (Vyukov's per-cell sequence scheme).
+// Producers and consumers each claim a position with one CAS; no locks are taken.
+typedef struct
+{
+    TxQueueCell *cells;                                         // Ring storage
+    uint64_t mask;                                              // Slots - 1
+    uint64_t head __attribute__((aligned(TXQUEUE_CACHE_LINE))); // Next position to fill
+    uint64_t tail __attribute__((aligned(TXQUEUE_CACHE_LINE))); // Next position to drain
+    uint64_t full __attribute__((aligned(TXQUEUE_CACHE_LINE))); // Pushes refused because the ring was full
+} TxQueue;
+
+// Producers -> input ring -> validation workers -> output ring -> the thread owning the mempool
+typedef struct TxIngest
+{
+    TxQueue input;                         // Raw submissions from any thread
+    TxQueue output;                        // Parsed and signature-checked, in arrival order per worker
+    pthread_t workers[INGEST_MAX_WORKERS]; // Validation pool
+    int worker_count;                      // Threads started
+    int event_fd;                          // Signalled when output goes from idle to non-empty (-1 = none)
+    int signalled;                         // An eventfd wakeup is outstanding
+    int stopping;                          // Tells workers to exit
+    uint32_t wake;                         // Futex word: bumped to wake workers blocked on an empty input
+    int sleepers;                          // Workers blocked on wake
+    uint64_t validated;                    // Submissions passed on to output
+    uint64_t rejected;                     // Submissions that failed parsing or the signature check
+    uint64_t stalls;                       // Times a worker waited for room in output
+    uint64_t dropped;                      // Validated submissions discarded because output stayed full at shutdown
+} TxIngest;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+int txqueue_init(TxQueue *queue, int slots);
+void txqueue_free(TxQueue *queue);
+int txqueue_push(TxQueue *queue, const unsigned char *tx, size_t length, const TxWitness *witness, int origin);
+int txqueue_pop(TxQueue *queue, TxSubmission *out);
+uint64_t txqueue_depth(const TxQueue *queue);
+int txqueue_capacity(const TxQueue *queue);
+
+int tx_ingest_start(TxIngest *ingest, int slots, int workers, int event_fd);
+void tx_ingest_stop(TxIngest *ingest);
+int tx_ingest_submit(TxIngest *ingest, const unsigned char *tx, size_t length, const TxWitness *witness, int origin);
+int tx_ingest_next(TxIngest *ingest, TxSubmission *out);
+void tx_ingest_rearm(TxIngest *ingest);
+
+int run_ingest_benchmark(int producers, int workers, int count);
+
+#endif
@@ -0,0 +1,245 @@
+#include "utxo.h"
+#include "coindb.h"
+#include "metrics.h"
+
+/* ================ HASH INDEX ================ */
+static uint64_t outpoint_key(const OutPoint *outpoint)
+{
+    // txids are SHA-256 output; the index is mixed in so sibling outputs land apart
+    uint64_t key;
+    memcpy(&key, outpoint->txid, sizeof(key));
+    return key ^ ((uint64_t)outpoint->index * 0x9e3779b97f4a7c15ull);
+}
+
+static int same_outpoint(const OutPoint *a, const OutPoint *b)
+{
+    return a->index == b->index && memcmp(a->txid, b->txid, TXID_SIZE) == 0;
+}
+
+static int find_slot(const UtxoSet *set, const OutPoint *outpoint)
+{
+    if (set->capacity == 0)
+        return -1;
+    int mask = set->capacity - 1;
+    int slot = (int)(outpoint_key(outpoint) & (uint64_t)mask);
+    while (set->slots[slot].used)
+    {
+        if (same_outpoint(&set->slots[slot].coin.outpoint, outpoint))
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+static int put_slot(CoinsEntry *slots, int capacity, const CoinsEntry *entry)
+{
+    int mask = capacity - 1;
+    int slot = (int)(outpoint_key(&entry->coin.outpoint) & (uint64_t)mask);
+    while (slots[slot].used)
+    {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = *entry;
+    slots[slot].used = 1;
+    return slot;
+}
+
+static int grow(UtxoSet *set)
+{
+    int capacity = set->capacity ? set->capacity * 2 : 256;
+    CoinsEntry *slots = calloc((size_t)capacity, sizeof(CoinsEntry));
+    if (!slots)
+        return 0;
+    for (int i = 0; i < set->capacity; i++)
+    {
+        if (set->slots[i].used)
+            put_slot(slots, capacity, &set->slots[i]);
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    return 1;
+}
+
+static int insert_entry(UtxoSet *set, const CoinsEntry *entry)
+{
+    if ((set->entries + 1) * 10 > set->capacity * 7 && !grow(set))
+        return -1;
+    set->entries++;
+    return put_slot(set->slots, set->capacity, entry);
+}
+
+static void remove_slot(UtxoSet *set, int slot)
+{
+    // Backward-shift deletion, as in the mempool index
+    int mask = set->capacity - 1;
+    int hole = slot;
+    int next = (hole + 1) & mask;
+    while (set->slots[next].used)
+    {
+        int home = (int)(outpoint_key(&set->slots[next].coin.outpoint) & (uint64_t)mask);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            set->slots[hole] = set->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    set->slots[hole].used = 0;
+    set->entries--;
+}
+
+// Slot holding the outpoint, pulling it in from the database on a miss; -1 if neither has it
+static int fetch(UtxoSet *set, const OutPoint *outpoint)
+{
+    metrics_count(METRIC_UTXO_LOOKUPS, 1);
+    int slot = find_slot(set, outpoint);
+    if (slot >= 0 || !set->db)
+        return slot;
+    CoinsEntry entry = {0};
+    set->db_reads++;
+    metrics_count(METRIC_UTXO_DB_READS, 1);
+    if (!coindb_get(set->db, outpoint, &entry.coin))
+        return -1;
+    return insert_entry(set, &entry);
+}
+
+/* ================ UTXO SET ================ */
+void utxo_set_init(UtxoSet *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+// The database must be empty or already match this set, which is true for a new one
+void utxo_set_attach(UtxoSet *set, struct CoinDB *db, size_t budget)
+{
+    set->db = db;
+    set->budget = budget;
+}
+
+void utxo_set_free(UtxoSet *set)
+{
+    free(set->slots);
+    utxo_set_init(set);
+}
+
+const Coin *utxo_set_find(UtxoSet *set, const OutPoint *outpoint)
+{
+    int slot = fetch(set, outpoint);
+    return slot >= 0 && !set->slots[slot].spent ? &set->slots[slot].coin : NULL;
+}
+
+// Fails if the outpoint is already unspent: a repeated txid may not overwrite a coin
+int utxo_set_add(UtxoSet *set, const Coin *coin)
+{
+    int slot = fetch(set, &coin->outpoint);
+    if (slot >= 0 && !set->slots[slot].spent)
+        return 0;
+    if (slot >= 0)
+    {
+        // Spent in the cache but unspent on disk: the new coin must overwrite that record
+        set->slots[slot].coin = *coin;
+        set->slots[slot].spent = 0;
+        set->slots[slot].dirty = 1;
+    }
+    else
+    {
+        CoinsEntry entry = {.coin = *coin, .dirty = 1, .fresh = 1};
+        if (insert_entry(set, &entry) < 0)
+            return 0;
+    }
+    set->count++;
+    set->total += coin->amount;
+    return 1;
+}
+
+// Removes the coin and copies it to spent; 0 if it was not unspent
+int utxo_set_spend(UtxoSet *set, const OutPoint *outpoint, Coin *spent)
+{
+    int slot = fetch(set, outpoint);
+    if (slot < 0 || set->slots[slot].spent)
+        return 0;
+    if (spent)
+        *spent = set->slots[slot].coin;
+    set->count--;
+    set->total -= set->slots[slot].coin.amount;
+
+    // A fresh coin never reached the database, so forgetting it is the whole spend
+    if (set->slots[slot].fresh)
+    {
+        set->fresh_skips += set->db != NULL;
+        remove_slot(set, slot);
+    }
+    else
+    {
+        set->slots[slot].spent = 1;
+        set->slots[slot].dirty = 1;
+    }
+    return 1;
+}
+
+size_t utxo_set_memory(const UtxoSet *set)
+{
+    return (size_t)set->capacity * sizeof(CoinsEntry);
+}
+
+int utxo_set_over_budget(const UtxoSet *set)
+{
+    return set->db && utxo_set_memory(set) > set->budget;
+}
+
+// Writes every dirty entry as one sorted batch and empties the cache
+int utxo_set_flush(UtxoSet *set)
+{
+    if (!set->db)
+        return 1;
+    CoinsEntry **dirty = malloc((size_t)(set->entries + 1) * sizeof(CoinsEntry *));
+    int count = 0;
+    if (!dirty)
+        return 0;
+    for (int i = 0; i < set->capacity; i++)
+    {
+        if (set->slots[i].used && set->slots[i].dirty)
+            dirty[count++] = &set->slots[i];
+    }
+    int ok = coindb_write(set->db, dirty, count);
+    free(dirty);
+    if (!ok)
+        return 0;
+
+    set->flushes++;
+    set->written += (uint64_t)count;
+    free(set->slots);
+    set->slots = NULL;
+    set->capacity = 0;
+    set->entries = 0;
+    return 1;
+}
+
+typedef struct
+{
+    UtxoSet *set;                                  // Cache whose entries override the database
+    int (*visit)(const Coin *coin, void *context); // Caller's callback
+    void *context;                                 // Its argument
+} ScanContext;
+
+static int visit_uncached(const Coin *coin, void *context)
+{
+    ScanContext *scan = context;
+    return find_slot(scan->set, &coin->outpoint) >= 0 || scan->visit(coin, scan->context);
+}
+
+// Cached coins first, then the database's, skipping any the cache has newer news of.
+// visit returns 0 to stop early.
+int utxo_set_for_each(UtxoSet *set, int (*visit)(const Coin *coin, void *context), void *context)
+{
+    for (int i = 0; i < set->capacity; i++)
+    {
+        if (set->slots[i].used && !set->slots[i].spent && !visit(&set->slots[i].coin, context))
+            return 0;
+    }
+    if (!set->db)
+        return 1;
+    ScanContext scan = {set, visit, context};
+    return coindb_scan(set->db, visit_uncached, &scan);
+}
@@ -0,0 +1,66 @@
+#ifndef UTXO_H
+#define UTXO_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "transaction.h"
+
+/* ================ CONSTANTS ================ */
+#define UTXO_DEFAULT_CACHE (64u << 20) // Cache budget in bytes when a coin database is attached
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char txid[TXID_SIZE]; // Transaction that created the output
+    uint32_t index;                // Position among its outputs
+} OutPoint;
+
+typedef struct
+{
+    OutPoint outpoint;                // Where the output was created
+    uint64_t amount;                  // In 1/AMOUNT_SCALE units
+    char address[TX_MAX_ADDRESS + 1]; // Owner, who must be the sender of the spending transaction
+    int height;                       // Block that created it
+} Coin;
+
+typedef struct
+{
+    Coin coin;     // Cached copy
+    uint8_t used;  // Slot holds an entry
+    uint8_t dirty; // Differs from the coin database
+    uint8_t fresh; // The database has no unspent version, so spending it needs no write
+    uint8_t spent; // Spent since the last flush (kept until then if the database still has it)
+} CoinsEntry;
+
+struct CoinDB;
+
+// Every unspent output of the active chain. Without a database it is a plain hash table;
+// with one it is a write-back cache in front of it, flushed when it outgrows budget.
+typedef struct
+{
+    CoinsEntry *slots;    // Open-addressing table keyed by outpoint
+    int capacity;         // Power of two (0 until the first insert)
+    int entries;          // Occupied slots, spent ones included
+    int count;            // Unspent outputs, cached or not
+    uint64_t total;       // Sum of their amounts
+    struct CoinDB *db;    // Backing store (NULL keeps everything in memory)
+    size_t budget;        // Bytes the table may use before a flush
+    uint64_t db_reads;    // Lookups the cache could not answer
+    uint64_t flushes;     // Batches written to the database
+    uint64_t written;     // Entries those batches held
+    uint64_t fresh_skips; // Outputs created and spent between flushes, never written
+} UtxoSet;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void utxo_set_init(UtxoSet *set);
+void utxo_set_attach(UtxoSet *set, struct CoinDB *db, size_t budget);
+void utxo_set_free(UtxoSet *set);
+const Coin *utxo_set_find(UtxoSet *set, const OutPoint *outpoint);
+int utxo_set_add(UtxoSet *set, const Coin *coin);
+int utxo_set_spend(UtxoSet *set, const OutPoint *outpoint, Coin *spent);
+size_t utxo_set_memory(const UtxoSet *set);
+int utxo_set_over_budget(const UtxoSet *set);
+int utxo_set_flush(UtxoSet *set);
+int utxo_set_for_each(UtxoSet *set, int (*visit)(const Coin *coin, void *context), void *context);
+
+#endif
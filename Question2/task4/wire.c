@@ -0,0 +1,259 @@
+#include "wire.h"
+#include "retarget.h"
+#include "signature.h"
+#include "transaction.h"
+
+/* ================ WRITER ================ */
+void writer_init(ByteWriter *writer)
+{
+    writer->data = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+}
+
+void writer_free(ByteWriter *writer)
+{
+    free(writer->data);
+    writer_init(writer);
+}
+
+void put_bytes(ByteWriter *writer, const void *bytes, size_t length)
+{
+    if (writer->length + length > writer->capacity)
+    {
+        size_t capacity = writer->capacity ? writer->capacity : 256;
+        while (capacity < writer->length + length)
+            capacity *= 2;
+        unsigned char *data = realloc(writer->data, capacity);
+        if (!data)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->data + writer->length, bytes, length);
+    writer->length += length;
+}
+
+void put_u8(ByteWriter *writer, uint8_t value)
+{
+    put_bytes(writer, &value, 1);
+}
+
+void put_u16(ByteWriter *writer, uint16_t value)
+{
+    unsigned char bytes[2] = {(unsigned char)value, (unsigned char)(value >> 8)};
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+void put_u32(ByteWriter *writer, uint32_t value)
+{
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+void put_u64(ByteWriter *writer, uint64_t value)
+{
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+void put_varint(ByteWriter *writer, uint64_t value)
+{
+    unsigned char bytes[VARINT_MAX_SIZE];
+    put_bytes(writer, bytes, varint_encode(value, bytes));
+}
+
+void put_hash(ByteWriter *writer, const char *hex_hash)
+{
+    unsigned char bytes[32] = {0};
+    hex_to_bytes(hex_hash, bytes, sizeof(bytes));
+    put_bytes(writer, bytes, sizeof(bytes));
+}
+
+/* ================ READER ================ */
+void reader_init(ByteReader *reader, const void *data, size_t length)
+{
+    reader->data = data;
+    reader->length = length;
+    reader->offset = 0;
+    reader->ok = 1;
+}
+
+int get_bytes(ByteReader *reader, void *bytes, size_t length)
+{
+    if (!reader->ok || reader->length - reader->offset < length)
+    {
+        reader->ok = 0;
+        memset(bytes, 0, length);
+        return 0;
+    }
+    memcpy(bytes, reader->data + reader->offset, length);
+    reader->offset += length;
+    return 1;
+}
+
+uint8_t get_u8(ByteReader *reader)
+{
+    uint8_t value;
+    get_bytes(reader, &value, 1);
+    return value;
+}
+
+uint16_t get_u16(ByteReader *reader)
+{
+    unsigned char bytes[2];
+    get_bytes(reader, bytes, sizeof(bytes));
+    return (uint16_t)(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t get_u32(ByteReader *reader)
+{
+    unsigned char bytes[4];
+    uint32_t value = 0;
+    get_bytes(reader, bytes, sizeof(bytes));
+    for (int i = 0; i < 4; i++)
+        value |= (uint32_t)bytes[i] << (8 * i);
+    return value;
+}
+
+uint64_t get_u64(ByteReader *reader)
+{
+    unsigned char bytes[8];
+    uint64_t value = 0;
+    get_bytes(reader, bytes, sizeof(bytes));
+    for (int i = 0; i < 8; i++)
+        value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+uint64_t get_varint(ByteReader *reader)
+{
+    const unsigned char *cursor = reader->data + reader->offset;
+    uint64_t value = 0;
+    if (!reader->ok || !varint_decode(&cursor, reader->data + reader->length, &value))
+    {
+        reader->ok = 0;
+        return 0;
+    }
+    reader->offset = (size_t)(cursor - reader->data);
+    return value;
+}
+
+// Zero-copy: returns a pointer into the reader's buffer instead of copying length bytes out
+const unsigned char *get_span(ByteReader *reader, size_t length)
+{
+    if (!reader->ok || reader->length - reader->offset < length)
+    {
+        reader->ok = 0;
+        return NULL;
+    }
+    const unsigned char *span = reader->data + reader->offset;
+    reader->offset += length;
+    return span;
+}
+
+void get_hash(ByteReader *reader, char *hex_hash)
+{
+    unsigned char bytes[32];
+    get_bytes(reader, bytes, sizeof(bytes));
+    bytes_to_hex(bytes, sizeof(bytes), hex_hash);
+}
+
+/* ================ BLOCKS ================ */
+void serialize_block_header(ByteWriter *writer, const Block *block)
+{
+    put_u32(writer, (uint32_t)block->index);
+    put_u64(writer, (uint64_t)block->timestamp);
+    put_u32(writer, block->target_bits);
+    put_u32(writer, (uint32_t)block->nonce);
+    put_hash(writer, block->previous_hash);
+    put_hash(writer, block->merkle_root);
+}
+
+int deserialize_block_header(ByteReader *reader, Block *block)
+{
+    memset(block, 0, sizeof(*block));
+    block->index = (int)get_u32(reader);
+    block->timestamp = (time_t)get_u64(reader);
+    block->target_bits = get_u32(reader);
+    block->difficulty = target_leading_zeros(block->target_bits);
+    block->nonce = (int)get_u32(reader);
+    get_hash(reader, block->previous_hash);
+    get_hash(reader, block->merkle_root);
+    if (!reader->ok)
+        return 0;
+    // The hash commits to every header field, so it is rebuilt instead of trusted off the wire
+    calculate_block_hash(block, block->hash);
+    return 1;
+}
+
+// Varint length and the encoded transaction, then a flag byte and the 96-byte witness if it is signed
+void serialize_transaction(ByteWriter *writer, const unsigned char *tx, size_t length, const TxWitness *witness)
+{
+    int is_signed = !witness_is_empty(witness);
+    put_varint(writer, length);
+    put_bytes(writer, tx, length);
+    put_u8(writer, (uint8_t)is_signed);
+    if (is_signed)
+    {
+        put_bytes(writer, witness->public_key, PUBLIC_KEY_SIZE);
+        put_bytes(writer, witness->signature, SIGNATURE_SIZE);
+    }
+}
+
+// Parses the transaction in place; view points into the reader's buffer and is valid as long as it is
+int deserialize_transaction(ByteReader *reader, TxView *view, TxWitness *witness)
+{
+    uint64_t length = get_varint(reader);
+    const unsigned char *tx = length <= MAX_TX_SIZE ? get_span(reader, (size_t)length) : NULL;
+    if (!tx || !tx_view_parse(tx, (size_t)length, view))
+        return 0;
+    memset(witness, 0, sizeof(*witness));
+    if (get_u8(reader))
+    {
+        get_bytes(reader, witness->public_key, PUBLIC_KEY_SIZE);
+        get_bytes(reader, witness->signature, SIGNATURE_SIZE);
+        // An all-zero key would read back as unsigned and change the transaction's merkle leaf
+        if (witness_is_empty(witness))
+            return 0;
+    }
+    return reader->ok;
+}
+
+void serialize_block(ByteWriter *writer, const Block *block)
+{
+    serialize_block_header(writer, block);
+    put_u8(writer, (uint8_t)block->transaction_count);
+    for (int i = 0; i < block->transaction_count; i++)
+    {
+        size_t length;
+        const unsigned char *tx = block_transaction_bytes(block, i, &length);
+        serialize_transaction(writer, tx, length, &block->witnesses[i]);
+    }
+}
+
+int deserialize_block(ByteReader *reader, Block *block)
+{
+    if (!deserialize_block_header(reader, block))
+        return 0;
+    int count = get_u8(reader);
+    if (count > MAX_TRANSACTIONS)
+        return 0;
+    block_clear_transactions(block);
+    for (int i = 0; i < count; i++)
+    {
+        TxView view;
+        TxWitness witness;
+        if (!deserialize_transaction(reader, &view, &witness) ||
+            !block_add_transaction(block, view.data, view.length, &witness))
+            return 0;
+    }
+    return reader->ok;
+}
@@ -0,0 +1,52 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include "blockchain.h"
+#include "transaction.h"
+
+/* ================ DATA STRUCTURES ================ */
+typedef struct
+{
+    unsigned char *data; // Growable output buffer
+    size_t length;       // Bytes written
+    size_t capacity;     // Allocated size of data
+} ByteWriter;
+
+typedef struct
+{
+    const unsigned char *data; // Input being parsed (not owned)
+    size_t length;             // Total input size
+    size_t offset;             // Read position
+    int ok;                    // Cleared on any out-of-bounds read
+} ByteReader;
+
+/* ================ FUNCTION PROTOTYPES ================ */
+void writer_init(ByteWriter *writer);
+void writer_free(ByteWriter *writer);
+void put_bytes(ByteWriter *writer, const void *bytes, size_t length);
+void put_u8(ByteWriter *writer, uint8_t value);
+void put_u16(ByteWriter *writer, uint16_t value);
+void put_u32(ByteWriter *writer, uint32_t value);
+void put_u64(ByteWriter *writer, uint64_t value);
+void put_varint(ByteWriter *writer, uint64_t value);
+void put_hash(ByteWriter *writer, const char *hex_hash);
+
+void reader_init(ByteReader *reader, const void *data, size_t length);
+int get_bytes(ByteReader *reader, void *bytes, size_t length);
+uint8_t get_u8(ByteReader *reader);
+uint16_t get_u16(ByteReader *reader);
+uint32_t get_u32(ByteReader *reader);
+uint64_t get_u64(ByteReader *reader);
+uint64_t get_varint(ByteReader *reader);
+const unsigned char *get_span(ByteReader *reader, size_t length);
+void get_hash(ByteReader *reader, char *hex_hash);
+
+void serialize_block_header(ByteWriter *writer, const Block *block);
+int deserialize_block_header(ByteReader *reader, Block *block);
+void serialize_transaction(ByteWriter *writer, const unsigned char *tx, size_t length, const TxWitness *witness);
+int deserialize_transaction(ByteReader *reader, TxView *view, TxWitness *witness);
+void serialize_block(ByteWriter *writer, const Block *block);
+int deserialize_block(ByteReader *reader, Block *block);
+
+#endif